@@ -0,0 +1,663 @@
+#include "BCEncoder.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+//BC_FORCE_SCALAR builds the scalar path on SSE2 targets too, the tests compare both
+#if !defined(BC_FORCE_SCALAR) && (defined(_M_X64) || defined(_M_IX86_FP) || defined(__SSE2__))
+#define BC_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	//Channels of one block as floats in 0-255, laid out so SIMD loads take 4 pixels at once
+	struct BlockPixels
+	{
+		alignas(16) float c[4][16];
+	};
+
+	void LoadBlock(const uint8_t* pixels, BlockPixels& block)
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int c = 0; c < 4; ++c)
+				block.c[c][i] = pixels[i * 4 + c];
+		}
+	}
+
+	inline float Clamp255(float v)
+	{
+		return v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v);
+	}
+
+	//Closest palette entry over the first channelCount channels for every pixel, returns the summed squared error
+	//Ties keep the lower index in both paths
+	float FitPalette(const BlockPixels& block, int channelCount, const float (*palette)[4], int paletteCount, uint8_t* indices)
+	{
+		float total = 0.0f;
+#ifdef BC_USE_SSE2
+		for (int group = 0; group < 16; group += 4)
+		{
+			__m128 best = _mm_set1_ps(FLT_MAX);
+			__m128i bestIndex = _mm_setzero_si128();
+			for (int p = 0; p < paletteCount; ++p)
+			{
+				__m128 distance = _mm_setzero_ps();
+				for (int c = 0; c < channelCount; ++c)
+				{
+					__m128 d = _mm_sub_ps(_mm_load_ps(&block.c[c][group]), _mm_set1_ps(palette[p][c]));
+					distance = _mm_add_ps(distance, _mm_mul_ps(d, d));
+				}
+				__m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+				bestIndex = _mm_or_si128(_mm_andnot_si128(closer, bestIndex), _mm_and_si128(closer, _mm_set1_epi32(p)));
+				best = _mm_min_ps(distance, best);
+			}
+			alignas(16) int32_t groupIndices[4];
+			alignas(16) float groupErrors[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(groupIndices), bestIndex);
+			_mm_store_ps(groupErrors, best);
+			for (int i = 0; i < 4; ++i)
+			{
+				indices[group + i] = (uint8_t)groupIndices[i];
+				total += groupErrors[i];
+			}
+		}
+#else
+		for (int i = 0; i < 16; ++i)
+		{
+			float best = FLT_MAX;
+			int bestIndex = 0;
+			for (int p = 0; p < paletteCount; ++p)
+			{
+				float distance = 0.0f;
+				for (int c = 0; c < channelCount; ++c)
+				{
+					float d = block.c[c][i] - palette[p][c];
+					distance += d * d;
+				}
+				if (distance < best)
+				{
+					best = distance;
+					bestIndex = p;
+				}
+			}
+			indices[i] = (uint8_t)bestIndex;
+			total += best;
+		}
+#endif
+		return total;
+	}
+
+	//Initial endpoints: the bounding box for FAST, the extent along the principal axis otherwise
+	void ComputeEndpoints(const BlockPixels& block, int channelCount, BCQuality quality, float* e0, float* e1)
+	{
+		float minValue[4];
+		float maxValue[4];
+		float mean[4];
+		for (int c = 0; c < channelCount; ++c)
+		{
+			minValue[c] = maxValue[c] = block.c[c][0];
+			mean[c] = 0.0f;
+			for (int i = 0; i < 16; ++i)
+			{
+				minValue[c] = std::min(minValue[c], block.c[c][i]);
+				maxValue[c] = std::max(maxValue[c], block.c[c][i]);
+				mean[c] += block.c[c][i];
+			}
+			mean[c] /= 16.0f;
+		}
+		if (quality == BC_QUALITY_FAST)
+		{
+			//The corners of the box are rarely hit exactly, pull them in a little
+			for (int c = 0; c < channelCount; ++c)
+			{
+				float inset = (maxValue[c] - minValue[c]) / 16.0f;
+				e0[c] = minValue[c] + inset;
+				e1[c] = maxValue[c] - inset;
+			}
+			return;
+		}
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int a = 0; a < channelCount; ++a)
+			{
+				float da = block.c[a][i] - mean[a];
+				for (int b = a; b < channelCount; ++b)
+					covariance[a][b] += da * (block.c[b][i] - mean[b]);
+			}
+		}
+		for (int a = 0; a < channelCount; ++a)
+		{
+			for (int b = 0; b < a; ++b)
+				covariance[a][b] = covariance[b][a];
+		}
+		//Power iteration from the box diagonal
+		float axis[4];
+		for (int c = 0; c < channelCount; ++c)
+			axis[c] = maxValue[c] - minValue[c];
+		for (int iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[4];
+			float largest = 0.0f;
+			for (int a = 0; a < channelCount; ++a)
+			{
+				next[a] = 0.0f;
+				for (int b = 0; b < channelCount; ++b)
+					next[a] += covariance[a][b] * axis[b];
+				largest = std::max(largest, std::fabs(next[a]));
+			}
+			if (largest < 1e-6f) break;
+			for (int c = 0; c < channelCount; ++c)
+				axis[c] = next[c] / largest;
+		}
+		float lengthSq = 0.0f;
+		for (int c = 0; c < channelCount; ++c)
+			lengthSq += axis[c] * axis[c];
+		if (lengthSq < 1e-12f)
+		{
+			for (int c = 0; c < channelCount; ++c)
+				e0[c] = e1[c] = mean[c];
+			return;
+		}
+		float tMin = FLT_MAX;
+		float tMax = -FLT_MAX;
+		for (int i = 0; i < 16; ++i)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < channelCount; ++c)
+				t += (block.c[c][i] - mean[c]) * axis[c];
+			tMin = std::min(tMin, t);
+			tMax = std::max(tMax, t);
+		}
+		for (int c = 0; c < channelCount; ++c)
+		{
+			e0[c] = Clamp255(mean[c] + tMin * axis[c] / lengthSq);
+			e1[c] = Clamp255(mean[c] + tMax * axis[c] / lengthSq);
+		}
+	}
+
+	//Endpoints with the least squared error for fixed indices, weights[index] is the share of e1
+	bool RefineEndpoints(const BlockPixels& block, int channelCount, const uint8_t* indices, const float* weights, float* e0, float* e1)
+	{
+		float aa = 0.0f;
+		float ab = 0.0f;
+		float bb = 0.0f;
+		float ax[4] = {};
+		float bx[4] = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			float b = weights[indices[i]];
+			float a = 1.0f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < channelCount; ++c)
+			{
+				ax[c] += a * block.c[c][i];
+				bx[c] += b * block.c[c][i];
+			}
+		}
+		float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) < 1e-6f) return false;
+		for (int c = 0; c < channelCount; ++c)
+		{
+			e0[c] = Clamp255((ax[c] * bb - bx[c] * ab) / determinant);
+			e1[c] = Clamp255((bx[c] * aa - ax[c] * ab) / determinant);
+		}
+		return true;
+	}
+
+	inline int RefinePasses(BCQuality quality)
+	{
+		return quality == BC_QUALITY_FAST ? 0 : (quality == BC_QUALITY_NORMAL ? 1 : 3);
+	}
+
+	//BC1 color, also the color half of BC3
+
+	uint16_t QuantizeRGB565(const float* c)
+	{
+		int r = std::min(std::max((int)(c[0] * 31.0f / 255.0f + 0.5f), 0), 31);
+		int g = std::min(std::max((int)(c[1] * 63.0f / 255.0f + 0.5f), 0), 63);
+		int b = std::min(std::max((int)(c[2] * 31.0f / 255.0f + 0.5f), 0), 31);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	void ExpandRGB565(uint16_t v, float* c)
+	{
+		int r = v >> 11;
+		int g = (v >> 5) & 63;
+		int b = v & 31;
+		c[0] = (float)((r << 3) | (r >> 2));
+		c[1] = (float)((g << 2) | (g >> 4));
+		c[2] = (float)((b << 3) | (b >> 2));
+		c[3] = 255.0f;
+	}
+
+	const float BC1_WEIGHTS4[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+	const float BC1_WEIGHTS3[3] = { 0.0f, 1.0f, 0.5f };
+
+	struct BC1Candidate
+	{
+		uint16_t c0;
+		uint16_t c1;
+		bool threeColor;
+		uint8_t indices[16];
+		float error;
+	};
+
+	//Four color blocks need c0 > c1, three color blocks (with transparent index 3) c0 <= c1
+	void EvaluateBC1(const BlockPixels& block, const float* e0, const float* e1, bool threeColor, BC1Candidate& result)
+	{
+		uint16_t c0 = QuantizeRGB565(e0);
+		uint16_t c1 = QuantizeRGB565(e1);
+		if (threeColor ? c0 > c1 : c0 < c1) std::swap(c0, c1);
+		float palette[4][4];
+		ExpandRGB565(c0, palette[0]);
+		ExpandRGB565(c1, palette[1]);
+		int paletteCount;
+		//Equal endpoints decode as three colors, entry 2 is c0 again then
+		if (!threeColor && c0 != c1)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+				palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+			}
+			paletteCount = 4;
+		}
+		else
+		{
+			for (int c = 0; c < 3; ++c)
+				palette[2][c] = (palette[0][c] + palette[1][c]) * 0.5f;
+			paletteCount = 3;
+		}
+		result.c0 = c0;
+		result.c1 = c1;
+		result.threeColor = threeColor;
+		result.error = FitPalette(block, 3, palette, paletteCount, result.indices);
+	}
+
+	void RefineBC1(const BlockPixels& block, int passes, BC1Candidate& best)
+	{
+		for (int pass = 0; pass < passes; ++pass)
+		{
+			float e0[4];
+			float e1[4];
+			bool fourColor = !best.threeColor && best.c0 != best.c1;
+			if (!RefineEndpoints(block, 3, best.indices, fourColor ? BC1_WEIGHTS4 : BC1_WEIGHTS3, e0, e1)) return;
+			BC1Candidate candidate;
+			EvaluateBC1(block, e0, e1, best.threeColor, candidate);
+			if (candidate.error >= best.error) return;
+			best = candidate;
+		}
+	}
+
+	//allowPunchThrough is BC1 only, the BC3 color block is always read as four colors
+	void EncodeColorBlock(const BlockPixels& block, BCQuality quality, bool allowPunchThrough, uint8_t* out)
+	{
+		bool transparent[16] = {};
+		int transparentCount = 0;
+		int firstOpaque = -1;
+		for (int i = 0; i < 16; ++i)
+		{
+			transparent[i] = allowPunchThrough && block.c[3][i] < 128.0f;
+			if (transparent[i]) ++transparentCount;
+			else if (firstOpaque < 0) firstOpaque = i;
+		}
+		uint32_t bits = 0;
+		BC1Candidate best;
+		if (transparentCount == 16)
+		{
+			best.c0 = 0;
+			best.c1 = 0;
+			bits = 0xffffffff;
+		}
+		else
+		{
+			//Transparent pixels take the color of an opaque one so they do not pull the endpoints
+			BlockPixels opaque = block;
+			for (int i = 0; i < 16; ++i)
+			{
+				if (!transparent[i]) continue;
+				for (int c = 0; c < 3; ++c)
+					opaque.c[c][i] = block.c[c][firstOpaque];
+			}
+			float e0[4];
+			float e1[4];
+			ComputeEndpoints(opaque, 3, quality, e0, e1);
+			EvaluateBC1(opaque, e0, e1, transparentCount > 0, best);
+			RefineBC1(opaque, RefinePasses(quality), best);
+			//Colors on the midpoint of two endpoints can fit three color mode better
+			if (allowPunchThrough && transparentCount == 0 && quality == BC_QUALITY_HIGH)
+			{
+				BC1Candidate candidate;
+				EvaluateBC1(opaque, e0, e1, true, candidate);
+				RefineBC1(opaque, RefinePasses(quality), candidate);
+				if (candidate.error < best.error) best = candidate;
+			}
+			for (int i = 0; i < 16; ++i)
+				bits |= (uint32_t)(transparent[i] ? 3 : best.indices[i]) << (i * 2);
+		}
+		out[0] = (uint8_t)(best.c0 & 0xff);
+		out[1] = (uint8_t)(best.c0 >> 8);
+		out[2] = (uint8_t)(best.c1 & 0xff);
+		out[3] = (uint8_t)(best.c1 >> 8);
+		for (int i = 0; i < 4; ++i)
+			out[4 + i] = (uint8_t)(bits >> (i * 8));
+	}
+
+	//BC4 single channel, also the alpha half of BC3 and both halves of BC5
+
+	//r0 > r1 interpolates 6 values, r0 <= r1 interpolates 4 and adds 0 and 255
+	float EvaluateBC4(const BlockPixels& single, int r0, int r1, uint8_t* indices)
+	{
+		float palette[8][4];
+		palette[0][0] = (float)r0;
+		palette[1][0] = (float)r1;
+		if (r0 > r1)
+		{
+			for (int i = 2; i < 8; ++i)
+				palette[i][0] = ((8 - i) * r0 + (i - 1) * r1) / 7.0f;
+		}
+		else
+		{
+			for (int i = 2; i < 6; ++i)
+				palette[i][0] = ((6 - i) * r0 + (i - 1) * r1) / 5.0f;
+			palette[6][0] = 0.0f;
+			palette[7][0] = 255.0f;
+		}
+		return FitPalette(single, 1, palette, 8, indices);
+	}
+
+	void EncodeSingleChannelBlock(const BlockPixels& block, int channel, BCQuality quality, uint8_t* out)
+	{
+		BlockPixels single;
+		memcpy(single.c[0], block.c[channel], sizeof(single.c[0]));
+		int minValue = 255;
+		int maxValue = 0;
+		int innerMin = 255;
+		int innerMax = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			int v = (int)single.c[0][i];
+			minValue = std::min(minValue, v);
+			maxValue = std::max(maxValue, v);
+			if (v > 0 && v < 255)
+			{
+				innerMin = std::min(innerMin, v);
+				innerMax = std::max(innerMax, v);
+			}
+		}
+		int bestR0 = maxValue;
+		int bestR1 = minValue;
+		uint8_t bestIndices[16];
+		float bestError = EvaluateBC4(single, bestR0, bestR1, bestIndices);
+		auto tryEndpoints = [&](int r0, int r1) -> void
+		{
+			uint8_t indices[16];
+			float error = EvaluateBC4(single, r0, r1, indices);
+			if (error < bestError)
+			{
+				bestError = error;
+				bestR0 = r0;
+				bestR1 = r1;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+		};
+		if (quality != BC_QUALITY_FAST && bestError > 0.0f)
+		{
+			//Blocks touching 0 or 255 may spend the interpolated values on the rest
+			if (innerMin <= innerMax) tryEndpoints(innerMin, innerMax);
+			else tryEndpoints(0, 0);
+		}
+		if (quality == BC_QUALITY_HIGH && bestError > 0.0f && maxValue > minValue)
+		{
+			int baseR0 = maxValue;
+			int baseR1 = minValue;
+			for (int d0 = -2; d0 <= 2; ++d0)
+			{
+				for (int d1 = -2; d1 <= 2; ++d1)
+				{
+					int r0 = std::min(std::max(baseR0 + d0, 0), 255);
+					int r1 = std::min(std::max(baseR1 + d1, 0), 255);
+					if (r0 > r1) tryEndpoints(r0, r1);
+				}
+			}
+		}
+		uint64_t bits = 0;
+		for (int i = 0; i < 16; ++i)
+			bits |= (uint64_t)bestIndices[i] << (i * 3);
+		out[0] = (uint8_t)bestR0;
+		out[1] = (uint8_t)bestR1;
+		for (int i = 0; i < 6; ++i)
+			out[2 + i] = (uint8_t)(bits >> (i * 8));
+	}
+
+	//BC7 mode 6: one subset, RGBA endpoints of 7 bits plus a shared low bit each, 4-bit indices
+
+	const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	struct BC7Candidate
+	{
+		int q0[4];
+		int q1[4];
+		int p0;
+		int p1;
+		uint8_t indices[16];
+		float error;
+	};
+
+	void QuantizeBC7Endpoint(const float* e, int pbit, int* q)
+	{
+		for (int c = 0; c < 4; ++c)
+			q[c] = std::min(std::max((int)std::floor((e[c] - pbit) * 0.5f + 0.5f), 0), 127);
+	}
+
+	//The low bit that keeps the endpoint closest on its own
+	int ChooseBC7PBit(const float* e)
+	{
+		float errors[2];
+		for (int p = 0; p < 2; ++p)
+		{
+			int q[4];
+			QuantizeBC7Endpoint(e, p, q);
+			errors[p] = 0.0f;
+			for (int c = 0; c < 4; ++c)
+			{
+				float d = e[c] - (float)((q[c] << 1) | p);
+				errors[p] += d * d;
+			}
+		}
+		return errors[1] < errors[0] ? 1 : 0;
+	}
+
+	void EvaluateBC7(const BlockPixels& block, const float* e0, const float* e1, int p0, int p1, BC7Candidate& result)
+	{
+		QuantizeBC7Endpoint(e0, p0, result.q0);
+		QuantizeBC7Endpoint(e1, p1, result.q1);
+		result.p0 = p0;
+		result.p1 = p1;
+		float palette[16][4];
+		for (int c = 0; c < 4; ++c)
+		{
+			int v0 = (result.q0[c] << 1) | p0;
+			int v1 = (result.q1[c] << 1) | p1;
+			for (int i = 0; i < 16; ++i)
+				palette[i][c] = (float)(((64 - BC7_WEIGHTS4[i]) * v0 + BC7_WEIGHTS4[i] * v1 + 32) >> 6);
+		}
+		result.error = FitPalette(block, 4, palette, 16, result.indices);
+	}
+
+	//HIGH tries every pair of low bits, the others pick each one on its own
+	void EvaluateBC7Endpoints(const BlockPixels& block, const float* e0, const float* e1, BCQuality quality, BC7Candidate& best)
+	{
+		if (quality != BC_QUALITY_HIGH)
+		{
+			EvaluateBC7(block, e0, e1, ChooseBC7PBit(e0), ChooseBC7PBit(e1), best);
+			return;
+		}
+		best.error = FLT_MAX;
+		for (int p = 0; p < 4; ++p)
+		{
+			BC7Candidate candidate;
+			EvaluateBC7(block, e0, e1, p & 1, p >> 1, candidate);
+			if (candidate.error < best.error) best = candidate;
+		}
+	}
+
+	struct BitWriter
+	{
+		uint8_t* out;
+		int position;
+		void Write(uint32_t value, int bitCount)
+		{
+			for (int i = 0; i < bitCount; ++i, ++position)
+				out[position >> 3] |= (uint8_t)(((value >> i) & 1) << (position & 7));
+		}
+	};
+
+	void EncodeBC7Block(const BlockPixels& block, BCQuality quality, uint8_t* out)
+	{
+		float e0[4];
+		float e1[4];
+		ComputeEndpoints(block, 4, quality, e0, e1);
+		BC7Candidate best;
+		EvaluateBC7Endpoints(block, e0, e1, quality, best);
+		float weights[16];
+		for (int i = 0; i < 16; ++i)
+			weights[i] = BC7_WEIGHTS4[i] / 64.0f;
+		int passes = RefinePasses(quality);
+		for (int pass = 0; pass < passes; ++pass)
+		{
+			if (!RefineEndpoints(block, 4, best.indices, weights, e0, e1)) break;
+			BC7Candidate candidate;
+			EvaluateBC7Endpoints(block, e0, e1, quality, candidate);
+			if (candidate.error >= best.error) break;
+			best = candidate;
+		}
+		//The first index is stored with 3 bits, its top bit has to be 0
+		if (best.indices[0] & 8)
+		{
+			for (int c = 0; c < 4; ++c)
+				std::swap(best.q0[c], best.q1[c]);
+			std::swap(best.p0, best.p1);
+			for (int i = 0; i < 16; ++i)
+				best.indices[i] = (uint8_t)(15 - best.indices[i]);
+		}
+		memset(out, 0, 16);
+		BitWriter writer = { out, 0 };
+		writer.Write(1 << 6, 7);
+		for (int c = 0; c < 4; ++c)
+		{
+			writer.Write(best.q0[c], 7);
+			writer.Write(best.q1[c], 7);
+		}
+		writer.Write(best.p0, 1);
+		writer.Write(best.p1, 1);
+		writer.Write(best.indices[0], 3);
+		for (int i = 1; i < 16; ++i)
+			writer.Write(best.indices[i], 4);
+	}
+}
+
+size_t BCEncoder::GetBlockBytes(BCFormat format)
+{
+	return (format == BC_FORMAT_BC1 || format == BC_FORMAT_BC4) ? 8 : 16;
+}
+
+DXGI_FORMAT BCEncoder::GetDXGIFormat(BCFormat format, bool srgb)
+{
+	switch (format)
+	{
+	case BC_FORMAT_BC1:
+		return srgb ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM;
+	case BC_FORMAT_BC3:
+		return srgb ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM;
+	case BC_FORMAT_BC4:
+		return DXGI_FORMAT_BC4_UNORM;
+	case BC_FORMAT_BC5:
+		return DXGI_FORMAT_BC5_UNORM;
+	case BC_FORMAT_BC7:
+		return srgb ? DXGI_FORMAT_BC7_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM;
+	default:
+		return DXGI_FORMAT_UNKNOWN;
+	}
+}
+
+size_t BCEncoder::GetImageSize(BCFormat format, uint32_t width, uint32_t height)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * GetBlockBytes(format);
+}
+
+void BCEncoder::EncodeBlock(BCFormat format, BCQuality quality, const uint8_t* pixels, uint8_t* out)
+{
+	BlockPixels block;
+	LoadBlock(pixels, block);
+	switch (format)
+	{
+	case BC_FORMAT_BC1:
+		EncodeColorBlock(block, quality, true, out);
+		break;
+	case BC_FORMAT_BC3:
+		EncodeSingleChannelBlock(block, 3, quality, out);
+		EncodeColorBlock(block, quality, false, out + 8);
+		break;
+	case BC_FORMAT_BC4:
+		EncodeSingleChannelBlock(block, 0, quality, out);
+		break;
+	case BC_FORMAT_BC5:
+		EncodeSingleChannelBlock(block, 0, quality, out);
+		EncodeSingleChannelBlock(block, 1, quality, out + 8);
+		break;
+	case BC_FORMAT_BC7:
+		EncodeBC7Block(block, quality, out);
+		break;
+	default:
+		break;
+	}
+}
+
+void BCEncoder::EncodeImage(
+	BCFormat format,
+	BCQuality quality,
+	const uint8_t* rgba,
+	uint32_t width,
+	uint32_t height,
+	size_t rowPitch,
+	uint8_t* out,
+	ThreadPool* pool)
+{
+	if (width == 0 || height == 0) return;
+	size_t blockBytes = GetBlockBytes(format);
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blocksY = (height + 3) / 4;
+	auto encodeRow = [&](unsigned int by) -> void
+	{
+		uint8_t pixels[64];
+		for (uint32_t bx = 0; bx < blocksX; ++bx)
+		{
+			for (uint32_t y = 0; y < 4; ++y)
+			{
+				uint32_t sy = std::min(by * 4 + y, height - 1);
+				for (uint32_t x = 0; x < 4; ++x)
+				{
+					uint32_t sx = std::min(bx * 4 + x, width - 1);
+					memcpy(pixels + (y * 4 + x) * 4, rgba + sy * rowPitch + sx * 4, 4);
+				}
+			}
+			EncodeBlock(format, quality, pixels, out + ((size_t)by * blocksX + bx) * blockBytes);
+		}
+	};
+	if (pool == nullptr)
+	{
+		for (uint32_t by = 0; by < blocksY; ++by)
+			encodeRow(by);
+	}
+	else
+	{
+		pool->ParallelFor(blocksY, encodeRow);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "DDSCore.h"
+#include <cstdint>
+#include <cstddef>
+class ThreadPool;
+
+enum BCFormat
+{
+	//RGB, alpha under 128 becomes punch-through transparent
+	BC_FORMAT_BC1 = 0,
+	//RGB and interpolated alpha
+	BC_FORMAT_BC3 = 1,
+	//Red only
+	BC_FORMAT_BC4 = 2,
+	//Red and green, e.g. normal map xy
+	BC_FORMAT_BC5 = 3,
+	//RGBA at 8 bits per pixel, encoded with mode 6 only
+	BC_FORMAT_BC7 = 4
+};
+
+enum BCQuality
+{
+	//Bounding box endpoints, no refinement
+	BC_QUALITY_FAST = 0,
+	//Principal axis endpoints, one least squares pass
+	BC_QUALITY_NORMAL = 1,
+	//Several refinement passes and a wider endpoint search
+	BC_QUALITY_HIGH = 2
+};
+
+//CPU block compression of RGBA8 images, does not depend on Windows or D3D
+//Palette fitting uses SSE2, which every x64 CPU has, other targets use the scalar path
+class BCEncoder
+{
+public:
+	static size_t GetBlockBytes(BCFormat format);
+	static DXGI_FORMAT GetDXGIFormat(BCFormat format, bool srgb);
+	//Bytes for one mip of width x height, rows of blocks are packed tightly
+	static size_t GetImageSize(BCFormat format, uint32_t width, uint32_t height);
+	//pixels holds the 16 RGBA8 pixels of a 4x4 block in row order, out receives GetBlockBytes bytes
+	static void EncodeBlock(BCFormat format, BCQuality quality, const uint8_t* pixels, uint8_t* out);
+	//Blocks past the right and bottom edge repeat the last column and row
+	//Rows of blocks are spread over pool, nullptr encodes on the calling thread
+	static void EncodeImage(
+		BCFormat format,
+		BCQuality quality,
+		const uint8_t* rgba,
+		uint32_t width,
+		uint32_t height,
+		size_t rowPitch,
+		uint8_t* out,
+		ThreadPool* pool);
+};
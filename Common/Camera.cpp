@@ -22,7 +22,11 @@ void Camera::Dispose()
 	for (int i = 0; i < FrameResource::mFrameResources.size(); ++i)
 	{
 		ConstBufferElement constBuffer = FrameResource::mFrameResources[i]->cameraCBs[GetInstanceID()];
-		pool.Release(constBuffer.buffer, constBuffer.element);
+		//The slot may still be read by frames in flight
+		DeferredReleaseQueue::Enqueue([constBuffer]() -> void
+		{
+			pool.Release(constBuffer.buffer, constBuffer.element);
+		});
 		FrameResource::mFrameResources[i]->cameraCBs.erase(GetInstanceID());
 	}
 }
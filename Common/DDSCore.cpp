@@ -0,0 +1,744 @@
+#include "DDSCore.h"
+#include <algorithm>
+#include <cstring>
+
+size_t DDSCore::BitsPerPixel(DXGI_FORMAT fmt)
+{
+	switch( fmt )
+	{
+	case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+	case DXGI_FORMAT_R32G32B32A32_UINT:
+	case DXGI_FORMAT_R32G32B32A32_SINT:
+		return 128;
+
+	case DXGI_FORMAT_R32G32B32_TYPELESS:
+	case DXGI_FORMAT_R32G32B32_FLOAT:
+	case DXGI_FORMAT_R32G32B32_UINT:
+	case DXGI_FORMAT_R32G32B32_SINT:
+		return 96;
+
+	case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+	case DXGI_FORMAT_R16G16B16A16_UNORM:
+	case DXGI_FORMAT_R16G16B16A16_UINT:
+	case DXGI_FORMAT_R16G16B16A16_SNORM:
+	case DXGI_FORMAT_R16G16B16A16_SINT:
+	case DXGI_FORMAT_R32G32_TYPELESS:
+	case DXGI_FORMAT_R32G32_FLOAT:
+	case DXGI_FORMAT_R32G32_UINT:
+	case DXGI_FORMAT_R32G32_SINT:
+	case DXGI_FORMAT_R32G8X24_TYPELESS:
+	case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+	case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
+	case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+	case DXGI_FORMAT_Y416:
+	case DXGI_FORMAT_Y210:
+	case DXGI_FORMAT_Y216:
+		return 64;
+
+	case DXGI_FORMAT_R10G10B10A2_TYPELESS:
+	case DXGI_FORMAT_R10G10B10A2_UNORM:
+	case DXGI_FORMAT_R10G10B10A2_UINT:
+	case DXGI_FORMAT_R11G11B10_FLOAT:
+	case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_R8G8B8A8_UINT:
+	case DXGI_FORMAT_R8G8B8A8_SNORM:
+	case DXGI_FORMAT_R8G8B8A8_SINT:
+	case DXGI_FORMAT_R16G16_TYPELESS:
+	case DXGI_FORMAT_R16G16_FLOAT:
+	case DXGI_FORMAT_R16G16_UNORM:
+	case DXGI_FORMAT_R16G16_UINT:
+	case DXGI_FORMAT_R16G16_SNORM:
+	case DXGI_FORMAT_R16G16_SINT:
+	case DXGI_FORMAT_R32_TYPELESS:
+	case DXGI_FORMAT_D32_FLOAT:
+	case DXGI_FORMAT_R32_FLOAT:
+	case DXGI_FORMAT_R32_UINT:
+	case DXGI_FORMAT_R32_SINT:
+	case DXGI_FORMAT_R24G8_TYPELESS:
+	case DXGI_FORMAT_D24_UNORM_S8_UINT:
+	case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+	case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
+	case DXGI_FORMAT_R9G9B9E5_SHAREDEXP:
+	case DXGI_FORMAT_R8G8_B8G8_UNORM:
+	case DXGI_FORMAT_G8R8_G8B8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+	case DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+	case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+	case DXGI_FORMAT_AYUV:
+	case DXGI_FORMAT_Y410:
+	case DXGI_FORMAT_YUY2:
+		return 32;
+
+	case DXGI_FORMAT_P010:
+	case DXGI_FORMAT_P016:
+		return 24;
+
+	case DXGI_FORMAT_R8G8_TYPELESS:
+	case DXGI_FORMAT_R8G8_UNORM:
+	case DXGI_FORMAT_R8G8_UINT:
+	case DXGI_FORMAT_R8G8_SNORM:
+	case DXGI_FORMAT_R8G8_SINT:
+	case DXGI_FORMAT_R16_TYPELESS:
+	case DXGI_FORMAT_R16_FLOAT:
+	case DXGI_FORMAT_D16_UNORM:
+	case DXGI_FORMAT_R16_UNORM:
+	case DXGI_FORMAT_R16_UINT:
+	case DXGI_FORMAT_R16_SNORM:
+	case DXGI_FORMAT_R16_SINT:
+	case DXGI_FORMAT_B5G6R5_UNORM:
+	case DXGI_FORMAT_B5G5R5A1_UNORM:
+	case DXGI_FORMAT_A8P8:
+	case DXGI_FORMAT_B4G4R4A4_UNORM:
+		return 16;
+
+	case DXGI_FORMAT_NV12:
+	case DXGI_FORMAT_420_OPAQUE:
+	case DXGI_FORMAT_NV11:
+		return 12;
+
+	case DXGI_FORMAT_R8_TYPELESS:
+	case DXGI_FORMAT_R8_UNORM:
+	case DXGI_FORMAT_R8_UINT:
+	case DXGI_FORMAT_R8_SNORM:
+	case DXGI_FORMAT_R8_SINT:
+	case DXGI_FORMAT_A8_UNORM:
+	case DXGI_FORMAT_AI44:
+	case DXGI_FORMAT_IA44:
+	case DXGI_FORMAT_P8:
+		return 8;
+
+	case DXGI_FORMAT_R1_UNORM:
+		return 1;
+
+	case DXGI_FORMAT_BC1_TYPELESS:
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_TYPELESS:
+	case DXGI_FORMAT_BC4_UNORM:
+	case DXGI_FORMAT_BC4_SNORM:
+		return 4;
+
+	case DXGI_FORMAT_BC2_TYPELESS:
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_TYPELESS:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_TYPELESS:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC6H_TYPELESS:
+	case DXGI_FORMAT_BC6H_UF16:
+	case DXGI_FORMAT_BC6H_SF16:
+	case DXGI_FORMAT_BC7_TYPELESS:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return 8;
+
+	default:
+		return 0;
+	}
+}
+
+void DDSCore::GetSurfaceInfo(
+	size_t width,
+	size_t height,
+	DXGI_FORMAT fmt,
+	size_t* outNumBytes,
+	size_t* outRowBytes,
+	size_t* outNumRows)
+{
+	size_t numBytes = 0;
+	size_t rowBytes = 0;
+	size_t numRows = 0;
+
+	bool bc = false;
+	bool packed = false;
+	bool planar = false;
+	size_t bpe = 0;
+	switch (fmt)
+	{
+	case DXGI_FORMAT_BC1_TYPELESS:
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_TYPELESS:
+	case DXGI_FORMAT_BC4_UNORM:
+	case DXGI_FORMAT_BC4_SNORM:
+		bc=true;
+		bpe = 8;
+		break;
+
+	case DXGI_FORMAT_BC2_TYPELESS:
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_TYPELESS:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_TYPELESS:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC6H_TYPELESS:
+	case DXGI_FORMAT_BC6H_UF16:
+	case DXGI_FORMAT_BC6H_SF16:
+	case DXGI_FORMAT_BC7_TYPELESS:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		bc = true;
+		bpe = 16;
+		break;
+
+	case DXGI_FORMAT_R8G8_B8G8_UNORM:
+	case DXGI_FORMAT_G8R8_G8B8_UNORM:
+	case DXGI_FORMAT_YUY2:
+		packed = true;
+		bpe = 4;
+		break;
+
+	case DXGI_FORMAT_Y210:
+	case DXGI_FORMAT_Y216:
+		packed = true;
+		bpe = 8;
+		break;
+
+	case DXGI_FORMAT_NV12:
+	case DXGI_FORMAT_420_OPAQUE:
+		planar = true;
+		bpe = 2;
+		break;
+
+	case DXGI_FORMAT_P010:
+	case DXGI_FORMAT_P016:
+		planar = true;
+		bpe = 4;
+		break;
+
+	default:
+		break;
+	}
+
+	if (bc)
+	{
+		size_t numBlocksWide = 0;
+		if (width > 0)
+		{
+			numBlocksWide = std::max<size_t>( 1, (width + 3) / 4 );
+		}
+		size_t numBlocksHigh = 0;
+		if (height > 0)
+		{
+			numBlocksHigh = std::max<size_t>( 1, (height + 3) / 4 );
+		}
+		rowBytes = numBlocksWide * bpe;
+		numRows = numBlocksHigh;
+		numBytes = rowBytes * numBlocksHigh;
+	}
+	else if (packed)
+	{
+		rowBytes = ( ( width + 1 ) >> 1 ) * bpe;
+		numRows = height;
+		numBytes = rowBytes * height;
+	}
+	else if ( fmt == DXGI_FORMAT_NV11 )
+	{
+		rowBytes = ( ( width + 3 ) >> 2 ) * 4;
+		numRows = height * 2; // Direct3D makes this simplifying assumption, although it is larger than the 4:1:1 data
+		numBytes = rowBytes * numRows;
+	}
+	else if (planar)
+	{
+		rowBytes = ( ( width + 1 ) >> 1 ) * bpe;
+		numBytes = ( rowBytes * height ) + ( ( rowBytes * height + 1 ) >> 1 );
+		numRows = height + ( ( height + 1 ) >> 1 );
+	}
+	else
+	{
+		size_t bpp = BitsPerPixel( fmt );
+		rowBytes = ( width * bpp + 7 ) / 8; // round up to nearest byte
+		numRows = height;
+		numBytes = rowBytes * height;
+	}
+
+	if (outNumBytes)
+	{
+		*outNumBytes = numBytes;
+	}
+	if (outRowBytes)
+	{
+		*outRowBytes = rowBytes;
+	}
+	if (outNumRows)
+	{
+		*outNumRows = numRows;
+	}
+}
+
+#define ISBITMASK( r,g,b,a ) ( ddpf.RBitMask == r && ddpf.GBitMask == g && ddpf.BBitMask == b && ddpf.ABitMask == a )
+
+DXGI_FORMAT DDSCore::GetDXGIFormat(const DDS_PIXELFORMAT& ddpf)
+{
+	if (ddpf.flags & DDS_RGB)
+	{
+		// Note that sRGB formats are written using the "DX10" extended header
+
+		switch (ddpf.RGBBitCount)
+		{
+		case 32:
+			if (ISBITMASK(0x000000ff,0x0000ff00,0x00ff0000,0xff000000))
+			{
+				return DXGI_FORMAT_R8G8B8A8_UNORM;
+			}
+
+			if (ISBITMASK(0x00ff0000,0x0000ff00,0x000000ff,0xff000000))
+			{
+				return DXGI_FORMAT_B8G8R8A8_UNORM;
+			}
+
+			if (ISBITMASK(0x00ff0000,0x0000ff00,0x000000ff,0x00000000))
+			{
+				return DXGI_FORMAT_B8G8R8X8_UNORM;
+			}
+
+			// No DXGI format maps to ISBITMASK(0x000000ff,0x0000ff00,0x00ff0000,0x00000000) aka D3DFMT_X8B8G8R8
+
+			// Note that many common DDS reader/writers (including D3DX) swap the
+			// the RED/BLUE masks for 10:10:10:2 formats. We assume
+			// below that the 'backwards' header mask is being used since it is most
+			// likely written by D3DX. The more robust solution is to use the 'DX10'
+			// header extension and specify the DXGI_FORMAT_R10G10B10A2_UNORM format directly
+
+			// For 'correct' writers, this should be 0x000003ff,0x000ffc00,0x3ff00000 for RGB data
+			if (ISBITMASK(0x3ff00000,0x000ffc00,0x000003ff,0xc0000000))
+			{
+				return DXGI_FORMAT_R10G10B10A2_UNORM;
+			}
+
+			// No DXGI format maps to ISBITMASK(0x000003ff,0x000ffc00,0x3ff00000,0xc0000000) aka D3DFMT_A2R10G10B10
+
+			if (ISBITMASK(0x0000ffff,0xffff0000,0x00000000,0x00000000))
+			{
+				return DXGI_FORMAT_R16G16_UNORM;
+			}
+
+			if (ISBITMASK(0xffffffff,0x00000000,0x00000000,0x00000000))
+			{
+				// Only 32-bit color channel format in D3D9 was R32F
+				return DXGI_FORMAT_R32_FLOAT; // D3DX writes this out as a FourCC of 114
+			}
+			break;
+
+		case 24:
+			// No 24bpp DXGI formats aka D3DFMT_R8G8B8
+			break;
+
+		case 16:
+			if (ISBITMASK(0x7c00,0x03e0,0x001f,0x8000))
+			{
+				return DXGI_FORMAT_B5G5R5A1_UNORM;
+			}
+			if (ISBITMASK(0xf800,0x07e0,0x001f,0x0000))
+			{
+				return DXGI_FORMAT_B5G6R5_UNORM;
+			}
+
+			// No DXGI format maps to ISBITMASK(0x7c00,0x03e0,0x001f,0x0000) aka D3DFMT_X1R5G5B5
+
+			if (ISBITMASK(0x0f00,0x00f0,0x000f,0xf000))
+			{
+				return DXGI_FORMAT_B4G4R4A4_UNORM;
+			}
+
+			// No DXGI format maps to ISBITMASK(0x0f00,0x00f0,0x000f,0x0000) aka D3DFMT_X4R4G4B4
+
+			// No 3:3:2, 3:3:2:8, or paletted DXGI formats aka D3DFMT_A8R3G3B2, D3DFMT_R3G3B2, D3DFMT_P8, D3DFMT_A8P8, etc.
+			break;
+		}
+	}
+	else if (ddpf.flags & DDS_LUMINANCE)
+	{
+		if (8 == ddpf.RGBBitCount)
+		{
+			if (ISBITMASK(0x000000ff,0x00000000,0x00000000,0x00000000))
+			{
+				return DXGI_FORMAT_R8_UNORM; // D3DX10/11 writes this out as DX10 extension
+			}
+
+			// No DXGI format maps to ISBITMASK(0x0f,0x00,0x00,0xf0) aka D3DFMT_A4L4
+		}
+
+		if (16 == ddpf.RGBBitCount)
+		{
+			if (ISBITMASK(0x0000ffff,0x00000000,0x00000000,0x00000000))
+			{
+				return DXGI_FORMAT_R16_UNORM; // D3DX10/11 writes this out as DX10 extension
+			}
+			if (ISBITMASK(0x000000ff,0x00000000,0x00000000,0x0000ff00))
+			{
+				return DXGI_FORMAT_R8G8_UNORM; // D3DX10/11 writes this out as DX10 extension
+			}
+		}
+	}
+	else if (ddpf.flags & DDS_ALPHA)
+	{
+		if (8 == ddpf.RGBBitCount)
+		{
+			return DXGI_FORMAT_A8_UNORM;
+		}
+	}
+	else if (ddpf.flags & DDS_FOURCC)
+	{
+		if (MAKEFOURCC( 'D', 'X', 'T', '1' ) == ddpf.fourCC)
+		{
+			return DXGI_FORMAT_BC1_UNORM;
+		}
+		if (MAKEFOURCC( 'D', 'X', 'T', '3' ) == ddpf.fourCC)
+		{
+			return DXGI_FORMAT_BC2_UNORM;
+		}
+		if (MAKEFOURCC( 'D', 'X', 'T', '5' ) == ddpf.fourCC)
+		{
+			return DXGI_FORMAT_BC3_UNORM;
+		}
+
+		// While pre-multiplied alpha isn't directly supported by the DXGI formats,
+		// they are basically the same as these BC formats so they can be mapped
+		if (MAKEFOURCC( 'D', 'X', 'T', '2' ) == ddpf.fourCC)
+		{
+			return DXGI_FORMAT_BC2_UNORM;
+		}
+		if (MAKEFOURCC( 'D', 'X', 'T', '4' ) == ddpf.fourCC)
+		{
+			return DXGI_FORMAT_BC3_UNORM;
+		}
+
+		if (MAKEFOURCC( 'A', 'T', 'I', '1' ) == ddpf.fourCC)
+		{
+			return DXGI_FORMAT_BC4_UNORM;
+		}
+		if (MAKEFOURCC( 'B', 'C', '4', 'U' ) == ddpf.fourCC)
+		{
+			return DXGI_FORMAT_BC4_UNORM;
+		}
+		if (MAKEFOURCC( 'B', 'C', '4', 'S' ) == ddpf.fourCC)
+		{
+			return DXGI_FORMAT_BC4_SNORM;
+		}
+
+		if (MAKEFOURCC( 'A', 'T', 'I', '2' ) == ddpf.fourCC)
+		{
+			return DXGI_FORMAT_BC5_UNORM;
+		}
+		if (MAKEFOURCC( 'B', 'C', '5', 'U' ) == ddpf.fourCC)
+		{
+			return DXGI_FORMAT_BC5_UNORM;
+		}
+		if (MAKEFOURCC( 'B', 'C', '5', 'S' ) == ddpf.fourCC)
+		{
+			return DXGI_FORMAT_BC5_SNORM;
+		}
+
+		// BC6H and BC7 are written using the "DX10" extended header
+
+		if (MAKEFOURCC( 'R', 'G', 'B', 'G' ) == ddpf.fourCC)
+		{
+			return DXGI_FORMAT_R8G8_B8G8_UNORM;
+		}
+		if (MAKEFOURCC( 'G', 'R', 'G', 'B' ) == ddpf.fourCC)
+		{
+			return DXGI_FORMAT_G8R8_G8B8_UNORM;
+		}
+
+		if (MAKEFOURCC('Y','U','Y','2') == ddpf.fourCC)
+		{
+			return DXGI_FORMAT_YUY2;
+		}
+
+		// Check for D3DFORMAT enums being set here
+		switch( ddpf.fourCC )
+		{
+		case 36: // D3DFMT_A16B16G16R16
+			return DXGI_FORMAT_R16G16B16A16_UNORM;
+
+		case 110: // D3DFMT_Q16W16V16U16
+			return DXGI_FORMAT_R16G16B16A16_SNORM;
+
+		case 111: // D3DFMT_R16F
+			return DXGI_FORMAT_R16_FLOAT;
+
+		case 112: // D3DFMT_G16R16F
+			return DXGI_FORMAT_R16G16_FLOAT;
+
+		case 113: // D3DFMT_A16B16G16R16F
+			return DXGI_FORMAT_R16G16B16A16_FLOAT;
+
+		case 114: // D3DFMT_R32F
+			return DXGI_FORMAT_R32_FLOAT;
+
+		case 115: // D3DFMT_G32R32F
+			return DXGI_FORMAT_R32G32_FLOAT;
+
+		case 116: // D3DFMT_A32B32G32R32F
+			return DXGI_FORMAT_R32G32B32A32_FLOAT;
+		}
+	}
+
+	return DXGI_FORMAT_UNKNOWN;
+}
+
+#undef ISBITMASK
+//D3D 11.x hardware limits, DDS metadata beyond them is not trusted
+static const uint32_t MAX_MIP_LEVELS = 15;
+static const uint32_t MAX_TEXTURE1D_DIMENSION = 16384;
+static const uint32_t MAX_TEXTURE2D_DIMENSION = 16384;
+static const uint32_t MAX_TEXTURECUBE_DIMENSION = 16384;
+static const uint32_t MAX_TEXTURE3D_DIMENSION = 2048;
+static const uint32_t MAX_ARRAY_SIZE = 2048;
+
+DDSResult DDSCore::ValidateHeader(const uint8_t* data, size_t size, const DDS_HEADER** header, size_t* dataOffset)
+{
+	//Need at least enough data to fill the header and magic number to be a valid DDS
+	if (data == nullptr || size < sizeof(uint32_t) + sizeof(DDS_HEADER))
+		return DDS_RESULT_INVALID_DATA;
+	uint32_t magic;
+	memcpy(&magic, data, sizeof(uint32_t));
+	if (magic != DDS_MAGIC)
+		return DDS_RESULT_INVALID_DATA;
+	const DDS_HEADER* hdr = reinterpret_cast<const DDS_HEADER*>(data + sizeof(uint32_t));
+	if (hdr->size != sizeof(DDS_HEADER) || hdr->ddspf.size != sizeof(DDS_PIXELFORMAT))
+		return DDS_RESULT_INVALID_DATA;
+	size_t offset = sizeof(uint32_t) + sizeof(DDS_HEADER);
+	if ((hdr->ddspf.flags & DDS_FOURCC) && MAKEFOURCC('D', 'X', '1', '0') == hdr->ddspf.fourCC)
+	{
+		if (size < offset + sizeof(DDS_HEADER_DXT10))
+			return DDS_RESULT_INVALID_DATA;
+		offset += sizeof(DDS_HEADER_DXT10);
+	}
+	if (header) *header = hdr;
+	if (dataOffset) *dataOffset = offset;
+	return DDS_RESULT_OK;
+}
+
+DDSResult DDSCore::ParseHeader(const uint8_t* data, size_t size, DDSTextureDesc& desc)
+{
+	const DDS_HEADER* header;
+	size_t offset;
+	DDSResult result = ValidateHeader(data, size, &header, &offset);
+	if (result != DDS_RESULT_OK) return result;
+	desc.width = header->width;
+	desc.height = header->height;
+	desc.depth = header->depth;
+	desc.mipCount = header->mipMapCount == 0 ? 1 : header->mipMapCount;
+	desc.arraySize = 1;
+	desc.format = DXGI_FORMAT_UNKNOWN;
+	desc.isCubeMap = false;
+	desc.alphaMode = 0;
+	desc.dataOffset = offset;
+	desc.dataSize = size - offset;
+	if ((header->ddspf.flags & DDS_FOURCC) && MAKEFOURCC('D', 'X', '1', '0') == header->ddspf.fourCC)
+	{
+		const DDS_HEADER_DXT10* d3d10ext = reinterpret_cast<const DDS_HEADER_DXT10*>(data + sizeof(uint32_t) + sizeof(DDS_HEADER));
+		desc.arraySize = d3d10ext->arraySize;
+		if (desc.arraySize == 0)
+			return DDS_RESULT_INVALID_DATA;
+		switch (d3d10ext->dxgiFormat)
+		{
+		case DXGI_FORMAT_AI44:
+		case DXGI_FORMAT_IA44:
+		case DXGI_FORMAT_P8:
+		case DXGI_FORMAT_A8P8:
+			return DDS_RESULT_NOT_SUPPORTED;
+		default:
+			if (BitsPerPixel(d3d10ext->dxgiFormat) == 0)
+				return DDS_RESULT_NOT_SUPPORTED;
+		}
+		desc.format = d3d10ext->dxgiFormat;
+		switch (d3d10ext->resourceDimension)
+		{
+		case DDS_DIMENSION_TEXTURE1D:
+			if ((header->flags & DDS_HEIGHT) && desc.height != 1)
+				return DDS_RESULT_INVALID_DATA;
+			desc.height = desc.depth = 1;
+			break;
+		case DDS_DIMENSION_TEXTURE2D:
+			if (d3d10ext->miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE)
+			{
+				desc.arraySize *= 6;
+				desc.isCubeMap = true;
+			}
+			desc.depth = 1;
+			break;
+		case DDS_DIMENSION_TEXTURE3D:
+			if (!(header->flags & DDS_HEADER_FLAGS_VOLUME))
+				return DDS_RESULT_INVALID_DATA;
+			if (desc.arraySize > 1)
+				return DDS_RESULT_NOT_SUPPORTED;
+			break;
+		default:
+			return DDS_RESULT_NOT_SUPPORTED;
+		}
+		desc.dimension = d3d10ext->resourceDimension;
+		uint32_t alphaMode = d3d10ext->miscFlags2 & DDS_MISC_FLAGS2_ALPHA_MODE_MASK;
+		//Straight, premultiplied, opaque and custom, anything else is unknown
+		if (alphaMode >= 1 && alphaMode <= 4)
+			desc.alphaMode = alphaMode;
+	}
+	else
+	{
+		desc.format = GetDXGIFormat(header->ddspf);
+		if (desc.format == DXGI_FORMAT_UNKNOWN)
+			return DDS_RESULT_NOT_SUPPORTED;
+		if (header->flags & DDS_HEADER_FLAGS_VOLUME)
+		{
+			desc.dimension = DDS_DIMENSION_TEXTURE3D;
+		}
+		else
+		{
+			if (header->caps2 & DDS_CUBEMAP)
+			{
+				if ((header->caps2 & DDS_CUBEMAP_ALLFACES) != DDS_CUBEMAP_ALLFACES)
+					return DDS_RESULT_NOT_SUPPORTED;
+				desc.arraySize = 6;
+				desc.isCubeMap = true;
+			}
+			desc.depth = 1;
+			desc.dimension = DDS_DIMENSION_TEXTURE2D;
+		}
+		if ((header->ddspf.flags & DDS_FOURCC) &&
+			(MAKEFOURCC('D', 'X', 'T', '2') == header->ddspf.fourCC || MAKEFOURCC('D', 'X', 'T', '4') == header->ddspf.fourCC))
+			desc.alphaMode = 2;
+	}
+	if (desc.mipCount > MAX_MIP_LEVELS)
+		return DDS_RESULT_NOT_SUPPORTED;
+	switch (desc.dimension)
+	{
+	case DDS_DIMENSION_TEXTURE1D:
+		if (desc.arraySize > MAX_ARRAY_SIZE || desc.width > MAX_TEXTURE1D_DIMENSION)
+			return DDS_RESULT_NOT_SUPPORTED;
+		break;
+	case DDS_DIMENSION_TEXTURE2D:
+		if (desc.isCubeMap)
+		{
+			//arraySize is already NumCubes * 6
+			if (desc.arraySize > MAX_ARRAY_SIZE || desc.width > MAX_TEXTURECUBE_DIMENSION || desc.height > MAX_TEXTURECUBE_DIMENSION)
+				return DDS_RESULT_NOT_SUPPORTED;
+		}
+		else if (desc.arraySize > MAX_ARRAY_SIZE || desc.width > MAX_TEXTURE2D_DIMENSION || desc.height > MAX_TEXTURE2D_DIMENSION)
+		{
+			return DDS_RESULT_NOT_SUPPORTED;
+		}
+		break;
+	case DDS_DIMENSION_TEXTURE3D:
+		if (desc.arraySize > 1 || desc.width > MAX_TEXTURE3D_DIMENSION ||
+			desc.height > MAX_TEXTURE3D_DIMENSION || desc.depth > MAX_TEXTURE3D_DIMENSION)
+			return DDS_RESULT_NOT_SUPPORTED;
+		break;
+	default:
+		return DDS_RESULT_NOT_SUPPORTED;
+	}
+	return DDS_RESULT_OK;
+}
+
+DDSResult DDSCore::ComputeLayout(const DDSTextureDesc& desc, size_t maxsize, DDSLayout& layout)
+{
+	layout.width = 0;
+	layout.height = 0;
+	layout.depth = 0;
+	layout.mipCount = 0;
+	layout.skipMip = 0;
+	layout.subresources.clear();
+	layout.subresources.reserve((size_t)desc.mipCount * desc.arraySize);
+	size_t offset = desc.dataOffset;
+	size_t end = desc.dataOffset + desc.dataSize;
+	for (uint32_t j = 0; j < desc.arraySize; ++j)
+	{
+		uint32_t w = desc.width;
+		uint32_t h = desc.height;
+		uint32_t d = desc.depth;
+		for (uint32_t i = 0; i < desc.mipCount; ++i)
+		{
+			DDSSubresource sub;
+			GetSurfaceInfo(w, h, desc.format, &sub.slicePitch, &sub.rowBytes, &sub.numRows);
+			size_t bytes = sub.slicePitch * d;
+			if (bytes > end - offset)
+				return DDS_RESULT_END_OF_FILE;
+			if (desc.mipCount <= 1 || maxsize == 0 || (w <= maxsize && h <= maxsize && d <= maxsize))
+			{
+				if (layout.width == 0)
+				{
+					layout.width = w;
+					layout.height = h;
+					layout.depth = d;
+				}
+				sub.offset = offset;
+				sub.width = w;
+				sub.height = h;
+				sub.depth = d;
+				layout.subresources.push_back(sub);
+			}
+			else if (j == 0)
+			{
+				//Count skipped mips on the first slice only
+				++layout.skipMip;
+			}
+			offset += bytes;
+			w = std::max<uint32_t>(w >> 1, 1);
+			h = std::max<uint32_t>(h >> 1, 1);
+			d = std::max<uint32_t>(d >> 1, 1);
+		}
+	}
+	if (layout.subresources.empty())
+		return DDS_RESULT_INVALID_DATA;
+	layout.mipCount = desc.mipCount - layout.skipMip;
+	return DDS_RESULT_OK;
+}
+
+DDSResult DDSCore::BuildHeader(const DDSTextureDesc& desc, std::vector<uint8_t>& header)
+{
+	if (desc.dimension != DDS_DIMENSION_TEXTURE2D || desc.width == 0 || desc.height == 0 ||
+		desc.mipCount == 0 || desc.arraySize == 0 || BitsPerPixel(desc.format) == 0)
+		return DDS_RESULT_NOT_SUPPORTED;
+	uint32_t arraySize = desc.arraySize;
+	if (desc.isCubeMap)
+	{
+		if (arraySize % 6 != 0) return DDS_RESULT_INVALID_DATA;
+		arraySize /= 6;
+	}
+	size_t numBytes, rowBytes, numRows;
+	GetSurfaceInfo(desc.width, desc.height, desc.format, &numBytes, &rowBytes, &numRows);
+	//Block compressed formats store a 4x4 block in one row and give their top mip size, others their pitch
+	size_t blockBytes, blockRowBytes, blockRows;
+	GetSurfaceInfo(4, 4, desc.format, &blockBytes, &blockRowBytes, &blockRows);
+	bool blockCompressed = blockRows == 1;
+	DDS_HEADER dds = {};
+	dds.size = sizeof(DDS_HEADER);
+	dds.flags = DDS_HEADER_FLAGS_TEXTURE | DDS_HEADER_FLAGS_MIPMAP |
+		(blockCompressed ? DDS_HEADER_FLAGS_LINEARSIZE : DDS_HEADER_FLAGS_PITCH);
+	dds.height = desc.height;
+	dds.width = desc.width;
+	dds.pitchOrLinearSize = (uint32_t)(blockCompressed ? numBytes : rowBytes);
+	dds.depth = 1;
+	dds.mipMapCount = desc.mipCount;
+	dds.ddspf.size = sizeof(DDS_PIXELFORMAT);
+	dds.ddspf.flags = DDS_FOURCC;
+	dds.ddspf.fourCC = MAKEFOURCC('D', 'X', '1', '0');
+	dds.caps = DDS_SURFACE_FLAGS_TEXTURE | (desc.mipCount > 1 ? DDS_SURFACE_FLAGS_MIPMAP : 0);
+	if (desc.isCubeMap) dds.caps2 = DDS_CUBEMAP_ALLFACES;
+	DDS_HEADER_DXT10 ext = {};
+	ext.dxgiFormat = desc.format;
+	ext.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+	ext.miscFlag = desc.isCubeMap ? DDS_RESOURCE_MISC_TEXTURECUBE : 0;
+	ext.arraySize = arraySize;
+	ext.miscFlags2 = desc.alphaMode & DDS_MISC_FLAGS2_ALPHA_MODE_MASK;
+	header.resize(sizeof(uint32_t) + sizeof(DDS_HEADER) + sizeof(DDS_HEADER_DXT10));
+	memcpy(header.data(), &DDS_MAGIC, sizeof(uint32_t));
+	memcpy(header.data() + sizeof(uint32_t), &dds, sizeof(DDS_HEADER));
+	memcpy(header.data() + sizeof(uint32_t) + sizeof(DDS_HEADER), &ext, sizeof(DDS_HEADER_DXT10));
+	return DDS_RESULT_OK;
+}
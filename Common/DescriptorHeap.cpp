@@ -1,5 +1,7 @@
 #pragma once
 #include "DescriptorHeap.h"
+#include "../Singleton/DeferredReleaseQueue.h"
+#include "../Singleton/ResidencyManager.h"
 HRESULT DescriptorHeap::Create(
 	ID3D12Device* pDevice,
 	D3D12_DESCRIPTOR_HEAP_TYPE Type,
@@ -16,13 +18,23 @@ HRESULT DescriptorHeap::Create(
 	if (FAILED(hr)) return hr;
 
 	hCPUHeapStart = pDH->GetCPUDescriptorHandleForHeapStart();
-	hGPUHeapStart = pDH->GetGPUDescriptorHandleForHeapStart();
+	//CPU only heaps have no GPU address
+	if (bShaderVisible)
+		hGPUHeapStart = pDH->GetGPUDescriptorHandleForHeapStart();
+	else
+		hGPUHeapStart.ptr = 0;
 
 	HandleIncrementSize = pDevice->GetDescriptorHandleIncrementSize(Desc.Type);
+	mResidency = ResidencyManager::Register(pDH.Get());
 	return hr;
 }
 
 void DescriptorHeap::Dispose()
 {
+	ResourceRegistry<DescriptorHeap>::Unregister(mHandle);
+	mHandle = DescriptorHeapHandle();
+	ResidencyManager::Unregister(mResidency);
+	mResidency = ResidencyHandle();
+	DeferredReleaseQueue::Release(pDH);
 	pDH = nullptr;
 }
\ No newline at end of file
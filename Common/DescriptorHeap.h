@@ -1,12 +1,16 @@
 #pragma once
 #include "d3dUtil.h"
 #include "../RenderComponent/MObject.h"
+#include "../RenderComponent/ResourceHandle.h"
 class DescriptorHeap : MObject
 {
 protected:
 	virtual void Dispose();
 public:
-	DescriptorHeap() : MObject(), pDH(nullptr) {}
+	DescriptorHeap() : MObject(), pDH(nullptr) { mHandle = ResourceRegistry<DescriptorHeap>::Register(this); }
+	~DescriptorHeap() { Release(); }
+	DescriptorHeapHandle GetHandle() const { return mHandle; }
+	ResidencyHandle GetResidency() const { return mResidency; }
 
 	HRESULT Create(
 		ID3D12Device* pDevice,
@@ -34,4 +38,6 @@ private:
 	D3D12_CPU_DESCRIPTOR_HANDLE hCPUHeapStart;
 	D3D12_GPU_DESCRIPTOR_HANDLE hGPUHeapStart;
 	UINT HandleIncrementSize;
+	DescriptorHeapHandle mHandle;
+	ResidencyHandle mResidency;
 };
\ No newline at end of file
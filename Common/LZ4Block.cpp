@@ -0,0 +1,168 @@
+#include "LZ4Block.h"
+#include <cstring>
+#include <memory>
+
+namespace
+{
+	const size_t MIN_MATCH = 4;
+	//The format requires the last 5 bytes to be literals and the last match to start 12 bytes before the end
+	const size_t LAST_LITERALS = 5;
+	const size_t MF_LIMIT = 12;
+	const size_t MAX_OFFSET = 65535;
+	const unsigned int HASH_BITS = 16;
+
+	inline uint32_t Read32(const uint8_t* p)
+	{
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline uint32_t HashSequence(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	//Lengths of 15 and up continue in bytes of 255 until a smaller byte
+	inline bool WriteLength(size_t length, uint8_t*& op, const uint8_t* opEnd)
+	{
+		while (length >= 255)
+		{
+			if (op >= opEnd) return false;
+			*op++ = 255;
+			length -= 255;
+		}
+		if (op >= opEnd) return false;
+		*op++ = (uint8_t)length;
+		return true;
+	}
+
+	inline bool ReadLength(size_t& length, const uint8_t*& ip, const uint8_t* ipEnd)
+	{
+		uint8_t b;
+		do
+		{
+			if (ip >= ipEnd) return false;
+			b = *ip++;
+			length += b;
+		} while (b == 255);
+		return true;
+	}
+
+	bool WriteSequence(
+		const uint8_t* literals,
+		size_t literalLength,
+		size_t offset,
+		size_t matchLength,
+		bool last,
+		uint8_t*& op,
+		const uint8_t* opEnd)
+	{
+		if (op >= opEnd) return false;
+		uint8_t* token = op++;
+		*token = (uint8_t)((literalLength < 15 ? literalLength : 15) << 4);
+		if (literalLength >= 15 && !WriteLength(literalLength - 15, op, opEnd)) return false;
+		if ((size_t)(opEnd - op) < literalLength) return false;
+		memcpy(op, literals, literalLength);
+		op += literalLength;
+		if (last) return true;
+		if (opEnd - op < 2) return false;
+		*op++ = (uint8_t)(offset & 0xff);
+		*op++ = (uint8_t)(offset >> 8);
+		size_t matchCode = matchLength - MIN_MATCH;
+		*token |= (uint8_t)(matchCode < 15 ? matchCode : 15);
+		if (matchCode >= 15 && !WriteLength(matchCode - 15, op, opEnd)) return false;
+		return true;
+	}
+}
+
+size_t LZ4Block::CompressBound(size_t srcSize)
+{
+	return srcSize + srcSize / 255 + 16;
+}
+
+size_t LZ4Block::Compress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstCapacity)
+{
+	uint8_t* op = dst;
+	const uint8_t* opEnd = dst + dstCapacity;
+	size_t anchor = 0;
+	if (srcSize > MF_LIMIT)
+	{
+		//Positions are stored plus one so 0 means empty
+		std::unique_ptr<uint32_t[]> table(new uint32_t[(size_t)1 << HASH_BITS]());
+		size_t matchLimit = srcSize - LAST_LITERALS;
+		size_t ip = 0;
+		while (ip + MF_LIMIT <= srcSize)
+		{
+			uint32_t sequence = Read32(src + ip);
+			uint32_t h = HashSequence(sequence);
+			size_t candidate = table[h];
+			table[h] = (uint32_t)(ip + 1);
+			if (candidate == 0 || ip - (candidate - 1) > MAX_OFFSET || Read32(src + candidate - 1) != sequence)
+			{
+				++ip;
+				continue;
+			}
+			size_t ref = candidate - 1;
+			size_t matchLength = MIN_MATCH;
+			while (ip + matchLength < matchLimit && src[ref + matchLength] == src[ip + matchLength])
+				++matchLength;
+			//Grow the match backwards over literals that also match
+			while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1])
+			{
+				--ip;
+				--ref;
+				++matchLength;
+			}
+			if (!WriteSequence(src + anchor, ip - anchor, ip - ref, matchLength, false, op, opEnd)) return 0;
+			ip += matchLength;
+			anchor = ip;
+			//Keep the table filled inside long matches so the next search finds close matches
+			if (ip >= 2 && ip - 2 + 4 <= srcSize)
+				table[HashSequence(Read32(src + ip - 2))] = (uint32_t)(ip - 2 + 1);
+		}
+	}
+	if (!WriteSequence(src + anchor, srcSize - anchor, 0, 0, true, op, opEnd)) return 0;
+	return (size_t)(op - dst);
+}
+
+bool LZ4Block::Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize)
+{
+	const uint8_t* ip = src;
+	const uint8_t* ipEnd = src + srcSize;
+	uint8_t* op = dst;
+	uint8_t* opEnd = dst + dstSize;
+	while (ip < ipEnd)
+	{
+		uint8_t token = *ip++;
+		size_t literalLength = token >> 4;
+		if (literalLength == 15 && !ReadLength(literalLength, ip, ipEnd)) return false;
+		if ((size_t)(ipEnd - ip) < literalLength || (size_t)(opEnd - op) < literalLength) return false;
+		memcpy(op, ip, literalLength);
+		ip += literalLength;
+		op += literalLength;
+		//The last sequence has literals only
+		if (ip == ipEnd) break;
+		if (ipEnd - ip < 2) return false;
+		size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - dst)) return false;
+		size_t matchLength = token & 15;
+		if (matchLength == 15 && !ReadLength(matchLength, ip, ipEnd)) return false;
+		matchLength += MIN_MATCH;
+		if ((size_t)(opEnd - op) < matchLength) return false;
+		const uint8_t* match = op - offset;
+		if (offset >= matchLength)
+		{
+			memcpy(op, match, matchLength);
+			op += matchLength;
+		}
+		else
+		{
+			//Overlapping copy repeats the last offset bytes
+			for (size_t i = 0; i < matchLength; ++i)
+				*op++ = match[i];
+		}
+	}
+	return op == opEnd;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+//Raw LZ4 block format, no frame header or checksum
+//Compressed blocks can be read by any LZ4 block decoder and the other way round
+class LZ4Block
+{
+public:
+	//Largest output Compress can produce for srcSize bytes
+	static size_t CompressBound(size_t srcSize);
+	//Returns the compressed size, 0 if dst is too small
+	static size_t Compress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstCapacity);
+	//dstSize must be the exact decompressed size, fails on corrupt input without reading or writing out of bounds
+	static bool Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
+};
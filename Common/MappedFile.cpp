@@ -0,0 +1,175 @@
+#include "MappedFile.h"
+#include <string>
+#include <cstdlib>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile() : mData(nullptr), mSize(0), mFile(INVALID_HANDLE_VALUE), mMapping(nullptr)
+{
+}
+
+bool MappedFile::Open(const char* path)
+{
+	int length = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+	if (length <= 0) return false;
+	std::wstring widePath(length, 0);
+	MultiByteToWideChar(CP_UTF8, 0, path, -1, &widePath[0], length);
+	return Open(widePath.c_str());
+}
+
+bool MappedFile::Open(const wchar_t* path)
+{
+	Close();
+	mFile = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (mFile == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(mFile, &fileSize))
+	{
+		Close();
+		return false;
+	}
+	mSize = (uint64_t)fileSize.QuadPart;
+	return Map();
+}
+
+bool MappedFile::Map()
+{
+	if (mSize == 0) return true;
+	//A view must fit the address space, 32-bit builds can not map files over 4GB whole
+	if (mSize > (uint64_t)SIZE_MAX)
+	{
+		Close();
+		return false;
+	}
+	mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMapping == nullptr)
+	{
+		Close();
+		return false;
+	}
+	mData = (const uint8_t*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+	if (mData == nullptr)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData != nullptr)
+		UnmapViewOfFile(mData);
+	if (mMapping != nullptr)
+		CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+	mData = nullptr;
+	mMapping = nullptr;
+	mFile = INVALID_HANDLE_VALUE;
+	mSize = 0;
+}
+
+bool MappedFile::IsOpen() const
+{
+	return mFile != INVALID_HANDLE_VALUE;
+}
+
+void MappedFile::Prefetch(uint64_t offset, uint64_t length) const
+{
+	if (mData == nullptr || offset >= mSize) return;
+	if (length > mSize - offset) length = mSize - offset;
+#if (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = (PVOID)(mData + offset);
+	range.NumberOfBytes = (SIZE_T)length;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+}
+#else
+MappedFile::MappedFile() : mData(nullptr), mSize(0), mFile(-1)
+{
+}
+
+bool MappedFile::Open(const char* path)
+{
+	Close();
+	mFile = open(path, O_RDONLY);
+	if (mFile < 0) return false;
+	struct stat info;
+	if (fstat(mFile, &info) != 0)
+	{
+		Close();
+		return false;
+	}
+	mSize = (uint64_t)info.st_size;
+	return Map();
+}
+
+bool MappedFile::Open(const wchar_t* path)
+{
+	size_t length = wcstombs(nullptr, path, 0);
+	if (length == (size_t)-1) return false;
+	std::string narrowPath(length, 0);
+	wcstombs(&narrowPath[0], path, length + 1);
+	return Open(narrowPath.c_str());
+}
+
+bool MappedFile::Map()
+{
+	if (mSize == 0) return true;
+	if (mSize > (uint64_t)SIZE_MAX)
+	{
+		Close();
+		return false;
+	}
+	void* view = mmap(nullptr, (size_t)mSize, PROT_READ, MAP_PRIVATE, mFile, 0);
+	if (view == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	//Texture loads walk the file front to back once
+	madvise(view, (size_t)mSize, MADV_SEQUENTIAL);
+	mData = (const uint8_t*)view;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData != nullptr)
+		munmap((void*)mData, (size_t)mSize);
+	if (mFile >= 0)
+		close(mFile);
+	mData = nullptr;
+	mFile = -1;
+	mSize = 0;
+}
+
+bool MappedFile::IsOpen() const
+{
+	return mFile >= 0;
+}
+
+void MappedFile::Prefetch(uint64_t offset, uint64_t length) const
+{
+	if (mData == nullptr || offset >= mSize) return;
+	if (length > mSize - offset) length = mSize - offset;
+	//madvise wants a page aligned start
+	uint64_t pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+	uint64_t alignedOffset = offset - offset % pageSize;
+	madvise((void*)(mData + alignedOffset), (size_t)(length + offset - alignedOffset), MADV_WILLNEED);
+}
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+//Read-only view of a whole file through the OS page cache
+//Reads come straight from the mapping, nothing is copied into a heap buffer
+class MappedFile
+{
+private:
+	const uint8_t* mData;
+	uint64_t mSize;
+#ifdef _WIN32
+	void* mFile;
+	void* mMapping;
+#else
+	int mFile;
+#endif
+	bool Map();
+public:
+	MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+	//Returns false and leaves the file closed on failure, empty files open with no data
+	bool Open(const char* path);
+	bool Open(const wchar_t* path);
+	void Close();
+	bool IsOpen() const;
+	const uint8_t* GetData() const { return mData; }
+	uint64_t GetSize() const { return mSize; }
+	//Asks the OS to start reading a range in ahead of use
+	void Prefetch(uint64_t offset, uint64_t length) const;
+};
@@ -0,0 +1,306 @@
+#include "MipGenerator.h"
+#include "TextureImporter.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#if defined(_M_X64) || defined(_M_IX86_FP) || defined(__SSE2__)
+#define MIP_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const float PI = 3.14159265358979f;
+	const float FILTER_SUPPORT = 3.0f;
+	const float KAISER_ALPHA = 4.0f;
+
+	//Source pixels and weights for every destination pixel along one axis
+	struct FilterTaps
+	{
+		//Taps of destination i are [start[i], start[i + 1])
+		std::vector<uint32_t> start;
+		std::vector<uint32_t> index;
+		std::vector<float> weight;
+	};
+
+	float Sinc(float x)
+	{
+		if (std::fabs(x) < 1e-5f) return 1.0f;
+		x *= PI;
+		return std::sin(x) / x;
+	}
+
+	float BesselI0(float x)
+	{
+		//Power series, converges quickly for the small arguments used here
+		float sum = 1.0f;
+		float term = 1.0f;
+		float halfX = x * 0.5f;
+		for (int k = 1; k < 32; ++k)
+		{
+			term *= (halfX / k) * (halfX / k);
+			sum += term;
+			if (term < sum * 1e-7f) break;
+		}
+		return sum;
+	}
+
+	//t in destination pixels from the destination pixel center
+	float EvaluateFilter(MipFilter filter, float t)
+	{
+		float x = std::fabs(t);
+		if (x >= FILTER_SUPPORT) return 0.0f;
+		if (filter == MIP_FILTER_LANCZOS)
+			return Sinc(x) * Sinc(x / FILTER_SUPPORT);
+		float ratio = x / FILTER_SUPPORT;
+		return Sinc(x) * BesselI0(KAISER_ALPHA * std::sqrt(1.0f - ratio * ratio)) / BesselI0(KAISER_ALPHA);
+	}
+
+	uint32_t AddressPixel(int64_t i, uint32_t size, bool wrap)
+	{
+		if (wrap)
+		{
+			int64_t m = i % (int64_t)size;
+			return (uint32_t)(m < 0 ? m + size : m);
+		}
+		return (uint32_t)std::min<int64_t>(std::max<int64_t>(i, 0), (int64_t)size - 1);
+	}
+
+	void BuildTaps(uint32_t srcSize, uint32_t dstSize, const MipSettings& settings, FilterTaps& taps)
+	{
+		float scale = (float)srcSize / (float)dstSize;
+		taps.start.resize(dstSize + 1);
+		taps.index.clear();
+		taps.weight.clear();
+		for (uint32_t i = 0; i < dstSize; ++i)
+		{
+			taps.start[i] = (uint32_t)taps.index.size();
+			float center = (i + 0.5f) * scale;
+			float radius = settings.filter == MIP_FILTER_BOX ? scale * 0.5f : FILTER_SUPPORT * scale;
+			int64_t first = (int64_t)std::floor(center - radius);
+			int64_t last = (int64_t)std::ceil(center + radius);
+			float sum = 0.0f;
+			for (int64_t j = first; j < last; ++j)
+			{
+				float w;
+				if (settings.filter == MIP_FILTER_BOX)
+				{
+					//Overlap of source pixel j with the destination pixel's footprint
+					w = std::min(center + radius, (float)(j + 1)) - std::max(center - radius, (float)j);
+				}
+				else
+				{
+					w = EvaluateFilter(settings.filter, ((float)j + 0.5f - center) / scale);
+				}
+				if (std::fabs(w) < 1e-6f) continue;
+				taps.index.push_back(AddressPixel(j, srcSize, settings.wrap));
+				taps.weight.push_back(w);
+				sum += w;
+			}
+			for (uint32_t k = taps.start[i]; k < taps.index.size(); ++k)
+				taps.weight[k] /= sum;
+		}
+		taps.start[dstSize] = (uint32_t)taps.index.size();
+	}
+
+	//dest pixel += weight * src pixel, pixels are 4 floats
+	inline void AccumulatePixels(float* dest, const float* src, float weight, uint32_t count)
+	{
+#ifdef MIP_USE_SSE2
+		__m128 w = _mm_set1_ps(weight);
+		for (uint32_t i = 0; i < count; ++i)
+			_mm_storeu_ps(dest + i * 4, _mm_add_ps(_mm_loadu_ps(dest + i * 4), _mm_mul_ps(w, _mm_loadu_ps(src + i * 4))));
+#else
+		for (uint32_t i = 0; i < count * 4; ++i)
+			dest[i] += weight * src[i];
+#endif
+	}
+
+	void FilterRowHorizontal(const float* src, float* dest, uint32_t dstWidth, const FilterTaps& taps)
+	{
+		for (uint32_t x = 0; x < dstWidth; ++x)
+		{
+#ifdef MIP_USE_SSE2
+			__m128 sum = _mm_setzero_ps();
+			for (uint32_t k = taps.start[x]; k < taps.start[x + 1]; ++k)
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(taps.weight[k]), _mm_loadu_ps(src + taps.index[k] * 4)));
+			_mm_storeu_ps(dest + x * 4, sum);
+#else
+			float sum[4] = {};
+			for (uint32_t k = taps.start[x]; k < taps.start[x + 1]; ++k)
+			{
+				for (int c = 0; c < 4; ++c)
+					sum[c] += taps.weight[k] * src[taps.index[k] * 4 + c];
+			}
+			memcpy(dest + x * 4, sum, sizeof(sum));
+#endif
+		}
+	}
+
+	struct SRGBTables
+	{
+		float toLinear[256];
+		//Linear value at each halfway point between two codes, so encoding rounds in sRGB space
+		float thresholds[255];
+		SRGBTables()
+		{
+			for (int i = 0; i < 256; ++i)
+				toLinear[i] = Decode(i / 255.0f);
+			for (int i = 0; i < 255; ++i)
+				thresholds[i] = Decode((i + 0.5f) / 255.0f);
+		}
+		static float Decode(float v)
+		{
+			return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+		}
+		uint8_t Encode(float linear) const
+		{
+			return (uint8_t)(std::upper_bound(thresholds, thresholds + 255, linear) - thresholds);
+		}
+	};
+
+	const SRGBTables& GetSRGBTables()
+	{
+		static SRGBTables tables;
+		return tables;
+	}
+
+	inline uint8_t EncodeUNorm(float v)
+	{
+		v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+		return (uint8_t)(v * 255.0f + 0.5f);
+	}
+
+	template<typename Func>
+	void ForRows(ThreadPool* pool, uint32_t rows, uint32_t rowPixels, Func&& func)
+	{
+		if (pool == nullptr)
+		{
+			for (uint32_t y = 0; y < rows; ++y)
+				func(y);
+		}
+		else
+		{
+			//Short rows are batched so a job is not cheaper than handing it out
+			pool->ParallelFor(rows, func, std::max<uint32_t>(1, 4096 / std::max<uint32_t>(rowPixels, 1)));
+		}
+	}
+
+	//Share of pixels whose alpha, scaled, passes the cutoff
+	float ComputeCoverage(const std::vector<float>& pixels, float cutoff, float scale)
+	{
+		size_t count = pixels.size() / 4;
+		size_t passed = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (pixels[i * 4 + 3] * scale > cutoff) ++passed;
+		}
+		return count == 0 ? 0.0f : (float)passed / (float)count;
+	}
+}
+
+uint32_t MipGenerator::GetMipCount(uint32_t width, uint32_t height)
+{
+	uint32_t count = 1;
+	uint32_t size = std::max(width, height);
+	while (size > 1)
+	{
+		size >>= 1;
+		++count;
+	}
+	return count;
+}
+
+void MipGenerator::Generate(std::vector<ImportedImage>& mips, const MipSettings& settings, bool srgb, ThreadPool* pool)
+{
+	if (mips.empty() || mips[0].width == 0 || mips[0].height == 0) return;
+	uint32_t levelCount = GetMipCount(mips[0].width, mips[0].height);
+	if (settings.maxLevels != 0) levelCount = std::min(levelCount, settings.maxLevels);
+	mips.resize(levelCount);
+	const SRGBTables& tables = GetSRGBTables();
+	bool premultiply = settings.weightColorByAlpha;
+	bool preserveCoverage = settings.alphaCoverageCutoff >= 0.0f;
+	//Linear, optionally premultiplied copy of the current level
+	uint32_t width = mips[0].width;
+	uint32_t height = mips[0].height;
+	std::vector<float> current((size_t)width * height * 4);
+	ForRows(pool, height, width, [&](unsigned int y) -> void
+	{
+		const uint8_t* src = mips[0].rgba.data() + (size_t)y * width * 4;
+		float* dest = current.data() + (size_t)y * width * 4;
+		for (uint32_t x = 0; x < width; ++x, src += 4, dest += 4)
+		{
+			float alpha = src[3] / 255.0f;
+			float colorScale = premultiply ? alpha : 1.0f;
+			for (int c = 0; c < 3; ++c)
+				dest[c] = (srgb ? tables.toLinear[src[c]] : src[c] / 255.0f) * colorScale;
+			dest[3] = alpha;
+		}
+	});
+	float targetCoverage = preserveCoverage ? ComputeCoverage(current, settings.alphaCoverageCutoff, 1.0f) : 0.0f;
+	//Nothing or everything passing stays that way without help
+	preserveCoverage = preserveCoverage && targetCoverage > 0.0f && targetCoverage < 1.0f;
+	FilterTaps tapsX;
+	FilterTaps tapsY;
+	std::vector<float> horizontal;
+	std::vector<float> next;
+	for (uint32_t level = 1; level < levelCount; ++level)
+	{
+		uint32_t dstWidth = std::max<uint32_t>(width >> 1, 1);
+		uint32_t dstHeight = std::max<uint32_t>(height >> 1, 1);
+		BuildTaps(width, dstWidth, settings, tapsX);
+		BuildTaps(height, dstHeight, settings, tapsY);
+		horizontal.resize((size_t)dstWidth * height * 4);
+		ForRows(pool, height, dstWidth, [&](unsigned int y) -> void
+		{
+			FilterRowHorizontal(current.data() + (size_t)y * width * 4, horizontal.data() + (size_t)y * dstWidth * 4, dstWidth, tapsX);
+		});
+		next.assign((size_t)dstWidth * dstHeight * 4, 0.0f);
+		ForRows(pool, dstHeight, dstWidth, [&](unsigned int y) -> void
+		{
+			float* dest = next.data() + (size_t)y * dstWidth * 4;
+			for (uint32_t k = tapsY.start[y]; k < tapsY.start[y + 1]; ++k)
+				AccumulatePixels(dest, horizontal.data() + (size_t)tapsY.index[k] * dstWidth * 4, tapsY.weight[k], dstWidth);
+		});
+		//Scale alpha so as many texels pass the alpha test as on the top level
+		//Only the stored level is scaled, the next one is filtered from the unscaled values
+		float alphaScale = 1.0f;
+		if (preserveCoverage)
+		{
+			float low = 0.0f;
+			float high = 4.0f;
+			for (int step = 0; step < 16; ++step)
+			{
+				float mid = (low + high) * 0.5f;
+				if (ComputeCoverage(next, settings.alphaCoverageCutoff, mid) < targetCoverage) low = mid;
+				else high = mid;
+			}
+			alphaScale = high;
+		}
+		ImportedImage& mip = mips[level];
+		mip.width = dstWidth;
+		mip.height = dstHeight;
+		mip.rgba.resize((size_t)dstWidth * dstHeight * 4);
+		ForRows(pool, dstHeight, dstWidth, [&](unsigned int y) -> void
+		{
+			const float* src = next.data() + (size_t)y * dstWidth * 4;
+			uint8_t* dest = mip.rgba.data() + (size_t)y * dstWidth * 4;
+			for (uint32_t x = 0; x < dstWidth; ++x, src += 4, dest += 4)
+			{
+				float alpha = std::min(std::max(src[3], 0.0f), 1.0f);
+				//Fully transparent texels keep black, their color never shows
+				float colorScale = premultiply ? (alpha > 1e-6f ? 1.0f / alpha : 0.0f) : 1.0f;
+				for (int c = 0; c < 3; ++c)
+				{
+					float v = std::min(std::max(src[c] * colorScale, 0.0f), 1.0f);
+					dest[c] = srgb ? tables.Encode(v) : EncodeUNorm(v);
+				}
+				dest[3] = EncodeUNorm(alpha * alphaScale);
+			}
+		});
+		current.swap(next);
+		width = dstWidth;
+		height = dstHeight;
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+class ThreadPool;
+struct ImportedImage;
+
+enum MipFilter
+{
+	//Area average, exact for odd sizes as well
+	MIP_FILTER_BOX = 0,
+	//Kaiser windowed sinc, 3 destination pixels each side, sharp with little ringing
+	MIP_FILTER_KAISER = 1,
+	//Lanczos with 3 lobes, sharpest, rings more on hard edges
+	MIP_FILTER_LANCZOS = 2
+};
+
+struct MipSettings
+{
+	MipFilter filter = MIP_FILTER_KAISER;
+	//Alpha test reference in 0-1, each mip rescales alpha so the share of pixels passing matches the top level
+	//Negative leaves alpha as filtered
+	float alphaCoverageCutoff = -1.0f;
+	//Filter across the edges for tiling textures, clamp otherwise
+	bool wrap = false;
+	//Colors are weighted by alpha so transparent texels do not bleed into visible ones
+	bool weightColorByAlpha = true;
+	//0 builds the full chain down to 1x1
+	uint32_t maxLevels = 0;
+};
+
+//Builds mip chains for imported images on the CPU, does not depend on Windows or D3D
+//Every level is filtered from the previous one in linear float RGBA, one SSE2 vector per pixel
+//Sizes that do not halve evenly use a resampling filter, so odd sizes keep their footprint
+class MipGenerator
+{
+public:
+	static uint32_t GetMipCount(uint32_t width, uint32_t height);
+	//mips[0] holds the top level, the chain replaces everything after it
+	//srgb color channels are filtered in linear space, alpha always is linear
+	//Rows of each level are spread over pool, nullptr works on the calling thread
+	static void Generate(std::vector<ImportedImage>& mips, const MipSettings& settings, bool srgb, ThreadPool* pool);
+};
@@ -0,0 +1,175 @@
+#include "ResidencyTracker.h"
+#include <algorithm>
+
+ResidencyTracker::ResidencyTracker(IResidencyDevice* device) :
+	mDevice(device),
+	mFrame(0),
+	mCompletedFrame(0),
+	mStats()
+{
+	mBatch.reserve(MAX_BATCH);
+}
+
+ResidencyHandle ResidencyTracker::Register(ResidencyObject object, uint64_t size, bool evictable)
+{
+	Entry entry;
+	entry.object = object;
+	entry.size = size;
+	//Counts as used so nothing evicts it before the GPU ran the frame that filled it
+	entry.lastUsedFrame = mFrame;
+	entry.workingSetFrame = 0;
+	entry.resident = true;
+	entry.evictable = evictable;
+	mStats.trackedBytes += size;
+	mStats.residentBytes += size;
+	return mEntries.Insert(entry);
+}
+
+void ResidencyTracker::Replace(ResidencyHandle handle, ResidencyObject object, uint64_t size)
+{
+	Entry* entry = mEntries.Get(handle);
+	if (entry == nullptr) return;
+	mStats.trackedBytes = mStats.trackedBytes - entry->size + size;
+	if (entry->resident)
+		mStats.residentBytes -= entry->size;
+	mStats.residentBytes += size;
+	entry->object = object;
+	entry->size = size;
+	entry->lastUsedFrame = mFrame;
+	entry->resident = true;
+}
+
+void ResidencyTracker::Unregister(ResidencyHandle handle)
+{
+	Entry* entry = mEntries.Get(handle);
+	if (entry == nullptr) return;
+	mStats.trackedBytes -= entry->size;
+	if (entry->resident)
+		mStats.residentBytes -= entry->size;
+	mEntries.Remove(handle);
+}
+
+void ResidencyTracker::MarkUsed(ResidencyHandle handle)
+{
+	Entry* entry = mEntries.Get(handle);
+	if (entry == nullptr) return;
+	entry->lastUsedFrame = mFrame;
+	if (entry->workingSetFrame == mFrame) return;
+	entry->workingSetFrame = mFrame;
+	mWorkingSet.push_back(handle);
+}
+
+void ResidencyTracker::BeginFrame(uint64_t frame, uint64_t completedFrame)
+{
+	mFrame = frame;
+	mCompletedFrame = completedFrame;
+	mWorkingSet.clear();
+}
+
+uint64_t ResidencyTracker::EvictIdle(uint64_t bytes)
+{
+	mCandidates.clear();
+	for (Entry& entry : mEntries)
+	{
+		if (entry.resident && entry.evictable &&
+			entry.lastUsedFrame <= mCompletedFrame &&
+			entry.workingSetFrame != mFrame)
+			mCandidates.push_back(&entry);
+	}
+	//Oldest first, larger objects first within a frame so fewer are evicted
+	std::sort(mCandidates.begin(), mCandidates.end(), [](const Entry* a, const Entry* b)
+	{
+		if (a->lastUsedFrame != b->lastUsedFrame) return a->lastUsedFrame < b->lastUsedFrame;
+		return a->size > b->size;
+	});
+	uint64_t freed = 0;
+	mBatch.clear();
+	for (size_t i = 0; i < mCandidates.size() && freed < bytes; ++i)
+	{
+		Entry* entry = mCandidates[i];
+		mBatch.push_back(entry->object);
+		entry->resident = false;
+		freed += entry->size;
+		mStats.residentBytes -= entry->size;
+		++mStats.evictedCount;
+		if (mBatch.size() == MAX_BATCH)
+		{
+			mDevice->Evict(mBatch.data(), (uint32_t)mBatch.size());
+			mBatch.clear();
+		}
+	}
+	if (!mBatch.empty())
+		mDevice->Evict(mBatch.data(), (uint32_t)mBatch.size());
+	mStats.totalEvictedBytes += freed;
+	return freed;
+}
+
+bool ResidencyTracker::MakeResident(Entry* const* entries, size_t count)
+{
+	size_t start = 0;
+	while (start < count)
+	{
+		size_t end = start;
+		mBatch.clear();
+		for (; end < count && mBatch.size() < MAX_BATCH; ++end)
+		{
+			if (!entries[end]->resident)
+				mBatch.push_back(entries[end]->object);
+		}
+		if (!mBatch.empty() && !mDevice->MakeResident(mBatch.data(), (uint32_t)mBatch.size()))
+			return false;
+		for (size_t i = start; i < end; ++i)
+		{
+			Entry* entry = entries[i];
+			if (entry->resident) continue;
+			entry->resident = true;
+			mStats.residentBytes += entry->size;
+			mStats.totalMadeResidentBytes += entry->size;
+			++mStats.madeResidentCount;
+		}
+		start = end;
+	}
+	return true;
+}
+
+bool ResidencyTracker::EndFrame()
+{
+	mStats.workingSetBytes = 0;
+	mStats.workingSetCount = 0;
+	mStats.evictedCount = 0;
+	mStats.madeResidentCount = 0;
+	uint64_t needed = 0;
+	mPending.clear();
+	for (size_t i = 0; i < mWorkingSet.size(); ++i)
+	{
+		Entry* entry = mEntries.Get(mWorkingSet[i]);
+		if (entry == nullptr) continue;
+		mStats.workingSetBytes += entry->size;
+		++mStats.workingSetCount;
+		if (!entry->resident)
+		{
+			needed += entry->size;
+			mPending.push_back(entry);
+		}
+	}
+	mDevice->QueryBudget(mStats.budget, mStats.usage);
+	if (mStats.usage + needed > mStats.budget)
+		EvictIdle(mStats.usage + needed - mStats.budget);
+	if (MakeResident(mPending.data(), mPending.size()))
+		return true;
+	//The budget was off, free everything the GPU does not need and try once more
+	EvictIdle(UINT64_MAX);
+	return MakeResident(mPending.data(), mPending.size());
+}
+
+bool ResidencyTracker::IsResident(ResidencyHandle handle) const
+{
+	const Entry* entry = mEntries.Get(handle);
+	return entry != nullptr && entry->resident;
+}
+
+uint64_t ResidencyTracker::GetLastUsedFrame(ResidencyHandle handle) const
+{
+	const Entry* entry = mEntries.Get(handle);
+	return entry == nullptr ? 0 : entry->lastUsedFrame;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "SlotMap.h"
+//Residency policy for GPU memory, does not depend on Windows or D3D
+//Every tracked object has a size and the last frame that used it, resources bound or drawn in
+//a frame form its working set. EndFrame makes the working set resident and, while the budget is
+//exceeded, evicts objects the GPU is done with, least recently used first
+//Objects start resident, MakeResident and Evict calls always alternate for each object
+//so the device's residency reference counts stay balanced
+//Frames are fence values: an object last used in a frame at or before the completed frame is idle
+
+//Opaque to the tracker, an ID3D12Pageable* for the D3D12 device
+typedef void* ResidencyObject;
+struct ResidencyEntryTag;
+typedef Handle<ResidencyEntryTag> ResidencyHandle;
+
+//What the tracker drives, implemented by ResidencyManager over a D3D12 device
+class IResidencyDevice
+{
+public:
+	//Bytes the process may use and is using in the memory residency is managed for
+	virtual void QueryBudget(uint64_t& budget, uint64_t& usage) = 0;
+	//False if the objects could not be made resident, e.g. out of memory
+	virtual bool MakeResident(const ResidencyObject* objects, uint32_t count) = 0;
+	virtual void Evict(const ResidencyObject* objects, uint32_t count) = 0;
+	virtual ~IResidencyDevice() {}
+};
+
+struct ResidencyStats
+{
+	uint64_t budget;
+	uint64_t usage;
+	uint64_t trackedBytes;
+	uint64_t residentBytes;
+	//Filled in by EndFrame for the frame it finished
+	uint64_t workingSetBytes;
+	uint32_t workingSetCount;
+	uint32_t evictedCount;
+	uint32_t madeResidentCount;
+	//Counted over the tracker's lifetime
+	uint64_t totalEvictedBytes;
+	uint64_t totalMadeResidentBytes;
+};
+
+class ResidencyTracker
+{
+private:
+	struct Entry
+	{
+		ResidencyObject object;
+		uint64_t size;
+		uint64_t lastUsedFrame;
+		//Frame the entry was last added to the working set
+		uint64_t workingSetFrame;
+		bool resident;
+		//Objects the CPU writes to directly stay resident
+		bool evictable;
+	};
+	IResidencyDevice* mDevice;
+	SlotMap<Entry, ResidencyEntryTag> mEntries;
+	std::vector<ResidencyHandle> mWorkingSet;
+	uint64_t mFrame;
+	uint64_t mCompletedFrame;
+	ResidencyStats mStats;
+	//Kept between frames so EndFrame does not allocate
+	std::vector<ResidencyObject> mBatch;
+	std::vector<Entry*> mPending;
+	std::vector<Entry*> mCandidates;
+	//Evicts idle entries, least recently used first, until at least bytes were freed
+	//Returns the bytes evicted
+	uint64_t EvictIdle(uint64_t bytes);
+	//Skips entries that are already resident, stops at the first batch that fails
+	bool MakeResident(Entry* const* entries, size_t count);
+public:
+	//Objects per MakeResident or Evict call
+	static const uint32_t MAX_BATCH = 64;
+	explicit ResidencyTracker(IResidencyDevice* device);
+	ResidencyTracker(const ResidencyTracker&) = delete;
+	ResidencyTracker& operator=(const ResidencyTracker&) = delete;
+	//New objects are resident and count as used in the current frame
+	ResidencyHandle Register(ResidencyObject object, uint64_t size, bool evictable = true);
+	//The object behind handle was recreated, the new one is resident
+	void Replace(ResidencyHandle handle, ResidencyObject object, uint64_t size);
+	//Stops tracking, the object may be released while evicted
+	void Unregister(ResidencyHandle handle);
+	//Adds the object to the current frame's working set, null and stale handles are ignored
+	void MarkUsed(ResidencyHandle handle);
+	//frame is the fence value the frame signals when done, completedFrame the last value the GPU reached
+	void BeginFrame(uint64_t frame, uint64_t completedFrame);
+	//Before the frame's command lists are submitted, false if the working set could not be made
+	//resident even after evicting everything idle
+	bool EndFrame();
+	bool IsResident(ResidencyHandle handle) const;
+	bool Contains(ResidencyHandle handle) const { return mEntries.Contains(handle); }
+	uint64_t GetLastUsedFrame(ResidencyHandle handle) const;
+	const std::vector<ResidencyHandle>& GetWorkingSet() const { return mWorkingSet; }
+	const ResidencyStats& GetStats() const { return mStats; }
+	size_t Count() const { return mEntries.Size(); }
+};
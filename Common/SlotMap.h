@@ -0,0 +1,139 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <stdexcept>
+//32-bit typed handle, low bits index a slot and high bits hold the slot's generation
+//Value 0 is never issued, so a default handle is always invalid
+template<typename T>
+struct Handle
+{
+	static const unsigned int INDEX_BITS = 20;
+	static const unsigned int INDEX_MASK = (1u << INDEX_BITS) - 1;
+	static const unsigned int GENERATION_MASK = (1u << (32 - INDEX_BITS)) - 1;
+	unsigned int value;
+	Handle() : value(0) {}
+	explicit Handle(unsigned int v) : value(v) {}
+	Handle(unsigned int index, unsigned int generation) : value((generation << INDEX_BITS) | index) {}
+	unsigned int Index() const { return value & INDEX_MASK; }
+	unsigned int Generation() const { return value >> INDEX_BITS; }
+	bool IsNull() const { return value == 0; }
+	bool operator==(const Handle& other) const { return value == other.value; }
+	bool operator!=(const Handle& other) const { return value != other.value; }
+};
+
+//Values are kept dense for iteration, handles stay valid until their value is removed
+//Not thread safe
+template<typename T, typename Tag = T>
+class SlotMap
+{
+public:
+	typedef Handle<Tag> HandleType;
+private:
+	static const unsigned int INVALID_INDEX = 0xffffffff;
+	struct Slot
+	{
+		//Index into values while alive, next free slot while free
+		unsigned int denseIndex;
+		unsigned int generation;
+	};
+	std::vector<T> values;
+	std::vector<unsigned int> denseToSlot;
+	std::vector<Slot> slots;
+	unsigned int freeHead = INVALID_INDEX;
+	HandleType AllocateSlot()
+	{
+		unsigned int slotIndex;
+		if (freeHead != INVALID_INDEX)
+		{
+			slotIndex = freeHead;
+			freeHead = slots[slotIndex].denseIndex;
+		}
+		else
+		{
+			//A larger index would spill into the generation bits and alias live handles
+			if (slots.size() > HandleType::INDEX_MASK)
+				throw std::length_error("SlotMap has run out of handle indices");
+			slotIndex = (unsigned int)slots.size();
+			Slot s;
+			s.generation = 1;
+			slots.push_back(s);
+		}
+		slots[slotIndex].denseIndex = (unsigned int)values.size();
+		denseToSlot.push_back(slotIndex);
+		return HandleType(slotIndex, slots[slotIndex].generation);
+	}
+	const Slot* FindSlot(HandleType handle) const
+	{
+		unsigned int index = handle.Index();
+		if (handle.IsNull() || index >= slots.size()) return nullptr;
+		const Slot& s = slots[index];
+		if (s.generation != handle.Generation()) return nullptr;
+		return &s;
+	}
+public:
+	HandleType Insert(const T& value)
+	{
+		HandleType handle = AllocateSlot();
+		values.push_back(value);
+		return handle;
+	}
+	HandleType Insert(T&& value)
+	{
+		HandleType handle = AllocateSlot();
+		values.push_back(std::move(value));
+		return handle;
+	}
+	bool Remove(HandleType handle)
+	{
+		const Slot* found = FindSlot(handle);
+		if (found == nullptr) return false;
+		unsigned int slotIndex = handle.Index();
+		unsigned int denseIndex = found->denseIndex;
+		unsigned int last = (unsigned int)values.size() - 1;
+		//Swap the last value into the hole to keep values dense
+		if (denseIndex != last)
+		{
+			values[denseIndex] = std::move(values[last]);
+			denseToSlot[denseIndex] = denseToSlot[last];
+			slots[denseToSlot[denseIndex]].denseIndex = denseIndex;
+		}
+		values.pop_back();
+		denseToSlot.pop_back();
+		Slot& s = slots[slotIndex];
+		//Skip generation 0 so a recycled slot never produces the null handle
+		s.generation = (s.generation + 1) & HandleType::GENERATION_MASK;
+		if (s.generation == 0) s.generation = 1;
+		s.denseIndex = freeHead;
+		freeHead = slotIndex;
+		return true;
+	}
+	bool Contains(HandleType handle) const { return FindSlot(handle) != nullptr; }
+	T* Get(HandleType handle)
+	{
+		const Slot* found = FindSlot(handle);
+		return found == nullptr ? nullptr : &values[found->denseIndex];
+	}
+	const T* Get(HandleType handle) const
+	{
+		const Slot* found = FindSlot(handle);
+		return found == nullptr ? nullptr : &values[found->denseIndex];
+	}
+	//Handle of the value at a dense position, for use while iterating
+	HandleType GetHandle(size_t denseIndex) const
+	{
+		unsigned int slotIndex = denseToSlot[denseIndex];
+		return HandleType(slotIndex, slots[slotIndex].generation);
+	}
+	size_t Size() const { return values.size(); }
+	T* begin() { return values.data(); }
+	T* end() { return values.data() + values.size(); }
+	const T* begin() const { return values.data(); }
+	const T* end() const { return values.data() + values.size(); }
+	void Reserve(size_t capacity)
+	{
+		values.reserve(capacity);
+		denseToSlot.reserve(capacity);
+		slots.reserve(capacity);
+	}
+};
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <type_traits>
+//Vector keeping the first N elements inside the object, only goes to the heap after that
+//Elements stay contiguous so data() can be handed to APIs taking an array
+template<typename T, size_t N>
+class SmallVector
+{
+private:
+	typename std::aligned_storage<sizeof(T), alignof(T)>::type inlineStorage[N];
+	T* arr;
+	size_t mSize;
+	size_t mCapacity;
+	T* InlineData() { return reinterpret_cast<T*>(inlineStorage); }
+	void Grow(size_t newCapacity)
+	{
+		T* newArr = reinterpret_cast<T*>(::operator new(sizeof(T) * newCapacity));
+		for (size_t i = 0; i < mSize; ++i)
+		{
+			new (newArr + i) T(std::move(arr[i]));
+			arr[i].~T();
+		}
+		if (arr != InlineData())
+			::operator delete(arr);
+		arr = newArr;
+		mCapacity = newCapacity;
+	}
+public:
+	SmallVector() : arr(InlineData()), mSize(0), mCapacity(N) {}
+	SmallVector(const SmallVector& other) : arr(InlineData()), mSize(0), mCapacity(N)
+	{
+		reserve(other.mSize);
+		for (size_t i = 0; i < other.mSize; ++i)
+			new (arr + i) T(other.arr[i]);
+		mSize = other.mSize;
+	}
+	SmallVector& operator=(const SmallVector& other)
+	{
+		if (this == &other) return *this;
+		clear();
+		reserve(other.mSize);
+		for (size_t i = 0; i < other.mSize; ++i)
+			new (arr + i) T(other.arr[i]);
+		mSize = other.mSize;
+		return *this;
+	}
+	~SmallVector()
+	{
+		clear();
+		if (arr != InlineData())
+			::operator delete(arr);
+	}
+	size_t size() const { return mSize; }
+	size_t capacity() const { return mCapacity; }
+	bool empty() const { return mSize == 0; }
+	T* data() { return arr; }
+	const T* data() const { return arr; }
+	T* begin() { return arr; }
+	T* end() { return arr + mSize; }
+	const T* begin() const { return arr; }
+	const T* end() const { return arr + mSize; }
+	T& operator[](size_t index) { return arr[index]; }
+	const T& operator[](size_t index) const { return arr[index]; }
+	void reserve(size_t capacity)
+	{
+		if (capacity > mCapacity) Grow(capacity);
+	}
+	void push_back(const T& value)
+	{
+		insert(mSize, value);
+	}
+	//Keeps the order, elements after index are moved one step back
+	void insert(size_t index, const T& value)
+	{
+		if (mSize == mCapacity) Grow(mCapacity * 2);
+		if (index == mSize)
+		{
+			new (arr + mSize) T(value);
+		}
+		else
+		{
+			new (arr + mSize) T(std::move(arr[mSize - 1]));
+			for (size_t i = mSize - 1; i > index; --i)
+				arr[i] = std::move(arr[i - 1]);
+			arr[index] = value;
+		}
+		++mSize;
+	}
+	//Keeps the order, elements after index are moved one step forward
+	void erase(size_t index)
+	{
+		for (size_t i = index + 1; i < mSize; ++i)
+			arr[i - 1] = std::move(arr[i]);
+		--mSize;
+		arr[mSize].~T();
+	}
+	void clear()
+	{
+		for (size_t i = 0; i < mSize; ++i)
+			arr[i].~T();
+		mSize = 0;
+	}
+};
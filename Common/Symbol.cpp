@@ -0,0 +1,100 @@
+#include "Symbol.h"
+#include <cstring>
+#include <stdexcept>
+
+template<typename Char>
+TSymbolArena<Char>::TSymbolArena() : charChunkUsed(CHAR_CHUNK_SIZE), entryCount(0)
+{
+	dict.reserve(ENTRY_CHUNK_SIZE);
+	//Handle 0 is the empty string
+	Entry empty;
+	empty.str = Store(View());
+	empty.length = 0;
+	empty.hash = Hash(View());
+	entryChunks[0].reset(new Entry[ENTRY_CHUNK_SIZE]);
+	entryChunks[0][0] = empty;
+	entryCount = 1;
+	dict[View(empty.str, 0)] = 0;
+}
+
+template<typename Char>
+TSymbolArena<Char>& TSymbolArena<Char>::GetInstance()
+{
+	static TSymbolArena<Char> instance;
+	return instance;
+}
+
+template<typename Char>
+unsigned int TSymbolArena<Char>::Hash(View str)
+{
+	unsigned int hash = 2166136261u;
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		hash ^= (unsigned int)str[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+template<typename Char>
+const Char* TSymbolArena<Char>::Store(View str)
+{
+	unsigned int size = (unsigned int)str.size() + 1;
+	Char* dest;
+	if (size > CHAR_CHUNK_SIZE)
+	{
+		//Oversized strings get a chunk of their own, the current chunk stays open
+		largeChunks.emplace_back(new Char[size]);
+		dest = largeChunks[largeChunks.size() - 1].get();
+	}
+	else
+	{
+		if (charChunkUsed + size > CHAR_CHUNK_SIZE)
+		{
+			charChunks.emplace_back(new Char[CHAR_CHUNK_SIZE]);
+			charChunkUsed = 0;
+		}
+		dest = charChunks[charChunks.size() - 1].get() + charChunkUsed;
+		charChunkUsed += size;
+	}
+	if (!str.empty())
+		memcpy(dest, str.data(), str.size() * sizeof(Char));
+	dest[str.size()] = 0;
+	return dest;
+}
+
+template<typename Char>
+unsigned int TSymbolArena<Char>::Intern(View str)
+{
+	{
+		std::shared_lock<std::shared_mutex> lck(mtx);
+		auto&& ite = dict.find(str);
+		if (ite != dict.end()) return ite->second;
+	}
+	std::unique_lock<std::shared_mutex> lck(mtx);
+	//Another thread may have added it between the locks
+	auto&& ite = dict.find(str);
+	if (ite != dict.end()) return ite->second;
+	unsigned int handle = entryCount;
+	unsigned int chunk = handle / ENTRY_CHUNK_SIZE;
+	if (chunk >= MAX_ENTRY_CHUNKS) throw std::length_error("Symbol arena is full");
+	if (entryChunks[chunk] == nullptr)
+		entryChunks[chunk].reset(new Entry[ENTRY_CHUNK_SIZE]);
+	Entry& entry = entryChunks[chunk][handle % ENTRY_CHUNK_SIZE];
+	entry.str = Store(str);
+	entry.length = (unsigned int)str.size();
+	entry.hash = Hash(str);
+	++entryCount;
+	dict[View(entry.str, entry.length)] = handle;
+	return handle;
+}
+
+template<typename Char>
+unsigned int TSymbolArena<Char>::Count()
+{
+	std::shared_lock<std::shared_mutex> lck(mtx);
+	return entryCount;
+}
+
+template class TSymbolArena<char>;
+template class TSymbolArena<wchar_t>;
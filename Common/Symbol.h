@@ -0,0 +1,97 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <functional>
+//Append-only storage of every interned string of one character type
+//Strings are never moved or freed, entries are read without locking
+template<typename Char>
+class TSymbolArena
+{
+public:
+	typedef std::basic_string_view<Char> View;
+	struct Entry
+	{
+		const Char* str;
+		unsigned int length;
+		//FNV-1a of the characters
+		unsigned int hash;
+	};
+private:
+	static const unsigned int CHAR_CHUNK_SIZE = 16384;
+	static const unsigned int ENTRY_CHUNK_SIZE = 1024;
+	static const unsigned int MAX_ENTRY_CHUNKS = 4096;
+	struct ViewHash
+	{
+		size_t operator()(const View& str) const { return Hash(str); }
+	};
+	std::vector<std::unique_ptr<Char[]>> charChunks;
+	std::vector<std::unique_ptr<Char[]>> largeChunks;
+	unsigned int charChunkUsed;
+	std::unique_ptr<Entry[]> entryChunks[MAX_ENTRY_CHUNKS];
+	unsigned int entryCount;
+	//Keys point into the arena itself
+	std::unordered_map<View, unsigned int, ViewHash> dict;
+	std::shared_mutex mtx;
+	TSymbolArena();
+	const Char* Store(View str);
+public:
+	TSymbolArena(const TSymbolArena&) = delete;
+	TSymbolArena& operator=(const TSymbolArena&) = delete;
+	static TSymbolArena& GetInstance();
+	static unsigned int Hash(View str);
+	//Safe to call from any thread, handle 0 is the empty string
+	unsigned int Intern(View str);
+	const Entry& Get(unsigned int handle) const
+	{
+		return entryChunks[handle / ENTRY_CHUNK_SIZE][handle % ENTRY_CHUNK_SIZE];
+	}
+	unsigned int Count();
+};
+
+//32-bit handle of an interned string, comparing two symbols is one integer compare
+template<typename Char>
+class TSymbol
+{
+private:
+	typedef TSymbolArena<Char> Arena;
+	unsigned int handle;
+public:
+	typedef std::basic_string_view<Char> View;
+	TSymbol() : handle(0) {}
+	TSymbol(View str) : handle(str.empty() ? 0 : Arena::GetInstance().Intern(str)) {}
+	TSymbol(const Char* str) : TSymbol(View(str)) {}
+	TSymbol(const std::basic_string<Char>& str) : TSymbol(View(str)) {}
+	bool operator==(const TSymbol& other) const { return handle == other.handle; }
+	bool operator!=(const TSymbol& other) const { return handle != other.handle; }
+	//Orders by handle, not alphabetically
+	bool operator<(const TSymbol& other) const { return handle < other.handle; }
+	bool empty() const { return handle == 0; }
+	unsigned int GetHandle() const { return handle; }
+	unsigned int GetHash() const { return Arena::GetInstance().Get(handle).hash; }
+	unsigned int size() const { return Arena::GetInstance().Get(handle).length; }
+	//Null terminated, valid for the lifetime of the program
+	const Char* c_str() const { return Arena::GetInstance().Get(handle).str; }
+	View view() const
+	{
+		const typename Arena::Entry& entry = Arena::GetInstance().Get(handle);
+		return View(entry.str, entry.length);
+	}
+	std::basic_string<Char> str() const { return std::basic_string<Char>(view()); }
+};
+typedef TSymbol<char> Symbol;
+typedef TSymbol<wchar_t> WSymbol;
+
+namespace std
+{
+	template<typename Char>
+	struct hash<TSymbol<Char>>
+	{
+		//Handles are unique per string, so they make a perfect hash
+		size_t operator()(const TSymbol<Char>& symbol) const { return symbol.GetHandle(); }
+	};
+}
@@ -0,0 +1,203 @@
+#include "TextureArchive.h"
+#include "LZ4Block.h"
+#include <cstring>
+
+TextureArchive::TextureArchive() :
+	mHeader(nullptr),
+	mEntries(nullptr),
+	mSubresources(nullptr),
+	mChunks(nullptr),
+	mNames(nullptr)
+{
+}
+
+bool TextureArchive::Open(const char* path)
+{
+	Close();
+	if (!mFile.Open(path)) return false;
+	if (!Validate())
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool TextureArchive::Open(const wchar_t* path)
+{
+	Close();
+	if (!mFile.Open(path)) return false;
+	if (!Validate())
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void TextureArchive::Close()
+{
+	mFile.Close();
+	mHeader = nullptr;
+	mEntries = nullptr;
+	mSubresources = nullptr;
+	mChunks = nullptr;
+	mNames = nullptr;
+}
+
+static bool IsRangeInFile(uint64_t offset, uint64_t size, uint64_t fileSize)
+{
+	return offset <= fileSize && size <= fileSize - offset;
+}
+
+bool TextureArchive::Validate()
+{
+	const uint8_t* data = mFile.GetData();
+	uint64_t fileSize = mFile.GetSize();
+	if (fileSize < sizeof(TextureArchiveHeader)) return false;
+	const TextureArchiveHeader* header = reinterpret_cast<const TextureArchiveHeader*>(data);
+	if (header->magic != TextureArchiveHeader::MAGIC || header->version != TextureArchiveHeader::VERSION) return false;
+	//Tables are read in place, so they have to be aligned as well as inside the file
+	if (header->entryOffset % 8 != 0 || header->subresourceOffset % 8 != 0 || header->chunkOffset % 8 != 0) return false;
+	if (!IsRangeInFile(header->entryOffset, (uint64_t)header->textureCount * sizeof(TextureArchiveEntry), fileSize) ||
+		!IsRangeInFile(header->subresourceOffset, (uint64_t)header->subresourceCount * sizeof(TextureArchiveSubresource), fileSize) ||
+		!IsRangeInFile(header->chunkOffset, (uint64_t)header->chunkCount * sizeof(TextureArchiveChunk), fileSize) ||
+		!IsRangeInFile(header->nameOffset, header->nameSize, fileSize))
+		return false;
+	const TextureArchiveEntry* entries = reinterpret_cast<const TextureArchiveEntry*>(data + header->entryOffset);
+	const TextureArchiveSubresource* subresources = reinterpret_cast<const TextureArchiveSubresource*>(data + header->subresourceOffset);
+	const TextureArchiveChunk* chunks = reinterpret_cast<const TextureArchiveChunk*>(data + header->chunkOffset);
+	for (uint32_t i = 0; i < header->textureCount; ++i)
+	{
+		const TextureArchiveEntry& entry = entries[i];
+		if (i > 0 && entries[i - 1].nameHash > entry.nameHash) return false;
+		if ((uint64_t)entry.nameOffset + entry.nameLength > header->nameSize) return false;
+		if (entry.compression > TEXTURE_ARCHIVE_COMPRESSION_LZ4) return false;
+		if (entry.mipCount == 0 || entry.arraySize == 0 ||
+			(uint64_t)entry.mipCount * entry.arraySize != entry.subresourceCount ||
+			(uint64_t)entry.firstSubresource + entry.subresourceCount > header->subresourceCount)
+			return false;
+		if (!IsRangeInFile(entry.payloadOffset, entry.storedSize, fileSize)) return false;
+		if (entry.compression == TEXTURE_ARCHIVE_COMPRESSION_NONE && entry.storedSize != entry.payloadSize) return false;
+		for (uint32_t s = 0; s < entry.subresourceCount; ++s)
+		{
+			const TextureArchiveSubresource& sub = subresources[entry.firstSubresource + s];
+			if (sub.numRows == 0 || sub.depth == 0 || sub.rowBytes > sub.rowPitch) return false;
+			if (sub.size != (uint64_t)sub.rowPitch * ((uint64_t)sub.numRows * sub.depth - 1) + sub.rowBytes) return false;
+			if (sub.offset > entry.payloadSize || sub.size > entry.payloadSize - sub.offset) return false;
+			if (entry.compression == TEXTURE_ARCHIVE_COMPRESSION_NONE) continue;
+			if ((uint64_t)sub.firstChunk + sub.chunkCount > header->chunkCount) return false;
+			uint64_t rawSize = 0;
+			for (uint32_t c = 0; c < sub.chunkCount; ++c)
+			{
+				const TextureArchiveChunk& chunk = chunks[sub.firstChunk + c];
+				if (chunk.rawSize > TEXTURE_ARCHIVE_CHUNK_SIZE || chunk.storedSize > chunk.rawSize) return false;
+				if (!IsRangeInFile(chunk.storedOffset, chunk.storedSize, fileSize)) return false;
+				rawSize += chunk.rawSize;
+			}
+			if (rawSize != sub.size) return false;
+		}
+	}
+	mHeader = header;
+	mEntries = entries;
+	mSubresources = subresources;
+	mChunks = chunks;
+	mNames = reinterpret_cast<const char*>(data + header->nameOffset);
+	return true;
+}
+
+uint64_t TextureArchive::HashName(const char* name, size_t length)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < length; ++i)
+	{
+		hash ^= (uint8_t)name[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+const TextureArchiveEntry* TextureArchive::Find(const char* name, size_t length) const
+{
+	if (mHeader == nullptr) return nullptr;
+	uint64_t hash = HashName(name, length);
+	uint32_t first = 0;
+	uint32_t count = mHeader->textureCount;
+	//Lower bound on the hash, then walk the equal run comparing names
+	while (count > 0)
+	{
+		uint32_t step = count / 2;
+		if (mEntries[first + step].nameHash < hash)
+		{
+			first += step + 1;
+			count -= step + 1;
+		}
+		else
+		{
+			count = step;
+		}
+	}
+	for (uint32_t i = first; i < mHeader->textureCount && mEntries[i].nameHash == hash; ++i)
+	{
+		const TextureArchiveEntry& entry = mEntries[i];
+		if (entry.nameLength == length && memcmp(mNames + entry.nameOffset, name, length) == 0)
+			return &entry;
+	}
+	return nullptr;
+}
+
+std::string TextureArchive::GetName(const TextureArchiveEntry& entry) const
+{
+	return std::string(mNames + entry.nameOffset, entry.nameLength);
+}
+
+void TextureArchive::GetDesc(const TextureArchiveEntry& entry, DDSTextureDesc& desc) const
+{
+	desc.dimension = entry.dimension;
+	desc.width = entry.width;
+	desc.height = entry.height;
+	desc.depth = entry.depth;
+	desc.mipCount = entry.mipCount;
+	desc.arraySize = entry.arraySize;
+	desc.format = (DXGI_FORMAT)entry.format;
+	desc.isCubeMap = entry.isCubeMap != 0;
+	desc.alphaMode = entry.alphaMode;
+	desc.dataOffset = (size_t)entry.payloadOffset;
+	desc.dataSize = (size_t)entry.storedSize;
+}
+
+bool TextureArchive::ReadSubresource(const TextureArchiveEntry& entry, uint32_t subresource, uint8_t* dest, std::vector<uint8_t>& scratch) const
+{
+	if (subresource >= entry.subresourceCount) return false;
+	const TextureArchiveSubresource& sub = GetSubresource(entry, subresource);
+	const uint8_t* data = mFile.GetData();
+	if (entry.compression == TEXTURE_ARCHIVE_COMPRESSION_NONE)
+	{
+		memcpy(dest, data + entry.payloadOffset + sub.offset, (size_t)sub.size);
+		return true;
+	}
+	if (scratch.size() < TEXTURE_ARCHIVE_CHUNK_SIZE)
+		scratch.resize(TEXTURE_ARCHIVE_CHUNK_SIZE);
+	for (uint32_t c = 0; c < sub.chunkCount; ++c)
+	{
+		const TextureArchiveChunk& chunk = mChunks[sub.firstChunk + c];
+		const uint8_t* stored = data + chunk.storedOffset;
+		if (chunk.storedSize == chunk.rawSize)
+		{
+			memcpy(dest, stored, chunk.rawSize);
+		}
+		else
+		{
+			//The decoder reads back its own output, which must not be uncached memory
+			if (!LZ4Block::Decompress(stored, chunk.storedSize, scratch.data(), chunk.rawSize)) return false;
+			memcpy(dest, scratch.data(), chunk.rawSize);
+		}
+		dest += chunk.rawSize;
+	}
+	return true;
+}
+
+void TextureArchive::Prefetch(const TextureArchiveEntry& entry) const
+{
+	mFile.Prefetch(entry.payloadOffset, entry.storedSize);
+}
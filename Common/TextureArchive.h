@@ -0,0 +1,138 @@
+#pragma once
+#include "DDSCore.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+//One file holding many textures, written offline by TextureArchiveWriter
+//Layout: header, entries sorted by name hash, subresource table, chunk table, names, payloads
+//Texels are stored in upload layout: subresources start on TEXTURE_ARCHIVE_PLACEMENT_ALIGNMENT
+//and rows on TEXTURE_ARCHIVE_PITCH_ALIGNMENT, so loading is a copy per subresource without parsing
+//All values are little endian, offsets are from the start of the file unless noted
+
+//Same values as D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT and D3D12_TEXTURE_DATA_PITCH_ALIGNMENT
+#define TEXTURE_ARCHIVE_PLACEMENT_ALIGNMENT 512
+#define TEXTURE_ARCHIVE_PITCH_ALIGNMENT 256
+//Compressed payloads are split into chunks of at most this many raw bytes, never across subresources
+#define TEXTURE_ARCHIVE_CHUNK_SIZE (256 * 1024)
+
+enum TextureArchiveCompression
+{
+	TEXTURE_ARCHIVE_COMPRESSION_NONE = 0,
+	TEXTURE_ARCHIVE_COMPRESSION_LZ4 = 1
+};
+
+struct TextureArchiveHeader
+{
+	static const uint32_t MAGIC = 0x5241544d;	//"MTAR"
+	static const uint32_t VERSION = 2;
+	uint32_t magic;
+	uint32_t version;
+	uint32_t textureCount;
+	uint32_t subresourceCount;
+	uint32_t chunkCount;
+	uint32_t nameSize;
+	uint64_t entryOffset;
+	uint64_t subresourceOffset;
+	uint64_t chunkOffset;
+	uint64_t nameOffset;
+};
+
+//The header DDSCore::ParseHeader would produce, stored so nothing is parsed at load
+struct TextureArchiveEntry
+{
+	//FNV-1a of the name, entries are sorted by it
+	uint64_t nameHash;
+	//Offset into the name block, names are not null terminated
+	uint32_t nameOffset;
+	uint32_t nameLength;
+	uint32_t dimension;
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+	uint32_t mipCount;
+	uint32_t arraySize;
+	uint32_t format;
+	uint32_t isCubeMap;
+	uint32_t alphaMode;
+	uint32_t compression;
+	//mipCount * arraySize subresources in D3D order
+	uint32_t firstSubresource;
+	uint32_t subresourceCount;
+	//Placement aligned for uncompressed payloads, the first chunk's data otherwise
+	uint64_t payloadOffset;
+	//Size once decompressed, subresource offsets are relative to the payload
+	uint64_t payloadSize;
+	//Bytes in the file, same as payloadSize when uncompressed
+	uint64_t storedSize;
+	//XXH64 and size of the DDS file the texture was packed from, the content key TextureCache
+	//computes for loose files, so it can share textures without reading or hashing anything
+	uint64_t contentHash;
+	uint64_t contentSize;
+};
+
+struct TextureArchiveSubresource
+{
+	//Placement aligned, from the start of the payload
+	uint64_t offset;
+	//rowPitch * (numRows * depth - 1) + rowBytes, the last row is not padded
+	uint64_t size;
+	uint32_t rowPitch;
+	uint32_t rowBytes;
+	uint32_t numRows;
+	//Footprint size, rounded up to whole blocks for block compressed formats
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+	//Chunks covering this subresource in order, none when uncompressed
+	uint32_t firstChunk;
+	uint32_t chunkCount;
+};
+
+struct TextureArchiveChunk
+{
+	uint64_t storedOffset;
+	//Chunks that did not shrink are stored raw, storedSize equals rawSize then
+	uint32_t storedSize;
+	uint32_t rawSize;
+};
+
+class TextureArchive
+{
+private:
+	MappedFile mFile;
+	const TextureArchiveHeader* mHeader;
+	const TextureArchiveEntry* mEntries;
+	const TextureArchiveSubresource* mSubresources;
+	const TextureArchiveChunk* mChunks;
+	const char* mNames;
+	bool Validate();
+public:
+	TextureArchive();
+	TextureArchive(const TextureArchive&) = delete;
+	TextureArchive& operator=(const TextureArchive&) = delete;
+	//Maps the archive and checks every table, reads later only check decompression
+	bool Open(const char* path);
+	bool Open(const wchar_t* path);
+	void Close();
+	bool IsOpen() const { return mHeader != nullptr; }
+	static uint64_t HashName(const char* name, size_t length);
+	//nullptr if the archive has no texture with that name
+	const TextureArchiveEntry* Find(const char* name, size_t length) const;
+	const TextureArchiveEntry* Find(const std::string& name) const { return Find(name.data(), name.size()); }
+	uint32_t GetTextureCount() const { return mHeader == nullptr ? 0 : mHeader->textureCount; }
+	const TextureArchiveEntry& GetEntry(uint32_t index) const { return mEntries[index]; }
+	std::string GetName(const TextureArchiveEntry& entry) const;
+	const TextureArchiveSubresource& GetSubresource(const TextureArchiveEntry& entry, uint32_t subresource) const
+	{
+		return mSubresources[entry.firstSubresource + subresource];
+	}
+	void GetDesc(const TextureArchiveEntry& entry, DDSTextureDesc& desc) const;
+	//Writes the subresource's size bytes to dest with rows at rowPitch
+	//Compressed chunks are decoded into scratch first, so dest may be write-combined upload memory
+	//Safe to call from several threads at once
+	bool ReadSubresource(const TextureArchiveEntry& entry, uint32_t subresource, uint8_t* dest, std::vector<uint8_t>& scratch) const;
+	//Asks the OS to start reading a texture's payload
+	void Prefetch(const TextureArchiveEntry& entry) const;
+};
@@ -0,0 +1,310 @@
+#include "TextureArchiveWriter.h"
+#include "LZ4Block.h"
+#include "XXHash64.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+static_assert(sizeof(TextureArchiveHeader) == 56, "TextureArchiveHeader layout changed");
+static_assert(sizeof(TextureArchiveEntry) == 104, "TextureArchiveEntry layout changed");
+static_assert(sizeof(TextureArchiveSubresource) == 48, "TextureArchiveSubresource layout changed");
+static_assert(sizeof(TextureArchiveChunk) == 16, "TextureArchiveChunk layout changed");
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+//Pixels per block along x and y, copy footprints have to cover whole blocks
+static uint32_t GetBlockSize(DXGI_FORMAT format, uint32_t& blockHeight)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_BC1_TYPELESS:
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC2_TYPELESS:
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_TYPELESS:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_TYPELESS:
+	case DXGI_FORMAT_BC4_UNORM:
+	case DXGI_FORMAT_BC4_SNORM:
+	case DXGI_FORMAT_BC5_TYPELESS:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC6H_TYPELESS:
+	case DXGI_FORMAT_BC6H_UF16:
+	case DXGI_FORMAT_BC6H_SF16:
+	case DXGI_FORMAT_BC7_TYPELESS:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		blockHeight = 4;
+		return 4;
+	case DXGI_FORMAT_R8G8_B8G8_UNORM:
+	case DXGI_FORMAT_G8R8_G8B8_UNORM:
+	case DXGI_FORMAT_YUY2:
+		blockHeight = 1;
+		return 2;
+	default:
+		blockHeight = 1;
+		return 1;
+	}
+}
+
+bool TextureArchiveWriter::AddTexture(const std::string& name, const uint8_t* ddsData, size_t ddsSize, TextureArchiveCompression compression)
+{
+	for (int i = 0; i < mTextures.size(); ++i)
+	{
+		if (mTextures[i].name == name) return false;
+	}
+	DDSTextureDesc desc;
+	DDSLayout layout;
+	if (DDSCore::ParseHeader(ddsData, ddsSize, desc) != DDS_RESULT_OK) return false;
+	if (DDSCore::ComputeLayout(desc, 0, layout) != DDS_RESULT_OK) return false;
+	PendingTexture texture;
+	texture.name = name;
+	TextureArchiveEntry& entry = texture.entry;
+	memset(&entry, 0, sizeof(entry));
+	entry.nameHash = TextureArchive::HashName(name.data(), name.size());
+	entry.nameLength = (uint32_t)name.size();
+	entry.dimension = desc.dimension;
+	entry.width = desc.width;
+	entry.height = desc.height;
+	entry.depth = desc.depth;
+	entry.mipCount = desc.mipCount;
+	entry.arraySize = desc.arraySize;
+	entry.format = (uint32_t)desc.format;
+	entry.isCubeMap = desc.isCubeMap ? 1 : 0;
+	entry.alphaMode = desc.alphaMode;
+	entry.subresourceCount = (uint32_t)layout.subresources.size();
+	entry.contentHash = XXHash64::Hash(ddsData, ddsSize);
+	entry.contentSize = ddsSize;
+	uint32_t blockHeight;
+	uint32_t blockWidth = GetBlockSize(desc.format, blockHeight);
+	uint64_t payloadSize = 0;
+	texture.subresources.resize(layout.subresources.size());
+	for (int i = 0; i < layout.subresources.size(); ++i)
+	{
+		const DDSSubresource& src = layout.subresources[i];
+		TextureArchiveSubresource& sub = texture.subresources[i];
+		memset(&sub, 0, sizeof(sub));
+		sub.offset = AlignUp(payloadSize, TEXTURE_ARCHIVE_PLACEMENT_ALIGNMENT);
+		sub.rowPitch = (uint32_t)AlignUp(src.rowBytes, TEXTURE_ARCHIVE_PITCH_ALIGNMENT);
+		sub.rowBytes = (uint32_t)src.rowBytes;
+		sub.numRows = (uint32_t)src.numRows;
+		sub.width = (uint32_t)AlignUp(src.width, blockWidth);
+		sub.height = (uint32_t)AlignUp(src.height, blockHeight);
+		sub.depth = src.depth;
+		sub.size = (uint64_t)sub.rowPitch * ((uint64_t)sub.numRows * sub.depth - 1) + sub.rowBytes;
+		payloadSize = sub.offset + sub.size;
+	}
+	std::vector<uint8_t> payload((size_t)payloadSize, 0);
+	for (int i = 0; i < layout.subresources.size(); ++i)
+	{
+		const DDSSubresource& src = layout.subresources[i];
+		const TextureArchiveSubresource& sub = texture.subresources[i];
+		size_t rowCount = (size_t)sub.numRows * sub.depth;
+		for (size_t row = 0; row < rowCount; ++row)
+			memcpy(payload.data() + sub.offset + row * sub.rowPitch, ddsData + src.offset + row * src.rowBytes, src.rowBytes);
+	}
+	entry.payloadSize = payloadSize;
+	if (compression == TEXTURE_ARCHIVE_COMPRESSION_LZ4)
+	{
+		std::vector<uint8_t> compressed(LZ4Block::CompressBound(TEXTURE_ARCHIVE_CHUNK_SIZE));
+		for (int i = 0; i < texture.subresources.size(); ++i)
+		{
+			TextureArchiveSubresource& sub = texture.subresources[i];
+			sub.firstChunk = (uint32_t)texture.chunks.size();
+			for (uint64_t done = 0; done < sub.size; done += TEXTURE_ARCHIVE_CHUNK_SIZE)
+			{
+				const uint8_t* raw = payload.data() + sub.offset + done;
+				TextureArchiveChunk chunk;
+				chunk.storedOffset = texture.stored.size();
+				chunk.rawSize = (uint32_t)std::min<uint64_t>(sub.size - done, TEXTURE_ARCHIVE_CHUNK_SIZE);
+				size_t compressedSize = LZ4Block::Compress(raw, chunk.rawSize, compressed.data(), compressed.size());
+				if (compressedSize == 0 || compressedSize >= chunk.rawSize)
+				{
+					chunk.storedSize = chunk.rawSize;
+					texture.stored.insert(texture.stored.end(), raw, raw + chunk.rawSize);
+				}
+				else
+				{
+					chunk.storedSize = (uint32_t)compressedSize;
+					texture.stored.insert(texture.stored.end(), compressed.data(), compressed.data() + compressedSize);
+				}
+				texture.chunks.push_back(chunk);
+			}
+			sub.chunkCount = (uint32_t)texture.chunks.size() - sub.firstChunk;
+		}
+		if (texture.stored.size() < payloadSize)
+		{
+			entry.compression = TEXTURE_ARCHIVE_COMPRESSION_LZ4;
+		}
+		else
+		{
+			texture.chunks.clear();
+			texture.stored.clear();
+			for (int i = 0; i < texture.subresources.size(); ++i)
+			{
+				texture.subresources[i].firstChunk = 0;
+				texture.subresources[i].chunkCount = 0;
+			}
+		}
+	}
+	if (entry.compression == TEXTURE_ARCHIVE_COMPRESSION_NONE)
+		texture.stored.swap(payload);
+	entry.storedSize = texture.stored.size();
+	mTextures.push_back(std::move(texture));
+	return true;
+}
+
+bool TextureArchiveWriter::AddFile(const std::string& name, const char* path, TextureArchiveCompression compression)
+{
+	MappedFile file;
+	if (!file.Open(path)) return false;
+	return AddTexture(name, file.GetData(), (size_t)file.GetSize(), compression);
+}
+
+static bool WriteBytes(std::ofstream& file, const void* data, size_t size)
+{
+	if (size > 0) file.write(reinterpret_cast<const char*>(data), (std::streamsize)size);
+	return file.good();
+}
+
+static bool WritePadding(std::ofstream& file, uint64_t& position, uint64_t alignment)
+{
+	static const uint8_t zeros[TEXTURE_ARCHIVE_PLACEMENT_ALIGNMENT] = {};
+	uint64_t aligned = AlignUp(position, alignment);
+	size_t padding = (size_t)(aligned - position);
+	position = aligned;
+	return WriteBytes(file, zeros, padding);
+}
+
+bool TextureArchiveWriter::Write(const char* path) const
+{
+	//Sorted by hash for the reader's binary search, names break ties so output is deterministic
+	std::vector<uint32_t> order(mTextures.size());
+	for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+	std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) -> bool
+	{
+		const PendingTexture& ta = mTextures[a];
+		const PendingTexture& tb = mTextures[b];
+		if (ta.entry.nameHash != tb.entry.nameHash) return ta.entry.nameHash < tb.entry.nameHash;
+		return ta.name < tb.name;
+	});
+	TextureArchiveHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = TextureArchiveHeader::MAGIC;
+	header.version = TextureArchiveHeader::VERSION;
+	header.textureCount = (uint32_t)mTextures.size();
+	std::vector<TextureArchiveEntry> entries(mTextures.size());
+	std::vector<TextureArchiveSubresource> subresources;
+	std::vector<TextureArchiveChunk> chunks;
+	std::string names;
+	std::vector<uint32_t> firstChunks(order.size());
+	for (int i = 0; i < order.size(); ++i)
+	{
+		const PendingTexture& texture = mTextures[order[i]];
+		TextureArchiveEntry& entry = entries[i];
+		entry = texture.entry;
+		entry.nameOffset = (uint32_t)names.size();
+		names += texture.name;
+		entry.firstSubresource = (uint32_t)subresources.size();
+		uint32_t firstChunk = (uint32_t)chunks.size();
+		firstChunks[i] = firstChunk;
+		for (int s = 0; s < texture.subresources.size(); ++s)
+		{
+			TextureArchiveSubresource sub = texture.subresources[s];
+			if (sub.chunkCount > 0) sub.firstChunk += firstChunk;
+			subresources.push_back(sub);
+		}
+		chunks.insert(chunks.end(), texture.chunks.begin(), texture.chunks.end());
+	}
+	header.subresourceCount = (uint32_t)subresources.size();
+	header.chunkCount = (uint32_t)chunks.size();
+	header.nameSize = (uint32_t)names.size();
+	header.entryOffset = sizeof(TextureArchiveHeader);
+	header.subresourceOffset = header.entryOffset + entries.size() * sizeof(TextureArchiveEntry);
+	header.chunkOffset = header.subresourceOffset + subresources.size() * sizeof(TextureArchiveSubresource);
+	header.nameOffset = header.chunkOffset + chunks.size() * sizeof(TextureArchiveChunk);
+	//Every payload starts placement aligned, so uncompressed subresources are aligned in the file as well
+	uint64_t position = header.nameOffset + names.size();
+	for (int i = 0; i < order.size(); ++i)
+	{
+		const PendingTexture& texture = mTextures[order[i]];
+		TextureArchiveEntry& entry = entries[i];
+		position = AlignUp(position, TEXTURE_ARCHIVE_PLACEMENT_ALIGNMENT);
+		entry.payloadOffset = position;
+		for (uint32_t c = 0; c < texture.chunks.size(); ++c)
+			chunks[firstChunks[i] + c].storedOffset += position;
+		position += texture.stored.size();
+	}
+	std::filesystem::path filePath = std::filesystem::u8path(path);
+	std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+	if (!file) return false;
+	position = 0;
+	bool ok = WriteBytes(file, &header, sizeof(header)) &&
+		WriteBytes(file, entries.data(), entries.size() * sizeof(TextureArchiveEntry)) &&
+		WriteBytes(file, subresources.data(), subresources.size() * sizeof(TextureArchiveSubresource)) &&
+		WriteBytes(file, chunks.data(), chunks.size() * sizeof(TextureArchiveChunk)) &&
+		WriteBytes(file, names.data(), names.size());
+	position = header.nameOffset + names.size();
+	for (int i = 0; ok && i < order.size(); ++i)
+	{
+		const PendingTexture& texture = mTextures[order[i]];
+		ok = WritePadding(file, position, TEXTURE_ARCHIVE_PLACEMENT_ALIGNMENT) &&
+			WriteBytes(file, texture.stored.data(), texture.stored.size());
+		position += texture.stored.size();
+	}
+	file.close();
+	if (file.fail()) ok = false;
+	if (!ok)
+	{
+		std::error_code ec;
+		std::filesystem::remove(filePath, ec);
+	}
+	return ok;
+}
+
+bool TextureArchiveWriter::PackDirectory(const char* directory, const char* archivePath, TextureArchiveCompression compression, std::string& error)
+{
+	namespace fs = std::filesystem;
+	std::string root = directory;
+	while (!root.empty() && (root.back() == '/' || root.back() == '\\')) root.pop_back();
+	fs::path rootPath = fs::u8path(root);
+	std::vector<fs::path> files;
+	std::error_code ec;
+	for (fs::recursive_directory_iterator ite(rootPath, ec), end; !ec && ite != end; ite.increment(ec))
+	{
+		if (!ite->is_regular_file()) continue;
+		std::string extension = ite->path().extension().u8string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) -> char { return (char)tolower((unsigned char)c); });
+		if (extension == ".dds") files.push_back(ite->path());
+	}
+	if (ec)
+	{
+		error = "Can not list " + root;
+		return false;
+	}
+	std::sort(files.begin(), files.end());
+	TextureArchiveWriter writer;
+	for (int i = 0; i < files.size(); ++i)
+	{
+		std::string name = root + "/" + files[i].lexically_relative(rootPath).generic_u8string();
+		if (!writer.AddFile(name, files[i].u8string().c_str(), compression))
+		{
+			error = "Can not pack " + files[i].u8string();
+			return false;
+		}
+	}
+	if (!writer.Write(archivePath))
+	{
+		error = std::string("Can not write ") + archivePath;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "TextureArchive.h"
+#include <string>
+#include <vector>
+//Offline packer for TextureArchive, lays texels out for upload and optionally compresses them
+//Textures are kept in memory until Write
+class TextureArchiveWriter
+{
+private:
+	struct PendingTexture
+	{
+		std::string name;
+		TextureArchiveEntry entry;
+		std::vector<TextureArchiveSubresource> subresources;
+		std::vector<TextureArchiveChunk> chunks;
+		//Raw payload for NONE, chunks back to back for LZ4, chunk offsets are relative to it until Write
+		std::vector<uint8_t> stored;
+	};
+	std::vector<PendingTexture> mTextures;
+public:
+	//Lays out every subresource of a DDS file, data is not referenced afterwards
+	//LZ4 falls back to NONE for textures it does not shrink
+	bool AddTexture(const std::string& name, const uint8_t* ddsData, size_t ddsSize, TextureArchiveCompression compression);
+	bool AddFile(const std::string& name, const char* path, TextureArchiveCompression compression);
+	bool Write(const char* path) const;
+	size_t GetTextureCount() const { return mTextures.size(); }
+	//Adds every .dds below directory, named directory + "/" + the relative path with forward slashes
+	//so a loader can look textures up by the path it would have opened
+	//On failure error names the file that could not be packed
+	static bool PackDirectory(const char* directory, const char* archivePath, TextureArchiveCompression compression, std::string& error);
+};
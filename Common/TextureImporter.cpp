@@ -0,0 +1,254 @@
+#include "TextureImporter.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace
+{
+	const uint32_t BMP_RGB = 0;
+	const uint32_t BMP_BITFIELDS = 3;
+	const uint32_t BMP_ALPHABITFIELDS = 6;
+	const size_t BMP_FILE_HEADER_SIZE = 14;
+	const size_t BMP_INFO_HEADER_SIZE = 40;
+
+	inline uint32_t ReadU32(const uint8_t* p)
+	{
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	inline uint16_t ReadU16(const uint8_t* p)
+	{
+		return (uint16_t)(p[0] | (p[1] << 8));
+	}
+
+	//Pulls a channel out of a pixel through its mask and scales it to 8 bits
+	struct ChannelMask
+	{
+		uint32_t mask;
+		uint32_t shift;
+		uint32_t maxValue;
+		void Init(uint32_t m)
+		{
+			mask = m;
+			shift = 0;
+			maxValue = 0;
+			if (m == 0) return;
+			while (((m >> shift) & 1) == 0) ++shift;
+			maxValue = m >> shift;
+		}
+		uint8_t Extract(uint32_t pixel, uint8_t missing) const
+		{
+			if (mask == 0) return missing;
+			uint32_t v = (pixel & mask) >> shift;
+			return (uint8_t)((v * 255 + maxValue / 2) / maxValue);
+		}
+	};
+}
+
+bool TextureImporter::LoadBMP(const uint8_t* data, size_t size, ImportedImage& image)
+{
+	if (size < BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE || data[0] != 'B' || data[1] != 'M') return false;
+	uint32_t pixelOffset = ReadU32(data + 10);
+	const uint8_t* info = data + BMP_FILE_HEADER_SIZE;
+	uint32_t infoSize = ReadU32(info);
+	int32_t width = (int32_t)ReadU32(info + 4);
+	int32_t height = (int32_t)ReadU32(info + 8);
+	uint16_t planes = ReadU16(info + 12);
+	uint16_t bitCount = ReadU16(info + 14);
+	uint32_t compression = ReadU32(info + 16);
+	if (infoSize < BMP_INFO_HEADER_SIZE || planes != 1 || width <= 0 || height == 0 || height == INT32_MIN) return false;
+	if (bitCount != 24 && bitCount != 32) return false;
+	bool topDown = height < 0;
+	uint32_t rows = (uint32_t)(topDown ? -height : height);
+	uint32_t columns = (uint32_t)width;
+	if (columns > 16384 || rows > 16384) return false;
+	ChannelMask red, green, blue, alpha;
+	if (compression == BMP_RGB)
+	{
+		red.Init(0x00ff0000);
+		green.Init(0x0000ff00);
+		blue.Init(0x000000ff);
+		alpha.Init(bitCount == 32 ? 0xff000000 : 0);
+	}
+	else if ((compression == BMP_BITFIELDS || compression == BMP_ALPHABITFIELDS) && bitCount == 32)
+	{
+		//Masks follow a 40 byte header or sit at the same place inside the larger ones
+		size_t maskOffset = BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE;
+		bool hasAlphaMask = compression == BMP_ALPHABITFIELDS || infoSize >= 56;
+		if (size < maskOffset + (hasAlphaMask ? 16 : 12)) return false;
+		red.Init(ReadU32(data + maskOffset));
+		green.Init(ReadU32(data + maskOffset + 4));
+		blue.Init(ReadU32(data + maskOffset + 8));
+		alpha.Init(hasAlphaMask ? ReadU32(data + maskOffset + 12) : 0);
+	}
+	else
+	{
+		return false;
+	}
+	size_t stride = ((size_t)columns * bitCount + 31) / 32 * 4;
+	if (pixelOffset > size || stride * rows > size - pixelOffset) return false;
+	image.width = columns;
+	image.height = rows;
+	image.rgba.resize((size_t)columns * rows * 4);
+	size_t bytesPerPixel = bitCount / 8;
+	bool anyAlpha = false;
+	for (uint32_t y = 0; y < rows; ++y)
+	{
+		const uint8_t* src = data + pixelOffset + stride * (topDown ? y : rows - 1 - y);
+		uint8_t* dest = image.rgba.data() + (size_t)y * columns * 4;
+		for (uint32_t x = 0; x < columns; ++x, src += bytesPerPixel, dest += 4)
+		{
+			uint32_t pixel = bitCount == 32 ? ReadU32(src) : ((uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16));
+			dest[0] = red.Extract(pixel, 0);
+			dest[1] = green.Extract(pixel, 0);
+			dest[2] = blue.Extract(pixel, 0);
+			dest[3] = alpha.Extract(pixel, 255);
+			anyAlpha |= dest[3] != 0;
+		}
+	}
+	if (!anyAlpha)
+	{
+		for (size_t i = 3; i < image.rgba.size(); i += 4)
+			image.rgba[i] = 255;
+	}
+	return true;
+}
+
+bool TextureImporter::LoadBMP(const char* path, ImportedImage& image)
+{
+	MappedFile file;
+	if (!file.Open(path)) return false;
+	return LoadBMP(file.GetData(), (size_t)file.GetSize(), image);
+}
+
+bool TextureImporter::LoadDDS(const uint8_t* data, size_t size, ImportedImage& image)
+{
+	DDSTextureDesc desc;
+	if (DDSCore::ParseHeader(data, size, desc) != DDS_RESULT_OK || desc.dimension != DDS_DIMENSION_TEXTURE2D) return false;
+	int red;
+	bool hasAlpha = true;
+	switch (desc.format)
+	{
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		red = 0;
+		break;
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+		red = 2;
+		break;
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+	case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+		red = 2;
+		hasAlpha = false;
+		break;
+	default:
+		return false;
+	}
+	DDSLayout layout;
+	if (DDSCore::ComputeLayout(desc, 0, layout) != DDS_RESULT_OK || layout.subresources.empty()) return false;
+	//The top mip of the first slice comes first in D3D order
+	const DDSSubresource& top = layout.subresources[0];
+	image.width = top.width;
+	image.height = top.height;
+	image.rgba.resize((size_t)top.width * top.height * 4);
+	for (uint32_t y = 0; y < top.height; ++y)
+	{
+		const uint8_t* src = data + top.offset + top.rowBytes * y;
+		uint8_t* dest = image.rgba.data() + (size_t)y * top.width * 4;
+		for (uint32_t x = 0; x < top.width; ++x, src += 4, dest += 4)
+		{
+			dest[0] = src[red];
+			dest[1] = src[1];
+			dest[2] = src[2 - red];
+			dest[3] = hasAlpha ? src[3] : 255;
+		}
+	}
+	return true;
+}
+
+bool TextureImporter::LoadDDS(const char* path, ImportedImage& image)
+{
+	MappedFile file;
+	if (!file.Open(path)) return false;
+	return LoadDDS(file.GetData(), (size_t)file.GetSize(), image);
+}
+
+bool TextureImporter::WriteDDS(const char* path, const std::vector<ImportedImage>& mips, const TextureImportSettings& settings, ThreadPool* pool)
+{
+	if (mips.empty()) return false;
+	for (int i = 0; i < mips.size(); ++i)
+	{
+		if (mips[i].width != std::max<uint32_t>(mips[0].width >> i, 1) ||
+			mips[i].height != std::max<uint32_t>(mips[0].height >> i, 1) ||
+			mips[i].rgba.size() != (size_t)mips[i].width * mips[i].height * 4)
+			return false;
+	}
+	DDSTextureDesc desc = {};
+	desc.dimension = DDS_DIMENSION_TEXTURE2D;
+	desc.width = mips[0].width;
+	desc.height = mips[0].height;
+	desc.depth = 1;
+	desc.mipCount = (uint32_t)mips.size();
+	desc.arraySize = 1;
+	desc.format = BCEncoder::GetDXGIFormat(settings.format, settings.srgb);
+	desc.isCubeMap = false;
+	desc.alphaMode = 0;
+	std::vector<uint8_t> header;
+	if (DDSCore::BuildHeader(desc, header) != DDS_RESULT_OK) return false;
+	size_t dataSize = 0;
+	for (int i = 0; i < mips.size(); ++i)
+		dataSize += BCEncoder::GetImageSize(settings.format, mips[i].width, mips[i].height);
+	std::vector<uint8_t> blocks(dataSize);
+	std::vector<size_t> offsets(mips.size());
+	for (int i = 1; i < mips.size(); ++i)
+		offsets[i] = offsets[i - 1] + BCEncoder::GetImageSize(settings.format, mips[i - 1].width, mips[i - 1].height);
+	auto encodeLevel = [&](unsigned int i) -> void
+	{
+		const ImportedImage& mip = mips[i];
+		BCEncoder::EncodeImage(settings.format, settings.quality, mip.rgba.data(), mip.width, mip.height,
+			(size_t)mip.width * 4, blocks.data() + offsets[i], pool);
+	};
+	if (pool == nullptr)
+	{
+		for (unsigned int i = 0; i < mips.size(); ++i)
+			encodeLevel(i);
+	}
+	else
+	{
+		//Small levels finish long before the top one, running them side by side keeps every worker busy
+		pool->ParallelFor((unsigned int)mips.size(), encodeLevel, 1);
+	}
+	std::filesystem::path filePath = std::filesystem::u8path(path);
+	std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+	if (!file) return false;
+	file.write(reinterpret_cast<const char*>(header.data()), (std::streamsize)header.size());
+	file.write(reinterpret_cast<const char*>(blocks.data()), (std::streamsize)blocks.size());
+	file.close();
+	if (file.fail())
+	{
+		std::error_code ec;
+		std::filesystem::remove(filePath, ec);
+		return false;
+	}
+	return true;
+}
+
+bool TextureImporter::ImportTexture(const char* sourcePath, const char* ddsPath, const TextureImportSettings& settings, ThreadPool* pool)
+{
+	std::string extension = std::filesystem::u8path(sourcePath).extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) -> char { return (char)tolower((unsigned char)c); });
+	std::vector<ImportedImage> mips(1);
+	bool loaded = false;
+	if (extension == ".bmp") loaded = LoadBMP(sourcePath, mips[0]);
+	else if (extension == ".dds") loaded = LoadDDS(sourcePath, mips[0]);
+	if (!loaded) return false;
+	if (settings.generateMips)
+		MipGenerator::Generate(mips, settings.mips, settings.srgb, pool);
+	return WriteDDS(ddsPath, mips, settings, pool);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "BCEncoder.h"
+#include "MipGenerator.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+class ThreadPool;
+
+//RGBA8 pixels, rows packed tightly from the top
+struct ImportedImage
+{
+	uint32_t width;
+	uint32_t height;
+	std::vector<uint8_t> rgba;
+};
+
+struct TextureImportSettings
+{
+	BCFormat format = BC_FORMAT_BC7;
+	BCQuality quality = BC_QUALITY_NORMAL;
+	//Picks the _SRGB DXGI format and filters mips in linear space, texels are encoded as they are
+	bool srgb = false;
+	//Replaces any levels the source has with a full chain
+	bool generateMips = true;
+	MipSettings mips;
+};
+
+//Turns uncompressed source images into block compressed DDS files, does not depend on Windows or D3D
+//Runs on offline tools and build machines as well as in the engine
+class TextureImporter
+{
+public:
+	//Uncompressed 24 and 32 bit BMPs, plain or with bit fields, top-down or bottom-up
+	//32 bit images whose alpha is 0 everywhere are treated as opaque, as most writers leave it unused
+	static bool LoadBMP(const uint8_t* data, size_t size, ImportedImage& image);
+	static bool LoadBMP(const char* path, ImportedImage& image);
+	//Top mip of the first slice of an uncompressed 8 bit RGBA, BGRA or BGRX DDS
+	static bool LoadDDS(const uint8_t* data, size_t size, ImportedImage& image);
+	static bool LoadDDS(const char* path, ImportedImage& image);
+	//Encodes every level and writes a DX10 DDS, mips[i] must be max(1, top >> i) in size
+	//Levels and the blocks inside them are encoded on pool, nullptr encodes on the calling thread
+	static bool WriteDDS(const char* path, const std::vector<ImportedImage>& mips, const TextureImportSettings& settings, ThreadPool* pool);
+	//Loads a .bmp or an uncompressed .dds, builds its mips and writes a block compressed DDS
+	static bool ImportTexture(const char* sourcePath, const char* ddsPath, const TextureImportSettings& settings, ThreadPool* pool);
+};
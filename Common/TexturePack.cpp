@@ -0,0 +1,163 @@
+#include "TexturePack.h"
+#include "MappedFile.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+static_assert(sizeof(TexturePackHeader) == 16, "TexturePackHeader layout changed");
+
+namespace
+{
+	//Bounds checked reads over the whole file
+	struct PackReader
+	{
+		const uint8_t* data;
+		size_t size;
+		size_t offset;
+		bool Read(void* dest, size_t bytes)
+		{
+			if (bytes > size - offset) return false;
+			memcpy(dest, data + offset, bytes);
+			offset += bytes;
+			return true;
+		}
+		bool ReadString(std::string& str)
+		{
+			uint32_t length;
+			if (!Read(&length, sizeof(length)) || length > size - offset) return false;
+			str.assign(reinterpret_cast<const char*>(data + offset), length);
+			offset += length;
+			return true;
+		}
+	};
+
+	void WriteString(std::ofstream& file, const std::string& str)
+	{
+		uint32_t length = (uint32_t)str.size();
+		file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+		file.write(str.data(), (std::streamsize)str.size());
+	}
+}
+
+bool TexturePack::Read(const char* path)
+{
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		Clear();
+		return false;
+	}
+	return Read(file.GetData(), (size_t)file.GetSize());
+}
+
+bool TexturePack::Read(const wchar_t* path)
+{
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		Clear();
+		return false;
+	}
+	return Read(file.GetData(), (size_t)file.GetSize());
+}
+
+bool TexturePack::Read(const uint8_t* data, size_t size)
+{
+	Clear();
+	PackReader reader = { data, size, 0 };
+	TexturePackHeader header;
+	if (!reader.Read(&header, sizeof(header)) || header.magic != TEXTURE_PACK_MAGIC || header.version != TEXTURE_PACK_VERSION)
+		return false;
+	//Every page and entry takes at least 8 bytes, so corrupt counts fail before allocating
+	if (header.pageCount > size / 8 || header.entryCount > size / 8) return false;
+	mPages.resize(header.pageCount);
+	for (uint32_t i = 0; i < header.pageCount; ++i)
+	{
+		uint32_t kind;
+		if (!reader.Read(&kind, sizeof(kind)) || kind > TEXTURE_PACK_PAGE_ATLAS || !reader.ReadString(mPages[i].path))
+		{
+			Clear();
+			return false;
+		}
+		mPages[i].kind = (TexturePackPageKind)kind;
+	}
+	mEntries.resize(header.entryCount);
+	for (uint32_t i = 0; i < header.entryCount; ++i)
+	{
+		TexturePackEntry& entry = mEntries[i];
+		uint32_t addressMode;
+		if (!reader.ReadString(entry.name) ||
+			!reader.Read(&entry.page, sizeof(entry.page)) ||
+			!reader.Read(&entry.slice, sizeof(entry.slice)) ||
+			!reader.Read(entry.uvScaleOffset, sizeof(entry.uvScaleOffset)) ||
+			!reader.Read(&addressMode, sizeof(addressMode)) ||
+			entry.page >= header.pageCount || addressMode > TEXTURE_PACK_ADDRESS_CLAMP)
+		{
+			Clear();
+			return false;
+		}
+		entry.addressMode = (TexturePackAddressMode)addressMode;
+	}
+	return true;
+}
+
+bool TexturePack::Write(const char* path) const
+{
+	std::filesystem::path filePath = std::filesystem::u8path(path);
+	std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+	if (!file) return false;
+	TexturePackHeader header;
+	header.magic = TEXTURE_PACK_MAGIC;
+	header.version = TEXTURE_PACK_VERSION;
+	header.pageCount = (uint32_t)mPages.size();
+	header.entryCount = (uint32_t)mEntries.size();
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (int i = 0; i < mPages.size(); ++i)
+	{
+		uint32_t kind = (uint32_t)mPages[i].kind;
+		file.write(reinterpret_cast<const char*>(&kind), sizeof(kind));
+		WriteString(file, mPages[i].path);
+	}
+	for (int i = 0; i < mEntries.size(); ++i)
+	{
+		const TexturePackEntry& entry = mEntries[i];
+		WriteString(file, entry.name);
+		file.write(reinterpret_cast<const char*>(&entry.page), sizeof(entry.page));
+		file.write(reinterpret_cast<const char*>(&entry.slice), sizeof(entry.slice));
+		file.write(reinterpret_cast<const char*>(entry.uvScaleOffset), sizeof(entry.uvScaleOffset));
+		uint32_t addressMode = (uint32_t)entry.addressMode;
+		file.write(reinterpret_cast<const char*>(&addressMode), sizeof(addressMode));
+	}
+	file.close();
+	if (file.fail())
+	{
+		std::error_code ec;
+		std::filesystem::remove(filePath, ec);
+		return false;
+	}
+	return true;
+}
+
+void TexturePack::Clear()
+{
+	mPages.clear();
+	mEntries.clear();
+}
+
+uint32_t TexturePack::AddPage(TexturePackPageKind kind, const std::string& path)
+{
+	TexturePackPage page;
+	page.kind = kind;
+	page.path = path;
+	mPages.push_back(page);
+	return (uint32_t)mPages.size() - 1;
+}
+
+const TexturePackEntry* TexturePack::Find(const std::string& name) const
+{
+	for (int i = 0; i < mEntries.size(); ++i)
+	{
+		if (mEntries[i].name == name) return &mEntries[i];
+	}
+	return nullptr;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+//Where TexturePacker put each source texture: a page, a slice of it and the UV rectangle inside that slice
+//Pages are ordinary DDS files, loaded like any other texture
+//File layout, little endian:
+//  TexturePackHeader
+//  pageCount x { uint32 kind, uint32 pathLength, char path[pathLength] }
+//  entryCount x { uint32 nameLength, char name[nameLength], uint32 page, uint32 slice, float uvScaleOffset[4], uint32 addressMode }
+
+#define TEXTURE_PACK_MAGIC 0x4B50544D
+#define TEXTURE_PACK_VERSION 2
+
+enum TexturePackPageKind
+{
+	//The source file itself, it could not be grouped with anything
+	TEXTURE_PACK_PAGE_SINGLE = 0,
+	//Texture2DArray, one slice per source with the same format, size and mip count
+	TEXTURE_PACK_PAGE_ARRAY = 1,
+	//Small sources side by side in one texture, with gutters so mips do not bleed
+	TEXTURE_PACK_PAGE_ATLAS = 2
+};
+
+//How an entry may be sampled past the edge of its rectangle
+enum TexturePackAddressMode
+{
+	//Atlas gutters repeat the opposite edge, so frac() tiling inside the rectangle filters seamlessly
+	TEXTURE_PACK_ADDRESS_WRAP = 0,
+	//Atlas gutters repeat the nearest edge, for elements that are stretched over a surface once
+	TEXTURE_PACK_ADDRESS_CLAMP = 1
+};
+
+struct TexturePackHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t pageCount;
+	uint32_t entryCount;
+};
+
+struct TexturePackPage
+{
+	TexturePackPageKind kind;
+	std::string path;
+};
+
+struct TexturePackEntry
+{
+	//Source path as given to the packer, the path the texture would have been loaded from
+	std::string name;
+	uint32_t page;
+	uint32_t slice;
+	//Sample at uv * xy + zw, (1, 1, 0, 0) for singles and arrays
+	float uvScaleOffset[4];
+	//What the atlas gutters were filled for, singles and arrays follow the sampler and are WRAP
+	TexturePackAddressMode addressMode;
+};
+
+class TexturePack
+{
+private:
+	std::vector<TexturePackPage> mPages;
+	std::vector<TexturePackEntry> mEntries;
+public:
+	//Returns false and leaves the pack empty if the file is missing or malformed
+	bool Read(const char* path);
+	bool Read(const wchar_t* path);
+	bool Read(const uint8_t* data, size_t size);
+	bool Write(const char* path) const;
+	void Clear();
+	uint32_t AddPage(TexturePackPageKind kind, const std::string& path);
+	void AddEntry(const TexturePackEntry& entry) { mEntries.push_back(entry); }
+	uint32_t GetPageCount() const { return (uint32_t)mPages.size(); }
+	const TexturePackPage& GetPage(uint32_t index) const { return mPages[index]; }
+	uint32_t GetEntryCount() const { return (uint32_t)mEntries.size(); }
+	const TexturePackEntry& GetEntry(uint32_t index) const { return mEntries[index]; }
+	//Linear search, packs are read once at load time; nullptr if name was not packed
+	const TexturePackEntry* Find(const std::string& name) const;
+};
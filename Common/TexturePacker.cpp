@@ -0,0 +1,317 @@
+#include "TexturePacker.h"
+#include "DDSCore.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <tuple>
+
+namespace
+{
+	struct PackSource
+	{
+		std::string path;
+		MappedFile file;
+		DDSTextureDesc desc;
+		DDSLayout layout;
+		bool packed;
+	};
+
+	//An atlas element, positions are of the gutter's top left corner
+	struct AtlasElement
+	{
+		uint32_t source;
+		uint32_t x;
+		uint32_t y;
+	};
+
+	bool IsPlain2D(const DDSTextureDesc& desc)
+	{
+		return desc.dimension == DDS_DIMENSION_TEXTURE2D && !desc.isCubeMap && desc.arraySize == 1 && desc.depth == 1;
+	}
+
+	//Pixels per block side, 0 for formats atlases can not place texels of, e.g. packed 4:2:2
+	uint32_t GetAtlasBlockSize(DXGI_FORMAT format)
+	{
+		size_t numBytes, rowBytes, numRows;
+		DDSCore::GetSurfaceInfo(4, 4, format, &numBytes, &rowBytes, &numRows);
+		if (numRows == 1) return 4;
+		if (numRows == 4 && rowBytes * 8 == 4 * DDSCore::BitsPerPixel(format)) return 1;
+		return 0;
+	}
+
+	bool WriteDDS(const std::string& path, const DDSTextureDesc& desc, const std::vector<uint8_t>& payload)
+	{
+		std::vector<uint8_t> header;
+		if (DDSCore::BuildHeader(desc, header) != DDS_RESULT_OK) return false;
+		std::filesystem::path filePath = std::filesystem::u8path(path);
+		std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+		if (!file) return false;
+		file.write(reinterpret_cast<const char*>(header.data()), (std::streamsize)header.size());
+		file.write(reinterpret_cast<const char*>(payload.data()), (std::streamsize)payload.size());
+		file.close();
+		if (file.fail())
+		{
+			std::error_code ec;
+			std::filesystem::remove(filePath, ec);
+			return false;
+		}
+		return true;
+	}
+
+	void AddEntry(TexturePack& pack, const std::string& name, uint32_t page, uint32_t slice,
+		float scaleX, float scaleY, float offsetX, float offsetY, TexturePackAddressMode addressMode = TEXTURE_PACK_ADDRESS_WRAP)
+	{
+		TexturePackEntry entry;
+		entry.name = name;
+		entry.page = page;
+		entry.slice = slice;
+		entry.uvScaleOffset[0] = scaleX;
+		entry.uvScaleOffset[1] = scaleY;
+		entry.uvScaleOffset[2] = offsetX;
+		entry.uvScaleOffset[3] = offsetY;
+		entry.addressMode = addressMode;
+		pack.AddEntry(entry);
+	}
+
+	//Shelf packing, tallest first, returns one element list per page
+	std::vector<std::vector<AtlasElement>> PlaceAtlasElements(
+		const std::vector<uint32_t>& candidates,
+		const std::vector<std::unique_ptr<PackSource>>& sources,
+		uint32_t atlasSize,
+		uint32_t gutter)
+	{
+		std::vector<uint32_t> order = candidates;
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) -> bool
+		{
+			if (sources[a]->desc.height != sources[b]->desc.height) return sources[a]->desc.height > sources[b]->desc.height;
+			return sources[a]->desc.width > sources[b]->desc.width;
+		});
+		std::vector<std::vector<AtlasElement>> pages;
+		uint32_t x = 0, shelfY = 0, shelfHeight = 0;
+		for (int i = 0; i < order.size(); ++i)
+		{
+			const DDSTextureDesc& desc = sources[order[i]]->desc;
+			uint32_t width = desc.width + gutter * 2;
+			uint32_t height = desc.height + gutter * 2;
+			if (pages.empty() || x + width > atlasSize)
+			{
+				//Next shelf, or next page once the shelf would run off the bottom
+				shelfY += shelfHeight;
+				x = 0;
+				shelfHeight = 0;
+				if (pages.empty() || shelfY + height > atlasSize)
+				{
+					pages.emplace_back();
+					shelfY = 0;
+				}
+			}
+			AtlasElement element;
+			element.source = order[i];
+			element.x = x;
+			element.y = shelfY;
+			pages.back().push_back(element);
+			x += width;
+			shelfHeight = std::max(shelfHeight, height);
+		}
+		return pages;
+	}
+
+	//Source block a gutter or element block shows, position counted from the gutter's start
+	uint32_t GetGutterSource(int64_t position, uint32_t gutterBlocks, uint32_t blocks, bool wrap)
+	{
+		int64_t x = position - gutterBlocks;
+		if (wrap) return (uint32_t)(((x % blocks) + blocks) % blocks);
+		return (uint32_t)std::min<int64_t>(std::max<int64_t>(x, 0), blocks - 1);
+	}
+
+	//One mip of an atlas page, every element is copied block by block and its gutter is filled
+	//from the opposite edge when wrapping, or by repeating the nearest edge when clamping
+	void BuildAtlasMip(
+		const std::vector<AtlasElement>& elements,
+		const std::vector<std::unique_ptr<PackSource>>& sources,
+		DXGI_FORMAT format,
+		uint32_t blockSize,
+		uint32_t gutter,
+		uint32_t atlasWidth,
+		uint32_t atlasHeight,
+		uint32_t mip,
+		bool wrap,
+		std::vector<uint8_t>& payload)
+	{
+		size_t numBytes, rowBytes, numRows;
+		DDSCore::GetSurfaceInfo(std::max<uint32_t>(atlasWidth >> mip, 1), std::max<uint32_t>(atlasHeight >> mip, 1), format, &numBytes, &rowBytes, &numRows);
+		size_t mipOffset = payload.size();
+		payload.resize(mipOffset + numBytes, 0);
+		uint8_t* dest = payload.data() + mipOffset;
+		size_t blockBytes = rowBytes / ((atlasWidth >> mip) / blockSize);
+		uint32_t gutterBlocks = (gutter >> mip) / blockSize;
+		for (int i = 0; i < elements.size(); ++i)
+		{
+			const PackSource& source = *sources[elements[i].source];
+			//Mip is the same for the only slice, so the subresource index is the mip
+			const DDSSubresource& sub = source.layout.subresources[mip];
+			const uint8_t* src = source.file.GetData() + sub.offset;
+			uint32_t blocksX = (uint32_t)(sub.rowBytes / blockBytes);
+			uint32_t blocksY = (uint32_t)sub.numRows;
+			uint32_t destX = (elements[i].x >> mip) / blockSize;
+			uint32_t destY = (elements[i].y >> mip) / blockSize;
+			for (uint32_t y = 0; y < blocksY + gutterBlocks * 2; ++y)
+			{
+				const uint8_t* srcRow = src + sub.rowBytes * GetGutterSource(y, gutterBlocks, blocksY, wrap);
+				uint8_t* destRow = dest + rowBytes * (destY + y) + blockBytes * destX;
+				for (uint32_t g = 0; g < gutterBlocks; ++g)
+				{
+					memcpy(destRow + blockBytes * g, srcRow + blockBytes * GetGutterSource(g, gutterBlocks, blocksX, wrap), blockBytes);
+					uint32_t rightX = gutterBlocks + blocksX + g;
+					memcpy(destRow + blockBytes * rightX, srcRow + blockBytes * GetGutterSource(rightX, gutterBlocks, blocksX, wrap), blockBytes);
+				}
+				memcpy(destRow + blockBytes * gutterBlocks, srcRow, sub.rowBytes);
+			}
+		}
+	}
+}
+
+bool TexturePacker::Pack(
+	const std::vector<std::string>& sourcePaths,
+	const char* outputDirectory,
+	const char* packPath,
+	const TexturePackSettings& settings,
+	std::string& error)
+{
+	std::vector<std::unique_ptr<PackSource>> sources(sourcePaths.size());
+	for (int i = 0; i < sourcePaths.size(); ++i)
+	{
+		sources[i].reset(new PackSource());
+		PackSource& source = *sources[i];
+		source.path = sourcePaths[i];
+		source.packed = false;
+		if (!source.file.Open(source.path.c_str()) ||
+			DDSCore::ParseHeader(source.file.GetData(), (size_t)source.file.GetSize(), source.desc) != DDS_RESULT_OK ||
+			DDSCore::ComputeLayout(source.desc, 0, source.layout) != DDS_RESULT_OK)
+		{
+			error = source.path;
+			return false;
+		}
+	}
+	std::error_code ec;
+	std::filesystem::create_directories(std::filesystem::u8path(outputDirectory), ec);
+	std::string directory = std::filesystem::u8path(outputDirectory).generic_u8string();
+	TexturePack pack;
+	//Arrays: same format, size and mip count, in source order
+	if (settings.minArraySize > 0)
+	{
+		std::map<std::tuple<uint32_t, uint32_t, uint32_t, uint32_t>, std::vector<uint32_t>> groups;
+		for (uint32_t i = 0; i < sources.size(); ++i)
+		{
+			const DDSTextureDesc& desc = sources[i]->desc;
+			if (IsPlain2D(desc))
+				groups[std::make_tuple((uint32_t)desc.format, desc.width, desc.height, desc.mipCount)].push_back(i);
+		}
+		uint32_t arrayCount = 0;
+		for (auto ite = groups.begin(); ite != groups.end(); ++ite)
+		{
+			const std::vector<uint32_t>& members = ite->second;
+			if (members.size() < std::max<uint32_t>(settings.minArraySize, 2)) continue;
+			DDSTextureDesc desc = sources[members[0]]->desc;
+			desc.arraySize = (uint32_t)members.size();
+			//Slice major, mip minor, the order each source already stores its mips in
+			std::vector<uint8_t> payload;
+			for (int m = 0; m < members.size(); ++m)
+			{
+				const PackSource& source = *sources[members[m]];
+				for (int s = 0; s < source.layout.subresources.size(); ++s)
+				{
+					const DDSSubresource& sub = source.layout.subresources[s];
+					const uint8_t* data = source.file.GetData() + sub.offset;
+					payload.insert(payload.end(), data, data + sub.slicePitch * sub.depth);
+				}
+			}
+			std::string pagePath = directory + "/array" + std::to_string(arrayCount++) + ".dds";
+			if (!WriteDDS(pagePath, desc, payload))
+			{
+				error = pagePath;
+				return false;
+			}
+			uint32_t page = pack.AddPage(TEXTURE_PACK_PAGE_ARRAY, pagePath);
+			for (uint32_t m = 0; m < members.size(); ++m)
+			{
+				sources[members[m]]->packed = true;
+				AddEntry(pack, sources[members[m]]->path, page, m, 1.0f, 1.0f, 0.0f, 0.0f);
+			}
+		}
+	}
+	//Atlases: small leftovers that divide into whole blocks at every kept mip, per format
+	if (settings.maxAtlasElementSize > 0 && settings.atlasMipCount > 0)
+	{
+		std::map<uint32_t, std::vector<uint32_t>> formats;
+		for (uint32_t i = 0; i < sources.size(); ++i)
+		{
+			const DDSTextureDesc& desc = sources[i]->desc;
+			uint32_t blockSize = GetAtlasBlockSize(desc.format);
+			uint32_t gutter = blockSize << (settings.atlasMipCount - 1);
+			if (sources[i]->packed || !IsPlain2D(desc) || blockSize == 0 ||
+				desc.width > settings.maxAtlasElementSize || desc.height > settings.maxAtlasElementSize ||
+				desc.mipCount < settings.atlasMipCount || desc.width % gutter != 0 || desc.height % gutter != 0 ||
+				desc.width + gutter * 2 > settings.atlasSize || desc.height + gutter * 2 > settings.atlasSize)
+				continue;
+			formats[(uint32_t)desc.format].push_back(i);
+		}
+		uint32_t atlasCount = 0;
+		for (auto ite = formats.begin(); ite != formats.end(); ++ite)
+		{
+			DXGI_FORMAT format = (DXGI_FORMAT)ite->first;
+			uint32_t blockSize = GetAtlasBlockSize(format);
+			uint32_t gutter = blockSize << (settings.atlasMipCount - 1);
+			std::vector<std::vector<AtlasElement>> pages = PlaceAtlasElements(ite->second, sources, settings.atlasSize, gutter);
+			for (int p = 0; p < pages.size(); ++p)
+			{
+				const std::vector<AtlasElement>& elements = pages[p];
+				//A lone element gains nothing, it stays a single
+				if (elements.size() < 2) continue;
+				uint32_t height = 0;
+				for (int e = 0; e < elements.size(); ++e)
+					height = std::max(height, elements[e].y + sources[elements[e].source]->desc.height + gutter * 2);
+				DDSTextureDesc desc = sources[elements[0].source]->desc;
+				desc.width = settings.atlasSize;
+				desc.height = height;
+				desc.mipCount = settings.atlasMipCount;
+				std::vector<uint8_t> payload;
+				for (uint32_t mip = 0; mip < desc.mipCount; ++mip)
+					BuildAtlasMip(elements, sources, format, blockSize, gutter, desc.width, desc.height, mip,
+						settings.atlasAddressMode == TEXTURE_PACK_ADDRESS_WRAP, payload);
+				std::string pagePath = directory + "/atlas" + std::to_string(atlasCount++) + ".dds";
+				if (!WriteDDS(pagePath, desc, payload))
+				{
+					error = pagePath;
+					return false;
+				}
+				uint32_t page = pack.AddPage(TEXTURE_PACK_PAGE_ATLAS, pagePath);
+				for (int e = 0; e < elements.size(); ++e)
+				{
+					PackSource& source = *sources[elements[e].source];
+					source.packed = true;
+					AddEntry(pack, source.path, page, 0,
+						(float)source.desc.width / desc.width, (float)source.desc.height / desc.height,
+						(float)(elements[e].x + gutter) / desc.width, (float)(elements[e].y + gutter) / desc.height,
+						settings.atlasAddressMode);
+				}
+			}
+		}
+	}
+	for (int i = 0; i < sources.size(); ++i)
+	{
+		if (sources[i]->packed) continue;
+		uint32_t page = pack.AddPage(TEXTURE_PACK_PAGE_SINGLE, sources[i]->path);
+		AddEntry(pack, sources[i]->path, page, 0, 1.0f, 1.0f, 0.0f, 0.0f);
+	}
+	if (!pack.Write(packPath))
+	{
+		error = packPath;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "TexturePack.h"
+#include <string>
+#include <vector>
+
+struct TexturePackSettings
+{
+	//Sources sharing format, size and mip count become a Texture2DArray once there are this many
+	uint32_t minArraySize = 2;
+	//Remaining sources no larger than this on either axis go into atlases, 0 disables atlases
+	uint32_t maxAtlasElementSize = 256;
+	//Atlas width, must be a power of two, the height is cut down to what is used
+	uint32_t atlasSize = 2048;
+	//Atlases keep this many mips, elements are aligned and surrounded by a gutter of
+	//blockSize << (atlasMipCount - 1) texels, so every kept mip still has a block of gutter
+	uint32_t atlasMipCount = 3;
+	//How atlas gutters are filled, WRAP for materials that tile inside the rectangle as Default.hlsl does
+	TexturePackAddressMode atlasAddressMode = TEXTURE_PACK_ADDRESS_WRAP;
+};
+
+//Offline grouping of DDS files into fewer, larger textures, does not depend on Windows or D3D
+//Pages are written as DDS files next to a TexturePack that maps every source to its page, slice and UV rectangle
+//Sources that do not fit an array or an atlas stay where they are and are listed as single pages
+class TexturePacker
+{
+public:
+	//Pages go to outputDirectory as array<N>.dds and atlas<N>.dds, named with forward slashes
+	//On failure error names the file that could not be read or written
+	static bool Pack(
+		const std::vector<std::string>& sourcePaths,
+		const char* outputDirectory,
+		const char* packPath,
+		const TexturePackSettings& settings,
+		std::string& error);
+};
@@ -0,0 +1,56 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned int threadCount) : stopped(false)
+{
+	workers.reserve(threadCount);
+	for (unsigned int i = 0; i < threadCount; ++i)
+	{
+		workers.emplace_back([this]() -> void { WorkerLoop(); });
+	}
+}
+
+ThreadPool* ThreadPool::GetInstance()
+{
+	//Leave one core to the render thread
+	static unsigned int hardwareCount = std::thread::hardware_concurrency();
+	static ThreadPool instance(hardwareCount > 1 ? hardwareCount - 1 : 1);
+	return &instance;
+}
+
+void ThreadPool::Push(std::function<void()>&& job)
+{
+	{
+		std::lock_guard<std::mutex> lck(jobMtx);
+		jobs.push_back(std::move(job));
+	}
+	jobCV.notify_one();
+}
+
+void ThreadPool::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lck(jobMtx);
+			jobCV.wait(lck, [this]() -> bool { return stopped || !jobs.empty(); });
+			if (stopped && jobs.empty()) return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lck(jobMtx);
+		stopped = true;
+	}
+	jobCV.notify_all();
+	for (int i = 0; i < workers.size(); ++i)
+	{
+		workers[i].join();
+	}
+}
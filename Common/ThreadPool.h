@@ -0,0 +1,112 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <type_traits>
+//Fixed size worker pool shared by CPU side jobs (shader compile, texture decode...)
+//Has no dependency on Direct3D so it can be used by offline tools as well
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex jobMtx;
+	std::condition_variable jobCV;
+	bool stopped;
+	void WorkerLoop();
+	void Push(std::function<void()>&& job);
+public:
+	ThreadPool(unsigned int threadCount);
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	~ThreadPool();
+	unsigned int ThreadCount() const { return (unsigned int)workers.size(); }
+	static ThreadPool* GetInstance();
+	template<typename Func>
+	std::future<std::invoke_result_t<Func>> Execute(Func&& func)
+	{
+		typedef std::invoke_result_t<Func> ReturnType;
+		auto task = std::make_shared<std::packaged_task<ReturnType()>>(std::forward<Func>(func));
+		std::future<ReturnType> result = task->get_future();
+		Push([task]() -> void { (*task)(); });
+		return result;
+	}
+	//Call func(i) for every i in [0, count), blocks until all finished
+	//The calling thread takes part in the work, so nested calls from a worker will not deadlock
+	//It only ever runs batches of this call, never other queued jobs such as file reads or compiles
+	//If func throws, batches not started yet are skipped and the first exception is rethrown here
+	//once every running batch has finished, so func is never called after ParallelFor returned
+	template<typename Func>
+	void ParallelFor(unsigned int count, Func&& func, unsigned int batchSize = 1)
+	{
+		if (count == 0) return;
+		if (batchSize == 0) batchSize = 1;
+		unsigned int batchCount = (count + batchSize - 1) / batchSize;
+		if (batchCount == 1 || workers.empty())
+		{
+			for (unsigned int i = 0; i < count; ++i)
+				func(i);
+			return;
+		}
+		struct ForState
+		{
+			std::atomic<unsigned int> next;
+			std::atomic<unsigned int> finished;
+			std::atomic<bool> failed;
+			//First exception thrown by func, written under mtx
+			std::exception_ptr error;
+			std::mutex mtx;
+			std::condition_variable cv;
+		};
+		std::shared_ptr<ForState> state = std::make_shared<ForState>();
+		state->next = 0;
+		state->finished = 0;
+		state->failed = false;
+		typename std::remove_reference<Func>::type* funcPtr = &func;
+		auto runBatches = [state, funcPtr, count, batchSize, batchCount]() -> void
+		{
+			unsigned int batch;
+			while ((batch = state->next.fetch_add(1)) < batchCount)
+			{
+				unsigned int end = (batch + 1) * batchSize;
+				if (end > count) end = count;
+				//A failed batch still counts as finished, the caller waits for all of them
+				if (!state->failed.load())
+				{
+					try
+					{
+						for (unsigned int i = batch * batchSize; i < end; ++i)
+							(*funcPtr)(i);
+					}
+					catch (...)
+					{
+						std::lock_guard<std::mutex> lck(state->mtx);
+						if (!state->error) state->error = std::current_exception();
+						state->failed = true;
+					}
+				}
+				if (state->finished.fetch_add(1) + 1 == batchCount)
+				{
+					std::lock_guard<std::mutex> lck(state->mtx);
+					state->cv.notify_all();
+				}
+			}
+		};
+		unsigned int helperCount = (unsigned int)workers.size();
+		if (helperCount > batchCount - 1) helperCount = batchCount - 1;
+		for (unsigned int i = 0; i < helperCount; ++i)
+			Push(runBatches);
+		runBatches();
+		//Every batch is claimed once runBatches returns, the rest are already running on workers
+		std::unique_lock<std::mutex> lck(state->mtx);
+		state->cv.wait(lck, [&]() -> bool { return state->finished.load() >= batchCount; });
+		if (state->error) std::rethrow_exception(state->error);
+	}
+};
@@ -0,0 +1,338 @@
+#include "VirtualTexture.h"
+#include <algorithm>
+
+VirtualTexturePageTable::VirtualTexturePageTable(uint32_t width, uint32_t height, uint32_t pageWidth, uint32_t pageHeight, uint32_t tailMip) :
+	mWidth(width),
+	mHeight(height),
+	mPageWidth(pageWidth),
+	mPageHeight(pageHeight),
+	mVersion(0)
+{
+	mLevels.resize(tailMip);
+	for (uint32_t mip = 0; mip < tailMip; ++mip)
+	{
+		Level& level = mLevels[mip];
+		uint32_t mipWidth = std::max(width >> mip, 1u);
+		uint32_t mipHeight = std::max(height >> mip, 1u);
+		level.pagesX = (mipWidth + pageWidth - 1) / pageWidth;
+		level.pagesY = (mipHeight + pageHeight - 1) / pageHeight;
+		level.pages.resize((size_t)level.pagesX * level.pagesY, VIRTUAL_TEXTURE_INVALID_PAGE);
+		level.pending.resize(level.pages.size(), false);
+	}
+}
+
+bool VirtualTexturePageTable::IsValid(uint32_t mip, uint32_t x, uint32_t y) const
+{
+	return mip < mLevels.size() && x < mLevels[mip].pagesX && y < mLevels[mip].pagesY;
+}
+
+uint32_t VirtualTexturePageTable::GetPhysicalPage(uint32_t mip, uint32_t x, uint32_t y) const
+{
+	const Level& level = mLevels[mip];
+	return level.pages[(size_t)y * level.pagesX + x];
+}
+
+bool VirtualTexturePageTable::IsResident(uint32_t mip, uint32_t x, uint32_t y) const
+{
+	const Level& level = mLevels[mip];
+	size_t index = (size_t)y * level.pagesX + x;
+	return level.pages[index] != VIRTUAL_TEXTURE_INVALID_PAGE && !level.pending[index];
+}
+
+bool VirtualTexturePageTable::IsPending(uint32_t mip, uint32_t x, uint32_t y) const
+{
+	const Level& level = mLevels[mip];
+	return level.pending[(size_t)y * level.pagesX + x];
+}
+
+void VirtualTexturePageTable::SetPending(uint32_t mip, uint32_t x, uint32_t y, uint32_t physicalPage)
+{
+	Level& level = mLevels[mip];
+	size_t index = (size_t)y * level.pagesX + x;
+	level.pages[index] = physicalPage;
+	level.pending[index] = true;
+}
+
+void VirtualTexturePageTable::SetResident(uint32_t mip, uint32_t x, uint32_t y)
+{
+	Level& level = mLevels[mip];
+	level.pending[(size_t)y * level.pagesX + x] = false;
+	++mVersion;
+}
+
+void VirtualTexturePageTable::Clear(uint32_t mip, uint32_t x, uint32_t y)
+{
+	Level& level = mLevels[mip];
+	size_t index = (size_t)y * level.pagesX + x;
+	//Pending pages were never part of the residency map
+	if (!level.pending[index]) ++mVersion;
+	level.pages[index] = VIRTUAL_TEXTURE_INVALID_PAGE;
+	level.pending[index] = false;
+}
+
+void VirtualTexturePageTable::GetParent(uint32_t mip, uint32_t x, uint32_t y, uint32_t parentMip, uint32_t& parentX, uint32_t& parentY) const
+{
+	const Level& parent = mLevels[parentMip];
+	parentX = std::min(x >> (parentMip - mip), parent.pagesX - 1);
+	parentY = std::min(y >> (parentMip - mip), parent.pagesY - 1);
+}
+
+void VirtualTexturePageTable::BuildResidencyMap(std::vector<uint8_t>& map) const
+{
+	uint32_t tailMip = GetTailMip();
+	if (tailMip == 0)
+	{
+		map.assign(1, 0);
+		return;
+	}
+	const Level& top = mLevels[0];
+	map.resize((size_t)top.pagesX * top.pagesY);
+	for (uint32_t y = 0; y < top.pagesY; ++y)
+	{
+		for (uint32_t x = 0; x < top.pagesX; ++x)
+		{
+			//Walk down from the tail and stop at the first hole, so every mip above the result is there too
+			uint32_t resident = tailMip;
+			while (resident > 0)
+			{
+				uint32_t parentX, parentY;
+				GetParent(0, x, y, resident - 1, parentX, parentY);
+				if (!IsResident(resident - 1, parentX, parentY)) break;
+				--resident;
+			}
+			map[(size_t)y * top.pagesX + x] = (uint8_t)resident;
+		}
+	}
+}
+
+VirtualTexturePageCache::VirtualTexturePageCache(uint32_t pageCount)
+{
+	Reset(pageCount);
+}
+
+void VirtualTexturePageCache::Reset(uint32_t pageCount)
+{
+	mSlots.resize(pageCount);
+	mFree.resize(pageCount);
+	for (uint32_t i = 0; i < pageCount; ++i)
+	{
+		Slot& slot = mSlots[i];
+		slot.lastUsedFrame = 0;
+		slot.prev = VIRTUAL_TEXTURE_INVALID_PAGE;
+		slot.next = VIRTUAL_TEXTURE_INVALID_PAGE;
+		slot.used = false;
+		slot.pinned = false;
+		//Popped from the back, so slot 0 is handed out first
+		mFree[i] = pageCount - 1 - i;
+	}
+	mHead = VIRTUAL_TEXTURE_INVALID_PAGE;
+	mTail = VIRTUAL_TEXTURE_INVALID_PAGE;
+}
+
+void VirtualTexturePageCache::Unlink(uint32_t slot)
+{
+	Slot& s = mSlots[slot];
+	if (s.prev != VIRTUAL_TEXTURE_INVALID_PAGE) mSlots[s.prev].next = s.next;
+	else mHead = s.next;
+	if (s.next != VIRTUAL_TEXTURE_INVALID_PAGE) mSlots[s.next].prev = s.prev;
+	else mTail = s.prev;
+	s.prev = VIRTUAL_TEXTURE_INVALID_PAGE;
+	s.next = VIRTUAL_TEXTURE_INVALID_PAGE;
+}
+
+void VirtualTexturePageCache::PushBack(uint32_t slot)
+{
+	Slot& s = mSlots[slot];
+	s.prev = mTail;
+	s.next = VIRTUAL_TEXTURE_INVALID_PAGE;
+	if (mTail != VIRTUAL_TEXTURE_INVALID_PAGE) mSlots[mTail].next = slot;
+	else mHead = slot;
+	mTail = slot;
+}
+
+uint32_t VirtualTexturePageCache::Allocate(const VirtualPage& page, uint32_t frame, VirtualPage& evicted, bool& hasEvicted)
+{
+	hasEvicted = false;
+	uint32_t slot = VIRTUAL_TEXTURE_INVALID_PAGE;
+	if (!mFree.empty())
+	{
+		slot = mFree.back();
+		mFree.pop_back();
+	}
+	else
+	{
+		//Use order is touch order, so everything after the first page used this frame was used this frame too
+		for (uint32_t i = mHead; i != VIRTUAL_TEXTURE_INVALID_PAGE && mSlots[i].lastUsedFrame != frame; i = mSlots[i].next)
+		{
+			if (mSlots[i].pinned) continue;
+			slot = i;
+			break;
+		}
+		if (slot == VIRTUAL_TEXTURE_INVALID_PAGE) return slot;
+		evicted = mSlots[slot].page;
+		hasEvicted = true;
+		Unlink(slot);
+	}
+	Slot& s = mSlots[slot];
+	s.page = page;
+	s.lastUsedFrame = frame;
+	s.used = true;
+	s.pinned = false;
+	PushBack(slot);
+	return slot;
+}
+
+void VirtualTexturePageCache::Touch(uint32_t slot, uint32_t frame)
+{
+	mSlots[slot].lastUsedFrame = frame;
+	Unlink(slot);
+	PushBack(slot);
+}
+
+void VirtualTexturePageCache::Free(uint32_t slot)
+{
+	Slot& s = mSlots[slot];
+	if (!s.used) return;
+	Unlink(slot);
+	s.used = false;
+	s.pinned = false;
+	mFree.push_back(slot);
+}
+
+VirtualTextureSystem::VirtualTextureSystem(uint32_t physicalPageCount) :
+	mCache(physicalPageCount),
+	mFrame(0)
+{
+}
+
+void VirtualTextureSystem::Reset(uint32_t physicalPageCount)
+{
+	mTables.clear();
+	mCache.Reset(physicalPageCount);
+	mFrame = 0;
+}
+
+int VirtualTextureSystem::AddTexture(uint32_t width, uint32_t height, uint32_t pageWidth, uint32_t pageHeight, uint32_t tailMip)
+{
+	if (mTables.size() >= VIRTUAL_TEXTURE_MAX_TEXTURES) return -1;
+	mTables.emplace_back(width, height, pageWidth, pageHeight, std::min<uint32_t>(tailMip, VIRTUAL_TEXTURE_MAX_MIPS));
+	return (int)mTables.size() - 1;
+}
+
+uint32_t VirtualTextureSystem::EncodeFeedback(const VirtualPage& page)
+{
+	return (page.texture << 28) | (page.mip << 24) | (page.y << 12) | page.x;
+}
+
+VirtualPage VirtualTextureSystem::DecodeFeedback(uint32_t word)
+{
+	VirtualPage page;
+	page.texture = word >> 28;
+	page.mip = (word >> 24) & 0xf;
+	page.y = (word >> 12) & 0xfff;
+	page.x = word & 0xfff;
+	return page;
+}
+
+void VirtualTextureSystem::ProcessFeedback(const uint32_t* words, size_t count, uint32_t maxLoads, VirtualTextureUpdate& update)
+{
+	update.evictions.clear();
+	update.loads.clear();
+	++mFrame;
+	//Sorting groups repeats, so each page is looked at once with its pixel count
+	mSorted.assign(words, words + count);
+	std::sort(mSorted.begin(), mSorted.end());
+	mCandidates.clear();
+	mTouched.clear();
+	for (size_t i = 0; i < mSorted.size();)
+	{
+		uint32_t word = mSorted[i];
+		uint32_t hits = 0;
+		for (; i < mSorted.size() && mSorted[i] == word; ++i) ++hits;
+		if (word == VIRTUAL_TEXTURE_FEEDBACK_NONE) continue;
+		VirtualPage page = DecodeFeedback(word);
+		if (page.texture >= mTables.size()) continue;
+		const VirtualTexturePageTable& table = mTables[page.texture];
+		//Tail mips are always there
+		if (!table.IsValid(page.mip, page.x, page.y)) continue;
+		//Finest first, so every page is touched before the coarser pages it needs
+		for (uint32_t mip = page.mip; mip < table.GetTailMip(); ++mip)
+		{
+			VirtualPage chain = page;
+			chain.mip = mip;
+			table.GetParent(page.mip, page.x, page.y, mip, chain.x, chain.y);
+			uint32_t physicalPage = table.GetPhysicalPage(mip, chain.x, chain.y);
+			if (physicalPage == VIRTUAL_TEXTURE_INVALID_PAGE)
+			{
+				Candidate candidate;
+				candidate.word = EncodeFeedback(chain);
+				candidate.hits = hits;
+				mCandidates.push_back(candidate);
+			}
+			else if (!table.IsPending(mip, chain.x, chain.y))
+			{
+				mTouched.push_back(physicalPage);
+			}
+		}
+	}
+	//Pages seen this frame can not be evicted for the loads below
+	for (int i = 0; i < mTouched.size(); ++i)
+		mCache.Touch(mTouched[i], mFrame);
+
+	//Several requests share coarse pages, merge them and add up their pixels
+	std::sort(mCandidates.begin(), mCandidates.end(), [](const Candidate& a, const Candidate& b) -> bool { return a.word < b.word; });
+	size_t merged = 0;
+	for (size_t i = 0; i < mCandidates.size(); ++i)
+	{
+		if (merged > 0 && mCandidates[merged - 1].word == mCandidates[i].word)
+			mCandidates[merged - 1].hits += mCandidates[i].hits;
+		else
+			mCandidates[merged++] = mCandidates[i];
+	}
+	mCandidates.resize(merged);
+	//A page is only useful once its coarser pages are there, so coarse mips go first
+	std::sort(mCandidates.begin(), mCandidates.end(), [](const Candidate& a, const Candidate& b) -> bool
+	{
+		uint32_t mipA = (a.word >> 24) & 0xf;
+		uint32_t mipB = (b.word >> 24) & 0xf;
+		if (mipA != mipB) return mipA > mipB;
+		if (a.hits != b.hits) return a.hits > b.hits;
+		return a.word < b.word;
+	});
+	for (size_t i = 0; i < mCandidates.size() && update.loads.size() < maxLoads; ++i)
+	{
+		VirtualPageLoad load;
+		load.page = DecodeFeedback(mCandidates[i].word);
+		VirtualPage evicted;
+		bool hasEvicted;
+		load.physicalPage = mCache.Allocate(load.page, mFrame, evicted, hasEvicted);
+		//Everything left is needed this frame, the rest waits for pages to fall out of view
+		if (load.physicalPage == VIRTUAL_TEXTURE_INVALID_PAGE) break;
+		if (hasEvicted)
+		{
+			mTables[evicted.texture].Clear(evicted.mip, evicted.x, evicted.y);
+			VirtualPageLoad eviction;
+			eviction.page = evicted;
+			eviction.physicalPage = load.physicalPage;
+			update.evictions.push_back(eviction);
+		}
+		mCache.Pin(load.physicalPage);
+		mTables[load.page.texture].SetPending(load.page.mip, load.page.x, load.page.y, load.physicalPage);
+		update.loads.push_back(load);
+	}
+	//Again after the loads, so coarser pages stay more recent than the finer ones that need them
+	for (int i = 0; i < mTouched.size(); ++i)
+		mCache.Touch(mTouched[i], mFrame);
+}
+
+void VirtualTextureSystem::CompleteLoad(const VirtualPageLoad& load)
+{
+	mCache.Unpin(load.physicalPage);
+	mTables[load.page.texture].SetResident(load.page.mip, load.page.x, load.page.y);
+}
+
+void VirtualTextureSystem::CancelLoad(const VirtualPageLoad& load)
+{
+	mCache.Free(load.physicalPage);
+	mTables[load.page.texture].Clear(load.page.mip, load.page.x, load.page.y);
+}
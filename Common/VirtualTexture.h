@@ -0,0 +1,161 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+//CPU side of sparse virtual texturing, does not depend on Windows or D3D
+//A feedback pass writes one word per sampled page, ProcessFeedback turns the readback into
+//page loads and evictions for a fixed pool of physical pages, least recently used first
+//Whoever owns the GPU resources maps and fills the pages, then calls CompleteLoad
+//Mips from a texture's tail mip on are always resident and never show up here
+
+//Feedback word: texture in bits 28-31, mip in 24-27, page y in 12-23, page x in 0-11
+//Must match EncodeVirtualTextureFeedback in Shaders/VirtualTexture.hlsl
+#define VIRTUAL_TEXTURE_MAX_TEXTURES 16
+#define VIRTUAL_TEXTURE_MAX_MIPS 16
+#define VIRTUAL_TEXTURE_MAX_PAGES 4096
+//Value the feedback buffer is cleared to, pixels that sampled no virtual texture keep it
+#define VIRTUAL_TEXTURE_FEEDBACK_NONE 0xffffffff
+#define VIRTUAL_TEXTURE_INVALID_PAGE 0xffffffff
+
+struct VirtualPage
+{
+	uint32_t texture;
+	uint32_t mip;
+	uint32_t x;
+	uint32_t y;
+};
+
+struct VirtualPageLoad
+{
+	VirtualPage page;
+	//Slot in the physical page pool
+	uint32_t physicalPage;
+};
+
+//What the caller has to do on the GPU after ProcessFeedback
+struct VirtualTextureUpdate
+{
+	//Unmap these first, their physical pages are reused by loads
+	std::vector<VirtualPageLoad> evictions;
+	//Coarser mips first, map and fill these then call CompleteLoad or CancelLoad for each
+	std::vector<VirtualPageLoad> loads;
+};
+
+//Which physical page, if any, holds every page of the tiled mips of one texture
+class VirtualTexturePageTable
+{
+private:
+	struct Level
+	{
+		uint32_t pagesX;
+		uint32_t pagesY;
+		//Physical page, VIRTUAL_TEXTURE_INVALID_PAGE when not mapped
+		std::vector<uint32_t> pages;
+		//Mapped but not filled yet
+		std::vector<bool> pending;
+	};
+	std::vector<Level> mLevels;
+	uint32_t mWidth;
+	uint32_t mHeight;
+	uint32_t mPageWidth;
+	uint32_t mPageHeight;
+	//Bumped whenever a page becomes resident or is evicted
+	uint32_t mVersion;
+public:
+	VirtualTexturePageTable(uint32_t width, uint32_t height, uint32_t pageWidth, uint32_t pageHeight, uint32_t tailMip);
+	uint32_t GetWidth() const { return mWidth; }
+	uint32_t GetHeight() const { return mHeight; }
+	uint32_t GetPageWidth() const { return mPageWidth; }
+	uint32_t GetPageHeight() const { return mPageHeight; }
+	//Mips before it are paged
+	uint32_t GetTailMip() const { return (uint32_t)mLevels.size(); }
+	uint32_t GetPagesX(uint32_t mip) const { return mLevels[mip].pagesX; }
+	uint32_t GetPagesY(uint32_t mip) const { return mLevels[mip].pagesY; }
+	uint32_t GetVersion() const { return mVersion; }
+	bool IsValid(uint32_t mip, uint32_t x, uint32_t y) const;
+	uint32_t GetPhysicalPage(uint32_t mip, uint32_t x, uint32_t y) const;
+	bool IsResident(uint32_t mip, uint32_t x, uint32_t y) const;
+	bool IsPending(uint32_t mip, uint32_t x, uint32_t y) const;
+	void SetPending(uint32_t mip, uint32_t x, uint32_t y, uint32_t physicalPage);
+	void SetResident(uint32_t mip, uint32_t x, uint32_t y);
+	void Clear(uint32_t mip, uint32_t x, uint32_t y);
+	//Page of mip parentMip covering page (x, y) of mip, clamped for sizes that are not a power of two
+	void GetParent(uint32_t mip, uint32_t x, uint32_t y, uint32_t parentMip, uint32_t& parentX, uint32_t& parentY) const;
+	//One byte per page of mip 0: the most detailed mip resident there together with every coarser one
+	//Used as the minimum LOD so sampling never reaches an unmapped tile
+	void BuildResidencyMap(std::vector<uint8_t>& map) const;
+};
+
+//Fixed pool of physical pages handed out least recently used first
+class VirtualTexturePageCache
+{
+private:
+	struct Slot
+	{
+		VirtualPage page;
+		uint32_t lastUsedFrame;
+		//Doubly linked use order, head is the least recently used
+		uint32_t prev;
+		uint32_t next;
+		bool used;
+		//Waiting for its load, can not be evicted
+		bool pinned;
+	};
+	std::vector<Slot> mSlots;
+	std::vector<uint32_t> mFree;
+	uint32_t mHead;
+	uint32_t mTail;
+	void Unlink(uint32_t slot);
+	void PushBack(uint32_t slot);
+public:
+	explicit VirtualTexturePageCache(uint32_t pageCount = 0);
+	void Reset(uint32_t pageCount);
+	uint32_t GetPageCount() const { return (uint32_t)mSlots.size(); }
+	uint32_t GetUsedCount() const { return (uint32_t)(mSlots.size() - mFree.size()); }
+	//A free slot, else the least recently used one not used in frame and not pinned
+	//Returns VIRTUAL_TEXTURE_INVALID_PAGE when every slot is needed this frame
+	uint32_t Allocate(const VirtualPage& page, uint32_t frame, VirtualPage& evicted, bool& hasEvicted);
+	void Touch(uint32_t slot, uint32_t frame);
+	void Pin(uint32_t slot) { mSlots[slot].pinned = true; }
+	void Unpin(uint32_t slot) { mSlots[slot].pinned = false; }
+	void Free(uint32_t slot);
+	const VirtualPage& GetPage(uint32_t slot) const { return mSlots[slot].page; }
+};
+
+//Page tables of every virtual texture sharing one physical page pool
+//Render thread only
+class VirtualTextureSystem
+{
+private:
+	struct Candidate
+	{
+		uint32_t word;
+		uint32_t hits;
+	};
+	std::vector<VirtualTexturePageTable> mTables;
+	VirtualTexturePageCache mCache;
+	uint32_t mFrame;
+	//Kept between frames so analysis does not allocate
+	std::vector<uint32_t> mSorted;
+	std::vector<Candidate> mCandidates;
+	std::vector<uint32_t> mTouched;
+public:
+	explicit VirtualTextureSystem(uint32_t physicalPageCount = 0);
+	//Drops every texture and empties the pool
+	void Reset(uint32_t physicalPageCount);
+	//Returns the id written into feedback words, -1 once VIRTUAL_TEXTURE_MAX_TEXTURES are added
+	int AddTexture(uint32_t width, uint32_t height, uint32_t pageWidth, uint32_t pageHeight, uint32_t tailMip);
+	uint32_t GetTextureCount() const { return (uint32_t)mTables.size(); }
+	const VirtualTexturePageTable& GetPageTable(uint32_t texture) const { return mTables[texture]; }
+	const VirtualTexturePageCache& GetCache() const { return mCache; }
+	static uint32_t EncodeFeedback(const VirtualPage& page);
+	static VirtualPage DecodeFeedback(uint32_t word);
+	//Once per frame with the latest feedback readback, words may repeat and be in any order
+	//Every page a word asks for keeps its coarser pages, missing ones are loaded coarsest first,
+	//pages asked for by more pixels first within a mip, at most maxLoads of them
+	void ProcessFeedback(const uint32_t* words, size_t count, uint32_t maxLoads, VirtualTextureUpdate& update);
+	//The page's texels are on the GPU, it now counts as resident
+	void CompleteLoad(const VirtualPageLoad& load);
+	//The page could not be filled, its physical page goes back to the pool
+	void CancelLoad(const VirtualPageLoad& load);
+};
@@ -0,0 +1,292 @@
+#include "VirtualTextureFile.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+static_assert(sizeof(VirtualTextureFileHeader) == 88, "VirtualTextureFileHeader layout changed");
+static_assert(sizeof(VirtualTextureFileLevel) == 24, "VirtualTextureFileLevel layout changed");
+static_assert(sizeof(VirtualTextureFileTailMip) == 32, "VirtualTextureFileTailMip layout changed");
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool IsRangeInFile(uint64_t offset, uint64_t size, uint64_t fileSize)
+{
+	return offset <= fileSize && size <= fileSize - offset;
+}
+
+static bool IsBlockCompressed(DXGI_FORMAT format)
+{
+	return (format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM) ||
+		(format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+}
+
+VirtualTextureFile::VirtualTextureFile() :
+	mHeader(nullptr),
+	mLevels(nullptr),
+	mTailMips(nullptr)
+{
+}
+
+bool VirtualTextureFile::Open(const char* path)
+{
+	Close();
+	if (!mFile.Open(path)) return false;
+	if (!Validate())
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool VirtualTextureFile::Open(const wchar_t* path)
+{
+	Close();
+	if (!mFile.Open(path)) return false;
+	if (!Validate())
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void VirtualTextureFile::Close()
+{
+	mFile.Close();
+	mHeader = nullptr;
+	mLevels = nullptr;
+	mTailMips = nullptr;
+}
+
+bool VirtualTextureFile::Validate()
+{
+	const uint8_t* data = mFile.GetData();
+	uint64_t fileSize = mFile.GetSize();
+	if (fileSize < sizeof(VirtualTextureFileHeader)) return false;
+	const VirtualTextureFileHeader* header = reinterpret_cast<const VirtualTextureFileHeader*>(data);
+	if (header->magic != VirtualTextureFileHeader::MAGIC || header->version != VirtualTextureFileHeader::VERSION) return false;
+	uint32_t tileWidth, tileHeight;
+	if (!GetTileShape((DXGI_FORMAT)header->format, tileWidth, tileHeight) ||
+		tileWidth != header->tileWidth || tileHeight != header->tileHeight ||
+		(uint64_t)header->tileRowPitch * header->tileRows != VIRTUAL_TEXTURE_TILE_SIZE)
+		return false;
+	//The tail is what is shown until tiles arrive, so there always is one
+	if (header->mipCount == 0 || header->mipCount > 16 || header->tailMip >= header->mipCount) return false;
+	if (header->levelOffset % 8 != 0 || header->tailMipOffset % 8 != 0 || header->tileOffset % VIRTUAL_TEXTURE_TILE_SIZE != 0) return false;
+	if (!IsRangeInFile(header->levelOffset, (uint64_t)header->tailMip * sizeof(VirtualTextureFileLevel), fileSize) ||
+		!IsRangeInFile(header->tailMipOffset, (uint64_t)(header->mipCount - header->tailMip) * sizeof(VirtualTextureFileTailMip), fileSize) ||
+		!IsRangeInFile(header->tileOffset, (uint64_t)header->tileCount * VIRTUAL_TEXTURE_TILE_SIZE, fileSize) ||
+		!IsRangeInFile(header->tailOffset, header->tailSize, fileSize))
+		return false;
+	const VirtualTextureFileLevel* levels = reinterpret_cast<const VirtualTextureFileLevel*>(data + header->levelOffset);
+	const VirtualTextureFileTailMip* tailMips = reinterpret_cast<const VirtualTextureFileTailMip*>(data + header->tailMipOffset);
+	for (uint32_t mip = 0; mip < header->tailMip; ++mip)
+	{
+		const VirtualTextureFileLevel& level = levels[mip];
+		if (level.width < tileWidth || level.height < tileHeight) return false;
+		if (level.pagesX != (level.width + tileWidth - 1) / tileWidth || level.pagesY != (level.height + tileHeight - 1) / tileHeight) return false;
+		if ((uint64_t)level.firstTile + (uint64_t)level.pagesX * level.pagesY > header->tileCount) return false;
+	}
+	for (uint32_t mip = 0; mip < header->mipCount - header->tailMip; ++mip)
+	{
+		const VirtualTextureFileTailMip& tail = tailMips[mip];
+		if (tail.numRows == 0 || tail.rowBytes > tail.rowPitch || tail.offset % VIRTUAL_TEXTURE_PLACEMENT_ALIGNMENT != 0) return false;
+		if (!IsRangeInFile(tail.offset, (uint64_t)tail.rowPitch * tail.numRows, header->tailSize)) return false;
+	}
+	mHeader = header;
+	mLevels = levels;
+	mTailMips = tailMips;
+	return true;
+}
+
+void VirtualTextureFile::ReadTile(uint32_t mip, uint32_t pageX, uint32_t pageY, uint8_t* dest) const
+{
+	const VirtualTextureFileLevel& level = mLevels[mip];
+	uint64_t tile = level.firstTile + (uint64_t)pageY * level.pagesX + pageX;
+	memcpy(dest, mFile.GetData() + mHeader->tileOffset + tile * VIRTUAL_TEXTURE_TILE_SIZE, VIRTUAL_TEXTURE_TILE_SIZE);
+}
+
+void VirtualTextureFile::PrefetchTile(uint32_t mip, uint32_t pageX, uint32_t pageY) const
+{
+	const VirtualTextureFileLevel& level = mLevels[mip];
+	uint64_t tile = level.firstTile + (uint64_t)pageY * level.pagesX + pageX;
+	mFile.Prefetch(mHeader->tileOffset + tile * VIRTUAL_TEXTURE_TILE_SIZE, VIRTUAL_TEXTURE_TILE_SIZE);
+}
+
+bool VirtualTextureFile::GetTileShape(DXGI_FORMAT format, uint32_t& tileWidth, uint32_t& tileHeight)
+{
+	//Planar and packed video formats have no standard tile shape
+	if (format == DXGI_FORMAT_R8G8_B8G8_UNORM || format == DXGI_FORMAT_G8R8_G8B8_UNORM || format >= DXGI_FORMAT_AYUV)
+		return false;
+	size_t bitsPerPixel = DDSCore::BitsPerPixel(format);
+	uint32_t blockSize = IsBlockCompressed(format) ? 4 : 1;
+	uint32_t blockBytes = (uint32_t)(bitsPerPixel * blockSize * blockSize / 8);
+	//Sub-byte and 96 bit formats fall through to default
+	//64KB of blocks, twice as wide as high when the block count is not a square
+	uint32_t blocksWide;
+	switch (blockBytes)
+	{
+	case 1: blocksWide = 256; break;
+	case 2: blocksWide = 256; break;
+	case 4: blocksWide = 128; break;
+	case 8: blocksWide = 128; break;
+	case 16: blocksWide = 64; break;
+	default: return false;
+	}
+	tileWidth = blocksWide * blockSize;
+	tileHeight = VIRTUAL_TEXTURE_TILE_SIZE / blockBytes / blocksWide * blockSize;
+	return true;
+}
+
+static bool WriteBytes(std::ofstream& file, const void* data, size_t size)
+{
+	if (size > 0) file.write(reinterpret_cast<const char*>(data), (std::streamsize)size);
+	return file.good();
+}
+
+static bool WritePadding(std::ofstream& file, uint64_t& position, uint64_t alignment)
+{
+	static const uint8_t zeros[VIRTUAL_TEXTURE_PLACEMENT_ALIGNMENT] = {};
+	uint64_t aligned = AlignUp(position, alignment);
+	while (position < aligned)
+	{
+		size_t padding = (size_t)std::min<uint64_t>(aligned - position, sizeof(zeros));
+		if (!WriteBytes(file, zeros, padding)) return false;
+		position += padding;
+	}
+	return true;
+}
+
+bool VirtualTextureFile::Build(const char* sourcePath, const char* destPath, std::string& error)
+{
+	MappedFile source;
+	DDSTextureDesc desc;
+	DDSLayout layout;
+	if (!source.Open(sourcePath) ||
+		DDSCore::ParseHeader(source.GetData(), (size_t)source.GetSize(), desc) != DDS_RESULT_OK ||
+		DDSCore::ComputeLayout(desc, 0, layout) != DDS_RESULT_OK)
+	{
+		error = std::string("Can not read ") + sourcePath;
+		return false;
+	}
+	uint32_t tileWidth, tileHeight;
+	if (desc.dimension != DDS_DIMENSION_TEXTURE2D || desc.arraySize != 1 || desc.isCubeMap ||
+		!GetTileShape(desc.format, tileWidth, tileHeight))
+	{
+		error = std::string("Not a plain 2D texture in a tileable format: ") + sourcePath;
+		return false;
+	}
+	VirtualTextureFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = VirtualTextureFileHeader::MAGIC;
+	header.version = VirtualTextureFileHeader::VERSION;
+	header.format = (uint32_t)desc.format;
+	header.width = desc.width;
+	header.height = desc.height;
+	header.mipCount = desc.mipCount;
+	header.tileWidth = tileWidth;
+	header.tileHeight = tileHeight;
+	uint32_t blockSize = IsBlockCompressed(desc.format) ? 4 : 1;
+	header.tileRows = tileHeight / blockSize;
+	header.tileRowPitch = VIRTUAL_TEXTURE_TILE_SIZE / header.tileRows;
+	header.tailMip = 0;
+	while (header.tailMip < desc.mipCount &&
+		layout.subresources[header.tailMip].width >= tileWidth &&
+		layout.subresources[header.tailMip].height >= tileHeight)
+		++header.tailMip;
+	if (header.tailMip == desc.mipCount)
+	{
+		error = std::string("The smallest mip does not fit a tile, import with mips: ") + sourcePath;
+		return false;
+	}
+	std::vector<VirtualTextureFileLevel> levels(header.tailMip);
+	for (uint32_t mip = 0; mip < header.tailMip; ++mip)
+	{
+		VirtualTextureFileLevel& level = levels[mip];
+		level.width = layout.subresources[mip].width;
+		level.height = layout.subresources[mip].height;
+		level.pagesX = (level.width + tileWidth - 1) / tileWidth;
+		level.pagesY = (level.height + tileHeight - 1) / tileHeight;
+		level.firstTile = header.tileCount;
+		level.padding = 0;
+		header.tileCount += level.pagesX * level.pagesY;
+	}
+	std::vector<VirtualTextureFileTailMip> tailMips(desc.mipCount - header.tailMip);
+	for (int i = 0; i < tailMips.size(); ++i)
+	{
+		const DDSSubresource& src = layout.subresources[header.tailMip + i];
+		VirtualTextureFileTailMip& tail = tailMips[i];
+		tail.offset = AlignUp(header.tailSize, VIRTUAL_TEXTURE_PLACEMENT_ALIGNMENT);
+		tail.rowPitch = (uint32_t)AlignUp(src.rowBytes, VIRTUAL_TEXTURE_PITCH_ALIGNMENT);
+		tail.rowBytes = (uint32_t)src.rowBytes;
+		tail.numRows = (uint32_t)src.numRows;
+		tail.width = (uint32_t)AlignUp(src.width, blockSize);
+		tail.height = (uint32_t)AlignUp(src.height, blockSize);
+		tail.padding = 0;
+		header.tailSize = tail.offset + (uint64_t)tail.rowPitch * tail.numRows;
+	}
+	header.levelOffset = sizeof(VirtualTextureFileHeader);
+	header.tailMipOffset = header.levelOffset + levels.size() * sizeof(VirtualTextureFileLevel);
+	header.tileOffset = AlignUp(header.tailMipOffset + tailMips.size() * sizeof(VirtualTextureFileTailMip), VIRTUAL_TEXTURE_TILE_SIZE);
+	header.tailOffset = AlignUp(header.tileOffset + (uint64_t)header.tileCount * VIRTUAL_TEXTURE_TILE_SIZE, VIRTUAL_TEXTURE_PLACEMENT_ALIGNMENT);
+
+	std::filesystem::path filePath = std::filesystem::u8path(destPath);
+	std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+	bool ok = (bool)file;
+	uint64_t position = 0;
+	ok = ok && WriteBytes(file, &header, sizeof(header));
+	ok = ok && WriteBytes(file, levels.data(), levels.size() * sizeof(VirtualTextureFileLevel));
+	ok = ok && WriteBytes(file, tailMips.data(), tailMips.size() * sizeof(VirtualTextureFileTailMip));
+	position = header.tailMipOffset + tailMips.size() * sizeof(VirtualTextureFileTailMip);
+	ok = ok && WritePadding(file, position, VIRTUAL_TEXTURE_TILE_SIZE);
+	//Texels past the edge of a mip are left zero, they are never sampled
+	std::vector<uint8_t> tile(VIRTUAL_TEXTURE_TILE_SIZE);
+	for (uint32_t mip = 0; ok && mip < header.tailMip; ++mip)
+	{
+		const VirtualTextureFileLevel& level = levels[mip];
+		const DDSSubresource& src = layout.subresources[mip];
+		const uint8_t* srcData = source.GetData() + src.offset;
+		for (uint32_t y = 0; ok && y < level.pagesY; ++y)
+		{
+			for (uint32_t x = 0; ok && x < level.pagesX; ++x)
+			{
+				memset(tile.data(), 0, tile.size());
+				size_t columnStart = (size_t)x * header.tileRowPitch;
+				size_t columnBytes = std::min<size_t>(header.tileRowPitch, src.rowBytes - columnStart);
+				for (uint32_t row = 0; row < header.tileRows; ++row)
+				{
+					size_t srcRow = (size_t)y * header.tileRows + row;
+					if (srcRow >= src.numRows) break;
+					memcpy(tile.data() + (size_t)row * header.tileRowPitch, srcData + srcRow * src.rowBytes + columnStart, columnBytes);
+				}
+				ok = WriteBytes(file, tile.data(), tile.size());
+				position += tile.size();
+			}
+		}
+	}
+	ok = ok && WritePadding(file, position, VIRTUAL_TEXTURE_PLACEMENT_ALIGNMENT);
+	std::vector<uint8_t> tail((size_t)header.tailSize, 0);
+	for (int i = 0; i < tailMips.size(); ++i)
+	{
+		const DDSSubresource& src = layout.subresources[header.tailMip + i];
+		const VirtualTextureFileTailMip& mip = tailMips[i];
+		for (uint32_t row = 0; row < mip.numRows; ++row)
+			memcpy(tail.data() + mip.offset + (size_t)row * mip.rowPitch, source.GetData() + src.offset + row * src.rowBytes, src.rowBytes);
+	}
+	ok = ok && WriteBytes(file, tail.data(), tail.size());
+	file.close();
+	if (file.fail()) ok = false;
+	if (!ok)
+	{
+		std::error_code ec;
+		std::filesystem::remove(filePath, ec);
+		error = std::string("Can not write ") + destPath;
+	}
+	return ok;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include "DDSCore.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+//Tile source for virtual textures, built offline from a DDS file with a full mip chain
+//Mips at least one tile wide and high are cut into 64KB tiles in the D3D12 standard tile shape,
+//every tile is stored whole and 64KB aligned so loading one is a single aligned read
+//Smaller mips form the tail, stored like TextureArchive payloads and always kept resident
+//Layout: header, levels, tail mips, tiles, tail; all values are little endian
+
+//Same value as D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES
+#define VIRTUAL_TEXTURE_TILE_SIZE 65536
+//Same values as D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT and D3D12_TEXTURE_DATA_PITCH_ALIGNMENT
+#define VIRTUAL_TEXTURE_PLACEMENT_ALIGNMENT 512
+#define VIRTUAL_TEXTURE_PITCH_ALIGNMENT 256
+
+struct VirtualTextureFileHeader
+{
+	static const uint32_t MAGIC = 0x5854564d;	//"MVTX"
+	static const uint32_t VERSION = 1;
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipCount;
+	//Texels covered by one tile
+	uint32_t tileWidth;
+	uint32_t tileHeight;
+	//Rows of blocks in a tile are tileRowPitch apart, tileRowPitch * tileRows is the tile size
+	uint32_t tileRowPitch;
+	uint32_t tileRows;
+	//First mip stored in the tail, mips before it are tiled
+	uint32_t tailMip;
+	uint32_t tileCount;
+	uint64_t levelOffset;
+	uint64_t tailMipOffset;
+	uint64_t tileOffset;
+	uint64_t tailOffset;
+	uint64_t tailSize;
+};
+
+//One per tiled mip
+struct VirtualTextureFileLevel
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t pagesX;
+	uint32_t pagesY;
+	//Tiles of the mip are stored row by row from here
+	uint32_t firstTile;
+	uint32_t padding;
+};
+
+//One per tail mip, laid out for a copy from upload memory
+struct VirtualTextureFileTailMip
+{
+	//From the start of the tail, placement aligned
+	uint64_t offset;
+	uint32_t rowPitch;
+	uint32_t rowBytes;
+	uint32_t numRows;
+	//Footprint size, rounded up to whole blocks for block compressed formats
+	uint32_t width;
+	uint32_t height;
+	uint32_t padding;
+};
+
+class VirtualTextureFile
+{
+private:
+	MappedFile mFile;
+	const VirtualTextureFileHeader* mHeader;
+	const VirtualTextureFileLevel* mLevels;
+	const VirtualTextureFileTailMip* mTailMips;
+	bool Validate();
+public:
+	VirtualTextureFile();
+	VirtualTextureFile(const VirtualTextureFile&) = delete;
+	VirtualTextureFile& operator=(const VirtualTextureFile&) = delete;
+	//Maps the file and checks every table, tile reads are not checked again
+	bool Open(const char* path);
+	bool Open(const wchar_t* path);
+	void Close();
+	bool IsOpen() const { return mHeader != nullptr; }
+	const VirtualTextureFileHeader& GetHeader() const { return *mHeader; }
+	const VirtualTextureFileLevel& GetLevel(uint32_t mip) const { return mLevels[mip]; }
+	//mip counts from the first tail mip
+	const VirtualTextureFileTailMip& GetTailMip(uint32_t mip) const { return mTailMips[mip]; }
+	const uint8_t* GetTailData() const { return mFile.GetData() + mHeader->tailOffset; }
+	//Copies a whole VIRTUAL_TEXTURE_TILE_SIZE tile, safe to call from several threads at once
+	void ReadTile(uint32_t mip, uint32_t pageX, uint32_t pageY, uint8_t* dest) const;
+	//Asks the OS to start reading a tile in ahead of ReadTile
+	void PrefetchTile(uint32_t mip, uint32_t pageX, uint32_t pageY) const;
+	//Texels in a tile of the standard tile shape, false for formats virtual textures do not support
+	static bool GetTileShape(DXGI_FORMAT format, uint32_t& tileWidth, uint32_t& tileHeight);
+	//Cuts a 2D DDS file into tiles, the last mip has to fit a single tile
+	//On failure error says which file could not be read or written and why
+	static bool Build(const char* sourcePath, const char* destPath, std::string& error);
+};
@@ -0,0 +1,100 @@
+#include "XXHash64.h"
+#include <cstring>
+
+namespace
+{
+	const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+	const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+	const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+	const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+	const uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+	inline uint64_t RotateLeft(uint64_t v, int bits)
+	{
+		return (v << bits) | (v >> (64 - bits));
+	}
+
+	//Little endian loads, memcpy keeps unaligned reads legal
+	inline uint64_t Read64(const uint8_t* p)
+	{
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline uint32_t Read32(const uint8_t* p)
+	{
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline uint64_t Round(uint64_t acc, uint64_t input)
+	{
+		acc += input * PRIME2;
+		acc = RotateLeft(acc, 31);
+		return acc * PRIME1;
+	}
+
+	inline uint64_t MergeRound(uint64_t acc, uint64_t v)
+	{
+		acc ^= Round(0, v);
+		return acc * PRIME1 + PRIME4;
+	}
+}
+
+uint64_t XXHash64::Hash(const void* data, size_t size, uint64_t seed)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	const uint8_t* end = p + size;
+	uint64_t h;
+	if (size >= 32)
+	{
+		//Four independent lanes over 32 byte stripes
+		uint64_t v1 = seed + PRIME1 + PRIME2;
+		uint64_t v2 = seed + PRIME2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - PRIME1;
+		const uint8_t* limit = end - 32;
+		do
+		{
+			v1 = Round(v1, Read64(p));
+			v2 = Round(v2, Read64(p + 8));
+			v3 = Round(v3, Read64(p + 16));
+			v4 = Round(v4, Read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+		h = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+		h = MergeRound(h, v1);
+		h = MergeRound(h, v2);
+		h = MergeRound(h, v3);
+		h = MergeRound(h, v4);
+	}
+	else
+	{
+		h = seed + PRIME5;
+	}
+	h += (uint64_t)size;
+	for (; p + 8 <= end; p += 8)
+	{
+		h ^= Round(0, Read64(p));
+		h = RotateLeft(h, 27) * PRIME1 + PRIME4;
+	}
+	if (p + 4 <= end)
+	{
+		h ^= (uint64_t)Read32(p) * PRIME1;
+		h = RotateLeft(h, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	for (; p < end; ++p)
+	{
+		h ^= (*p) * PRIME5;
+		h = RotateLeft(h, 11) * PRIME1;
+	}
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
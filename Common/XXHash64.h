@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+//64 bit xxHash (XXH64), gives the same values as the reference implementation
+//Fast non-cryptographic hash for content keys, not for anything an attacker controls
+class XXHash64
+{
+public:
+	static uint64_t Hash(const void* data, size_t size, uint64_t seed = 0);
+};
@@ -28,6 +28,8 @@
 #include "d3dx12.h"
 #include "DDSTextureLoader.h"
 #include "MathHelper.h"
+#include "ResidencyTracker.h"
+#include "Symbol.h"
 
 extern const int gNumFrameResources;
 
@@ -160,7 +162,7 @@ struct SubmeshGeometry
 struct MeshGeometry
 {
 	// Give it a name so we can look it up by name.
-	std::string Name;
+	Symbol Name;
 
 	// System memory copies.  Use Blobs because the vertex/index format can be generic.
 	// It is up to the client to cast appropriately.  
@@ -169,9 +171,9 @@ struct MeshGeometry
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferGPU = nullptr;
 	Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferGPU = nullptr;
-
-	Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferUploader = nullptr;
-	Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferUploader = nullptr;
+	// Registered with ResidencyManager, marked used whenever the geometry is drawn.
+	ResidencyHandle VertexBufferResidency;
+	ResidencyHandle IndexBufferResidency;
 
     // Data about the buffers.
 	UINT VertexByteStride = 0;
@@ -182,7 +184,7 @@ struct MeshGeometry
 	// A MeshGeometry may store multiple geometries in one vertex/index buffer.
 	// Use this container to define the Submesh geometries so we can draw
 	// the Submeshes individually.
-	std::unordered_map<std::string, SubmeshGeometry> DrawArgs;
+	std::unordered_map<Symbol, SubmeshGeometry> DrawArgs;
 
 	D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const
 	{
@@ -203,13 +205,6 @@ struct MeshGeometry
 
 		return ibv;
 	}
-
-	// We can free this memory after we finish upload to the GPU.
-	void DisposeUploaders()
-	{
-		VertexBufferUploader = nullptr;
-		IndexBufferUploader = nullptr;
-	}
 };
 
 struct Light
@@ -232,6 +227,14 @@ struct MaterialConstants
 
 	// Used in texture mapping.
 	DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4x4();
+
+	// Rectangle of the diffuse map inside its slice, uv * xy + zw, see TexturePack.
+	DirectX::XMFLOAT4 DiffuseUVRemap = { 1.0f, 1.0f, 0.0f, 0.0f };
+	// Descriptor of the texture array the diffuse map lives in and its slice.
+	UINT DiffuseMapIndex = 0;
+	UINT DiffuseMapSlice = 0;
+	UINT MatPad0 = 0;
+	UINT MatPad1 = 0;
 };
 
 // Simple struct to represent a material for our demos.  A production 3D engine
@@ -3,6 +3,7 @@
 //***************************************************************************************
 #include "RenderComponent/Shader.h"
 #include "RenderComponent/Material.h"
+#include "RenderComponent/MaterialInstance.h"
 #include "Common/d3dApp.h"
 #include "Common/MathHelper.h"
 #include "RenderComponent/UploadBuffer.h"
@@ -12,7 +13,22 @@
 #include "RenderComponent/Texture2D.h"
 #include "Singleton/MeshLayout.h"
 #include "Singleton/PSOContainer.h"
+#include "Singleton/DeferredReleaseQueue.h"
+#include "Singleton/TextureStreamer.h"
+#include "Singleton/TextureResidency.h"
+#include "Singleton/TextureCache.h"
+#include "Singleton/UploadManager.h"
+#include "Singleton/ResidencyManager.h"
+#include "RenderComponent/TextureDescriptorTable.h"
 #include "Common/Camera.h"
+#include "Common/TextureArchiveWriter.h"
+#include "Common/TextureImporter.h"
+#include "Common/TexturePacker.h"
+#include "Common/VirtualTextureFile.h"
+#include "Common/ThreadPool.h"
+#ifdef MENGINE_BENCHMARKS
+#include "Tests/BindingBenchmark.h"
+#endif
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
 using namespace DirectX::PackedVector;
@@ -21,6 +37,10 @@ using namespace DirectX::PackedVector;
 #pragma comment(lib, "D3D12.lib")
 
 const int gNumFrameResources = 2;
+// Memory streamed textures may use, lower mips are dropped beyond it.
+const UINT64 gTextureBudget = 256ull << 20;
+// Matches gDiffuseMap in Default.hlsl.
+const UINT gDiffuseMapCount = 9;
 
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
@@ -41,11 +61,20 @@ struct RenderItem
 	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
 	int NumFramesDirty = gNumFrameResources;
 
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
+	// Index into the ObjectCB structured buffer for this render item, passed as a root constant.
 	UINT ObjCBIndex = -1;
 
-	FMaterial* Mat = nullptr;
+	// UV units the diffuse map spans per world unit, drives the texture mip the item needs.
+	float UVDensity = 1.0f;
+
+	Material* Mat = nullptr;
+	// Used instead of Mat when the item draws a variant of it.
+	MaterialInstance* MatInstance = nullptr;
+	// MatInstance's index version the object constants were written with.
+	UINT MatIndexVersion = 0;
 	MeshGeometry* Geo = nullptr;
+	// Local bounds of the submesh drawn, demand for its textures is measured from them.
+	BoundingBox Bounds;
 
     // Primitive topology.
     D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -65,6 +94,10 @@ public:
     ~CrateApp();
 
     virtual bool Initialize()override;
+    // Times the frame's bindings through SetResource and through pre-resolved replay.
+#ifdef MENGINE_BENCHMARKS
+    std::string RunBindingBenchmark(UINT drawCount);
+#endif
 
 private:
     virtual void OnResize()override;
@@ -81,6 +114,10 @@ private:
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateMaterialCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
+	void UpdateTextureResidency(const GameTimer& gt);
+	void MergeDuplicateTextures();
+	// Texture table slot of the diffuse map the item's material or material instance samples.
+	UINT GetDiffuseMapIndex(const RenderItem* ri) const;
 
 	void LoadTextures();
 	void BuildDescriptorHeaps();
@@ -100,11 +137,23 @@ private:
 
 	//ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
 	std::shared_ptr<DescriptorHeap> bindlessTextureHeap;
-	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
-	std::unordered_map<std::string, std::unique_ptr<FMaterial>> mMaterials;
+	std::shared_ptr<TextureDescriptorTable> textureTable;
+	// First descriptor of this frame's copy of the texture table.
+	UINT mTextureTableStart = 0;
+	std::unordered_map<Symbol, std::unique_ptr<MeshGeometry>> mGeometries;
+	std::unordered_map<Symbol, std::shared_ptr<Material>> mMaterials;
+	std::shared_ptr<MaterialTable> materialTable;
+	std::unordered_map<Symbol, std::shared_ptr<MaterialInstance>> mMaterialInstances;
 	std::vector<std::shared_ptr<Texture2D>> mTextures;
+	// Where a texture ended up: its descriptor, the array slice and the UV rectangle in an atlas.
+	struct TextureRef
+	{
+		UINT descriptorIndex;
+		UINT slice;
+		XMFLOAT4 uvScaleOffset;
+	};
+	std::unordered_map<Symbol, TextureRef> mTextureRefs;
 	Shader* opaqueShader;
-	std::shared_ptr<Material> opaqueMaterial;
 	
 
    // std::vector<D3D12_INPUT_ELEMENT_DESC>* mInputLayout;
@@ -119,7 +168,6 @@ private:
 
     PassConstants mMainPassCB;
 	std::shared_ptr<Camera> mainCamera;
-	std::shared_ptr <UploadBuffer> materialPropertyBuffer;
 	float mTheta = 1.3f*XM_PI;
 	float mPhi = 0.4f*XM_PI;
 	float mRadius = 2.5f;
@@ -127,6 +175,91 @@ private:
     POINT mLastMousePos;
 };
 
+// "-packtextures <directory> <archive>" packs DDS files into a TextureArchive.
+// "-importtexture <source.bmp|dds> <dest.dds> <bc1|bc3|bc4|bc5|bc7> [fast|normal|high] [srgb]
+// [box|kaiser|lanczos] [wrap] [cutoff=<alpha>] [nomips]" builds mips for an uncompressed image
+// and block compresses them.
+// "-packtextureset <outputDirectory> <pack> <file.dds>..." groups DDS files into texture arrays
+// and atlases and writes the TexturePack that LoadTextures reads.
+// "-buildvirtualtexture <source.dds> <dest.mvt>" cuts a texture with a full mip chain into tiles
+// for VirtualTextureManager.
+// Returns the exit code, or -1 when the command line is not a tool command.
+static int RunTextureTool(int argc, char** argv)
+{
+    if(argc == 4 && strcmp(argv[1], "-packtextures") == 0)
+    {
+        std::string error;
+        if(TextureArchiveWriter::PackDirectory(argv[2], argv[3], TEXTURE_ARCHIVE_COMPRESSION_LZ4, error))
+            return 0;
+        MessageBoxA(nullptr, error.c_str(), "Texture packing failed", MB_OK);
+        return 1;
+    }
+    if(argc >= 5 && strcmp(argv[1], "-importtexture") == 0)
+    {
+        const char* formats[] = { "bc1", "bc3", "bc4", "bc5", "bc7" };
+        const BCFormat formatValues[] = { BC_FORMAT_BC1, BC_FORMAT_BC3, BC_FORMAT_BC4, BC_FORMAT_BC5, BC_FORMAT_BC7 };
+        const char* qualities[] = { "fast", "normal", "high" };
+        const BCQuality qualityValues[] = { BC_QUALITY_FAST, BC_QUALITY_NORMAL, BC_QUALITY_HIGH };
+        const char* filters[] = { "box", "kaiser", "lanczos" };
+        const MipFilter filterValues[] = { MIP_FILTER_BOX, MIP_FILTER_KAISER, MIP_FILTER_LANCZOS };
+        TextureImportSettings settings;
+        bool validFormat = false;
+        for(int i = 0; i < _countof(formats); ++i)
+        {
+            if(_stricmp(argv[4], formats[i]) == 0)
+            {
+                settings.format = formatValues[i];
+                validFormat = true;
+            }
+        }
+        for(int arg = 5; arg < argc; ++arg)
+        {
+            if(_stricmp(argv[arg], "srgb") == 0)
+                settings.srgb = true;
+            else if(_stricmp(argv[arg], "nomips") == 0)
+                settings.generateMips = false;
+            else if(_stricmp(argv[arg], "wrap") == 0)
+                settings.mips.wrap = true;
+            // Alpha tested textures keep their coverage, e.g. cutoff=0.5
+            else if(_strnicmp(argv[arg], "cutoff=", 7) == 0)
+                settings.mips.alphaCoverageCutoff = (float)atof(argv[arg] + 7);
+            for(int i = 0; i < _countof(qualities); ++i)
+            {
+                if(_stricmp(argv[arg], qualities[i]) == 0)
+                    settings.quality = qualityValues[i];
+            }
+            for(int i = 0; i < _countof(filters); ++i)
+            {
+                if(_stricmp(argv[arg], filters[i]) == 0)
+                    settings.mips.filter = filterValues[i];
+            }
+        }
+        if(validFormat && TextureImporter::ImportTexture(argv[2], argv[3], settings, ThreadPool::GetInstance()))
+            return 0;
+        MessageBoxA(nullptr, argv[2], "Texture import failed", MB_OK);
+        return 1;
+    }
+    if(argc >= 5 && strcmp(argv[1], "-packtextureset") == 0)
+    {
+        std::vector<std::string> sources(argv + 4, argv + argc);
+        TexturePackSettings settings;
+        std::string error;
+        if(TexturePacker::Pack(sources, argv[2], argv[3], settings, error))
+            return 0;
+        MessageBoxA(nullptr, error.c_str(), "Texture set packing failed", MB_OK);
+        return 1;
+    }
+    if(argc == 4 && strcmp(argv[1], "-buildvirtualtexture") == 0)
+    {
+        std::string error;
+        if(VirtualTextureFile::Build(argv[2], argv[3], error))
+            return 0;
+        MessageBoxA(nullptr, error.c_str(), "Virtual texture build failed", MB_OK);
+        return 1;
+    }
+    return -1;
+}
+
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
     PSTR cmdLine, int showCmd)
 {
@@ -135,12 +268,33 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+    // Offline texture tools run instead of the app, see RunTextureTool.
+    if(__argv != nullptr)
+    {
+        int toolResult = RunTextureTool(__argc, __argv);
+        if(toolResult >= 0)
+            return toolResult;
+    }
+
     try
     {
         CrateApp theApp(hInstance);
         if(!theApp.Initialize())
             return 0;
 
+#ifdef MENGINE_BENCHMARKS
+        // "-benchbindings [drawCount]" reports binding costs instead of running the app.
+        // Only in builds with /p:MEngineBenchmarks=true.
+        if(__argv != nullptr && __argc >= 2 && strcmp(__argv[1], "-benchbindings") == 0)
+        {
+            UINT drawCount = __argc >= 3 ? (UINT)atoi(__argv[2]) : 100000;
+            std::string report = theApp.RunBindingBenchmark(drawCount);
+            OutputDebugStringA(report.c_str());
+            MessageBoxA(nullptr, report.c_str(), "Binding benchmark", MB_OK);
+            return 0;
+        }
+#endif
+
         return theApp.Run();
     }
     catch(DxException& e)
@@ -159,6 +313,11 @@ CrateApp::~CrateApp()
 {
     if(md3dDevice != nullptr)
         FlushCommandQueue();
+	TextureCache::Clear();
+	TextureStreamer::Shutdown();
+	DeferredReleaseQueue::Flush();
+	UploadManager::Shutdown();
+	ResidencyManager::Shutdown();
 }
 
 bool CrateApp::Initialize()
@@ -173,6 +332,10 @@ bool CrateApp::Initialize()
     // Get the increment size of a descriptor in this heap type.  This is hardware specific, 
 	// so we have to query this information.
     mCbvSrvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	// Texture and geometry uploads are staged in one shared ring, streamed textures in a second one.
+	UploadManager::Init(md3dDevice.Get());
+	// Everything created from here on is tracked and may be evicted once unused.
+	ResidencyManager::Init(md3dDevice.Get(), mdxgiFactory.Get());
 	LoadTextures();
 	BuildDescriptorHeaps();
     BuildShadersAndInputLayout();
@@ -194,6 +357,22 @@ bool CrateApp::Initialize()
     return true;
 }
  
+#ifdef MENGINE_BENCHMARKS
+std::string CrateApp::RunBindingBenchmark(UINT drawCount)
+{
+    FrameResource* frameResource = FrameResource::mFrameResources[0].get();
+    const ConstBufferElement& cameraCB = frameResource->cameraCBs[mainCamera->GetInstanceID()];
+    std::vector<BindingBenchmarkResource> resources =
+    {
+        { ShaderID::GetPerCameraBufferID(), cameraCB.buffer, 0 },
+        { ShaderID::GetObjectDataBufferID(), frameResource->ObjectCB, 0 },
+        { ShaderID::GetMaterialDataBufferID(), materialTable->GetBuffer(0), 0 },
+        { SHADER_ID("gDiffuseMap"), std::reinterpret_pointer_cast<MObject, DescriptorHeap>(bindlessTextureHeap), 0 }
+    };
+    return BindingBenchmark::Format(BindingBenchmark::Run(opaqueShader, resources, drawCount));
+}
+#endif
+
 void CrateApp::OnResize()
 {
     D3DApp::OnResize();
@@ -211,6 +390,14 @@ void CrateApp::Update(const GameTimer& gt)
     // Has the GPU finished processing the commands of the current frame resource?
     // If not, wait until the GPU has completed commands up to this fence point.
 	mCurrFrameResource->UpdateBeforeFrame(mFence.Get());
+	ResidencyManager::BeginFrame(mCurrentFence + 1, mFence->GetCompletedValue());
+	// Choose the mips each texture needs, then pick up whatever finished loading.
+	UpdateTextureResidency(gt);
+	TextureStreamer::Update();
+	MergeDuplicateTextures();
+	// This frame's copy of the texture table was last read by the frame we just waited on.
+	// Bound with the other per-frame buffers in Draw, so material bindings stay unchanged between frames.
+	mTextureTableStart = textureTable->Prepare(md3dDevice.Get(), mCurrFrameResourceIndex);
 	AnimateMaterials(gt);
 	UpdateObjectCBs(gt);
 	UpdateMaterialCBs(gt);
@@ -248,9 +435,11 @@ void CrateApp::Draw(const GameTimer& gt)
 	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
 	opaqueShader->BindRootSignature(mCommandList.Get());
 	UINT camID = mainCamera->GetInstanceID();
-	std::shared_ptr<MObject> passCB = std::reinterpret_pointer_cast<MObject, UploadBuffer>(mCurrFrameResource->cameraCBs[camID].buffer);
 	//mCommandList->SetGraphicsRootConstantBufferView(2, mCurrFrameResource->PassCB->Resource()->GetGPUVirtualAddress());
-	opaqueShader->SetResource(mCommandList.Get(), ShaderID::GetPerCameraBufferID(), passCB, 0);
+	opaqueShader->SetResource(mCommandList.Get(), ShaderID::GetPerCameraBufferID(), mCurrFrameResource->cameraCBs[camID].buffer->GetHandle(), 0);
+	opaqueShader->SetResource(mCommandList.Get(), ShaderID::GetObjectDataBufferID(), mCurrFrameResource->ObjectCB->GetHandle(), 0);
+	opaqueShader->SetResource(mCommandList.Get(), ShaderID::GetMaterialDataBufferID(), materialTable->GetBuffer(mCurrFrameResourceIndex)->GetHandle(), 0);
+	opaqueShader->SetResource(mCommandList.Get(), SHADER_ID("gDiffuseMap"), bindlessTextureHeap->GetHandle(), mTextureTableStart);
     DrawRenderItems(mCommandList.Get(), mOpaqueRitems);
 
     // Indicate a state transition on the resource usage.
@@ -260,6 +449,9 @@ void CrateApp::Draw(const GameTimer& gt)
     // Done recording commands.
     ThrowIfFailed(mCommandList->Close());
 
+	// Bring back whatever this frame uses that was evicted, evicting older resources if over budget.
+	ResidencyManager::EndFrame();
+
     // Add the command list to the queue for execution.
     ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
     mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
@@ -342,6 +534,13 @@ void CrateApp::UpdateObjectCBs(const GameTimer& gt)
 	auto currObjectCB = mCurrFrameResource->ObjectCB;
 	for(auto& e : mAllRitems)
 	{
+		// The instance moved to or from its own material slot, every frame needs the new index.
+		if(e->MatInstance != nullptr && e->MatInstance->GetIndexVersion() != e->MatIndexVersion)
+		{
+			e->MatIndexVersion = e->MatInstance->GetIndexVersion();
+			e->NumFramesDirty = gNumFrameResources;
+		}
+
 		// Only update the cbuffer data if the constants have changed.  
 		// This needs to be tracked per frame resource.
 		if(e->NumFramesDirty > 0)
@@ -352,6 +551,7 @@ void CrateApp::UpdateObjectCBs(const GameTimer& gt)
 			ObjectConstants objConstants;
 			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
 			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+			objConstants.MaterialIndex = e->MatInstance != nullptr ? e->MatInstance->GetMaterialIndex() : e->Mat->GetMaterialIndex();
 
 			currObjectCB->CopyData(e->ObjCBIndex, &objConstants);
 
@@ -363,28 +563,8 @@ void CrateApp::UpdateObjectCBs(const GameTimer& gt)
 
 void CrateApp::UpdateMaterialCBs(const GameTimer& gt)
 {
-	auto currMaterialCB = materialPropertyBuffer;
-	for(auto& e : mMaterials)
-	{
-		// Only update the cbuffer data if the constants have changed.  If the cbuffer
-		// data changes, it needs to be updated for each FrameResource.
-		FMaterial* mat = e.second.get();
-		if(mat->NumFramesDirty > 0)
-		{
-			XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
-
-			MaterialConstants matConstants;
-			matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
-			matConstants.FresnelR0 = mat->FresnelR0;
-			matConstants.Roughness = mat->Roughness;
-			XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
-
-			currMaterialCB->CopyData(mat->MatCBIndex, &matConstants);
-
-			// Next FrameResource need to be updated too.
-			mat->NumFramesDirty--;
-		}
-	}
+	// Only the materials changed in the last frames are copied into this frame's table.
+	materialTable->UploadDirty(md3dDevice.Get(), mCurrFrameResourceIndex);
 }
 
 void CrateApp::UpdateMainPassCB(const GameTimer& gt)
@@ -412,43 +592,122 @@ void CrateApp::UpdateMainPassCB(const GameTimer& gt)
 	currPassCB.buffer->CopyData(0, &mMainPassCB);
 }
 
+void CrateApp::UpdateTextureResidency(const GameTimer& gt)
+{
+	XMVECTOR camPos = mainCamera->GetPosition();
+	float fovY = mainCamera->GetFovY();
+	for (size_t i = 0; i < mOpaqueRitems.size(); ++i)
+	{
+		RenderItem* ri = mOpaqueRitems[i];
+		const BoundingBox& bounds = ri->Bounds;
+		XMVECTOR center = XMVector3Transform(XMLoadFloat3(&bounds.Center), XMLoadFloat4x4(&ri->World));
+		float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Extents)));
+		float distance = XMVectorGetX(XMVector3Length(center - camPos)) - radius;
+		distance = std::max(distance, mainCamera->GetNearZ());
+		float uvPerPixel = TextureResidency::EstimateUVPerPixel(ri->UVDensity, distance, fovY, (float)mClientHeight);
+		// Only the diffuse map the item's material or instance points at is sampled.
+		UINT diffuseMapIndex = GetDiffuseMapIndex(ri);
+		if (diffuseMapIndex < mTextures.size())
+			TextureResidency::ReportDemand(mTextures[diffuseMapIndex]->GetHandle(), uvPerPixel);
+	}
+	TextureResidency::Update();
+}
+
+void CrateApp::MergeDuplicateTextures()
+{
+	// Loose files are hashed while they stream in, a copy of an earlier texture is only found then.
+	// Its slot shows the original from now on and the copy is released once nothing holds it.
+	std::vector<TextureCache::Merge> merges;
+	TextureCache::Update(merges);
+	for (int i = 0; i < merges.size(); ++i)
+	{
+		const TextureCache::Merge& merge = merges[i];
+		TextureResidency::Untrack(mTextures[merge.duplicate]->GetHandle());
+		mTextures[merge.duplicate] = mTextures[merge.original];
+		textureTable->SetTexture(merge.duplicate, mTextures[merge.original]->GetHandle());
+	}
+}
+
+UINT CrateApp::GetDiffuseMapIndex(const RenderItem* ri) const
+{
+	return ri->MatInstance != nullptr ? ri->MatInstance->GetConstants().DiffuseMapIndex : ri->Mat->GetConstants().DiffuseMapIndex;
+}
+
 void CrateApp::LoadTextures()
 {
-	mTextures.reserve(9);
+	// Textures stream in on background threads and show white1x1 until then.
+	TextureStreamer::Init(md3dDevice.Get(), mCommandList.Get(), L"Textures/white1x1.dds");
+	// Built with "-packtextures Textures Textures.mtar", loose files are used without it.
+	TextureStreamer::MountArchive(L"Textures.mtar");
+	TextureResidency::SetBudget(gTextureBudget);
+	const char* names[] = { "woodCrateTex", "brickTex", "brickTex2", "brickTex3", "grass", "head_diff", "ice", "jacket_diff", "pants_diff" };
+	const wchar_t* paths[] = {
+		L"Textures/WoodCrate01.dds",
+		L"Textures/bricks.dds",
+		L"Textures/bricks2.dds",
+		L"Textures/bricks3.dds",
+		L"Textures/grass.dds",
+		L"Textures/head_diff.dds",
+		L"Textures/ice.dds",
+		L"Textures/jacket_diff.dds",
+		L"Textures/pants_diff.dds"
+	};
+	// Built with "-packtextureset Textures/Packed Textures/Packed/textures.mtpk Textures/*.dds",
+	// textures missing from it or all of them without it load from their own file.
+	TexturePack pack;
+	pack.Read(L"Textures/Packed/textures.mtpk");
+	mTextures.reserve(_countof(paths));
 	mTextures.clear();
-	auto woodCrateTex = std::make_shared<Texture2D>(mCommandList.Get(), md3dDevice.Get(), "woodCrateTex", L"Textures/WoodCrate01.dds");
-	mTextures.push_back(woodCrateTex);
-	auto brickTex = std::make_shared<Texture2D>(mCommandList.Get(), md3dDevice.Get(), "brickTex", L"Textures/bricks.dds");
-	mTextures.push_back(brickTex);
-    brickTex = std::make_shared<Texture2D>(mCommandList.Get(), md3dDevice.Get(), "brickTex2", L"Textures/bricks2.dds");
-	mTextures.push_back(brickTex);
-	brickTex = std::make_shared<Texture2D>(mCommandList.Get(), md3dDevice.Get(), "brickTex3", L"Textures/bricks3.dds");
-	mTextures.push_back(brickTex);
-	brickTex = std::make_shared<Texture2D>(mCommandList.Get(), md3dDevice.Get(), "grass", L"Textures/grass.dds");
-	mTextures.push_back(brickTex);
-	brickTex = std::make_shared<Texture2D>(mCommandList.Get(), md3dDevice.Get(), "head_diff", L"Textures/head_diff.dds");
-	mTextures.push_back(brickTex);
-	brickTex = std::make_shared<Texture2D>(mCommandList.Get(), md3dDevice.Get(), "ice", L"Textures/ice.dds");
-	mTextures.push_back(brickTex);	
-	brickTex = std::make_shared<Texture2D>(mCommandList.Get(), md3dDevice.Get(), "jacket_diff", L"Textures/jacket_diff.dds");
-	mTextures.push_back(brickTex);
-	brickTex = std::make_shared<Texture2D>(mCommandList.Get(), md3dDevice.Get(), "jacket_diff", L"Textures/pants_diff.dds");
-	mTextures.push_back(brickTex);
+	mTextureRefs.clear();
+	for (int i = 0; i < _countof(paths); ++i)
+	{
+		// Earlier textures load first until the camera says otherwise.
+		float priority = 1.0f - i / (float)_countof(paths);
+		TextureRef ref;
+		ref.slice = 0;
+		ref.uvScaleOffset = XMFLOAT4(1.0f, 1.0f, 0.0f, 0.0f);
+		std::wstring path = paths[i];
+		Symbol textureName = names[i];
+		// The packer names entries by the UTF-8 source path.
+		std::string utf8Path(WideCharToMultiByte(CP_UTF8, 0, path.c_str(), (int)path.size(), nullptr, 0, nullptr, nullptr), '\0');
+		WideCharToMultiByte(CP_UTF8, 0, path.c_str(), (int)path.size(), &utf8Path[0], (int)utf8Path.size(), nullptr, nullptr);
+		const TexturePackEntry* entry = pack.Find(utf8Path);
+		if (entry != nullptr)
+		{
+			const TexturePackPage& page = pack.GetPage(entry->page);
+			int length = MultiByteToWideChar(CP_UTF8, 0, page.path.c_str(), (int)page.path.size(), nullptr, 0);
+			path.assign(length, L'\0');
+			MultiByteToWideChar(CP_UTF8, 0, page.path.c_str(), (int)page.path.size(), &path[0], length);
+			// Arrays and atlases are shared by several names, so they go by their page.
+			if (page.kind != TEXTURE_PACK_PAGE_SINGLE)
+				textureName = page.path;
+			ref.slice = entry->slice;
+			ref.uvScaleOffset = XMFLOAT4(entry->uvScaleOffset);
+		}
+		// Identical files share one texture, mTextures is indexed like the descriptor table.
+		bool isNew;
+		std::shared_ptr<Texture2D> texture = TextureCache::Load(textureName, path, priority, ref.descriptorIndex, isNew);
+		mTextureRefs[names[i]] = ref;
+		if (!isNew)
+			continue;
+		mTextures.push_back(texture);
+		TextureResidency::Track(texture->GetHandle());
+	}
 }
 
 void CrateApp::BuildDescriptorHeaps()
 {
 	//
-	// Create the SRV heap.
+	// Create the SRV heap, one copy of the table per frame resource.
 	//
-	bindlessTextureHeap = std::make_shared<DescriptorHeap>();
-	bindlessTextureHeap->Create(md3dDevice.Get(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, mTextures.size(), true);
-	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	// Packing may leave fewer textures than the shader declares, the rest stay null.
+	UINT tableSize = std::max((UINT)mTextures.size(), gDiffuseMapCount);
+	textureTable = std::make_shared<TextureDescriptorTable>(md3dDevice.Get(), tableSize, gNumFrameResources);
 	for (int i = 0; i < mTextures.size(); ++i)
 	{
-		mTextures[i]->GetResourceViewDescriptor(srvDesc);
-		md3dDevice->CreateShaderResourceView(mTextures[i]->GetResource(), &srvDesc, bindlessTextureHeap->hCPU(i));
+		textureTable->SetTexture(i, mTextures[i]->GetHandle());
 	}
+	bindlessTextureHeap = textureTable->GetHeap();
 }
 
 void CrateApp::BuildShadersAndInputLayout()
@@ -464,28 +723,27 @@ void CrateApp::BuildShadersAndInputLayout()
 	p.depthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
 	p.psShader = nullptr;
 	p.vsShader = nullptr;
-	std::vector<ShaderVariable> var(4);
-	var[0].type = ShaderVariable::Type::BindlessTexture;
-	var[0].registerPos = 2;
-	var[0].space = 1;
-	var[0].tableSize = 9;
-	var[0].name = "gDiffuseMap";
-	
-	var[1].type = ShaderVariable::Type::ConstantBuffer;
-	var[1].name = "Per_Object_Buffer";
-	var[1].registerPos = 0;
-	var[1].space = 0;
-
-	var[2].type = ShaderVariable::Type::ConstantBuffer;
-	var[2].name = "Per_Camera_Buffer";
-	var[2].registerPos = 1;
-	var[2].space = 0;
-
-	var[3].type = ShaderVariable::Type::ConstantBuffer;
-	var[3].name = "Per_Material_Buffer";
-	var[3].registerPos = 2;
-	var[3].space = 0;
-	opaqueShader = new Shader(allPasses, var, md3dDevice.Get());
+	Shader::CompilePasses(allPasses);
+	// Light counts are compiled in, each set's first keyword matches the default in Default.hlsl.
+	std::vector<ShaderKeywordSet> keywordSets(3);
+	keywordSets[0] = {
+		{ "DIR_LIGHTS_3", { "NUM_DIR_LIGHTS", "3" } },
+		{ "DIR_LIGHTS_0", { "NUM_DIR_LIGHTS", "0" } },
+		{ "DIR_LIGHTS_1", { "NUM_DIR_LIGHTS", "1" } },
+		{ "DIR_LIGHTS_2", { "NUM_DIR_LIGHTS", "2" } }
+	};
+	keywordSets[1] = {
+		{ "POINT_LIGHTS_0", { "NUM_POINT_LIGHTS", "0" } },
+		{ "POINT_LIGHTS_1", { "NUM_POINT_LIGHTS", "1" } },
+		{ "POINT_LIGHTS_2", { "NUM_POINT_LIGHTS", "2" } },
+		{ "POINT_LIGHTS_4", { "NUM_POINT_LIGHTS", "4" } }
+	};
+	keywordSets[2] = {
+		{ "SPOT_LIGHTS_0", { "NUM_SPOT_LIGHTS", "0" } },
+		{ "SPOT_LIGHTS_1", { "NUM_SPOT_LIGHTS", "1" } },
+		{ "SPOT_LIGHTS_2", { "NUM_SPOT_LIGHTS", "2" } }
+	};
+	opaqueShader = new Shader(allPasses, md3dDevice.Get(), keywordSets);
 	/*mInputLayout = MeshLayout::GetMeshLayoutValue(
 		true,
 		false,
@@ -507,6 +765,7 @@ void CrateApp::BuildShapeGeometry()
 	boxSubmesh.IndexCount = (UINT)box.Indices32.size();
 	boxSubmesh.StartIndexLocation = 0;
 	boxSubmesh.BaseVertexLocation = 0;
+	BoundingBox::CreateFromPoints(boxSubmesh.Bounds, box.Vertices.size(), &box.Vertices[0].Position, sizeof(GeometryGenerator::Vertex));
 
  
 	std::vector<Vertex> vertices(box.Vertices.size());
@@ -532,11 +791,12 @@ void CrateApp::BuildShapeGeometry()
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+	geo->VertexBufferGPU = UploadManager::CreateDefaultBuffer(mCommandList.Get(), vertices.data(), vbByteSize);
+
+	geo->IndexBufferGPU = UploadManager::CreateDefaultBuffer(mCommandList.Get(), indices.data(), ibByteSize);
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+	geo->VertexBufferResidency = ResidencyManager::Register(geo->VertexBufferGPU.Get());
+	geo->IndexBufferResidency = ResidencyManager::Register(geo->IndexBufferGPU.Get());
 
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
@@ -565,6 +825,7 @@ void CrateApp::BuildPSOs()
 	desc.rtFormat[0] = mBackBufferFormat;
 	desc.shaderPass = 0;
 	desc.shaderPtr = opaqueShader;
+	desc.variantKey = mMaterials["woodCrate"]->GetVariantKey();
 	mOpaquePSO = PSOContainer::GetState(desc, md3dDevice.Get());
 }
 
@@ -579,19 +840,24 @@ void CrateApp::BuildFrameResources()
 
 void CrateApp::BuildMaterials()
 {
-	auto woodCrate = std::make_unique<FMaterial>();
-	woodCrate->Name = "woodCrate";
-	woodCrate->MatCBIndex = 0;
-	woodCrate->DiffuseSrvHeapIndex = 0;
-	woodCrate->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	woodCrate->FresnelR0 = XMFLOAT3(0.05f, 0.05f, 0.05f);
-	woodCrate->Roughness = 0.2f;
-
-	mMaterials["woodCrate"] = std::move(woodCrate);
-	materialPropertyBuffer = std::make_shared<UploadBuffer>();
-	materialPropertyBuffer->Create(md3dDevice.Get(), 1, true, sizeof(MaterialConstants));
-	opaqueMaterial = std::make_shared<Material>(opaqueShader, materialPropertyBuffer, 0, bindlessTextureHeap);
-	opaqueMaterial->SetBindlessResource(ShaderID::PropertyToID("gDiffuseMap"), 0);
+	materialTable = std::make_shared<MaterialTable>(gNumFrameResources, 16);
+	MaterialConstants woodCrateConstants;
+	woodCrateConstants.DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	woodCrateConstants.FresnelR0 = XMFLOAT3(0.05f, 0.05f, 0.05f);
+	woodCrateConstants.Roughness = 0.2f;
+	const TextureRef& woodCrateTex = mTextureRefs["woodCrateTex"];
+	woodCrateConstants.DiffuseMapIndex = woodCrateTex.descriptorIndex;
+	woodCrateConstants.DiffuseMapSlice = woodCrateTex.slice;
+	woodCrateConstants.DiffuseUVRemap = woodCrateTex.uvScaleOffset;
+	// Textures are fetched by DiffuseMapIndex from the per-frame texture table Draw binds.
+	auto woodCrate = std::make_shared<Material>(opaqueShader, materialTable, woodCrateConstants, bindlessTextureHeap);
+	mMaterials["woodCrate"] = woodCrate;
+	// Shares the crate's textures and bindings, only the albedo gets its own table slot.
+	auto tintedCrate = std::make_shared<MaterialInstance>(woodCrate);
+	tintedCrate->SetDiffuseAlbedo(XMFLOAT4(1.0f, 0.6f, 0.6f, 1.0f));
+	const TextureRef& brickTex = mTextureRefs["brickTex"];
+	tintedCrate->SetDiffuseMap(brickTex.descriptorIndex, brickTex.slice, brickTex.uvScaleOffset);
+	mMaterialInstances["tintedCrate"] = tintedCrate;
 }
 
 void CrateApp::BuildRenderItems()
@@ -600,12 +866,29 @@ void CrateApp::BuildRenderItems()
 	boxRitem->ObjCBIndex = 0;
 	boxRitem->Mat = mMaterials["woodCrate"].get();
 	boxRitem->Geo = mGeometries["boxGeo"].get();
+	// The pixel shader tiles the texture coordinates three times.
+	boxRitem->UVDensity = 3.0f;
 	boxRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 	boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
 	boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
 	boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
+	boxRitem->Bounds = boxRitem->Geo->DrawArgs["box"].Bounds;
 	mAllRitems.push_back(std::move(boxRitem));
 
+	auto tintedBoxRitem = std::make_unique<RenderItem>();
+	XMStoreFloat4x4(&tintedBoxRitem->World, XMMatrixTranslation(1.5f, 0.0f, 0.0f));
+	tintedBoxRitem->ObjCBIndex = 1;
+	tintedBoxRitem->Mat = mMaterials["woodCrate"].get();
+	tintedBoxRitem->MatInstance = mMaterialInstances["tintedCrate"].get();
+	tintedBoxRitem->Geo = mGeometries["boxGeo"].get();
+	tintedBoxRitem->UVDensity = 3.0f;
+	tintedBoxRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	tintedBoxRitem->IndexCount = tintedBoxRitem->Geo->DrawArgs["box"].IndexCount;
+	tintedBoxRitem->StartIndexLocation = tintedBoxRitem->Geo->DrawArgs["box"].StartIndexLocation;
+	tintedBoxRitem->BaseVertexLocation = tintedBoxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
+	tintedBoxRitem->Bounds = tintedBoxRitem->Geo->DrawArgs["box"].Bounds;
+	mAllRitems.push_back(std::move(tintedBoxRitem));
+
 	// All the render items are opaque.
 	for(auto& e : mAllRitems)
 		mOpaqueRitems.push_back(e.get());
@@ -613,10 +896,14 @@ void CrateApp::BuildRenderItems()
 
 void CrateApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
 {
-    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-    UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
- 
-	auto objectCB = std::reinterpret_pointer_cast<MObject, UploadBuffer>(mCurrFrameResource->ObjectCB);
+	// Object data is bound once per frame, each draw only sets its index as a root constant.
+	ShaderBinding drawBinding;
+	UINT objectIndex = 0;
+	bool hasDrawBinding = opaqueShader->ResolveRootConstants(ShaderID::GetPerDrawBufferID(), &objectIndex, 1, drawBinding);
+	// Material constants are fetched by index, only the material's own resources are rebound when it changes.
+	// Instances without resource overrides return their parent's table, so they skip the rebind as well.
+	const ShaderBinding* lastBindings = nullptr;
+	UINT lastVersion = 0;
     // For each render item...
     for(size_t i = 0; i < ritems.size(); ++i)
     {
@@ -625,9 +912,26 @@ void CrateApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::ve
         cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
         cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
         cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
-		opaqueMaterial->BindShaderResource(mCommandList.Get());
-		opaqueShader->SetResource(mCommandList.Get(), ShaderID::GetPerObjectBufferID(), objectCB, 0);
-		//opaqueShader->SetResource(mCommandList.Get(), ShaderID::PropertyToID("gDiffuseMap"), bindlessHeap, 0);
+		ResidencyManager::MarkUsed(ri->Geo->VertexBufferResidency);
+		ResidencyManager::MarkUsed(ri->Geo->IndexBufferResidency);
+		// Only textures a drawn material samples join the working set, the rest of the table may be evicted.
+		textureTable->MarkUsed(GetDiffuseMapIndex(ri));
+		UINT bindingCount;
+		const ShaderBinding* bindings = ri->MatInstance != nullptr ?
+			ri->MatInstance->GetBindings(bindingCount) : ri->Mat->GetBindings(bindingCount);
+		UINT version = ri->Mat->GetBindingVersion();
+		if (bindings != lastBindings || version != lastVersion)
+		{
+			Shader::ApplyBindings(cmdList, bindings, bindingCount);
+			lastBindings = bindings;
+			lastVersion = version;
+		}
+		if (hasDrawBinding)
+		{
+			drawBinding.constants[0] = ri->ObjCBIndex;
+			Shader::ApplyBindings(cmdList, &drawBinding, 1);
+		}
+		//opaqueShader->SetResource(cmdList, SHADER_ID("gDiffuseMap"), bindlessHeap, 0);
         cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
     }
 }
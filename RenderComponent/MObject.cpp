@@ -1,9 +1,8 @@
 #include "MObject.h"
-unsigned int MObject::CurrentID = 0;
+std::atomic<unsigned int> MObject::CurrentID(0);
 
 
 MObject::MObject() : avaliable(true)
 {
-	instanceID = CurrentID;
-	CurrentID++;
+	instanceID = CurrentID.fetch_add(1);
 }
\ No newline at end of file
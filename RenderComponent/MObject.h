@@ -1,8 +1,9 @@
 #pragma once
+#include <atomic>
 class MObject
 {
 private:
-	static unsigned int CurrentID;
+	static std::atomic<unsigned int> CurrentID;
 	unsigned int instanceID;
 	bool avaliable;
 protected:
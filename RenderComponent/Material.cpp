@@ -1,4 +1,5 @@
 #include "Material.h"
+#include "MaterialInstance.h"
 #include "../Singleton/ShaderID.h"
 using namespace std;
 using Microsoft::WRL::ComPtr;
@@ -13,81 +14,175 @@ Material::Material(
 	mPropertyIndex = propertyBufferIndex;
 	mShader = shader;
 	mPropertyBuffer = propertyBuffer;
+	if (mPropertyBuffer != nullptr)
+		SetProperty(ShaderID::GetPerMaterialBufferID(), mPropertyBuffer->GetHandle().value, ShaderVariable::Type::ConstantBuffer, mPropertyIndex);
+}
+Material::Material(
+	Shader* shader,
+	std::shared_ptr<MaterialTable> materialTable,
+	const MaterialConstants& constants,
+	std::shared_ptr<DescriptorHeap> srvHeap
+) : MObject()
+{
+	shaderResourceHeap = srvHeap;
+	mShader = shader;
+	mMaterialTable = materialTable;
+	mPropertyIndex = materialTable->Allocate(constants);
 }
 void Material::Dispose()
 {
+	if (mMaterialTable != nullptr)
+		mMaterialTable->Release(mPropertyIndex);
+	mMaterialTable = nullptr;
 	shaderResourceHeap = nullptr;
 	mPropertyBuffer = nullptr;
 	mShader = nullptr;
-	for (int i = 0; i < propertiesValue.size(); ++i)
+	properties.clear();
+	bindings.clear();
+	dirtyCount = 0;
+	mSlotInstances.clear();
+}
+
+void Material::RemoveSlotInstance(MaterialInstance* instance)
+{
+	for (int i = 0; i < mSlotInstances.size(); ++i)
 	{
-		propertiesValue[i].obj = nullptr;
+		if (mSlotInstances[i] == instance)
+		{
+			mSlotInstances.erase(mSlotInstances.begin() + i);
+			return;
+		}
 	}
 }
 
-void Material::BindShaderResource(ID3D12GraphicsCommandList* commandList)
+int Material::FindProperty(UINT id) const
 {
-	if (mPropertyBuffer != nullptr)
+	for (int i = 0; i < properties.size(); ++i)
 	{
-		mShader->SetResource(commandList, 
-			ShaderID::GetPerMaterialBufferID(), 
-			reinterpret_pointer_cast<MObject, UploadBuffer>(mPropertyBuffer),
-			mPropertyIndex);
+		if (properties[i].id == id) return i;
 	}
-	for (int i = 0; i < propertiesValue.size(); ++i)
+	return -1;
+}
+
+void Material::ResolveDirtyProperties()
+{
+	for (int i = 0; i < properties.size(); ++i)
 	{
-		MatProperty& prop = propertiesValue[i];
-		mShader->SetResource(commandList, prop.id, prop.obj, prop.indexOffset);
+		MatProperty& prop = properties[i];
+		if (!prop.dirty) continue;
+		//Keep the last binding if the resource is gone
+		ShaderBinding binding;
+		if (mShader->ResolveHandleBinding(prop.id, prop.handle, prop.indexOffset, binding))
+			bindings[i] = binding;
+		prop.dirty = false;
 	}
+	dirtyCount = 0;
+	++mBindingVersion;
+}
 
+const ShaderBinding* Material::GetBindings(UINT& count)
+{
+	if (dirtyCount > 0) ResolveDirtyProperties();
+	count = (UINT)bindings.size();
+	return bindings.data();
+}
+
+void Material::BindShaderResource(ID3D12GraphicsCommandList* commandList)
+{
+	if (dirtyCount > 0) ResolveDirtyProperties();
+	Shader::ApplyBindings(commandList, bindings.data(), (UINT)bindings.size());
 }
 
-bool Material::SetProperty(UINT id, std::shared_ptr<MObject> obj, ShaderVariable::Type type, UINT offsetIndex)
+bool Material::SetProperty(UINT id, UINT handle, ShaderVariable::Type type, UINT offsetIndex, const UINT* constants)
 {
 	ShaderVariable var;
-	if (mShader->TryGetShaderVariable(id, var) && var.type == type)
+	UINT rootSigPos;
+	if (!mShader->TryGetShaderVariable(id, var, rootSigPos) || var.type != type)
+		return false;
+	ShaderBinding binding;
+	bool resolved = type == ShaderVariable::Type::RootConstant ?
+		mShader->ResolveRootConstants(id, constants, offsetIndex, binding) :
+		mShader->ResolveHandleBinding(id, handle, offsetIndex, binding);
+	if (!resolved) return false;
+	MatProperty p;
+	p.id = id;
+	p.handle = handle;
+	p.indexOffset = offsetIndex;
+	p.dirty = false;
+	//Keep sorted by root slot, one variable owns one slot so an equal slot is the same property
+	size_t index = 0;
+	while (index < bindings.size() && bindings[index].rootSigPos < rootSigPos) ++index;
+	if (index < bindings.size() && bindings[index].rootSigPos == rootSigPos)
+	{
+		if (properties[index].dirty) --dirtyCount;
+		properties[index] = p;
+		bindings[index] = binding;
+	}
+	else
 	{
-		RemoveProperty(id);
-		propertiesKey[id] = propertiesValue.size();
-		MatProperty p;
-		p.type = type;
-		p.id = id;
-		p.indexOffset = offsetIndex;
-		p.obj = obj;
-		propertiesValue.push_back(p);
-		return true;
+		properties.insert(index, p);
+		bindings.insert(index, binding);
 	}
-	return false;
+	++mBindingVersion;
+	return true;
 }
 
 bool Material::SetBindlessResource(UINT id, UINT offsetIndex)
 {
-	std::shared_ptr<MObject> obj = reinterpret_pointer_cast<MObject, DescriptorHeap>(shaderResourceHeap);
-	return SetProperty(id, obj, ShaderVariable::Type::BindlessTexture, offsetIndex);
+	return SetProperty(id, shaderResourceHeap->GetHandle().value, ShaderVariable::Type::BindlessTexture, offsetIndex);
 }
 
-bool Material::SetTexture2D(UINT id, std::shared_ptr<Texture2D> targetTex)
+bool Material::SetTexture2D(UINT id, Texture2DHandle targetTex)
 {
-	std::shared_ptr<MObject> obj = reinterpret_pointer_cast<MObject, Texture2D>(targetTex);
-	return SetProperty(id, obj, ShaderVariable::Type::Texture2D, 0);
+	return SetProperty(id, targetTex.value, ShaderVariable::Type::Texture2D, 0);
+}
+
+bool Material::SetRootConstants(UINT id, const UINT* values, UINT count)
+{
+	//Values live in the binding itself, indexOffset is the value count
+	return SetProperty(id, 0, ShaderVariable::Type::RootConstant, count, values);
 }
 
 void Material::RemoveProperty(UINT key)
 {
-	auto&& ite = propertiesKey.find(key);
-	if (ite == propertiesKey.end()) return;
-	propertiesKey.erase(key);
-	if (ite->second != propertiesValue.size() - 1) {
-		propertiesValue[ite->second] = propertiesValue[propertiesValue.size() - 1];
-		propertiesValue[propertiesValue.size() - 1].obj = nullptr;
-		propertiesValue.erase(propertiesValue.end() - 1);
-		MatProperty* p = &propertiesValue[ite->second];
-		propertiesKey[p->id] = ite->second;
-	}
-	else
-	{
-		propertiesValue[propertiesValue.size() - 1].obj = nullptr;
-		propertiesValue.erase(propertiesValue.end() - 1);
+	int index = FindProperty(key);
+	if (index < 0) return;
+	if (properties[index].dirty) --dirtyCount;
+	properties.erase(index);
+	bindings.erase(index);
+	++mBindingVersion;
+}
 
+void Material::MarkPropertyDirty(UINT key)
+{
+	int index = FindProperty(key);
+	if (index < 0 || properties[index].dirty) return;
+	//Root constants have nothing to resolve
+	if (bindings[index].type == ShaderVariable::Type::RootConstant) return;
+	properties[index].dirty = true;
+	++dirtyCount;
+}
+
+void Material::SetConstants(const MaterialConstants& constants)
+{
+	++mConstantsVersion;
+	if (mMaterialTable != nullptr)
+	{
+		mMaterialTable->SetConstants(mPropertyIndex, constants);
+		//Instances copy the constants they do not override into their own slots
+		for (int i = 0; i < mSlotInstances.size(); ++i)
+			mSlotInstances[i]->RefreshParentConstants();
 	}
+	else if (mPropertyBuffer != nullptr)
+		mPropertyBuffer->CopyData(mPropertyIndex, &constants);
+}
+
+void Material::EnableKeyword(const std::string& keyword)
+{
+	mVariantKey = mShader->EnableKeyword(mVariantKey, keyword);
+}
+
+void Material::DisableKeyword(const std::string& keyword)
+{
+	mVariantKey = mShader->DisableKeyword(mVariantKey, keyword);
 }
\ No newline at end of file
@@ -2,27 +2,47 @@
 #include "../Common/d3dUtil.h"
 #include "Shader.h"
 #include "UploadBuffer.h"
+#include "MaterialTable.h"
 #include "Texture2D.h"
 #include <vector>
 #include <memory>
 #include "../Common/DescriptorHeap.h"
+#include "../Common/SmallVector.h"
+class MaterialInstance;
 class Material : public MObject
 {
 private:
+	//Materials rarely have more properties than this, so they never touch the heap
+	static const size_t INLINE_PROPERTY_COUNT = 8;
 	struct MatProperty
 	{
 		UINT id;
-		ShaderVariable::Type type;
-		std::shared_ptr<MObject> obj;
+		//Handle value of the resource, does not keep it alive
+		UINT handle;
 		UINT indexOffset;
+		//Binding needs to be resolved again, e.g. the resource was replaced
+		bool dirty;
 	};
 	UINT mPropertyIndex;
 	Shader* mShader;
+	UINT64 mVariantKey = 0;
 	std::shared_ptr<UploadBuffer> mPropertyBuffer;
-	std::unordered_map<UINT, UINT> propertiesKey;
-	std::vector<MatProperty> propertiesValue;
+	//Shared structured buffer, the material is fetched by mPropertyIndex in shader
+	std::shared_ptr<MaterialTable> mMaterialTable;
 	std::shared_ptr<DescriptorHeap> shaderResourceHeap;
-	bool SetProperty(UINT id, std::shared_ptr<MObject> obj, ShaderVariable::Type type, UINT offsetIndex);
+	//Both sorted by root signature slot, bindings[i] is resolved from properties[i]
+	//so binding is one pass over contiguous memory
+	SmallVector<MatProperty, INLINE_PROPERTY_COUNT> properties;
+	SmallVector<ShaderBinding, INLINE_PROPERTY_COUNT> bindings;
+	UINT dirtyCount = 0;
+	//Increased whenever bindings or the constants change, renderers and instances compare against them
+	UINT mBindingVersion = 0;
+	UINT mConstantsVersion = 0;
+	//Instances holding their own table slot, SetConstants rewrites their copies as well
+	std::vector<MaterialInstance*> mSlotInstances;
+	int FindProperty(UINT id) const;
+	void ResolveDirtyProperties();
+	bool SetProperty(UINT id, UINT handle, ShaderVariable::Type type, UINT offsetIndex, const UINT* constants = nullptr);
 protected:
 	virtual void Dispose();
 public:
@@ -32,9 +52,37 @@ public:
 		UINT propertyBufferIndex,
 		std::shared_ptr<DescriptorHeap> srvHeap
 	);
+	Material(
+		Shader* shader,
+		std::shared_ptr<MaterialTable> materialTable,
+		const MaterialConstants& constants,
+		std::shared_ptr<DescriptorHeap> srvHeap
+	);
+	~Material() { Release(); }
 	void BindShaderResource(ID3D12GraphicsCommandList* commandList);
 	bool SetBindlessResource(UINT id, UINT offsetIndex);
-	bool SetTexture2D(UINT id, std::shared_ptr<Texture2D> targetTex);
+	//The material only keeps the texture's handle, the caller owns the texture
+	bool SetTexture2D(UINT id, Texture2DHandle targetTex);
+	bool SetTexture2D(UINT id, const std::shared_ptr<Texture2D>& targetTex) { return SetTexture2D(id, targetTex->GetHandle()); }
+	bool SetRootConstants(UINT id, const UINT* values, UINT count);
 	void RemoveProperty(UINT key);
-	
+	//Resolve the property again before the next bind, call after its resource was recreated
+	void MarkPropertyDirty(UINT key);
+	void EnableKeyword(const std::string& keyword);
+	void DisableKeyword(const std::string& keyword);
+	//Selects the shader variant, part of the PSO key
+	UINT64 GetVariantKey() const { return mVariantKey; }
+	Shader* GetShader() const { return mShader; }
+	//Index into the material table, written into object data instead of binding per draw
+	UINT GetMaterialIndex() const { return mPropertyIndex; }
+	void SetConstants(const MaterialConstants& constants);
+	//Only valid for materials created from a material table
+	const MaterialConstants& GetConstants() const { return mMaterialTable->GetConstants(mPropertyIndex); }
+	std::shared_ptr<MaterialTable> GetMaterialTable() const { return mMaterialTable; }
+	std::shared_ptr<DescriptorHeap> GetDescriptorHeap() const { return shaderResourceHeap; }
+	const ShaderBinding* GetBindings(UINT& count);
+	UINT GetBindingVersion() const { return mBindingVersion; }
+	UINT GetConstantsVersion() const { return mConstantsVersion; }
+	void AddSlotInstance(MaterialInstance* instance) { mSlotInstances.push_back(instance); }
+	void RemoveSlotInstance(MaterialInstance* instance);
 };
\ No newline at end of file
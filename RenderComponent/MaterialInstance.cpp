@@ -0,0 +1,242 @@
+#include "MaterialInstance.h"
+using namespace std;
+using namespace DirectX;
+
+MaterialInstance::MaterialInstance(std::shared_ptr<Material> parent) : MObject()
+{
+	mParent = parent;
+}
+
+void MaterialInstance::Dispose()
+{
+	if (mOwnSlot)
+	{
+		mParent->RemoveSlotInstance(this);
+		mParent->GetMaterialTable()->Release(mMaterialIndex);
+	}
+	mOwnSlot = false;
+	mBindingTable.clear();
+	mResourceOverrides.clear();
+	mParent = nullptr;
+}
+
+void MaterialInstance::ApplyConstantOverrides(MaterialConstants& constants) const
+{
+	if (mOverrideMask & DiffuseAlbedo) constants.DiffuseAlbedo = mOverrideConstants.DiffuseAlbedo;
+	if (mOverrideMask & FresnelR0) constants.FresnelR0 = mOverrideConstants.FresnelR0;
+	if (mOverrideMask & Roughness) constants.Roughness = mOverrideConstants.Roughness;
+	if (mOverrideMask & MatTransform) constants.MatTransform = mOverrideConstants.MatTransform;
+	if (mOverrideMask & DiffuseMap)
+	{
+		constants.DiffuseMapIndex = mOverrideConstants.DiffuseMapIndex;
+		constants.DiffuseMapSlice = mOverrideConstants.DiffuseMapSlice;
+		constants.DiffuseUVRemap = mOverrideConstants.DiffuseUVRemap;
+	}
+}
+
+MaterialConstants MaterialInstance::GetConstants() const
+{
+	MaterialConstants constants = mParent->GetConstants();
+	ApplyConstantOverrides(constants);
+	return constants;
+}
+
+void MaterialInstance::UpdateSlot()
+{
+	std::shared_ptr<MaterialTable> table = mParent->GetMaterialTable();
+	if (mOverrideMask == 0)
+	{
+		//No override left, go back to the parent's slot
+		//The table keeps the slot until frames in flight are done with it
+		if (mOwnSlot)
+		{
+			mParent->RemoveSlotInstance(this);
+			table->Release(mMaterialIndex);
+			++mIndexVersion;
+		}
+		mOwnSlot = false;
+		return;
+	}
+	if (mOwnSlot)
+		table->SetConstants(mMaterialIndex, GetConstants());
+	else
+	{
+		mMaterialIndex = table->Allocate(GetConstants());
+		mOwnSlot = true;
+		mParent->AddSlotInstance(this);
+		++mIndexVersion;
+	}
+}
+
+void MaterialInstance::RefreshParentConstants()
+{
+	if (mOwnSlot)
+		mParent->GetMaterialTable()->SetConstants(mMaterialIndex, GetConstants());
+}
+
+bool MaterialInstance::SetConstantOverride(UINT field)
+{
+	mOverrideMask |= field;
+	UpdateSlot();
+	return true;
+}
+
+bool MaterialInstance::SetDiffuseAlbedo(const XMFLOAT4& value)
+{
+	if (mParent->GetMaterialTable() == nullptr) return false;
+	mOverrideConstants.DiffuseAlbedo = value;
+	return SetConstantOverride(DiffuseAlbedo);
+}
+
+bool MaterialInstance::SetFresnelR0(const XMFLOAT3& value)
+{
+	if (mParent->GetMaterialTable() == nullptr) return false;
+	mOverrideConstants.FresnelR0 = value;
+	return SetConstantOverride(FresnelR0);
+}
+
+bool MaterialInstance::SetRoughness(float value)
+{
+	if (mParent->GetMaterialTable() == nullptr) return false;
+	mOverrideConstants.Roughness = value;
+	return SetConstantOverride(Roughness);
+}
+
+bool MaterialInstance::SetMatTransform(const XMFLOAT4X4& value)
+{
+	if (mParent->GetMaterialTable() == nullptr) return false;
+	mOverrideConstants.MatTransform = value;
+	return SetConstantOverride(MatTransform);
+}
+
+bool MaterialInstance::SetDiffuseMap(UINT index, UINT slice, const XMFLOAT4& uvRemap)
+{
+	if (mParent->GetMaterialTable() == nullptr) return false;
+	mOverrideConstants.DiffuseMapIndex = index;
+	mOverrideConstants.DiffuseMapSlice = slice;
+	mOverrideConstants.DiffuseUVRemap = uvRemap;
+	return SetConstantOverride(DiffuseMap);
+}
+
+void MaterialInstance::ClearConstantOverrides(UINT fields)
+{
+	if ((mOverrideMask & fields) == 0) return;
+	mOverrideMask &= ~fields;
+	UpdateSlot();
+}
+
+bool MaterialInstance::SetOverride(UINT id, UINT handle, ShaderVariable::Type type, UINT offsetIndex)
+{
+	ShaderVariable var;
+	if (!mParent->GetShader()->TryGetShaderVariable(id, var) || var.type != type)
+		return false;
+	RemoveOverride(id);
+	ResourceOverride o;
+	o.id = id;
+	o.type = type;
+	o.handle = handle;
+	o.indexOffset = offsetIndex;
+	mResourceOverrides.push_back(o);
+	mBindingTableDirty = true;
+	return true;
+}
+
+bool MaterialInstance::SetBindlessResource(UINT id, UINT offsetIndex)
+{
+	return SetOverride(id, mParent->GetDescriptorHeap()->GetHandle().value, ShaderVariable::Type::BindlessTexture, offsetIndex);
+}
+
+bool MaterialInstance::SetTexture2D(UINT id, Texture2DHandle targetTex)
+{
+	return SetOverride(id, targetTex.value, ShaderVariable::Type::Texture2D, 0);
+}
+
+bool MaterialInstance::SetRootConstants(UINT id, const UINT* values, UINT count)
+{
+	ShaderVariable var;
+	if (count > ShaderBinding::MAX_INLINE_CONSTANTS ||
+		!mParent->GetShader()->TryGetShaderVariable(id, var) ||
+		var.type != ShaderVariable::Type::RootConstant ||
+		count > var.tableSize)
+		return false;
+	if (!SetOverride(id, 0, ShaderVariable::Type::RootConstant, count))
+		return false;
+	memcpy(mResourceOverrides[mResourceOverrides.size() - 1].constants, values, count * sizeof(UINT));
+	return true;
+}
+
+void MaterialInstance::RemoveOverride(UINT id)
+{
+	for (int i = 0; i < mResourceOverrides.size(); ++i)
+	{
+		if (mResourceOverrides[i].id == id)
+		{
+			mResourceOverrides.erase(mResourceOverrides.begin() + i);
+			mBindingTableDirty = true;
+			return;
+		}
+	}
+}
+
+void MaterialInstance::UpdateBindingTable()
+{
+	UINT parentCount;
+	const ShaderBinding* parentBindings = mParent->GetBindings(parentCount);
+	mBindingTable.clear();
+	mBindingTable.reserve(parentCount + mResourceOverrides.size());
+	for (UINT i = 0; i < parentCount; ++i)
+		mBindingTable.push_back(parentBindings[i]);
+	Shader* shader = mParent->GetShader();
+	ShaderBinding binding;
+	for (int i = 0; i < mResourceOverrides.size(); ++i)
+	{
+		ResourceOverride& o = mResourceOverrides[i];
+		bool resolved = o.type == ShaderVariable::Type::RootConstant ?
+			shader->ResolveRootConstants(o.id, o.constants, o.indexOffset, binding) :
+			shader->ResolveHandleBinding(o.id, o.handle, o.indexOffset, binding);
+		if (!resolved) continue;
+		//Replace the parent's binding on the same root parameter, keep the slot order otherwise
+		int j = 0;
+		while (j < mBindingTable.size() && mBindingTable[j].rootSigPos < binding.rootSigPos) ++j;
+		if (j < mBindingTable.size() && mBindingTable[j].rootSigPos == binding.rootSigPos)
+			mBindingTable[j] = binding;
+		else
+			mBindingTable.insert(j, binding);
+	}
+	mParentBindingVersion = mParent->GetBindingVersion();
+	mBindingTableDirty = false;
+}
+
+const ShaderBinding* MaterialInstance::GetBindings(UINT& count)
+{
+	const ShaderBinding* parentBindings = mParent->GetBindings(count);
+	if (mResourceOverrides.empty()) return parentBindings;
+	if (mBindingTableDirty || mParentBindingVersion != mParent->GetBindingVersion())
+		UpdateBindingTable();
+	count = (UINT)mBindingTable.size();
+	return mBindingTable.data();
+}
+
+void MaterialInstance::BindShaderResource(ID3D12GraphicsCommandList* commandList)
+{
+	UINT count;
+	const ShaderBinding* bindings = GetBindings(count);
+	Shader::ApplyBindings(commandList, bindings, count);
+}
+
+void MaterialInstance::EnableKeyword(const std::string& keyword)
+{
+	mVariantKey = mParent->GetShader()->EnableKeyword(GetVariantKey(), keyword);
+	mVariantOverridden = true;
+}
+
+void MaterialInstance::DisableKeyword(const std::string& keyword)
+{
+	mVariantKey = mParent->GetShader()->DisableKeyword(GetVariantKey(), keyword);
+	mVariantOverridden = true;
+}
+
+void MaterialInstance::ResetKeywords()
+{
+	mVariantOverridden = false;
+}
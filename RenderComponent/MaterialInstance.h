@@ -0,0 +1,84 @@
+#pragma once
+#include "Material.h"
+//A parent material plus a sparse set of overridden constants and resources
+//Shares the parent's table slot, binding table and PSO key until an override changes them
+class MaterialInstance : public MObject
+{
+public:
+	enum ConstantField
+	{
+		DiffuseAlbedo = 1,
+		FresnelR0 = 2,
+		Roughness = 4,
+		MatTransform = 8,
+		//Index, slice and UV remap together
+		DiffuseMap = 16
+	};
+private:
+	struct ResourceOverride
+	{
+		UINT id;
+		ShaderVariable::Type type;
+		UINT handle;
+		UINT indexOffset;
+		UINT constants[ShaderBinding::MAX_INLINE_CONSTANTS];
+	};
+	std::shared_ptr<Material> mParent;
+	MaterialConstants mOverrideConstants;
+	UINT mOverrideMask = 0;
+	//Own table slot, allocated on the first constant override
+	bool mOwnSlot = false;
+	UINT mMaterialIndex = 0;
+	//Increased whenever GetMaterialIndex returns a different slot
+	UINT mIndexVersion = 0;
+	std::vector<ResourceOverride> mResourceOverrides;
+	//Parent's bindings with the overrides applied, unused while there is no resource override
+	SmallVector<ShaderBinding, 8> mBindingTable;
+	bool mBindingTableDirty = true;
+	UINT mParentBindingVersion = 0;
+	bool mVariantOverridden = false;
+	UINT64 mVariantKey = 0;
+	void ApplyConstantOverrides(MaterialConstants& constants) const;
+	bool SetConstantOverride(UINT field);
+	void UpdateSlot();
+	//Called by the parent when its constants change, rewrites the own slot
+	void RefreshParentConstants();
+	void UpdateBindingTable();
+	bool SetOverride(UINT id, UINT handle, ShaderVariable::Type type, UINT offsetIndex);
+protected:
+	virtual void Dispose();
+	friend class Material;
+public:
+	MaterialInstance(std::shared_ptr<Material> parent);
+	~MaterialInstance() { Release(); }
+	//Constant overrides need the parent to be created from a material table
+	bool SetDiffuseAlbedo(const DirectX::XMFLOAT4& value);
+	bool SetFresnelR0(const DirectX::XMFLOAT3& value);
+	bool SetRoughness(float value);
+	//Matrix is expected in GPU layout (transposed)
+	bool SetMatTransform(const DirectX::XMFLOAT4X4& value);
+	//Descriptor index of the texture array, slice in it and uvScaleOffset of a TexturePackEntry
+	bool SetDiffuseMap(UINT index, UINT slice, const DirectX::XMFLOAT4& uvRemap);
+	//fields is a combination of ConstantField
+	void ClearConstantOverrides(UINT fields);
+	//Flattened on demand from the parent's current constants
+	MaterialConstants GetConstants() const;
+	bool SetBindlessResource(UINT id, UINT offsetIndex);
+	bool SetTexture2D(UINT id, Texture2DHandle targetTex);
+	bool SetTexture2D(UINT id, const std::shared_ptr<Texture2D>& targetTex) { return SetTexture2D(id, targetTex->GetHandle()); }
+	bool SetRootConstants(UINT id, const UINT* values, UINT count);
+	void RemoveOverride(UINT id);
+	void EnableKeyword(const std::string& keyword);
+	void DisableKeyword(const std::string& keyword);
+	//Follow the parent's keywords again
+	void ResetKeywords();
+	UINT64 GetVariantKey() const { return mVariantOverridden ? mVariantKey : mParent->GetVariantKey(); }
+	UINT GetMaterialIndex() const { return mOwnSlot ? mMaterialIndex : mParent->GetMaterialIndex(); }
+	//Object data holding GetMaterialIndex has to be written again when this changes
+	UINT GetIndexVersion() const { return mIndexVersion; }
+	//Same memory as the parent's bindings while no resource is overridden
+	const ShaderBinding* GetBindings(UINT& count);
+	void BindShaderResource(ID3D12GraphicsCommandList* commandList);
+	Material* GetParent() const { return mParent.get(); }
+	Shader* GetShader() const { return mParent->GetShader(); }
+};
@@ -0,0 +1,100 @@
+#include "MaterialTable.h"
+
+MaterialTable::MaterialTable(UINT frameCount, UINT initCapacity) :
+	mCapacity(initCapacity > 0 ? initCapacity : 1)
+{
+	mFrameBuffers.resize(frameCount);
+	for (int i = 0; i < mFrameBuffers.size(); ++i)
+	{
+		mFrameBuffers[i].capacity = 0;
+	}
+	mCPUData.reserve(mCapacity);
+	mNumFramesDirty.reserve(mCapacity);
+}
+
+void MaterialTable::MarkDirty(UINT id)
+{
+	if (mNumFramesDirty[id] <= 0)
+		mDirtyList.push_back(id);
+	mNumFramesDirty[id] = (int)mFrameBuffers.size();
+}
+
+UINT MaterialTable::Allocate(const MaterialConstants& constants)
+{
+	UINT id;
+	if (mFreeIDs.empty())
+	{
+		id = (UINT)mCPUData.size();
+		mCPUData.push_back(constants);
+		mNumFramesDirty.push_back(0);
+		while (mCapacity < mCPUData.size())
+			mCapacity *= 2;
+	}
+	else
+	{
+		id = mFreeIDs[mFreeIDs.size() - 1];
+		mFreeIDs.erase(mFreeIDs.end() - 1);
+		mCPUData[id] = constants;
+	}
+	MarkDirty(id);
+	return id;
+}
+
+void MaterialTable::Release(UINT id)
+{
+	PendingRelease release;
+	release.id = id;
+	release.framesLeft = (int)mFrameBuffers.size();
+	mPendingReleases.push_back(release);
+}
+
+void MaterialTable::SetConstants(UINT id, const MaterialConstants& constants)
+{
+	mCPUData[id] = constants;
+	MarkDirty(id);
+}
+
+void MaterialTable::UploadDirty(ID3D12Device* device, UINT frameIndex)
+{
+	FrameBuffer& frame = mFrameBuffers[frameIndex];
+	if (frame.capacity < mCapacity)
+	{
+		//This frame's fence has passed, so the old buffer is no longer read by the GPU
+		frame.buffer = std::make_shared<UploadBuffer>();
+		frame.buffer->Create(device, mCapacity, false, sizeof(MaterialConstants));
+		frame.capacity = mCapacity;
+		for (UINT i = 0; i < mCPUData.size(); ++i)
+		{
+			frame.buffer->CopyData(i, &mCPUData[i]);
+		}
+	}
+	else
+	{
+		for (int i = 0; i < mDirtyList.size(); ++i)
+		{
+			UINT id = mDirtyList[i];
+			frame.buffer->CopyData(id, &mCPUData[id]);
+		}
+	}
+	for (int i = 0; i < mDirtyList.size();)
+	{
+		UINT id = mDirtyList[i];
+		if (--mNumFramesDirty[id] <= 0)
+		{
+			mDirtyList[i] = mDirtyList[mDirtyList.size() - 1];
+			mDirtyList.erase(mDirtyList.end() - 1);
+		}
+		else ++i;
+	}
+	//Every frame resource rewrote its object data since these were released
+	for (int i = 0; i < mPendingReleases.size();)
+	{
+		if (--mPendingReleases[i].framesLeft <= 0)
+		{
+			mFreeIDs.push_back(mPendingReleases[i].id);
+			mPendingReleases[i] = mPendingReleases[mPendingReleases.size() - 1];
+			mPendingReleases.erase(mPendingReleases.end() - 1);
+		}
+		else ++i;
+	}
+}
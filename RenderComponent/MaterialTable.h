@@ -0,0 +1,45 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "UploadBuffer.h"
+//Every material's constants packed in one structured buffer, indexed by material ID
+//Keeps a dense CPU mirror and only uploads the materials changed since the last frames
+class MaterialTable
+{
+private:
+	struct FrameBuffer
+	{
+		std::shared_ptr<UploadBuffer> buffer;
+		UINT capacity;
+	};
+	struct PendingRelease
+	{
+		UINT id;
+		//Uploads left before the slot can be reused
+		int framesLeft;
+	};
+	std::vector<MaterialConstants> mCPUData;
+	//Frames that still need the current value, same as FMaterial::NumFramesDirty
+	std::vector<int> mNumFramesDirty;
+	std::vector<UINT> mDirtyList;
+	std::vector<UINT> mFreeIDs;
+	std::vector<PendingRelease> mPendingReleases;
+	std::vector<FrameBuffer> mFrameBuffers;
+	UINT mCapacity;
+	void MarkDirty(UINT id);
+public:
+	MaterialTable(UINT frameCount, UINT initCapacity);
+	MaterialTable(const MaterialTable&) = delete;
+	MaterialTable& operator=(const MaterialTable&) = delete;
+	UINT Allocate(const MaterialConstants& constants);
+	//The slot is reused only after every frame resource has uploaded once more,
+	//object data of frames in flight may still point at it until then
+	void Release(UINT id);
+	//Matrices are expected in GPU layout (transposed)
+	void SetConstants(UINT id, const MaterialConstants& constants);
+	const MaterialConstants& GetConstants(UINT id) const { return mCPUData[id]; }
+	//Call after the frame resource's fence has passed, grows that frame's buffer if needed
+	void UploadDirty(ID3D12Device* device, UINT frameIndex);
+	std::shared_ptr<UploadBuffer> GetBuffer(UINT frameIndex) const { return mFrameBuffers[frameIndex].buffer; }
+	UINT Count() const { return (UINT)mCPUData.size(); }
+	UINT DirtyCount() const { return (UINT)mDirtyList.size(); }
+};
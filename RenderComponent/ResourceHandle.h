@@ -0,0 +1,28 @@
+#pragma once
+#include "../Common/SlotMap.h"
+class UploadBuffer;
+class Texture2D;
+class DescriptorHeap;
+typedef Handle<UploadBuffer> UploadBufferHandle;
+typedef Handle<Texture2D> Texture2DHandle;
+typedef Handle<DescriptorHeap> DescriptorHeapHandle;
+//Live resources of one type, bind paths keep 32-bit handles instead of shared_ptr
+//Resources register when created and unregister in Dispose, render thread only
+template<typename T>
+class ResourceRegistry
+{
+public:
+	static SlotMap<T*>& GetMap()
+	{
+		static SlotMap<T*> map;
+		return map;
+	}
+	static Handle<T> Register(T* resource) { return GetMap().Insert(resource); }
+	static void Unregister(Handle<T> handle) { GetMap().Remove(handle); }
+	//nullptr if the resource was disposed
+	static T* Get(Handle<T> handle)
+	{
+		T** resource = GetMap().Get(handle);
+		return resource == nullptr ? nullptr : *resource;
+	}
+};
@@ -3,8 +3,124 @@
 #include "Texture2D.h"
 #include "../Common/DescriptorHeap.h"
 #include "UploadBuffer.h"
+#include "../Singleton/RootSignatureCache.h"
+#include <d3d12shader.h>
+#pragma comment(lib, "dxguid.lib")
 using namespace std;
 using Microsoft::WRL::ComPtr;
+namespace
+{
+	bool IsSameBinding(const ShaderVariable& a, const ShaderVariable& b)
+	{
+		return a.type == b.type &&
+			a.registerPos == b.registerPos &&
+			a.space == b.space &&
+			a.tableSize == b.tableSize;
+	}
+	bool IsCBufferRegister(const ShaderVariable& var)
+	{
+		return var.type == ShaderVariable::Type::ConstantBuffer || var.type == ShaderVariable::Type::RootConstant;
+	}
+	UINT GetRegisterCount(const ShaderVariable& var)
+	{
+		if (var.type != ShaderVariable::Type::BindlessTexture) return 1;
+		//Unbounded arrays take every register up to the end of the space
+		if (var.tableSize == ShaderVariable::UNBOUNDED_TABLE) return UINT_MAX - var.registerPos;
+		return max(var.tableSize, 1u);
+	}
+	bool IsOverlapped(const ShaderVariable& a, const ShaderVariable& b)
+	{
+		if (IsCBufferRegister(a) != IsCBufferRegister(b) || a.space != b.space) return false;
+		UINT aEnd = a.registerPos + GetRegisterCount(a);
+		UINT bEnd = b.registerPos + GetRegisterCount(b);
+		return a.registerPos < bEnd && b.registerPos < aEnd;
+	}
+	//cbuffers up to this size are set as root constants instead of root CBVs
+	const UINT MAX_ROOT_CONSTANT_BYTES = 16;
+	//Lower value changes more frequently and is put at the front of the root signature
+	UINT GetUpdateFrequencyRank(const ShaderVariable& var)
+	{
+		UINT id = ShaderID::PropertyToID(var.name);
+		if (var.type == ShaderVariable::Type::RootConstant) return 0;
+		if (id == ShaderID::GetPerObjectBufferID()) return 1;
+		if (id == ShaderID::GetPerMaterialBufferID()) return 2;
+		if (id == ShaderID::GetPerCameraBufferID()) return 5;
+		if (var.type == ShaderVariable::Type::BindlessTexture) return 4;
+		return 3;
+	}
+	void ThrowLayoutError(const std::string& msg)
+	{
+		::OutputDebugStringA(msg.c_str());
+		ThrowIfFailed(E_INVALIDARG);
+	}
+	void MergeVariable(std::vector<ShaderVariable>& target, const ShaderVariable& var, Symbol passName)
+	{
+		for (int i = 0; i < target.size(); ++i)
+		{
+			ShaderVariable& other = target[i];
+			if (other.name == var.name)
+			{
+				if (!IsSameBinding(other, var))
+					ThrowLayoutError("Shader variable " + var.name + " has different bindings in pass " + passName.str() + "\n");
+				return;
+			}
+			if (IsOverlapped(other, var))
+				ThrowLayoutError("Shader variable " + var.name + " overlaps " + other.name + " in pass " + passName.str() + "\n");
+		}
+		target.push_back(var);
+	}
+	void ReflectBlob(ID3DBlob* blob, std::vector<ShaderVariable>& target, Symbol passName)
+	{
+		if (blob == nullptr) return;
+		ComPtr<ID3D12ShaderReflection> reflection;
+		ThrowIfFailed(D3DReflect(blob->GetBufferPointer(), blob->GetBufferSize(), IID_PPV_ARGS(reflection.GetAddressOf())));
+		D3D12_SHADER_DESC shaderDesc;
+		ThrowIfFailed(reflection->GetDesc(&shaderDesc));
+		for (UINT i = 0; i < shaderDesc.BoundResources; ++i)
+		{
+			D3D12_SHADER_INPUT_BIND_DESC bindDesc;
+			ThrowIfFailed(reflection->GetResourceBindingDesc(i, &bindDesc));
+			ShaderVariable var;
+			var.name = bindDesc.Name;
+			var.registerPos = bindDesc.BindPoint;
+			var.space = bindDesc.Space;
+			var.tableSize = 0;
+			switch (bindDesc.Type)
+			{
+			case D3D_SIT_CBUFFER:
+			{
+				D3D12_SHADER_BUFFER_DESC bufferDesc;
+				ThrowIfFailed(reflection->GetConstantBufferByName(bindDesc.Name)->GetDesc(&bufferDesc));
+				if (bufferDesc.Size <= MAX_ROOT_CONSTANT_BYTES)
+				{
+					var.type = ShaderVariable::Type::RootConstant;
+					var.tableSize = bufferDesc.Size / 4;
+				}
+				else
+					var.type = ShaderVariable::Type::ConstantBuffer;
+			}
+				break;
+			case D3D_SIT_TEXTURE:
+				//Textures can not be root descriptors, single textures use a table of one
+				var.type = ShaderVariable::Type::BindlessTexture;
+				//Arrays declared without a size report no bind count
+				var.tableSize = bindDesc.BindCount == 0 ? ShaderVariable::UNBOUNDED_TABLE : bindDesc.BindCount;
+				break;
+			case D3D_SIT_STRUCTURED:
+			case D3D_SIT_BYTEADDRESS:
+				var.type = ShaderVariable::Type::StructuredBuffer;
+				break;
+			case D3D_SIT_SAMPLER:
+				//Static samplers live in the root signature already
+				continue;
+			default:
+				ThrowLayoutError("Shader variable " + var.name + " has unsupported type in pass " + passName.str() + "\n");
+				break;
+			}
+			MergeVariable(target, var, passName);
+		}
+	}
+}
 Shader::~Shader()
 {
 
@@ -15,18 +131,91 @@ void Shader::BindRootSignature(ID3D12GraphicsCommandList* commandList)
 	commandList->SetGraphicsRootSignature(mRootSignature.Get());
 }
 
+void Shader::CompilePasses(std::vector<Pass>& passes)
+{
+	for (int i = 0; i < passes.size(); ++i)
+	{
+		Pass& p = passes[i];
+		if (p.vsShader == nullptr && !p.vsFuture.valid())
+			p.vsFuture = ShaderCompiler::Compile({ p.filePath, p.vertex, "vs_5_1" });
+		if (p.psShader == nullptr && !p.psFuture.valid())
+			p.psFuture = ShaderCompiler::Compile({ p.filePath, p.fragment, "ps_5_1" });
+	}
+}
+
 void Shader::GetPassPSODesc(UINT pass, D3D12_GRAPHICS_PIPELINE_STATE_DESC* targetPSO)
+{
+	GetPassPSODesc(pass, 0, targetPSO);
+}
+
+void Shader::GetPassPSODesc(UINT pass, UINT64 variantKey, D3D12_GRAPHICS_PIPELINE_STATE_DESC* targetPSO)
 {
 	Pass& p = allPasses[pass];
+	ID3DBlob* vsShader = p.vsShader.Get();
+	ID3DBlob* psShader = p.psShader.Get();
+	if (variantKey != 0)
+	{
+		PassVariant* variant;
+		ShaderCompileFuture vsFuture;
+		ShaderCompileFuture psFuture;
+		{
+			std::lock_guard<std::mutex> lck(mVariantMtx);
+			variant = &PrepareVariant(pass, variantKey);
+			vsFuture = variant->vsFuture;
+			psFuture = variant->psFuture;
+		}
+		//Wait outside of the lock so other variants can still be requested
+		if (vsFuture.valid())
+		{
+			std::vector<ShaderCompileJob> jobs(2);
+			jobs[0].entryPoint = p.vertex;
+			jobs[0].target = "vs_5_1";
+			jobs[1].entryPoint = p.fragment;
+			jobs[1].target = "ps_5_1";
+			try
+			{
+				ShaderCompiler::WaitAll(jobs, { vsFuture, psFuture });
+				std::lock_guard<std::mutex> lck(mVariantMtx);
+				if (variant->vsFuture.valid())
+				{
+					variant->vsShader = vsFuture.get().byteCode;
+					variant->psShader = psFuture.get().byteCode;
+					variant->vsFuture = ShaderCompileFuture();
+					variant->psFuture = ShaderCompileFuture();
+					ValidateVariant(pass, *variant);
+				}
+			}
+			catch (const DxException&)
+			{
+				//Keep the failure so later calls neither wait on the failed futures nor throw again
+				std::lock_guard<std::mutex> lck(mVariantMtx);
+				if (!variant->failed)
+				{
+					::OutputDebugStringA(("Shader variant of pass " + p.name.str() + " failed, using the base variant\n").c_str());
+					variant->failed = true;
+					variant->vsFuture = ShaderCompileFuture();
+					variant->psFuture = ShaderCompileFuture();
+					variant->vsShader = nullptr;
+					variant->psShader = nullptr;
+				}
+			}
+		}
+		std::lock_guard<std::mutex> lck(mVariantMtx);
+		if (!variant->failed)
+		{
+			vsShader = variant->vsShader.Get();
+			psShader = variant->psShader.Get();
+		}
+	}
 	targetPSO->VS = 
 	{
-		reinterpret_cast<BYTE*>(p.vsShader->GetBufferPointer()),
-		p.vsShader->GetBufferSize()
+		reinterpret_cast<BYTE*>(vsShader->GetBufferPointer()),
+		vsShader->GetBufferSize()
 	};
 	targetPSO->PS =
 	{
-		reinterpret_cast<BYTE*>(p.psShader->GetBufferPointer()),
-		p.psShader->GetBufferSize()
+		reinterpret_cast<BYTE*>(psShader->GetBufferPointer()),
+		psShader->GetBufferSize()
 	};
 	targetPSO->BlendState = p.blendState;
 	targetPSO->RasterizerState = p.rasterizeState;
@@ -34,118 +223,346 @@ void Shader::GetPassPSODesc(UINT pass, D3D12_GRAPHICS_PIPELINE_STATE_DESC* targe
 	targetPSO->DepthStencilState = p.depthStencilState;
 }
 
+void Shader::PrewarmVariant(UINT pass, UINT64 variantKey)
+{
+	if (variantKey == 0) return;
+	std::lock_guard<std::mutex> lck(mVariantMtx);
+	PrepareVariant(pass, variantKey);
+}
+
+Shader::PassVariant& Shader::PrepareVariant(UINT pass, UINT64 variantKey)
+{
+	std::unordered_map<UINT64, PassVariant>& variants = mPassVariants[pass];
+	auto&& ite = variants.find(variantKey);
+	if (ite != variants.end()) return ite->second;
+	Pass& p = allPasses[pass];
+	ShaderCompileJob job;
+	job.filePath = p.filePath;
+	for (UINT i = 0; i < mKeywords.size(); ++i)
+	{
+		if (variantKey & (1ull << i))
+			job.defines.push_back(mKeywords[i].macro);
+	}
+	PassVariant& variant = variants[variantKey];
+	job.entryPoint = p.vertex;
+	job.target = "vs_5_1";
+	variant.vsFuture = ShaderCompiler::Compile(job);
+	job.entryPoint = p.fragment;
+	job.target = "ps_5_1";
+	variant.psFuture = ShaderCompiler::Compile(job);
+	return variant;
+}
+
+void Shader::ValidateVariant(UINT pass, const PassVariant& variant)
+{
+	//Variants share the root signature, so they must not bind anything new
+	std::vector<Pass> variantPass(1);
+	variantPass[0].name = allPasses[pass].name;
+	variantPass[0].vsShader = variant.vsShader;
+	variantPass[0].psShader = variant.psShader;
+	std::vector<ShaderVariable> variables = ReflectVariables(variantPass);
+	for (int i = 0; i < variables.size(); ++i)
+	{
+		ShaderVariable var;
+		if (!TryGetShaderVariable(ShaderID::PropertyToID(variables[i].name), var) || !IsSameBinding(var, variables[i]))
+			ThrowLayoutError("Shader variant binds " + variables[i].name + " differently from pass " + variantPass[0].name.str() + "\n");
+	}
+}
+
+void Shader::InitKeywords(const std::vector<ShaderKeywordSet>& keywordSets)
+{
+	mPassVariants.resize(allPasses.size());
+	for (int i = 0; i < keywordSets.size(); ++i)
+	{
+		const ShaderKeywordSet& set = keywordSets[i];
+		UINT64 setMask = 0;
+		UINT setStart = (UINT)mKeywords.size();
+		for (int j = 0; j < set.size(); ++j)
+		{
+			UINT index = (UINT)mKeywords.size();
+			if (index >= 64)
+				ThrowLayoutError("Shader declares more than 64 keywords\n");
+			//The default keyword gets a bit too, but it is never set in a variant key
+			if (j != 0) setMask |= 1ull << index;
+			mKeywordsDict[set[j].name] = index;
+			mKeywords.push_back(set[j]);
+		}
+		mKeywordSetMasks.resize(mKeywords.size());
+		for (UINT j = setStart; j < mKeywords.size(); ++j)
+		{
+			mKeywordSetMasks[j] = setMask;
+		}
+	}
+}
+
+UINT64 Shader::EnableKeyword(UINT64 variantKey, const std::string& keyword) const
+{
+	auto&& ite = mKeywordsDict.find(keyword);
+	if (ite == mKeywordsDict.end()) return variantKey;
+	UINT64 setMask = mKeywordSetMasks[ite->second];
+	//Enabling the default keyword clears the whole set
+	return (variantKey & ~setMask) | (setMask & (1ull << ite->second));
+}
+
+UINT64 Shader::DisableKeyword(UINT64 variantKey, const std::string& keyword) const
+{
+	auto&& ite = mKeywordsDict.find(keyword);
+	if (ite == mKeywordsDict.end()) return variantKey;
+	return variantKey & ~(1ull << ite->second);
+}
+
 Shader::Shader(
 	std::vector<Pass> passPaths,
 	std::vector<ShaderVariable> allShaderVariables,
-	ID3D12Device* device
+	ID3D12Device* device,
+	const std::vector<ShaderKeywordSet>& keywordSets
+)
+{
+	InitPasses(passPaths);
+	InitVariables(allShaderVariables);
+	InitKeywords(keywordSets);
+	BuildRootSignature(device);
+}
+
+Shader::Shader(
+	std::vector<Pass> passPaths,
+	ID3D12Device* device,
+	const std::vector<ShaderKeywordSet>& keywordSets
 )
 {
-	//Create Pass
+	InitPasses(passPaths);
+	InitVariables(ReflectVariables(allPasses));
+	InitKeywords(keywordSets);
+	BuildRootSignature(device);
+}
+
+std::vector<ShaderVariable> Shader::ReflectVariables(const std::vector<Pass>& passes)
+{
+	std::vector<ShaderVariable> result;
+	for (int i = 0; i < passes.size(); ++i)
+	{
+		//Every pass shares one root signature, so a variable must have the same binding in all of them
+		std::vector<ShaderVariable> passVariables;
+		ReflectBlob(passes[i].vsShader.Get(), passVariables, passes[i].name);
+		ReflectBlob(passes[i].psShader.Get(), passVariables, passes[i].name);
+		for (int j = 0; j < passVariables.size(); ++j)
+		{
+			MergeVariable(result, passVariables[j], passes[i].name);
+		}
+	}
+	std::stable_sort(result.begin(), result.end(), [](const ShaderVariable& a, const ShaderVariable& b) -> bool
+	{
+		UINT aRank = GetUpdateFrequencyRank(a);
+		UINT bRank = GetUpdateFrequencyRank(b);
+		if (aRank != bRank) return aRank < bRank;
+		if (a.space != b.space) return a.space < b.space;
+		return a.registerPos < b.registerPos;
+	});
+	return result;
+}
+
+void Shader::InitPasses(std::vector<Pass>& passPaths)
+{
+	CompilePasses(passPaths);
+	std::vector<ShaderCompileJob> jobs;
+	std::vector<ShaderCompileFuture> futures;
+	jobs.reserve(passPaths.size() * 2);
+	futures.reserve(passPaths.size() * 2);
+	for (int i = 0; i < passPaths.size(); ++i)
+	{
+		Pass& p = passPaths[i];
+		if (p.vsFuture.valid())
+		{
+			jobs.push_back({ p.filePath, p.vertex, "vs_5_1" });
+			futures.push_back(p.vsFuture);
+		}
+		if (p.psFuture.valid())
+		{
+			jobs.push_back({ p.filePath, p.fragment, "ps_5_1" });
+			futures.push_back(p.psFuture);
+		}
+	}
+	ShaderCompiler::WaitAll(jobs, futures);
 	allPasses.reserve(passPaths.size());
 	for (int i = 0; i < passPaths.size(); ++i)
 	{
 		Pass& p = passPaths[i];
-		if(p.vsShader == nullptr)
-			p.vsShader = d3dUtil::CompileShader(p.filePath, nullptr, p.vertex, "vs_5_1");
-		if(p.psShader == nullptr)
-			p.psShader = d3dUtil::CompileShader(p.filePath, nullptr, p.fragment, "ps_5_1");
+		if (p.vsFuture.valid())
+		{
+			p.vsShader = p.vsFuture.get().byteCode;
+			p.vsFuture = ShaderCompileFuture();
+		}
+		if (p.psFuture.valid())
+		{
+			p.psShader = p.psFuture.get().byteCode;
+			p.psFuture = ShaderCompileFuture();
+		}
 		allPasses.push_back(std::move(p));
 	}
+}
+
+void Shader::InitVariables(const std::vector<ShaderVariable>& allShaderVariables)
+{
 	mVariablesDict.reserve(allShaderVariables.size() + 2);
 	mVariablesVector.reserve(allShaderVariables.size());
 	for (int i = 0; i < allShaderVariables.size(); ++i)
 	{
-		ShaderVariable& variable = allShaderVariables[i];
+		const ShaderVariable& variable = allShaderVariables[i];
 		mVariablesDict[ShaderID::PropertyToID(variable.name)] = i;
 		mVariablesVector.push_back(variable);
 	}
+}
 
-	//texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2, 2, 1);
-	vector<CD3DX12_ROOT_PARAMETER> allParameter;
+void Shader::BuildRootSignature(ID3D12Device* device)
+{
+	vector<D3D12_ROOT_PARAMETER1> allParameter;
 	auto staticSamplers = d3dUtil::GetStaticSamplers();
 	allParameter.reserve(VariableLength());
-	std::vector< CD3DX12_DESCRIPTOR_RANGE> allTexTable;
+	std::vector<D3D12_DESCRIPTOR_RANGE1> allTexTable;
 	IterateVariables([&](ShaderVariable& var) -> void {
 		if(var.type == ShaderVariable::Type::BindlessTexture)
 		{
-			CD3DX12_DESCRIPTOR_RANGE texTable;
-			texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, var.tableSize, var.registerPos, var.space);
+			D3D12_DESCRIPTOR_RANGE1 texTable;
+			texTable.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+			texTable.NumDescriptors = var.tableSize;
+			texTable.BaseShaderRegister = var.registerPos;
+			texTable.RegisterSpace = var.space;
+			//Texels are never written after upload, streaming swaps in a new resource instead
+			texTable.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC;
+			//Unbounded ranges reach past the descriptors that were written, which only volatile descriptors allow
+			if (var.tableSize == ShaderVariable::UNBOUNDED_TABLE)
+				texTable.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE | D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE;
+			texTable.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
 			allTexTable.push_back(texTable);
 		}
 	});
 	UINT offset = 0;
 	IterateVariables([&](ShaderVariable& var) -> void
 	{
-		CD3DX12_ROOT_PARAMETER slotRootParameter;
+		D3D12_ROOT_PARAMETER1 slotRootParameter;
+		slotRootParameter.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
 		switch (var.type)
 		{
 		case ShaderVariable::Type::Texture2D:
-			slotRootParameter.InitAsShaderResourceView(var.registerPos, var.space);
+			slotRootParameter.ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+			slotRootParameter.Descriptor = { var.registerPos, var.space, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC };
 			break;
 		case ShaderVariable::Type::BindlessTexture:
-			slotRootParameter.InitAsDescriptorTable(1, allTexTable.data() + offset);
+			slotRootParameter.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+			slotRootParameter.DescriptorTable = { 1, allTexTable.data() + offset };
 			offset++;
 			break;
 		case ShaderVariable::Type::ConstantBuffer:
-			slotRootParameter.InitAsConstantBufferView(var.registerPos, var.space);
+			//Upload buffers are rewritten by the CPU every frame, but never while the GPU executes
+			slotRootParameter.ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+			slotRootParameter.Descriptor = { var.registerPos, var.space, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE };
 			break;
 		case ShaderVariable::Type::StructuredBuffer:
-			slotRootParameter.InitAsShaderResourceView(var.registerPos, var.space);
+			slotRootParameter.ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+			slotRootParameter.Descriptor = { var.registerPos, var.space, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE };
+			break;
+		case ShaderVariable::Type::RootConstant:
+			slotRootParameter.ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+			slotRootParameter.Constants = { var.registerPos, var.space, var.tableSize };
 			break;
 		}
 		allParameter.push_back(slotRootParameter);
 	});
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(allParameter.size(), allParameter.data(),
-		(UINT)staticSamplers.size(), staticSamplers.data(),
-		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
-	ComPtr<ID3DBlob> serializedRootSig = nullptr;
-	ComPtr<ID3DBlob> errorBlob = nullptr;
-	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
-		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
-
-	if (errorBlob != nullptr)
-	{
-		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
-	}
-	ThrowIfFailed(hr);
-
-	ThrowIfFailed(device->CreateRootSignature(
-		0,
-		serializedRootSig->GetBufferPointer(),
-		serializedRootSig->GetBufferSize(),
-		IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+	D3D12_ROOT_SIGNATURE_DESC1 rootSigDesc;
+	rootSigDesc.NumParameters = (UINT)allParameter.size();
+	rootSigDesc.pParameters = allParameter.data();
+	rootSigDesc.NumStaticSamplers = (UINT)staticSamplers.size();
+	rootSigDesc.pStaticSamplers = staticSamplers.data();
+	rootSigDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
+	mRootSignature = RootSignatureCache::GetRootSignature(device, rootSigDesc);
 }
 
-void Shader::SetResource(ID3D12GraphicsCommandList* commandList, UINT id, std::shared_ptr<MObject> targetObj, UINT indexOffset)
+bool Shader::ResolveBinding(UINT id, MObject* targetObj, UINT indexOffset, ShaderBinding& binding)
 {
 	auto&& ite = mVariablesDict.find(id);
-	if (ite == mVariablesDict.end()) return;
+	if (ite == mVariablesDict.end() || targetObj == nullptr) return false;
 	UINT rootSigPos = ite->second;
 	ShaderVariable& var = mVariablesVector[rootSigPos];
-	std::shared_ptr<UploadBuffer> uploadBufferPtr = reinterpret_pointer_cast<UploadBuffer, MObject>(targetObj);
+	binding.rootSigPos = rootSigPos;
+	binding.type = var.type;
+	binding.constantCount = 0;
+	binding.residency = ResidencyHandle();
 	switch (var.type)
 	{
+	case ShaderVariable::Type::RootConstant:
+		return false;
 	case ShaderVariable::Type::Texture2D:
-		commandList->SetGraphicsRootShaderResourceView(
-			rootSigPos, 
-			reinterpret_pointer_cast<Texture2D, MObject>(targetObj)->GetResource()->GetGPUVirtualAddress());
+	{
+		Texture2D* texture = reinterpret_cast<Texture2D*>(targetObj);
+		binding.value = texture->GetResource()->GetGPUVirtualAddress();
+		binding.residency = texture->GetResidency();
+	}
 		break;
 	case ShaderVariable::Type::BindlessTexture:
-		commandList->SetGraphicsRootDescriptorTable(
-			rootSigPos,
-			reinterpret_pointer_cast<DescriptorHeap, MObject>(targetObj)->hGPU(indexOffset)
-		);
+	{
+		DescriptorHeap* heap = reinterpret_cast<DescriptorHeap*>(targetObj);
+		binding.value = heap->hGPU(indexOffset).ptr;
+		binding.residency = heap->GetResidency();
+	}
 		break;
 	case ShaderVariable::Type::ConstantBuffer:
-		commandList->SetGraphicsRootConstantBufferView(
-			rootSigPos,
-			uploadBufferPtr->Resource()->GetGPUVirtualAddress() + indexOffset * uploadBufferPtr->GetAlignedStride()
-		);
+	{
+		UploadBuffer* uploadBufferPtr = reinterpret_cast<UploadBuffer*>(targetObj);
+		binding.value = uploadBufferPtr->Resource()->GetGPUVirtualAddress() + indexOffset * uploadBufferPtr->GetAlignedStride();
+		binding.residency = uploadBufferPtr->GetResidency();
+	}
 		break;
 	case ShaderVariable::Type::StructuredBuffer:
-		//TODO
+	{
+		UploadBuffer* uploadBufferPtr = reinterpret_cast<UploadBuffer*>(targetObj);
+		binding.value = uploadBufferPtr->Resource()->GetGPUVirtualAddress() + indexOffset * uploadBufferPtr->GetStride();
+		binding.residency = uploadBufferPtr->GetResidency();
+	}
 		break;
 	}
+	return true;
+}
+
+bool Shader::ResolveHandleBinding(UINT id, UINT handleValue, UINT indexOffset, ShaderBinding& binding)
+{
+	auto&& ite = mVariablesDict.find(id);
+	if (ite == mVariablesDict.end()) return false;
+	switch (mVariablesVector[ite->second].type)
+	{
+	case ShaderVariable::Type::Texture2D:
+		return ResolveBinding(id, Texture2DHandle(handleValue), indexOffset, binding);
+	case ShaderVariable::Type::BindlessTexture:
+		return ResolveBinding(id, DescriptorHeapHandle(handleValue), indexOffset, binding);
+	case ShaderVariable::Type::ConstantBuffer:
+	case ShaderVariable::Type::StructuredBuffer:
+		return ResolveBinding(id, UploadBufferHandle(handleValue), indexOffset, binding);
+	}
+	return false;
+}
+
+bool Shader::ResolveRootConstants(UINT id, const UINT* values, UINT count, ShaderBinding& binding)
+{
+	auto&& ite = mVariablesDict.find(id);
+	if (ite == mVariablesDict.end()) return false;
+	ShaderVariable& var = mVariablesVector[ite->second];
+	if (var.type != ShaderVariable::Type::RootConstant ||
+		count > var.tableSize ||
+		count > ShaderBinding::MAX_INLINE_CONSTANTS) return false;
+	binding.rootSigPos = ite->second;
+	binding.type = var.type;
+	binding.constantCount = count;
+	binding.residency = ResidencyHandle();
+	memcpy(binding.constants, values, count * sizeof(UINT));
+	return true;
+}
+
+void Shader::SetRootConstants(ID3D12GraphicsCommandList* commandList, UINT id, const UINT* values, UINT count, UINT destOffset)
+{
+	auto&& ite = mVariablesDict.find(id);
+	if (ite == mVariablesDict.end()) return;
+	ShaderVariable& var = mVariablesVector[ite->second];
+	if (var.type != ShaderVariable::Type::RootConstant || destOffset + count > var.tableSize) return;
+	commandList->SetGraphicsRoot32BitConstants(ite->second, count, values, destOffset);
 }
 
 ShaderVariable Shader::GetVariable(std::string name)
@@ -165,6 +582,15 @@ bool Shader::TryGetShaderVariable(UINT id, ShaderVariable& targetVar)
 	targetVar = mVariablesVector[ite->second];
 	return true;
 }
+
+bool Shader::TryGetShaderVariable(UINT id, ShaderVariable& targetVar, UINT& rootSigPos)
+{
+	auto&& ite = mVariablesDict.find(id);
+	if (ite == mVariablesDict.end()) return false;
+	rootSigPos = ite->second;
+	targetVar = mVariablesVector[rootSigPos];
+	return true;
+}
 /*
 
 */
@@ -3,14 +3,30 @@
 #include <vector>
 #include <string>
 #include "MObject.h"
-struct Pass
+#include "ResourceHandle.h"
+#include "../Singleton/ShaderCompiler.h"
+#include "../Singleton/ResidencyManager.h"
+#include <mutex>
+struct ShaderKeyword
 {
+	//Name used by materials to select the keyword
 	std::string name;
-	std::wstring filePath;
+	ShaderMacro macro;
+};
+//Mutually exclusive keywords, the first one is the default
+//The default is compiled without its macro, so it must match the shader source's own default
+typedef std::vector<ShaderKeyword> ShaderKeywordSet;
+struct Pass
+{
+	Symbol name;
+	WSymbol filePath;
 	std::string vertex;
 	std::string fragment;
 	Microsoft::WRL::ComPtr<ID3DBlob> vsShader;
 	Microsoft::WRL::ComPtr<ID3DBlob> psShader;
+	//Pending compile results, filled by Shader::CompilePasses
+	ShaderCompileFuture vsFuture;
+	ShaderCompileFuture psFuture;
 	D3D12_RASTERIZER_DESC rasterizeState;
 	D3D12_DEPTH_STENCIL_DESC depthStencilState;
 	D3D12_BLEND_DESC blendState;
@@ -18,17 +34,37 @@ struct Pass
 
 struct ShaderVariable
 {
+	static const UINT UNBOUNDED_TABLE = UINT_MAX;
 	enum Type
 	{
-		Texture2D, ConstantBuffer, StructuredBuffer, BindlessTexture
+		Texture2D, ConstantBuffer, StructuredBuffer, BindlessTexture, RootConstant
 	};
 	std::string name;
 	Type type;
+	//Descriptor count for tables, 32-bit value count for root constants
+	//UNBOUNDED_TABLE for texture arrays declared without a size
 	UINT tableSize;
 	UINT registerPos;
 	UINT space;
 
 };
+//A root parameter resolved ahead of draw time: GPU virtual address for root
+//descriptors, GPU descriptor handle for tables
+struct ShaderBinding
+{
+	static const UINT MAX_INLINE_CONSTANTS = 4;
+	UINT rootSigPos;
+	ShaderVariable::Type type;
+	//Only used by root constants
+	UINT constantCount;
+	//Resource behind value, marked used whenever the binding is applied
+	ResidencyHandle residency;
+	union
+	{
+		UINT64 value;
+		UINT constants[MAX_INLINE_CONSTANTS];
+	};
+};
 class Shader
 {
 private:
@@ -36,20 +72,126 @@ private:
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> mRootSignature;
 	std::unordered_map<UINT, UINT> mVariablesDict;
 	std::vector<ShaderVariable> mVariablesVector;
+	struct PassVariant
+	{
+		ShaderCompileFuture vsFuture;
+		ShaderCompileFuture psFuture;
+		Microsoft::WRL::ComPtr<ID3DBlob> vsShader;
+		Microsoft::WRL::ComPtr<ID3DBlob> psShader;
+		//Compile or validation failed once, the pass falls back to variant 0 from then on
+		bool failed = false;
+	};
+	std::vector<ShaderKeyword> mKeywords;
+	//Bits of every keyword in the same set, indexed by keyword
+	std::vector<UINT64> mKeywordSetMasks;
+	std::unordered_map<std::string, UINT> mKeywordsDict;
+	//Variants of every pass keyed by keyword bitmask, variant 0 lives in allPasses
+	std::vector<std::unordered_map<UINT64, PassVariant>> mPassVariants;
+	std::mutex mVariantMtx;
+	void InitKeywords(const std::vector<ShaderKeywordSet>& keywordSets);
+	PassVariant& PrepareVariant(UINT pass, UINT64 variantKey);
+	void ValidateVariant(UINT pass, const PassVariant& variant);
+	void InitPasses(std::vector<Pass>& passPaths);
+	void InitVariables(const std::vector<ShaderVariable>& allShaderVariables);
+	void BuildRootSignature(ID3D12Device* device);
 public:
 	Shader() {}
 	~Shader();
 	Shader(
 		std::vector<Pass> passPaths,
 		std::vector<ShaderVariable> allShaderVariables,
-		ID3D12Device* device
+		ID3D12Device* device,
+		const std::vector<ShaderKeywordSet>& keywordSets = std::vector<ShaderKeywordSet>()
 	);
+	//Generate variables from the compiled bytecode of every pass
+	Shader(
+		std::vector<Pass> passPaths,
+		ID3D12Device* device,
+		const std::vector<ShaderKeywordSet>& keywordSets = std::vector<ShaderKeywordSet>()
+	);
+	//Reflect the bound resources of all passes, ordered by update frequency
+	//Throws if two passes bind one variable differently
+	static std::vector<ShaderVariable> ReflectVariables(const std::vector<Pass>& passes);
+	//Start compiling every pass without bytecode on the thread pool
+	//Call this for all shaders before constructing any of them so the compiles overlap
+	static void CompilePasses(std::vector<Pass>& passes);
 	void GetPassPSODesc(UINT pass, D3D12_GRAPHICS_PIPELINE_STATE_DESC* targetPSO);
+	//Compiles the variant on first use and caches it
+	//A variant that fails to compile is reported once and replaced by variant 0
+	void GetPassPSODesc(UINT pass, UINT64 variantKey, D3D12_GRAPHICS_PIPELINE_STATE_DESC* targetPSO);
+	//Start compiling a variant in the background without waiting for it
+	void PrewarmVariant(UINT pass, UINT64 variantKey);
+	//Returns variantKey with the keyword enabled and the rest of its set disabled
+	//Unknown keywords leave the key unchanged
+	UINT64 EnableKeyword(UINT64 variantKey, const std::string& keyword) const;
+	UINT64 DisableKeyword(UINT64 variantKey, const std::string& keyword) const;
 	ShaderVariable GetVariable(std::string name);
 	ShaderVariable GetVariable(UINT id);
 	void BindRootSignature(ID3D12GraphicsCommandList* commandList);
-	void SetResource(ID3D12GraphicsCommandList* commandList, UINT id, std::shared_ptr<MObject> targetObj, UINT indexOffset);
+	//Shaders with the same layout share one root signature, compare before rebinding
+	ID3D12RootSignature* GetRootSignature() const { return mRootSignature.Get(); }
+	//Resolves and applies in one go, see Tests/BindingBenchmark for what pre-resolving saves
+	//CommandList is ID3D12GraphicsCommandList or anything with the same root argument setters
+	template<typename CommandList>
+	void SetResource(CommandList* commandList, UINT id, std::shared_ptr<MObject> targetObj, UINT indexOffset)
+	{
+		ShaderBinding binding;
+		if (ResolveBinding(id, targetObj.get(), indexOffset, binding))
+			ApplyBindings(commandList, &binding, 1);
+	}
+	//Look up the root slot and GPU address once, so draws only replay plain data
+	bool ResolveBinding(UINT id, MObject* targetObj, UINT indexOffset, ShaderBinding& binding);
+	//Typed handle to an UploadBuffer, Texture2D or DescriptorHeap, fails once the resource is disposed
+	template<typename T>
+	bool ResolveBinding(UINT id, Handle<T> handle, UINT indexOffset, ShaderBinding& binding)
+	{
+		T* resource = ResourceRegistry<T>::Get(handle);
+		return resource != nullptr && ResolveBinding(id, reinterpret_cast<MObject*>(resource), indexOffset, binding);
+	}
+	//Untyped handle value, the registry is picked from the variable's type
+	bool ResolveHandleBinding(UINT id, UINT handleValue, UINT indexOffset, ShaderBinding& binding);
+	template<typename CommandList, typename T>
+	void SetResource(CommandList* commandList, UINT id, Handle<T> handle, UINT indexOffset)
+	{
+		ShaderBinding binding;
+		if (ResolveBinding(id, handle, indexOffset, binding))
+			ApplyBindings(commandList, &binding, 1);
+	}
+	//Root constants up to MAX_INLINE_CONSTANTS values are stored in the binding itself
+	bool ResolveRootConstants(UINT id, const UINT* values, UINT count, ShaderBinding& binding);
+	void SetRootConstants(ID3D12GraphicsCommandList* commandList, UINT id, const UINT* values, UINT count, UINT destOffset = 0);
+	template<typename CommandList>
+	static void ApplyBindings(CommandList* commandList, const ShaderBinding* bindings, UINT count)
+	{
+		for (UINT i = 0; i < count; ++i)
+		{
+			const ShaderBinding& binding = bindings[i];
+			ResidencyManager::MarkUsed(binding.residency);
+			switch (binding.type)
+			{
+			case ShaderVariable::Type::BindlessTexture:
+			{
+				D3D12_GPU_DESCRIPTOR_HANDLE handle;
+				handle.ptr = binding.value;
+				commandList->SetGraphicsRootDescriptorTable(binding.rootSigPos, handle);
+			}
+				break;
+			case ShaderVariable::Type::ConstantBuffer:
+				commandList->SetGraphicsRootConstantBufferView(binding.rootSigPos, binding.value);
+				break;
+			case ShaderVariable::Type::Texture2D:
+			case ShaderVariable::Type::StructuredBuffer:
+				commandList->SetGraphicsRootShaderResourceView(binding.rootSigPos, binding.value);
+				break;
+			case ShaderVariable::Type::RootConstant:
+				commandList->SetGraphicsRoot32BitConstants(binding.rootSigPos, binding.constantCount, binding.constants, 0);
+				break;
+			}
+		}
+	}
 	bool TryGetShaderVariable(UINT id, ShaderVariable& targetVar);
+	//Also returns the variable's root signature slot
+	bool TryGetShaderVariable(UINT id, ShaderVariable& targetVar, UINT& rootSigPos);
 	size_t VariableLength() const { return mVariablesVector.size(); }
 	template<typename Func>
 	void IterateVariables(Func&& f)
@@ -1,29 +1,239 @@
 #include "Texture2D.h"
+#include "../Singleton/TextureStreamer.h"
+#include "../Singleton/UploadManager.h"
+#include "../Common/ThreadPool.h"
+#include "../Common/MappedFile.h"
+#include "../Common/DDSCore.h"
 
 Texture2D::Texture2D(
 	ID3D12GraphicsCommandList* commandList,
 	ID3D12Device* device,
-	std::string name,
-	std::wstring filePath
+	Symbol name,
+	WSymbol filePath
 ) : MObject()
 {
 	Name = name;
 	Filename = filePath;
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(device,
-		commandList, Filename.c_str(),
-		Resource, UploadHeap));
+	mHandle = ResourceRegistry<Texture2D>::Register(this);
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> resources;
+	LoadResources(commandList, device, std::vector<WSymbol>(1, Filename), resources);
+	Resource = resources[0];
+	mResidency = ResidencyManager::Register(Resource.Get());
+	InitStreamInfo();
+}
+
+Texture2D::Texture2D(
+	Symbol name,
+	WSymbol filePath,
+	float priority
+) : MObject()
+{
+	Name = name;
+	Filename = filePath;
+	mHandle = ResourceRegistry<Texture2D>::Register(this);
+	TextureStreamer::Request(mHandle, Filename.c_str(), priority);
+}
+
+Texture2D::Texture2D(
+	Symbol name,
+	WSymbol filePath,
+	Microsoft::WRL::ComPtr<ID3D12Resource> resource
+) : MObject()
+{
+	Name = name;
+	Filename = filePath;
+	mHandle = ResourceRegistry<Texture2D>::Register(this);
+	Resource = resource;
+	mResidency = ResidencyManager::Register(Resource.Get());
+	InitStreamInfo();
+}
+
+void Texture2D::InitStreamInfo()
+{
+	D3D12_RESOURCE_DESC resourceDesc = Resource->GetDesc();
+	mStreamInfo.width = (UINT)resourceDesc.Width;
+	mStreamInfo.height = resourceDesc.Height;
+	mStreamInfo.arraySize = resourceDesc.DepthOrArraySize;
+	mStreamInfo.mipCount = resourceDesc.MipLevels;
+	mStreamInfo.format = resourceDesc.Format;
+	mFirstResidentMip = 0;
+}
+
+void Texture2D::LoadResources(
+	ID3D12GraphicsCommandList* commandList,
+	ID3D12Device* device,
+	const std::vector<WSymbol>& paths,
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>>& resources
+)
+{
+	struct BatchFile
+	{
+		HRESULT result;
+		DDSLayout layout;
+		Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+		std::vector<D3D12_SUBRESOURCE_DATA> subresources;
+	};
+	UINT fileCount = (UINT)paths.size();
+	std::vector<BatchFile> batch(fileCount);
+	//Mappings stay open until every row was copied
+	std::unique_ptr<MappedFile[]> files(new MappedFile[fileCount]);
+	//Parse and create the resource, both per file
+	ThreadPool::GetInstance()->ParallelFor(fileCount, [&](unsigned int i) -> void
+	{
+		BatchFile& file = batch[i];
+		file.result = E_FAIL;
+		if (!files[i].Open(paths[i].c_str()))
+		{
+			file.result = HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+			return;
+		}
+		DDSTextureDesc desc;
+		if (DDSCore::ParseHeader(files[i].GetData(), (size_t)files[i].GetSize(), desc) != DDS_RESULT_OK ||
+			desc.dimension != DDS_DIMENSION_TEXTURE2D ||
+			DDSCore::ComputeLayout(desc, 0, file.layout) != DDS_RESULT_OK)
+			return;
+		D3D12_RESOURCE_DESC texDesc = {};
+		texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+		texDesc.Width = desc.width;
+		texDesc.Height = desc.height;
+		texDesc.DepthOrArraySize = (UINT16)desc.arraySize;
+		texDesc.MipLevels = (UINT16)desc.mipCount;
+		texDesc.Format = desc.format;
+		texDesc.SampleDesc.Count = 1;
+		texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+		texDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+		file.result = device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+			D3D12_HEAP_FLAG_NONE,
+			&texDesc,
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(&file.resource));
+		if (FAILED(file.result)) return;
+		file.subresources.resize(file.layout.subresources.size());
+		for (int sub = 0; sub < file.subresources.size(); ++sub)
+		{
+			const DDSSubresource& source = file.layout.subresources[sub];
+			file.subresources[sub].pData = files[i].GetData() + source.offset;
+			file.subresources[sub].RowPitch = (LONG_PTR)source.rowBytes;
+			file.subresources[sub].SlicePitch = (LONG_PTR)source.slicePitch;
+		}
+	});
+	//Every failed file is reported before throwing, not only the first
+	HRESULT firstError = S_OK;
+	std::wstring failedPaths;
+	for (UINT i = 0; i < fileCount; ++i)
+	{
+		if (SUCCEEDED(batch[i].result)) continue;
+		wchar_t code[16];
+		swprintf_s(code, L"0x%08X", (UINT)batch[i].result);
+		std::wstring info = L"Texture load failed: " + paths[i].str() + L" (" + code + L")\n";
+		OutputDebugStringW(info.c_str());
+		failedPaths += failedPaths.empty() ? paths[i].str() : L", " + paths[i].str();
+		if (SUCCEEDED(firstError)) firstError = batch[i].result;
+	}
+	if (FAILED(firstError))
+		throw DxException(firstError, L"Texture2D::LoadResources " + failedPaths, AnsiToWString(__FILE__), __LINE__);
+	std::vector<TextureUpload> uploads(fileCount);
+	for (UINT i = 0; i < fileCount; ++i)
+	{
+		uploads[i].resource = batch[i].resource.Get();
+		uploads[i].firstSubresource = 0;
+		uploads[i].subresourceCount = (UINT)batch[i].subresources.size();
+		uploads[i].data = batch[i].subresources.data();
+	}
+	resources.resize(fileCount);
+	if (fileCount == 0) return;
+	//Every file shares one allocation, rows are copied per subresource on the thread pool
+	UploadManager::UploadTextures(commandList, uploads.data(), fileCount);
+	//Every transition in a single barrier call
+	std::vector<D3D12_RESOURCE_BARRIER> barriers(fileCount);
+	for (UINT i = 0; i < fileCount; ++i)
+	{
+		barriers[i] = CD3DX12_RESOURCE_BARRIER::Transition(batch[i].resource.Get(),
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		resources[i] = batch[i].resource;
+	}
+	commandList->ResourceBarrier(fileCount, barriers.data());
+}
+
+std::vector<std::shared_ptr<Texture2D>> Texture2D::LoadBatch(
+	ID3D12GraphicsCommandList* commandList,
+	ID3D12Device* device,
+	const std::vector<WSymbol>& paths
+)
+{
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> resources;
+	LoadResources(commandList, device, paths, resources);
+	std::vector<std::shared_ptr<Texture2D>> textures;
+	textures.reserve(paths.size());
+	for (UINT i = 0; i < paths.size(); ++i)
+	{
+		//Name is the file name without directory and extension
+		std::wstring path = paths[i].str();
+		size_t start = path.find_last_of(L"/\\");
+		start = start == std::wstring::npos ? 0 : start + 1;
+		size_t end = path.find_last_of(L'.');
+		if (end == std::wstring::npos || end < start) end = path.size();
+		int nameLength = WideCharToMultiByte(CP_UTF8, 0, path.c_str() + start, (int)(end - start), nullptr, 0, nullptr, nullptr);
+		std::string name(nameLength, '\0');
+		WideCharToMultiByte(CP_UTF8, 0, path.c_str() + start, (int)(end - start), &name[0], nameLength, nullptr, nullptr);
+		textures.push_back(std::shared_ptr<Texture2D>(new Texture2D(name, paths[i], resources[i])));
+	}
+	return textures;
+}
+
+ID3D12Resource* Texture2D::GetResource() const
+{
+	return Resource != nullptr ? Resource.Get() : TextureStreamer::GetPlaceholder();
+}
+
+ResidencyHandle Texture2D::GetResidency() const
+{
+	return Resource != nullptr ? mResidency : TextureStreamer::GetPlaceholderResidency();
+}
+
+void Texture2D::ReplaceResource(Microsoft::WRL::ComPtr<ID3D12Resource> resource, UINT firstMip, const TextureStreamInfo& info)
+{
+	DeferredReleaseQueue::Release(Resource);
+	Resource = resource;
+	if (mResidency.IsNull())
+		mResidency = ResidencyManager::Register(Resource.Get());
+	else
+		ResidencyManager::Replace(mResidency, Resource.Get());
+	mFirstResidentMip = firstMip;
+	mStreamInfo = info;
+	++mResourceVersion;
+}
+
+void Texture2D::SetTargetFirstMip(UINT firstMip)
+{
+	if (mTargetFirstMip == firstMip) return;
+	mTargetFirstMip = firstMip;
+	//The view clamp depends on the target while mips are being dropped
+	if (Resource != nullptr)
+		++mResourceVersion;
 }
 void Texture2D::GetResourceViewDescriptor(D3D12_SHADER_RESOURCE_VIEW_DESC& srvDesc)
 {
 	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-	srvDesc.Format = Resource->GetDesc().Format;
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MostDetailedMip = 0;
-	srvDesc.Texture2D.MipLevels = Resource->GetDesc().MipLevels;
-	srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+	ID3D12Resource* resource = GetResource();
+	D3D12_RESOURCE_DESC resourceDesc = resource->GetDesc();
+	srvDesc.Format = resourceDesc.Format;
+	//Always an array view, plain textures are arrays of one, so the bindless table holds a single view type
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.MipLevels = resourceDesc.MipLevels;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = resourceDesc.DepthOrArraySize;
+	srvDesc.Texture2DArray.PlaneSlice = 0;
+	//Mips about to be evicted are not sampled any more, so dropping them later is not visible
+	srvDesc.Texture2DArray.ResourceMinLODClamp = 0.0f;
+	if (Resource != nullptr && mTargetFirstMip > mFirstResidentMip)
+		srvDesc.Texture2DArray.ResourceMinLODClamp = (float)(mTargetFirstMip - mFirstResidentMip);
 }
 
 Texture2D::~Texture2D()
 {
-	Dispose();
+	Release();
  }
\ No newline at end of file
@@ -3,35 +3,99 @@
 #include <string>
 #include <vector>
 #include "MObject.h"
+#include "ResourceHandle.h"
+#include "../Singleton/DeferredReleaseQueue.h"
+#include "../Singleton/ResidencyManager.h"
+//Size of the whole mip chain in the file, resources may hold only part of it
+struct TextureStreamInfo
+{
+	UINT width;
+	UINT height;
+	UINT arraySize;
+	UINT mipCount;
+	DXGI_FORMAT format;
+};
+
 class Texture2D : public MObject
 {
+public:
+	static const UINT NO_MIP = 0xffffffff;
 private:
-	std::wstring Filename;
+	WSymbol Filename;
 	Microsoft::WRL::ComPtr<ID3D12Resource> Resource = nullptr;
-	Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap = nullptr;
+	Texture2DHandle mHandle;
+	ResidencyHandle mResidency;
+	//Increased whenever Resource or its view changes, descriptor tables compare against it
+	UINT mResourceVersion = 0;
+	//Mip of the full chain that Resource starts at, NO_MIP while nothing is resident
+	UINT mFirstResidentMip = NO_MIP;
+	//First mip the streamer was last asked for
+	UINT mTargetFirstMip = 0;
+	TextureStreamInfo mStreamInfo = {};
+	friend class TextureStreamer;
+	//Render thread only, the old resource is kept until the GPU is done with it
+	void ReplaceResource(Microsoft::WRL::ComPtr<ID3D12Resource> resource, UINT firstMip, const TextureStreamInfo& info);
+	void SetTargetFirstMip(UINT firstMip);
+	//Used by LoadBatch
+	Texture2D(
+		Symbol name,
+		WSymbol filePath,
+		Microsoft::WRL::ComPtr<ID3D12Resource> resource
+	);
+	//Parses and creates every resource on the thread pool and stages the texels through UploadManager
+	//Resources end in PIXEL_SHADER_RESOURCE once commandList ran, throws if any file fails
+	static void LoadResources(
+		ID3D12GraphicsCommandList* commandList,
+		ID3D12Device* device,
+		const std::vector<WSymbol>& paths,
+		std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>>& resources
+	);
+	void InitStreamInfo();
 protected:
 	virtual void Dispose() {
+		ResourceRegistry<Texture2D>::Unregister(mHandle);
+		mHandle = Texture2DHandle();
+		ResidencyManager::Unregister(mResidency);
+		mResidency = ResidencyHandle();
+		DeferredReleaseQueue::Release(Resource);
 		Resource = nullptr;
-		UploadHeap = nullptr;
 	}
 public:
-	std::string Name;
-	bool isReadable() const { return UploadHeap == nullptr; }
+	Symbol Name;
+	WSymbol GetFilename() const { return Filename; }
 	bool isAvaliable() const { return Resource == nullptr; }
-	ID3D12Resource* GetResource() const
-	{
-		return Resource.Get();
-	}
-	
-	void MakeNoLongerReadable()
-	{
-		UploadHeap = nullptr;
-	}
+	Texture2DHandle GetHandle() const { return mHandle; }
+	//The streaming placeholder until the first streamed mips arrive
+	ID3D12Resource* GetResource() const;
+	//Tracks whatever GetResource returns
+	ResidencyHandle GetResidency() const;
+	UINT GetResourceVersion() const { return mResourceVersion; }
+	UINT GetFirstResidentMip() const { return mFirstResidentMip; }
+	UINT GetTargetFirstMip() const { return mTargetFirstMip; }
+	//Mips of the full chain loaded so far, counted from the smallest
+	UINT GetResidentMipCount() const { return mFirstResidentMip == NO_MIP ? 0 : mStreamInfo.mipCount - mFirstResidentMip; }
+	//Valid once anything is resident
+	const TextureStreamInfo& GetStreamInfo() const { return mStreamInfo; }
+	//Upload memory comes from UploadManager and is reclaimed on its own once the copy ran
+	Texture2D(
+		ID3D12GraphicsCommandList* commandList,
+		ID3D12Device* device,
+		Symbol name,
+		WSymbol filePath
+	);
+	//Streamed through TextureStreamer, returns immediately
 	Texture2D(
+		Symbol name,
+		WSymbol filePath,
+		float priority
+	);
+	//Loads every file at once: parsing, layout and texel copies run on the thread pool,
+	//all files share one upload allocation and the copies are recorded into commandList in one pass
+	//Named after the file without extension, throws like the constructor if any file fails
+	static std::vector<std::shared_ptr<Texture2D>> LoadBatch(
 		ID3D12GraphicsCommandList* commandList,
 		ID3D12Device* device,
-		std::string name,
-		std::wstring filePath
+		const std::vector<WSymbol>& paths
 	);
 	void GetResourceViewDescriptor(D3D12_SHADER_RESOURCE_VIEW_DESC& desc);
 	virtual ~Texture2D();
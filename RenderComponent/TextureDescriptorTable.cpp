@@ -0,0 +1,65 @@
+#include "TextureDescriptorTable.h"
+#include "Texture2D.h"
+
+TextureDescriptorTable::TextureDescriptorTable(ID3D12Device* device, UINT count, UINT frameCount) :
+	mSlots(count), mFrameCount(frameCount)
+{
+	mStagingHeap = std::make_shared<DescriptorHeap>();
+	ThrowIfFailed(mStagingHeap->Create(device, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, count, false));
+	mShaderHeap = std::make_shared<DescriptorHeap>();
+	ThrowIfFailed(mShaderHeap->Create(device, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, count * frameCount, true));
+	for (int i = 0; i < mSlots.size(); ++i)
+	{
+		mSlots[i].resourceVersion = 0;
+		mSlots[i].dirtyFrames = 0;
+	}
+	//Slots without a texture read as black instead of an uninitialized descriptor
+	D3D12_SHADER_RESOURCE_VIEW_DESC nullDesc = {};
+	nullDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	nullDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	nullDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+	nullDesc.Texture2DArray.MipLevels = 1;
+	nullDesc.Texture2DArray.ArraySize = 1;
+	for (UINT i = 0; i < count * frameCount; ++i)
+		device->CreateShaderResourceView(nullptr, &nullDesc, mShaderHeap->hCPU(i));
+}
+
+void TextureDescriptorTable::SetTexture(UINT slot, Texture2DHandle texture)
+{
+	mSlots[slot].texture = texture;
+	//No texture reaches this version, so the next Prepare writes the slot
+	mSlots[slot].resourceVersion = 0xffffffff;
+}
+
+UINT TextureDescriptorTable::Prepare(ID3D12Device* device, UINT frameIndex)
+{
+	UINT frameBit = 1u << frameIndex;
+	UINT frameStart = frameIndex * (UINT)mSlots.size();
+	for (UINT i = 0; i < mSlots.size(); ++i)
+	{
+		Slot& slot = mSlots[i];
+		Texture2D* texture = ResourceRegistry<Texture2D>::Get(slot.texture);
+		if (texture != nullptr && texture->GetResourceVersion() != slot.resourceVersion)
+		{
+			D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc;
+			texture->GetResourceViewDescriptor(srvDesc);
+			device->CreateShaderResourceView(texture->GetResource(), &srvDesc, mStagingHeap->hCPU(i));
+			slot.resourceVersion = texture->GetResourceVersion();
+			slot.dirtyFrames = (1u << mFrameCount) - 1;
+		}
+		if (slot.dirtyFrames & frameBit)
+		{
+			device->CopyDescriptorsSimple(1, mShaderHeap->hCPU(frameStart + i), mStagingHeap->hCPU(i), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+			slot.dirtyFrames &= ~frameBit;
+		}
+	}
+	return frameStart;
+}
+
+void TextureDescriptorTable::MarkUsed(UINT slot) const
+{
+	if (slot >= mSlots.size()) return;
+	Texture2D* texture = ResourceRegistry<Texture2D>::Get(mSlots[slot].texture);
+	if (texture != nullptr)
+		ResidencyManager::MarkUsed(texture->GetResidency());
+}
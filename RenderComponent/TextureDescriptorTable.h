@@ -0,0 +1,37 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "../Common/DescriptorHeap.h"
+#include "ResourceHandle.h"
+//Bindless SRV table that follows its textures when streaming replaces their resources
+//The shader visible heap holds one copy of the table per frame resource, a frame only writes
+//its own copy, which the GPU finished reading when the frame resource's fence passed
+class TextureDescriptorTable
+{
+private:
+	struct Slot
+	{
+		Texture2DHandle texture;
+		//Resource version the CPU descriptor was written from
+		UINT resourceVersion;
+		//One bit per frame copy that is out of date
+		UINT dirtyFrames;
+	};
+	//CPU only, the newest descriptors are written here and copied to the frames
+	std::shared_ptr<DescriptorHeap> mStagingHeap;
+	std::shared_ptr<DescriptorHeap> mShaderHeap;
+	std::vector<Slot> mSlots;
+	UINT mFrameCount;
+public:
+	TextureDescriptorTable(ID3D12Device* device, UINT count, UINT frameCount);
+	TextureDescriptorTable(const TextureDescriptorTable&) = delete;
+	TextureDescriptorTable& operator=(const TextureDescriptorTable&) = delete;
+	void SetTexture(UINT slot, Texture2DHandle texture);
+	//Call after the frame resource's fence has passed
+	//Returns the index of the frame's first descriptor in GetHeap()
+	UINT Prepare(ID3D12Device* device, UINT frameIndex);
+	//Adds the slot's texture, or the placeholder it shows, to the frame's working set
+	//Call for every slot the frame's draws sample, other textures may be evicted
+	void MarkUsed(UINT slot) const;
+	std::shared_ptr<DescriptorHeap> GetHeap() const { return mShaderHeap; }
+	UINT Count() const { return (UINT)mSlots.size(); }
+};
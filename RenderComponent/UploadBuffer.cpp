@@ -20,6 +20,8 @@ void UploadBuffer::Create(ID3D12Device* device, UINT elementCount, bool isConsta
 		D3D12_RESOURCE_STATE_GENERIC_READ,
 		nullptr,
 		IID_PPV_ARGS(&mUploadBuffer)));
+	//Written through the persistent mapping, so it is tracked but never evicted
+	mResidency = ResidencyManager::Register(mUploadBuffer.Get(), false);
 
 	ThrowIfFailed(mUploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
 
@@ -2,19 +2,31 @@
 
 #include "../Common/d3dUtil.h"
 #include "../RenderComponent/MObject.h"
+#include "ResourceHandle.h"
+#include "../Singleton/DeferredReleaseQueue.h"
+#include "../Singleton/ResidencyManager.h"
 
 class UploadBuffer : public MObject
 {
 protected:
 	virtual void Dispose()
 	{
+		ResourceRegistry<UploadBuffer>::Unregister(mHandle);
+		mHandle = UploadBufferHandle();
+		ResidencyManager::Unregister(mResidency);
+		mResidency = ResidencyHandle();
 		if (mUploadBuffer != nullptr)
 			mUploadBuffer->Unmap(0, nullptr);
 		mMappedData = nullptr;
+		DeferredReleaseQueue::Release(mUploadBuffer);
+		mUploadBuffer = nullptr;
 	}
 public:
 	void Create(ID3D12Device* device, UINT elementCount, bool isConstantBuffer, size_t stride);
-	UploadBuffer() : MObject() {}
+	UploadBuffer() : MObject() { mHandle = ResourceRegistry<UploadBuffer>::Register(this); }
+	~UploadBuffer() { Release(); }
+	UploadBufferHandle GetHandle() const { return mHandle; }
+	ResidencyHandle GetResidency() const { return mResidency; }
     UploadBuffer(const UploadBuffer& rhs) = delete;
     UploadBuffer& operator=(const UploadBuffer& rhs) = delete;
     ID3D12Resource* Resource()const
@@ -34,4 +46,6 @@ private:
 	size_t mStride;
     UINT mElementByteSize = 0;
     bool mIsConstantBuffer = false;
+	UploadBufferHandle mHandle;
+	ResidencyHandle mResidency;
 };
\ No newline at end of file
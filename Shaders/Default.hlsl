@@ -20,13 +20,24 @@
 // Include structures and functions for lighting.
 #include "LightingUtil.hlsl"
 
-Texture2D    gDiffuseMap[9] : register(t2, space1);
+// Bindless, every texture is viewed as an array so plain textures, arrays and atlases share one table.
+Texture2DArray gDiffuseMap[9] : register(t2, space1);
 SamplerState gsamLinear  : register(s4);
-// Constant data that varies per frame.
-cbuffer Per_Object_Buffer : register(b0)
+struct ObjectData
 {
     float4x4 gWorld;
     float4x4 gTexTransform;
+    uint gMaterialIndex;
+    uint3 gObjPad;
+};
+
+// Data of every object in the frame, indexed per draw.
+StructuredBuffer<ObjectData> gObjectData : register(t0);
+
+// Root constants that vary per draw.
+cbuffer Per_Draw_Buffer : register(b0)
+{
+    uint gObjectIndex;
 };
 
 // Constant data that varies per material.
@@ -44,14 +55,22 @@ cbuffer Per_Camera_Buffer : register(b1)
     float gDeltaTime;
 };
 
-cbuffer Per_Material_Buffer : register(b2)
+struct MaterialData
 {
 	float4 gDiffuseAlbedo;
     float3 gFresnelR0;
     float  gRoughness;
     float4x4 gMatTransform;
+    // Rectangle of the diffuse map inside its slice, uv * xy + zw.
+    float4 gDiffuseUVRemap;
+    uint gDiffuseMapIndex;
+    uint gDiffuseMapSlice;
+    uint2 gMatPad;
 };
 
+// Constants of every material, indexed by the object's material index.
+StructuredBuffer<MaterialData> gMaterialData : register(t1);
+
 struct VertexIn
 {
 	float3 PosL    : POSITION;
@@ -65,11 +84,17 @@ struct VertexOut
     float3 PosW    : POSITION;
     float3 NormalW : NORMAL;
 	float2 TexC    : TEXCOORD;
+    nointerpolation uint MatIndex : MATINDEX;
 };
 
 VertexOut VS(VertexIn vin)
 {
 	VertexOut vout = (VertexOut)0.0f;
+    ObjectData objData = gObjectData[gObjectIndex];
+    float4x4 gWorld = objData.gWorld;
+    float4x4 gTexTransform = objData.gTexTransform;
+    MaterialData matData = gMaterialData[objData.gMaterialIndex];
+    vout.MatIndex = objData.gMaterialIndex;
 	
     // Transform to world space.
     float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
@@ -83,15 +108,21 @@ VertexOut VS(VertexIn vin)
 	
 	// Output vertex attributes for interpolation across triangle.
     float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
-    vout.TexC = mul(texC, gMatTransform).xy;
+    vout.TexC = mul(texC, matData.gMatTransform).xy;
 
     return vout;
 }
 
 float4 PS(VertexOut pin) : SV_Target
 {
-    float2 bindlessChooser = floor(saturate(pin.TexC) * 3);
-    float4 diffuseAlbedo = gDiffuseMap[bindlessChooser.x * 3 + bindlessChooser.y].Sample(gsamLinear, pin.TexC * 3) * gDiffuseAlbedo;
+    MaterialData matData = gMaterialData[pin.MatIndex];
+    float2 uv = pin.TexC * 3;
+    // Atlased maps only cover part of the slice, so tiling wraps inside the rectangle.
+    // Gradients come from the unwrapped coordinates, so mips do not jump at the wrap.
+    float2 uvScale = matData.gDiffuseUVRemap.xy;
+    float2 atlasUV = frac(uv) * uvScale + matData.gDiffuseUVRemap.zw;
+    float4 diffuseAlbedo = gDiffuseMap[NonUniformResourceIndex(matData.gDiffuseMapIndex)].SampleGrad(gsamLinear,
+        float3(atlasUV, matData.gDiffuseMapSlice), ddx(uv) * uvScale, ddy(uv) * uvScale) * matData.gDiffuseAlbedo;
     return diffuseAlbedo;
 }
 
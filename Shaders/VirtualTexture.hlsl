@@ -0,0 +1,41 @@
+//***************************************************************************************
+// VirtualTexture.hlsl
+//
+// Feedback and sampling for virtual textures, see VirtualTextureManager.
+//***************************************************************************************
+
+// Must match VirtualTextureSystem::EncodeFeedback.
+#define VIRTUAL_TEXTURE_FEEDBACK_NONE 0xffffffff
+
+uint EncodeVirtualTextureFeedback(uint textureId, uint mip, uint2 page)
+{
+    return (textureId << 28) | (mip << 24) | (page.y << 12) | page.x;
+}
+
+// Page a sample at uv wants, written to the feedback buffer and read back on the CPU.
+// pageSize is the tile shape in texels, tailMip the first mip that is always resident.
+uint VirtualTextureFeedback(Texture2D tex, SamplerState s, float2 uv, uint textureId, float2 pageSize, uint tailMip)
+{
+    uint width, height, mipCount;
+    tex.GetDimensions(0, width, height, mipCount);
+    float lod = tex.CalculateLevelOfDetailUnclamped(s, uv);
+    uint mip = (uint)clamp(floor(lod), 0.0f, (float)(mipCount - 1));
+    if(mip >= tailMip)
+        return VIRTUAL_TEXTURE_FEEDBACK_NONE;
+    float2 mipSize = float2(max(width >> mip, 1u), max(height >> mip, 1u));
+    uint2 pageCount = (uint2)ceil(mipSize / pageSize);
+    uint2 page = min((uint2)(frac(uv) * mipSize / pageSize), pageCount - 1);
+    return EncodeVirtualTextureFeedback(textureId, mip, page);
+}
+
+// Samples no finer than the residency map allows, so unmapped tiles are never read.
+float4 SampleVirtualTexture(Texture2D tex, Texture2D<uint> residencyMap, SamplerState s, float2 uv, float2 pageSize)
+{
+    uint width, height, mipCount;
+    tex.GetDimensions(0, width, height, mipCount);
+    uint2 mapSize;
+    residencyMap.GetDimensions(mapSize.x, mapSize.y);
+    uint2 page = min((uint2)(frac(uv) * float2(width, height) / pageSize), mapSize - 1);
+    float minMip = (float)residencyMap.Load(int3(page, 0));
+    return tex.Sample(s, uv, int2(0, 0), minMip);
+}
@@ -0,0 +1,94 @@
+#include "DeferredReleaseQueue.h"
+using Microsoft::WRL::ComPtr;
+
+DeferredReleaseQueue::QueueData& DeferredReleaseQueue::GetData()
+{
+	static QueueData* data = new QueueData();
+	return *data;
+}
+
+void DeferredReleaseQueue::Push(Entry&& entry)
+{
+	QueueData& data = GetData();
+	std::lock_guard<std::mutex> lck(data.mtx);
+	data.pending.push_back(std::move(entry));
+}
+
+void DeferredReleaseQueue::Release(ComPtr<IUnknown> object)
+{
+	if (object == nullptr) return;
+	Entry entry;
+	entry.fence = 0;
+	entry.object = object;
+	Push(std::move(entry));
+}
+
+void DeferredReleaseQueue::Enqueue(std::function<void()> callback)
+{
+	Entry entry;
+	entry.fence = 0;
+	entry.callback = std::move(callback);
+	Push(std::move(entry));
+}
+
+void DeferredReleaseQueue::Tag(UINT64 fenceValue)
+{
+	QueueData& data = GetData();
+	std::lock_guard<std::mutex> lck(data.mtx);
+	for (int i = 0; i < data.pending.size(); ++i)
+	{
+		data.pending[i].fence = fenceValue;
+		data.inFlight.push_back(std::move(data.pending[i]));
+	}
+	data.pending.clear();
+}
+
+void DeferredReleaseQueue::RunEntries(std::vector<Entry>& entries)
+{
+	//Outside the lock, callbacks and destructors may release more objects
+	for (int i = 0; i < entries.size(); ++i)
+	{
+		if (entries[i].callback)
+			entries[i].callback();
+	}
+	entries.clear();
+}
+
+void DeferredReleaseQueue::Retire(UINT64 completedFenceValue)
+{
+	QueueData& data = GetData();
+	std::vector<Entry> retired;
+	{
+		std::lock_guard<std::mutex> lck(data.mtx);
+		while (!data.inFlight.empty() && data.inFlight.front().fence <= completedFenceValue)
+		{
+			retired.push_back(std::move(data.inFlight.front()));
+			data.inFlight.pop_front();
+		}
+	}
+	RunEntries(retired);
+}
+
+void DeferredReleaseQueue::Flush()
+{
+	QueueData& data = GetData();
+	std::vector<Entry> retired;
+	{
+		std::lock_guard<std::mutex> lck(data.mtx);
+		retired.reserve(data.inFlight.size() + data.pending.size());
+		for (int i = 0; i < data.inFlight.size(); ++i)
+			retired.push_back(std::move(data.inFlight[i]));
+		for (int i = 0; i < data.pending.size(); ++i)
+			retired.push_back(std::move(data.pending[i]));
+		data.inFlight.clear();
+		data.pending.clear();
+	}
+	RunEntries(retired);
+}
+
+size_t DeferredReleaseQueue::Count()
+{
+	QueueData& data = GetData();
+	std::lock_guard<std::mutex> lck(data.mtx);
+	return data.pending.size() + data.inFlight.size();
+}
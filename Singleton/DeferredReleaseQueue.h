@@ -0,0 +1,39 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include <mutex>
+#include <deque>
+#include <functional>
+//Keeps released GPU objects alive until the GPU has finished every frame that may use them
+//Everything released while a frame is recorded is tagged with that frame's fence value in
+//FrameResource::UpdateAfterFrame, and retired in FrameResource::UpdateBeforeFrame once the fence passed
+class DeferredReleaseQueue
+{
+private:
+	struct Entry
+	{
+		UINT64 fence;
+		Microsoft::WRL::ComPtr<IUnknown> object;
+		std::function<void()> callback;
+	};
+	struct QueueData
+	{
+		std::mutex mtx;
+		//Released since the last signal, fence not known yet
+		std::vector<Entry> pending;
+		//Ordered by fence value
+		std::deque<Entry> inFlight;
+	};
+	//Never destroyed, so static objects released during exit can still enqueue
+	static QueueData& GetData();
+	static void Push(Entry&& entry);
+	static void RunEntries(std::vector<Entry>& entries);
+public:
+	static void Release(Microsoft::WRL::ComPtr<IUnknown> object);
+	//Run callback after the GPU is done, e.g. to return a pool slot
+	static void Enqueue(std::function<void()> callback);
+	static void Tag(UINT64 fenceValue);
+	static void Retire(UINT64 completedFenceValue);
+	//Release everything now, only after the command queue was flushed
+	static void Flush();
+	static size_t Count();
+};
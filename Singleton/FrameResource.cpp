@@ -1,4 +1,5 @@
 #include "FrameResource.h"
+#include "DeferredReleaseQueue.h"
 std::vector<std::unique_ptr<FrameResource>> FrameResource::mFrameResources;
 FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount)
 {
@@ -8,7 +9,8 @@ FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCo
 
   //  FrameCB = std::make_unique<UploadBuffer<FrameConstants>>(device, 1, true);
 	ObjectCB = std::make_shared<UploadBuffer>();
-    ObjectCB->Create(device, objectCount, true, sizeof(ObjectConstants));
+	//Read as a structured buffer indexed per draw, so elements are not padded to 256 bytes
+    ObjectCB->Create(device, objectCount, false, sizeof(ObjectConstants));
 	cameraCBs.reserve(50);
 }
 
@@ -21,6 +23,7 @@ void FrameResource::UpdateBeforeFrame(ID3D12Fence* mFence)
 		WaitForSingleObject(eventHandle, INFINITE);
 		CloseHandle(eventHandle);
 	}
+	DeferredReleaseQueue::Retire(mFence->GetCompletedValue());
 }
 void FrameResource::UpdateAfterFrame(UINT64& currentFence, ID3D12CommandQueue* commandQueue, ID3D12Fence* mFence)
 {
@@ -31,6 +34,8 @@ void FrameResource::UpdateAfterFrame(UINT64& currentFence, ID3D12CommandQueue* c
 	// Because we are on the GPU timeline, the new fence point won't be 
 	// set until the GPU finishes processing all the commands prior to this Signal().
 	commandQueue->Signal(mFence, currentFence);
+	//Objects released while recording this frame may still be used by it
+	DeferredReleaseQueue::Tag(currentFence);
 }
 
 FrameResource::~FrameResource()
@@ -4,6 +4,7 @@ std::unordered_map<PSODescriptor, Microsoft::WRL::ComPtr<ID3D12PipelineState>> P
 bool PSODescriptor::operator==(const PSODescriptor& other) const
 {
 	if (other.shaderPass == shaderPass &&
+		other.variantKey == variantKey &&
 		other.depthFormat == depthFormat &&
 		other.rtCount == rtCount &&
 		other.shaderPtr == shaderPtr &&
@@ -21,6 +22,7 @@ bool PSODescriptor::operator==(const PSODescriptor& other) const
 bool PSODescriptor::operator==(const PSODescriptor&& other) const
 {
 	if (other.shaderPass == shaderPass &&
+		other.variantKey == variantKey &&
 		other.depthFormat == depthFormat &&
 		other.rtCount == rtCount &&
 		other.shaderPtr == shaderPtr &&
@@ -49,7 +51,7 @@ ID3D12PipelineState* PSOContainer::GetState(PSODescriptor& desc, ID3D12Device* d
 		ZeroMemory(&opaquePsoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
 		std::vector<D3D12_INPUT_ELEMENT_DESC>* inputElement = MeshLayout::GetMeshLayoutValue(desc.meshLayoutIndex);
 		opaquePsoDesc.InputLayout = { inputElement->data(), (UINT)inputElement->size() };
-		desc.shaderPtr->GetPassPSODesc(desc.shaderPass, &opaquePsoDesc);
+		desc.shaderPtr->GetPassPSODesc(desc.shaderPass, desc.variantKey, &opaquePsoDesc);
 		opaquePsoDesc.SampleMask = UINT_MAX;
 		opaquePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
 		opaquePsoDesc.NumRenderTargets = desc.rtCount;
@@ -5,6 +5,7 @@ struct PSODescriptor
 {
 	Shader* shaderPtr;
 	UINT shaderPass;
+	UINT64 variantKey = 0;
 	DXGI_FORMAT depthFormat;
 	UINT rtCount;
 	DXGI_FORMAT rtFormat[8];
@@ -21,6 +22,7 @@ namespace std
 		{
 			size_t value = reinterpret_cast<size_t>(key.shaderPtr);
 			value += key.shaderPass;
+			value += key.variantKey * 31;
 			value += key.depthFormat;
 			value += key.rtCount;
 			value += key.meshLayoutIndex;
@@ -0,0 +1,120 @@
+#include "ResidencyManager.h"
+using Microsoft::WRL::ComPtr;
+
+ResidencyManager::ManagerData& ResidencyManager::GetData()
+{
+	static ManagerData* data = new ManagerData();
+	return *data;
+}
+
+void ResidencyManager::DeviceResidency::QueryBudget(uint64_t& budget, uint64_t& usage)
+{
+	DXGI_QUERY_VIDEO_MEMORY_INFO info = {};
+	if (adapter == nullptr || FAILED(adapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info)))
+	{
+		budget = UINT64_MAX;
+		usage = 0;
+		return;
+	}
+	budget = info.Budget;
+	usage = info.CurrentUsage;
+}
+
+bool ResidencyManager::DeviceResidency::MakeResident(const ResidencyObject* objects, uint32_t count)
+{
+	return SUCCEEDED(device->MakeResident(count, reinterpret_cast<ID3D12Pageable* const*>(objects)));
+}
+
+void ResidencyManager::DeviceResidency::Evict(const ResidencyObject* objects, uint32_t count)
+{
+	ThrowIfFailed(device->Evict(count, reinterpret_cast<ID3D12Pageable* const*>(objects)));
+}
+
+void ResidencyManager::Init(ID3D12Device* device, IDXGIFactory4* factory)
+{
+	ManagerData& data = GetData();
+	data.device.device = device;
+	data.device.adapter = nullptr;
+	if (FAILED(factory->EnumAdapterByLuid(device->GetAdapterLuid(), IID_PPV_ARGS(&data.device.adapter))))
+	{
+		OutputDebugStringA("ResidencyManager: adapter does not report a memory budget, nothing will be evicted\n");
+		data.device.adapter = nullptr;
+	}
+	data.tracker.reset(new ResidencyTracker(&data.device));
+}
+
+void ResidencyManager::Shutdown()
+{
+	ManagerData& data = GetData();
+	data.tracker = nullptr;
+	data.device.adapter = nullptr;
+	data.device.device = nullptr;
+}
+
+ResidencyHandle ResidencyManager::Register(ID3D12Resource* resource, bool evictable)
+{
+	ManagerData& data = GetData();
+	if (data.tracker == nullptr || resource == nullptr) return ResidencyHandle();
+	D3D12_RESOURCE_DESC desc = resource->GetDesc();
+	D3D12_RESOURCE_ALLOCATION_INFO info = data.device.device->GetResourceAllocationInfo(0, 1, &desc);
+	ID3D12Pageable* pageable = resource;
+	return data.tracker->Register(pageable, info.SizeInBytes, evictable);
+}
+
+ResidencyHandle ResidencyManager::Register(ID3D12DescriptorHeap* heap)
+{
+	ManagerData& data = GetData();
+	if (data.tracker == nullptr || heap == nullptr) return ResidencyHandle();
+	D3D12_DESCRIPTOR_HEAP_DESC desc = heap->GetDesc();
+	UINT64 size = (UINT64)desc.NumDescriptors * data.device.device->GetDescriptorHandleIncrementSize(desc.Type);
+	ID3D12Pageable* pageable = heap;
+	return data.tracker->Register(pageable, size, false);
+}
+
+void ResidencyManager::Replace(ResidencyHandle handle, ID3D12Resource* resource)
+{
+	ManagerData& data = GetData();
+	if (data.tracker == nullptr || resource == nullptr) return;
+	D3D12_RESOURCE_DESC desc = resource->GetDesc();
+	D3D12_RESOURCE_ALLOCATION_INFO info = data.device.device->GetResourceAllocationInfo(0, 1, &desc);
+	ID3D12Pageable* pageable = resource;
+	data.tracker->Replace(handle, pageable, info.SizeInBytes);
+}
+
+void ResidencyManager::Unregister(ResidencyHandle handle)
+{
+	ManagerData& data = GetData();
+	if (data.tracker == nullptr) return;
+	data.tracker->Unregister(handle);
+}
+
+void ResidencyManager::MarkUsed(ResidencyHandle handle)
+{
+	ManagerData& data = GetData();
+	if (data.tracker == nullptr) return;
+	data.tracker->MarkUsed(handle);
+}
+
+void ResidencyManager::BeginFrame(UINT64 frame, UINT64 completedFrame)
+{
+	ManagerData& data = GetData();
+	if (data.tracker == nullptr) return;
+	data.tracker->BeginFrame(frame, completedFrame);
+}
+
+void ResidencyManager::EndFrame()
+{
+	ManagerData& data = GetData();
+	if (data.tracker == nullptr) return;
+	if (!data.tracker->EndFrame())
+	{
+		OutputDebugStringA("ResidencyManager: the frame's working set does not fit in video memory\n");
+		ThrowIfFailed(E_OUTOFMEMORY);
+	}
+}
+
+const ResidencyStats* ResidencyManager::GetStats()
+{
+	ManagerData& data = GetData();
+	return data.tracker == nullptr ? nullptr : &data.tracker->GetStats();
+}
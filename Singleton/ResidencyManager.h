@@ -0,0 +1,50 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "../Common/ResidencyTracker.h"
+#include <memory>
+//Keeps the GPU memory the engine uses within the budget the OS gives the process
+//Resources are registered when created and marked used whenever they are bound or drawn,
+//EndFrame evicts what the GPU no longer needs, least recently used first, and makes the
+//frame's working set resident again before it is submitted, see ResidencyTracker
+//The budget is the local video memory segment reported by QueryVideoMemoryInfo
+//Every call does nothing before Init and after Shutdown
+//Render thread only
+class ResidencyManager
+{
+private:
+	class DeviceResidency : public IResidencyDevice
+	{
+	public:
+		Microsoft::WRL::ComPtr<ID3D12Device> device;
+		//Null if the adapter can not report its budget, nothing is evicted then
+		Microsoft::WRL::ComPtr<IDXGIAdapter3> adapter;
+		virtual void QueryBudget(uint64_t& budget, uint64_t& usage);
+		virtual bool MakeResident(const ResidencyObject* objects, uint32_t count);
+		virtual void Evict(const ResidencyObject* objects, uint32_t count);
+	};
+	struct ManagerData
+	{
+		DeviceResidency device;
+		std::unique_ptr<ResidencyTracker> tracker;
+	};
+	//Never destroyed, so resources released during exit can still unregister
+	static ManagerData& GetData();
+public:
+	static void Init(ID3D12Device* device, IDXGIFactory4* factory);
+	//Only after the command queue was flushed
+	static void Shutdown();
+	//Upload heap and other CPU written resources have to pass evictable = false
+	static ResidencyHandle Register(ID3D12Resource* resource, bool evictable = true);
+	//Descriptors are written by the CPU, so descriptor heaps are never evicted
+	static ResidencyHandle Register(ID3D12DescriptorHeap* heap);
+	//handle now tracks resource, e.g. after a texture streamed in other mips
+	static void Replace(ResidencyHandle handle, ID3D12Resource* resource);
+	static void Unregister(ResidencyHandle handle);
+	//Adds the resource to the working set of the frame being recorded
+	static void MarkUsed(ResidencyHandle handle);
+	//After waiting for the frame resource, frame is the fence value the frame will signal
+	static void BeginFrame(UINT64 frame, UINT64 completedFrame);
+	//Right before the frame's command lists are executed, throws if the working set does not fit
+	static void EndFrame();
+	static const ResidencyStats* GetStats();
+};
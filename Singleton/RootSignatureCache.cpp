@@ -0,0 +1,146 @@
+#include "RootSignatureCache.h"
+using Microsoft::WRL::ComPtr;
+std::unordered_map<UINT64, std::vector<RootSignatureCache::CacheValue>> RootSignatureCache::allRootSignatures;
+std::mutex RootSignatureCache::cacheMtx;
+
+UINT64 RootSignatureCache::HashBlob(ID3DBlob* blob)
+{
+	//FNV-1a
+	const BYTE* ptr = reinterpret_cast<const BYTE*>(blob->GetBufferPointer());
+	SIZE_T size = blob->GetBufferSize();
+	UINT64 value = 14695981039346656037ull;
+	for (SIZE_T i = 0; i < size; ++i)
+	{
+		value ^= ptr[i];
+		value *= 1099511628211ull;
+	}
+	return value;
+}
+
+D3D_ROOT_SIGNATURE_VERSION RootSignatureCache::GetHighestVersion(ID3D12Device* device)
+{
+	D3D12_FEATURE_DATA_ROOT_SIGNATURE featureData = {};
+	featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
+	if (FAILED(device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &featureData, sizeof(featureData))))
+		return D3D_ROOT_SIGNATURE_VERSION_1_0;
+	return featureData.HighestVersion;
+}
+
+void RootSignatureCache::ConvertToVersion1(
+	const D3D12_ROOT_SIGNATURE_DESC1& desc,
+	std::vector<D3D12_ROOT_PARAMETER>& parameters,
+	std::vector<D3D12_DESCRIPTOR_RANGE>& ranges,
+	D3D12_ROOT_SIGNATURE_DESC& result)
+{
+	UINT rangeCount = 0;
+	for (UINT i = 0; i < desc.NumParameters; ++i)
+	{
+		if (desc.pParameters[i].ParameterType == D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE)
+			rangeCount += desc.pParameters[i].DescriptorTable.NumDescriptorRanges;
+	}
+	//Reserve first so pointers into ranges stay valid
+	ranges.clear();
+	ranges.reserve(rangeCount);
+	parameters.resize(desc.NumParameters);
+	for (UINT i = 0; i < desc.NumParameters; ++i)
+	{
+		const D3D12_ROOT_PARAMETER1& src = desc.pParameters[i];
+		D3D12_ROOT_PARAMETER& dst = parameters[i];
+		dst.ParameterType = src.ParameterType;
+		dst.ShaderVisibility = src.ShaderVisibility;
+		switch (src.ParameterType)
+		{
+		case D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE:
+			dst.DescriptorTable.NumDescriptorRanges = src.DescriptorTable.NumDescriptorRanges;
+			dst.DescriptorTable.pDescriptorRanges = ranges.data() + ranges.size();
+			for (UINT r = 0; r < src.DescriptorTable.NumDescriptorRanges; ++r)
+			{
+				const D3D12_DESCRIPTOR_RANGE1& srcRange = src.DescriptorTable.pDescriptorRanges[r];
+				D3D12_DESCRIPTOR_RANGE dstRange;
+				dstRange.RangeType = srcRange.RangeType;
+				dstRange.NumDescriptors = srcRange.NumDescriptors;
+				dstRange.BaseShaderRegister = srcRange.BaseShaderRegister;
+				dstRange.RegisterSpace = srcRange.RegisterSpace;
+				dstRange.OffsetInDescriptorsFromTableStart = srcRange.OffsetInDescriptorsFromTableStart;
+				ranges.push_back(dstRange);
+			}
+			break;
+		case D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS:
+			dst.Constants = src.Constants;
+			break;
+		default:
+			dst.Descriptor.ShaderRegister = src.Descriptor.ShaderRegister;
+			dst.Descriptor.RegisterSpace = src.Descriptor.RegisterSpace;
+			break;
+		}
+	}
+	result.NumParameters = desc.NumParameters;
+	result.pParameters = parameters.data();
+	result.NumStaticSamplers = desc.NumStaticSamplers;
+	result.pStaticSamplers = desc.pStaticSamplers;
+	result.Flags = desc.Flags;
+}
+
+ComPtr<ID3D12RootSignature> RootSignatureCache::GetRootSignature(
+	ID3D12Device* device,
+	const D3D12_ROOT_SIGNATURE_DESC1& desc)
+{
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr;
+	if (GetHighestVersion(device) >= D3D_ROOT_SIGNATURE_VERSION_1_1)
+	{
+		D3D12_VERSIONED_ROOT_SIGNATURE_DESC versionedDesc;
+		versionedDesc.Version = D3D_ROOT_SIGNATURE_VERSION_1_1;
+		versionedDesc.Desc_1_1 = desc;
+		hr = D3D12SerializeVersionedRootSignature(&versionedDesc,
+			serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+	}
+	else
+	{
+		std::vector<D3D12_ROOT_PARAMETER> parameters;
+		std::vector<D3D12_DESCRIPTOR_RANGE> ranges;
+		D3D12_ROOT_SIGNATURE_DESC desc1_0;
+		ConvertToVersion1(desc, parameters, ranges, desc1_0);
+		hr = D3D12SerializeRootSignature(&desc1_0, D3D_ROOT_SIGNATURE_VERSION_1,
+			serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+	}
+	if (errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
+
+	UINT64 hash = HashBlob(serializedRootSig.Get());
+	std::lock_guard<std::mutex> lck(cacheMtx);
+	std::vector<CacheValue>& bucket = allRootSignatures[hash];
+	for (int i = 0; i < bucket.size(); ++i)
+	{
+		ID3DBlob* other = bucket[i].serializedBlob.Get();
+		if (other->GetBufferSize() == serializedRootSig->GetBufferSize() &&
+			memcmp(other->GetBufferPointer(), serializedRootSig->GetBufferPointer(), other->GetBufferSize()) == 0)
+		{
+			return bucket[i].rootSignature;
+		}
+	}
+	CacheValue value;
+	value.serializedBlob = serializedRootSig;
+	ThrowIfFailed(device->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(value.rootSignature.GetAddressOf())));
+	bucket.push_back(value);
+	return value.rootSignature;
+}
+
+size_t RootSignatureCache::Count()
+{
+	std::lock_guard<std::mutex> lck(cacheMtx);
+	size_t count = 0;
+	for (auto ite = allRootSignatures.begin(); ite != allRootSignatures.end(); ++ite)
+	{
+		count += ite->second.size();
+	}
+	return count;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include <mutex>
+//Shares one ID3D12RootSignature between all shaders with the same layout
+//Keyed by a hash of the serialized description, which is canonical for equal layouts
+class RootSignatureCache
+{
+private:
+	struct CacheValue
+	{
+		Microsoft::WRL::ComPtr<ID3DBlob> serializedBlob;
+		Microsoft::WRL::ComPtr<ID3D12RootSignature> rootSignature;
+	};
+	static std::unordered_map<UINT64, std::vector<CacheValue>> allRootSignatures;
+	static std::mutex cacheMtx;
+	static UINT64 HashBlob(ID3DBlob* blob);
+	static void ConvertToVersion1(
+		const D3D12_ROOT_SIGNATURE_DESC1& desc,
+		std::vector<D3D12_ROOT_PARAMETER>& parameters,
+		std::vector<D3D12_DESCRIPTOR_RANGE>& ranges,
+		D3D12_ROOT_SIGNATURE_DESC& result);
+public:
+	static D3D_ROOT_SIGNATURE_VERSION GetHighestVersion(ID3D12Device* device);
+	//Serialize as version 1.1 when supported, 1.0 otherwise (flags are dropped)
+	static Microsoft::WRL::ComPtr<ID3D12RootSignature> GetRootSignature(
+		ID3D12Device* device,
+		const D3D12_ROOT_SIGNATURE_DESC1& desc);
+	static size_t Count();
+};
@@ -0,0 +1,69 @@
+#include "ShaderCompiler.h"
+#include "../Common/ThreadPool.h"
+using Microsoft::WRL::ComPtr;
+
+ShaderCompileResult ShaderCompiler::CompileImmediate(const ShaderCompileJob& job)
+{
+	UINT compileFlags = 0;
+#if defined(DEBUG) || defined(_DEBUG)
+	compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+	std::vector<D3D_SHADER_MACRO> macros;
+	if (!job.defines.empty())
+	{
+		macros.reserve(job.defines.size() + 1);
+		for (int i = 0; i < job.defines.size(); ++i)
+		{
+			macros.push_back({ job.defines[i].name.c_str(), job.defines[i].definition.c_str() });
+		}
+		macros.push_back({ nullptr, nullptr });
+	}
+	ShaderCompileResult result;
+	ComPtr<ID3DBlob> errors;
+	result.result = D3DCompileFromFile(job.filePath.c_str(), macros.empty() ? nullptr : macros.data(), D3D_COMPILE_STANDARD_FILE_INCLUDE,
+		job.entryPoint.c_str(), job.target.c_str(), compileFlags, 0, &result.byteCode, &errors);
+	if (errors != nullptr)
+		result.message.assign((char*)errors->GetBufferPointer(), errors->GetBufferSize());
+	return result;
+}
+
+ShaderCompileFuture ShaderCompiler::Compile(const ShaderCompileJob& job)
+{
+	return ThreadPool::GetInstance()->Execute([job]() -> ShaderCompileResult
+	{
+		return CompileImmediate(job);
+	}).share();
+}
+
+std::vector<ShaderCompileFuture> ShaderCompiler::CompileBatch(const std::vector<ShaderCompileJob>& jobs)
+{
+	std::vector<ShaderCompileFuture> futures;
+	futures.reserve(jobs.size());
+	for (int i = 0; i < jobs.size(); ++i)
+	{
+		futures.push_back(Compile(jobs[i]));
+	}
+	return futures;
+}
+
+void ShaderCompiler::WaitAll(
+	const std::vector<ShaderCompileJob>& jobs,
+	const std::vector<ShaderCompileFuture>& futures
+)
+{
+	HRESULT firstError = S_OK;
+	for (int i = 0; i < futures.size(); ++i)
+	{
+		const ShaderCompileResult& result = futures[i].get();
+		if (!result.message.empty())
+			OutputDebugStringA(result.message.c_str());
+		if (!result.Succeeded())
+		{
+			std::string info = "Shader compile failed: " + jobs[i].entryPoint + " " + jobs[i].target + "\n";
+			OutputDebugStringA(info.c_str());
+			if (SUCCEEDED(firstError))
+				firstError = FAILED(result.result) ? result.result : E_FAIL;
+		}
+	}
+	ThrowIfFailed(firstError);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include <future>
+struct ShaderMacro
+{
+	std::string name;
+	std::string definition;
+};
+struct ShaderCompileJob
+{
+	WSymbol filePath;
+	std::string entryPoint;
+	std::string target;
+	std::vector<ShaderMacro> defines;
+};
+struct ShaderCompileResult
+{
+	Microsoft::WRL::ComPtr<ID3DBlob> byteCode;
+	HRESULT result = E_PENDING;
+	//Compiler output, contains warnings even when succeeded
+	std::string message;
+	bool Succeeded() const { return SUCCEEDED(result) && byteCode != nullptr; }
+};
+typedef std::shared_future<ShaderCompileResult> ShaderCompileFuture;
+class ShaderCompiler
+{
+private:
+	static ShaderCompileResult CompileImmediate(const ShaderCompileJob& job);
+public:
+	//Compile on the thread pool, the returned future is ready once the bytecode is
+	static ShaderCompileFuture Compile(const ShaderCompileJob& job);
+	static std::vector<ShaderCompileFuture> CompileBatch(const std::vector<ShaderCompileJob>& jobs);
+	//Wait for every future, output each failed job's message to debug output and
+	//throw one exception after all jobs are finished
+	static void WaitAll(
+		const std::vector<ShaderCompileJob>& jobs,
+		const std::vector<ShaderCompileFuture>& futures
+	);
+};
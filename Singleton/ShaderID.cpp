@@ -1,29 +1,60 @@
 #include "ShaderID.h"
-std::unordered_map<std::string, unsigned int> ShaderID::allShaderIDs;
-unsigned int ShaderID::currentCount = 0;
-unsigned int ShaderID::mPerCameraBuffer = 0;
-unsigned int ShaderID::mPerMaterialBuffer = 0;
-unsigned int ShaderID::mPerObjectBuffer = 0;
-unsigned int ShaderID::PropertyToID(std::string str)
+#include "../Common/d3dUtil.h"
+std::unordered_map<unsigned int, std::string> ShaderID::allShaderNames;
+std::shared_mutex ShaderID::namesMtx;
+
+void ShaderID::Register(unsigned int id, std::string_view str)
 {
-	auto&& ite = allShaderIDs.find(str);
-	if (ite == allShaderIDs.end())
 	{
-		unsigned int value = currentCount;
-		allShaderIDs[str] = currentCount;
-		++currentCount;
-		return value;
+		//Most names are interned already, readers do not block each other
+		std::shared_lock<std::shared_mutex> lck(namesMtx);
+		auto&& ite = allShaderNames.find(id);
+		if (ite != allShaderNames.end() && ite->second == str) return;
+	}
+	//Looked up again, another thread may have added the id since the shared lock was released
+	std::unique_lock<std::shared_mutex> lck(namesMtx);
+	auto&& ite = allShaderNames.find(id);
+	if (ite == allShaderNames.end())
+	{
+		allShaderNames.emplace(id, std::string(str));
+		return;
 	}
-	else
+#if defined(DEBUG) || defined(_DEBUG)
+	if (ite->second != str)
 	{
-		return ite->second;
+		std::string msg = "Shader property ID collision: " + ite->second + " and " + std::string(str) + "\n";
+		OutputDebugStringA(msg.c_str());
+		ThrowIfFailed(E_INVALIDARG);
 	}
+#endif
+}
+
+unsigned int ShaderID::PropertyToID(std::string_view str)
+{
+	unsigned int id = Hash(str);
+	Register(id, str);
+	return id;
+}
+
+std::string ShaderID::IDToName(unsigned int id)
+{
+	std::shared_lock<std::shared_mutex> lck(namesMtx);
+	auto&& ite = allShaderNames.find(id);
+	if (ite == allShaderNames.end()) return std::string();
+	return ite->second;
 }
 
 void ShaderID::Init()
 {
-	allShaderIDs.reserve(INIT_CAPACITY);
-	mPerCameraBuffer = PropertyToID("Per_Camera_Buffer");
-	mPerMaterialBuffer = PropertyToID("Per_Material_Buffer");
-	mPerObjectBuffer = PropertyToID("Per_Object_Buffer");
-}
\ No newline at end of file
+	{
+		std::unique_lock<std::shared_mutex> lck(namesMtx);
+		allShaderNames.reserve(INIT_CAPACITY);
+	}
+	//Register the built-in names so collisions with them are reported too
+	PropertyToID("Per_Camera_Buffer");
+	PropertyToID("Per_Material_Buffer");
+	PropertyToID("Per_Object_Buffer");
+	PropertyToID("Per_Draw_Buffer");
+	PropertyToID("gObjectData");
+	PropertyToID("gMaterialData");
+}
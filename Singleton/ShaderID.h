@@ -1,19 +1,42 @@
 #pragma once
 #include <unordered_map>
+#include <string>
+#include <string_view>
+#include <mutex>
+#include <shared_mutex>
+#include <type_traits>
+//Property IDs are the FNV-1a hash of the name, so literals can be hashed at compile time
+//Names seen at runtime are interned for reverse lookup, debug builds also check them for collisions
 class ShaderID
 {
 	static const unsigned int INIT_CAPACITY = 100;
-	static unsigned int currentCount;
-	static std::unordered_map<std::string, unsigned int> allShaderIDs;
-	static unsigned int mPerCameraBuffer;
-	static unsigned int mPerMaterialBuffer;
-	static unsigned int mPerObjectBuffer;
+	static const unsigned int FNV_OFFSET_BASIS = 2166136261u;
+	static const unsigned int FNV_PRIME = 16777619u;
+	static std::unordered_map<unsigned int, std::string> allShaderNames;
+	static std::shared_mutex namesMtx;
+	static void Register(unsigned int id, std::string_view str);
 public:
+	static constexpr unsigned int Hash(std::string_view str)
+	{
+		unsigned int hash = FNV_OFFSET_BASIS;
+		for (size_t i = 0; i < str.size(); ++i)
+		{
+			hash ^= (unsigned char)str[i];
+			hash *= FNV_PRIME;
+		}
+		return hash;
+	}
 	static void Init();
-	static unsigned int GetPerCameraBufferID() { return mPerCameraBuffer; }
-	static unsigned int GetPerMaterialBufferID() { return mPerMaterialBuffer; }
-	static unsigned int GetPerObjectBufferID() { return mPerObjectBuffer; }
-	static unsigned int PropertyToID(std::string str);
-
+	static constexpr unsigned int GetPerCameraBufferID() { return Hash("Per_Camera_Buffer"); }
+	static constexpr unsigned int GetPerMaterialBufferID() { return Hash("Per_Material_Buffer"); }
+	static constexpr unsigned int GetPerObjectBufferID() { return Hash("Per_Object_Buffer"); }
+	static constexpr unsigned int GetPerDrawBufferID() { return Hash("Per_Draw_Buffer"); }
+	static constexpr unsigned int GetObjectDataBufferID() { return Hash("gObjectData"); }
+	static constexpr unsigned int GetMaterialDataBufferID() { return Hash("gMaterialData"); }
+	//Same value as Hash, also interns the name, safe to call from any thread
+	static unsigned int PropertyToID(std::string_view str);
+	//Empty if the name was never passed to PropertyToID
+	static std::string IDToName(unsigned int id);
 };
-
+//Forces the hash to be evaluated at compile time
+#define SHADER_ID(str) (std::integral_constant<unsigned int, ShaderID::Hash(str)>::value)
@@ -0,0 +1,127 @@
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+#include <filesystem>
+
+TextureCache::CacheData& TextureCache::GetData()
+{
+	static CacheData* data = new CacheData();
+	return *data;
+}
+
+std::shared_ptr<Texture2D> TextureCache::Load(Symbol name, WSymbol filePath, float priority, UINT& descriptorIndex, bool& isNew)
+{
+	CacheData& data = GetData();
+	std::error_code ec;
+	std::filesystem::path path(filePath.str());
+	int64_t writeTime = (int64_t)std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+	bool exists = !ec;
+	uint64_t fileSize = exists ? (uint64_t)std::filesystem::file_size(path, ec) : 0;
+	exists = exists && !ec;
+	auto pathIte = data.paths.find(filePath);
+	if (pathIte != data.paths.end() && (!exists || (pathIte->second.writeTime == writeTime && pathIte->second.fileSize == fileSize)))
+	{
+		//Unchanged since it was loaded, or only known by path anyway
+		descriptorIndex = pathIte->second.entry;
+		isNew = false;
+		++data.duplicateCount;
+		return data.entries[descriptorIndex].texture;
+	}
+	Entry entry;
+	entry.contentHash = 0;
+	entry.fileSize = fileSize;
+	entry.hashed = false;
+	//Archives store the hash, nothing is read here; loose files are hashed by the streamer later
+	uint64_t contentSize;
+	if (TextureStreamer::FindArchivedContent(filePath.c_str(), entry.contentHash, contentSize))
+	{
+		entry.fileSize = contentSize;
+		entry.hashed = true;
+	}
+	if (entry.hashed)
+	{
+		auto hashIte = data.hashes.find(entry.contentHash);
+		//The size check keeps an unlikely hash collision from merging two different images
+		if (hashIte != data.hashes.end() && data.entries[hashIte->second].fileSize == entry.fileSize)
+		{
+			descriptorIndex = hashIte->second;
+			data.paths[filePath] = { writeTime, fileSize, descriptorIndex };
+			isNew = false;
+			++data.duplicateCount;
+			std::string info = "TextureCache: " + std::string(name.c_str()) + " has the same content as " +
+				std::string(data.entries[descriptorIndex].texture->Name.c_str()) + ", sharing it\n";
+			OutputDebugStringA(info.c_str());
+			return data.entries[descriptorIndex].texture;
+		}
+	}
+	descriptorIndex = (UINT)data.entries.size();
+	entry.texture = std::make_shared<Texture2D>(name, filePath, priority);
+	if (entry.hashed)
+		data.hashes[entry.contentHash] = descriptorIndex;
+	else if (exists)
+		data.pendingHashes[entry.texture->GetHandle().value] = descriptorIndex;
+	data.entries.push_back(entry);
+	data.paths[filePath] = { writeTime, fileSize, descriptorIndex };
+	isNew = true;
+	return entry.texture;
+}
+
+void TextureCache::Update(std::vector<Merge>& merges)
+{
+	merges.clear();
+	CacheData& data = GetData();
+	std::vector<TextureStreamer::ContentHash> hashes;
+	TextureStreamer::TakeContentHashes(hashes);
+	for (int i = 0; i < hashes.size(); ++i)
+	{
+		const TextureStreamer::ContentHash& content = hashes[i];
+		//Textures not loaded through the cache, or hashed before
+		auto pendingIte = data.pendingHashes.find(content.texture.value);
+		if (pendingIte == data.pendingHashes.end()) continue;
+		UINT descriptorIndex = pendingIte->second;
+		data.pendingHashes.erase(pendingIte);
+		Entry& entry = data.entries[descriptorIndex];
+		entry.contentHash = content.hash;
+		entry.fileSize = content.fileSize;
+		entry.hashed = true;
+		auto hashIte = data.hashes.find(content.hash);
+		if (hashIte == data.hashes.end() || data.entries[hashIte->second].fileSize != content.fileSize)
+		{
+			data.hashes[content.hash] = descriptorIndex;
+			continue;
+		}
+		Merge merge;
+		merge.duplicate = descriptorIndex;
+		merge.original = hashIte->second;
+		std::string info = "TextureCache: " + std::string(entry.texture->Name.c_str()) + " has the same content as " +
+			std::string(data.entries[merge.original].texture->Name.c_str()) + ", sharing it\n";
+		OutputDebugStringA(info.c_str());
+		entry.texture = data.entries[merge.original].texture;
+		++data.duplicateCount;
+		merges.push_back(merge);
+	}
+}
+
+UINT TextureCache::GetTextureCount()
+{
+	return (UINT)GetData().entries.size();
+}
+
+const std::shared_ptr<Texture2D>& TextureCache::GetTexture(UINT descriptorIndex)
+{
+	return GetData().entries[descriptorIndex].texture;
+}
+
+UINT TextureCache::GetDuplicateCount()
+{
+	return GetData().duplicateCount;
+}
+
+void TextureCache::Clear()
+{
+	CacheData& data = GetData();
+	data.entries.clear();
+	data.paths.clear();
+	data.hashes.clear();
+	data.pendingHashes.clear();
+	data.duplicateCount = 0;
+}
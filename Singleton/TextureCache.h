@@ -0,0 +1,62 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "../RenderComponent/Texture2D.h"
+#include <memory>
+#include <unordered_map>
+#include <vector>
+//Loads every distinct image once, no matter how many names or paths it is requested under
+//Files are keyed by an XXH64 of their whole content, so byte identical copies share one Texture2D and one descriptor
+//Archived textures carry the hash, loose files are hashed by TextureStreamer while their mip tail loads,
+//so a loose copy is only found once Update saw its hash and is merged into the original then
+//A path whose modification time and size did not change since it was loaded is looked up by path
+//Render thread only
+class TextureCache
+{
+public:
+	//duplicate turned out to hold the same content as original, its slot should show original from now on
+	struct Merge
+	{
+		UINT duplicate;
+		UINT original;
+	};
+private:
+	struct Entry
+	{
+		std::shared_ptr<Texture2D> texture;
+		uint64_t contentHash;
+		uint64_t fileSize;
+		bool hashed;
+	};
+	struct PathEntry
+	{
+		int64_t writeTime;
+		uint64_t fileSize;
+		UINT entry;
+	};
+	struct CacheData
+	{
+		//Indexed by descriptor index
+		std::vector<Entry> entries;
+		std::unordered_map<WSymbol, PathEntry> paths;
+		std::unordered_map<uint64_t, UINT> hashes;
+		//Descriptor index of textures whose hash the streamer has not reported yet, by handle value
+		std::unordered_map<UINT, UINT> pendingHashes;
+		UINT duplicateCount = 0;
+	};
+	static CacheData& GetData();
+public:
+	//Streams the texture with priority unless its content is already cached
+	//descriptorIndex is the texture's slot, counted in load order of distinct textures
+	//isNew is false when an existing texture was returned, which keeps the name it was first loaded with
+	static std::shared_ptr<Texture2D> Load(Symbol name, WSymbol filePath, float priority, UINT& descriptorIndex, bool& isNew);
+	//Once per frame, takes the hashes TextureStreamer computed and fills merges with the loose copies found
+	//GetTexture returns the original for a merged slot, the duplicate texture is released once the caller drops it
+	static void Update(std::vector<Merge>& merges);
+	//Distinct textures, descriptor indices are below this
+	static UINT GetTextureCount();
+	static const std::shared_ptr<Texture2D>& GetTexture(UINT descriptorIndex);
+	//Loads that were answered with an existing texture, or merged into one later
+	static UINT GetDuplicateCount();
+	//Drops the cache's references, textures still used elsewhere stay alive
+	static void Clear();
+};
@@ -0,0 +1,234 @@
+#include "TextureResidency.h"
+#include "TextureStreamer.h"
+#include "../Common/DDSCore.h"
+#include "../RenderComponent/Texture2D.h"
+#include <cfloat>
+#include <cmath>
+
+TextureResidency::ResidencyData& TextureResidency::GetData()
+{
+	static ResidencyData data;
+	return data;
+}
+
+int TextureResidency::Find(Texture2DHandle texture)
+{
+	ResidencyData& data = GetData();
+	UINT slot = texture.Index();
+	if (slot >= data.slotToEntry.size()) return -1;
+	int index = data.slotToEntry[slot];
+	//The slot may have been reused by a texture that is not tracked
+	if (index < 0 || data.entries[index].texture != texture) return -1;
+	return index;
+}
+
+void TextureResidency::RemoveEntry(int index)
+{
+	ResidencyData& data = GetData();
+	data.slotToEntry[data.entries[index].texture.Index()] = -1;
+	//Swap the last entry in
+	if (index != data.entries.size() - 1)
+	{
+		data.entries[index] = data.entries[data.entries.size() - 1];
+		data.slotToEntry[data.entries[index].texture.Index()] = index;
+	}
+	data.entries.pop_back();
+}
+
+void TextureResidency::SetBudget(UINT64 bytes)
+{
+	GetData().budget = bytes;
+}
+
+UINT64 TextureResidency::GetBudget()
+{
+	return GetData().budget;
+}
+
+void TextureResidency::Track(Texture2DHandle texture)
+{
+	if (texture.IsNull() || Find(texture) >= 0) return;
+	ResidencyData& data = GetData();
+	UINT slot = texture.Index();
+	//A disposed texture may still hold the slot until the next Update
+	if (slot < data.slotToEntry.size() && data.slotToEntry[slot] >= 0)
+		RemoveEntry(data.slotToEntry[slot]);
+	Entry entry;
+	entry.texture = texture;
+	entry.demand = FLT_MAX;
+	entry.lastDemand = FLT_MAX;
+	entry.framesUnseen = UNSEEN_GRACE_FRAMES;
+	entry.wanted = NO_CHOICE;
+	entry.framesCoarser = 0;
+	if (slot >= data.slotToEntry.size())
+		data.slotToEntry.resize(slot + 1, -1);
+	data.slotToEntry[slot] = (int)data.entries.size();
+	data.entries.push_back(entry);
+}
+
+void TextureResidency::Untrack(Texture2DHandle texture)
+{
+	int index = Find(texture);
+	if (index < 0) return;
+	RemoveEntry(index);
+}
+
+float TextureResidency::EstimateUVPerPixel(float uvPerWorldUnit, float distance, float fovY, float screenHeight)
+{
+	//World units one pixel covers at that distance
+	float worldPerPixel = 2.0f * distance * tanf(fovY * 0.5f) / screenHeight;
+	return worldPerPixel * uvPerWorldUnit;
+}
+
+void TextureResidency::ReportDemand(Texture2DHandle texture, float uvPerPixel)
+{
+	int index = Find(texture);
+	if (index < 0) return;
+	Entry& entry = GetData().entries[index];
+	if (uvPerPixel < entry.demand) entry.demand = uvPerPixel;
+}
+
+UINT64 TextureResidency::GetChainBytes(UINT width, UINT height, UINT arraySize, UINT mipCount, DXGI_FORMAT format, UINT firstMip)
+{
+	UINT64 bytes = 0;
+	for (UINT mip = firstMip; mip < mipCount; ++mip)
+	{
+		size_t numBytes;
+		DDSCore::GetSurfaceInfo(std::max(width >> mip, 1u), std::max(height >> mip, 1u), format, &numBytes, nullptr, nullptr);
+		bytes += numBytes;
+	}
+	return bytes * arraySize;
+}
+
+UINT TextureResidency::GetLastFirstMip(const TextureStreamInfo& info)
+{
+	bool blockCompressed = (info.format >= DXGI_FORMAT_BC1_TYPELESS && info.format <= DXGI_FORMAT_BC5_SNORM) ||
+		(info.format >= DXGI_FORMAT_BC6H_TYPELESS && info.format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+	if (!blockCompressed) return info.mipCount - 1;
+	//Mips below a block are padded up to 4x4 anyway, and a base smaller than a block can not drop at all
+	UINT mip = 0;
+	while (mip + 1 < info.mipCount && (info.width >> (mip + 1)) >= 4 && (info.height >> (mip + 1)) >= 4) ++mip;
+	return mip;
+}
+
+void TextureResidency::Update()
+{
+	ResidencyData& data = GetData();
+	struct Choice
+	{
+		Texture2D* texture;
+		int entry;
+		float demand;
+		UINT wanted;
+		UINT64 bytes;
+	};
+	std::vector<Choice> choices;
+	choices.reserve(data.entries.size());
+	UINT64 total = 0;
+	UINT64 resident = 0;
+	for (int i = 0; i < data.entries.size(); ++i)
+	{
+		Entry& entry = data.entries[i];
+		Texture2D* texture = ResourceRegistry<Texture2D>::Get(entry.texture);
+		if (texture == nullptr)
+		{
+			//Disposed, swap the last entry in and look at it next
+			RemoveEntry(i);
+			--i;
+			continue;
+		}
+		if (entry.demand != FLT_MAX)
+		{
+			entry.lastDemand = entry.demand;
+			entry.framesUnseen = 0;
+		}
+		else if (entry.framesUnseen < UNSEEN_GRACE_FRAMES)
+		{
+			++entry.framesUnseen;
+		}
+		float uvPerPixel = entry.framesUnseen < UNSEEN_GRACE_FRAMES ? entry.lastDemand : FLT_MAX;
+		entry.demand = FLT_MAX;
+		//Size is unknown until the first mips arrived
+		if (texture->GetFirstResidentMip() == Texture2D::NO_MIP) continue;
+		const TextureStreamInfo& info = texture->GetStreamInfo();
+		//Mip where one texel covers about one pixel
+		float texelsPerPixel = uvPerPixel == FLT_MAX ? FLT_MAX : uvPerPixel * std::max(info.width, info.height);
+		float demand = texelsPerPixel <= 1.0f ? 0.0f : (texelsPerPixel == FLT_MAX ? FLT_MAX : log2f(texelsPerPixel));
+		resident += GetChainBytes(info.width, info.height, info.arraySize, info.mipCount, info.format, texture->GetFirstResidentMip());
+		Choice choice;
+		choice.texture = texture;
+		choice.entry = i;
+		choice.demand = demand;
+		//Unseen textures fall back to their smallest mip
+		UINT lastFirstMip = GetLastFirstMip(info);
+		UINT target = demand >= (float)lastFirstMip ? lastFirstMip : (UINT)demand;
+		//Demand hovering around a mip boundary would stream the same mip in and out,
+		//refine only once it is clearly past the boundary and coarsen only once it stayed coarser
+		choice.wanted = std::min(entry.wanted, lastFirstMip);
+		if (entry.wanted == NO_CHOICE)
+			choice.wanted = target;
+		else if (target < choice.wanted)
+		{
+			if (demand < (float)choice.wanted - REFINE_MARGIN) choice.wanted = target;
+		}
+		if (target > choice.wanted)
+		{
+			if (++entry.framesCoarser >= COARSEN_DELAY_FRAMES) choice.wanted = target;
+		}
+		else entry.framesCoarser = 0;
+		choice.bytes = GetChainBytes(info.width, info.height, info.arraySize, info.mipCount, info.format, choice.wanted);
+		total += choice.bytes;
+		choices.push_back(choice);
+	}
+	//Over budget, drop one mip at a time from the texture that loses least:
+	//the one furthest ahead of its demand, the largest among equals
+	//Choices held back by the coarsen delay are ahead of their demand, so they go first
+	while (total > data.budget)
+	{
+		int best = -1;
+		float bestSlack = 0;
+		for (int i = 0; i < choices.size(); ++i)
+		{
+			const Choice& c = choices[i];
+			const TextureStreamInfo& info = c.texture->GetStreamInfo();
+			if (c.wanted >= GetLastFirstMip(info)) continue;
+			float slack = c.demand - (float)c.wanted;
+			if (best < 0 || slack > bestSlack || (slack == bestSlack && c.bytes > choices[best].bytes))
+			{
+				best = i;
+				bestSlack = slack;
+			}
+		}
+		//Everything is down to its smallest mip
+		if (best < 0) break;
+		Choice& c = choices[best];
+		const TextureStreamInfo& info = c.texture->GetStreamInfo();
+		++c.wanted;
+		UINT64 bytes = GetChainBytes(info.width, info.height, info.arraySize, info.mipCount, info.format, c.wanted);
+		total -= c.bytes - bytes;
+		c.bytes = bytes;
+	}
+	for (int i = 0; i < choices.size(); ++i)
+	{
+		const Choice& c = choices[i];
+		Entry& entry = data.entries[c.entry];
+		if (c.wanted != entry.wanted) entry.framesCoarser = 0;
+		entry.wanted = c.wanted;
+		if (c.wanted == c.texture->GetTargetFirstMip()) continue;
+		//The more detail a texture needs, the sooner it loads
+		float priority = 1.0f / (1.0f + std::min(c.demand, 64.0f));
+		TextureStreamer::RequestMips(c.texture->GetHandle(), c.wanted, priority);
+	}
+	data.residentBytes = resident;
+	data.wantedBytes = total;
+}
+
+UINT64 TextureResidency::GetResidentBytes()
+{
+	return GetData().residentBytes;
+}
+
+UINT64 TextureResidency::GetWantedBytes()
+{
+	return GetData().wantedBytes;
+}
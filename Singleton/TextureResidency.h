@@ -0,0 +1,64 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "../RenderComponent/ResourceHandle.h"
+#include <vector>
+struct TextureStreamInfo;
+//Keeps streamed textures within a memory budget by choosing how many mips each one holds
+//Renderers report how much UV every visible texture covers per pixel, Update turns that into
+//TextureStreamer requests, dropping detail where it is needed least once over budget
+//Render thread only
+class TextureResidency
+{
+private:
+	struct Entry
+	{
+		Texture2DHandle texture;
+		//Smallest UV area per pixel reported this frame, FLT_MAX if not seen
+		float demand;
+		//Kept for a while after the texture was last seen so views turning away do not thrash
+		float lastDemand;
+		UINT framesUnseen;
+		//First mip chosen at the last Update, NO_CHOICE before the first
+		UINT wanted;
+		//Consecutive frames the demand asked for less detail than wanted
+		UINT framesCoarser;
+	};
+	struct ResidencyData
+	{
+		std::vector<Entry> entries;
+		//Entry index for every handle slot, -1 if the slot is not tracked
+		std::vector<int> slotToEntry;
+		UINT64 budget = 512ull << 20;
+		UINT64 residentBytes = 0;
+		UINT64 wantedBytes = 0;
+	};
+	static const UINT UNSEEN_GRACE_FRAMES = 120;
+	static const UINT NO_CHOICE = 0xffffffff;
+	//Demand has to be this far past a mip boundary before more detail is streamed in
+	static constexpr float REFINE_MARGIN = 0.5f;
+	//Frames less detail has to be enough before mips are dropped while within budget
+	static const UINT COARSEN_DELAY_FRAMES = 30;
+	static ResidencyData& GetData();
+	static int Find(Texture2DHandle texture);
+	static void RemoveEntry(int index);
+	//Least detailed first mip a texture may drop to, block compressed textures keep at least one whole 4x4 block
+	static UINT GetLastFirstMip(const TextureStreamInfo& info);
+public:
+	static void SetBudget(UINT64 bytes);
+	static UINT64 GetBudget();
+	static void Track(Texture2DHandle texture);
+	static void Untrack(Texture2DHandle texture);
+	//UV units one pixel covers on a surface, independent of the texture's size
+	//uvPerWorldUnit is how many UV units the surface spans per world unit, distance is to its nearest point
+	static float EstimateUVPerPixel(float uvPerWorldUnit, float distance, float fovY, float screenHeight);
+	//The most detailed demand of the frame wins, the needed mip is log2(uvPerPixel * size)
+	static void ReportDemand(Texture2DHandle texture, float uvPerPixel);
+	//Once per frame after all demands were reported, before TextureStreamer::Update
+	static void Update();
+	//Bytes held by streamed textures at the last Update
+	static UINT64 GetResidentBytes();
+	//Bytes the chosen mips add up to, within budget unless every texture is down to its smallest mip
+	static UINT64 GetWantedBytes();
+	//Bytes of a mip chain from firstMip to the end
+	static UINT64 GetChainBytes(UINT width, UINT height, UINT arraySize, UINT mipCount, DXGI_FORMAT format, UINT firstMip);
+};
@@ -0,0 +1,445 @@
+#include "TextureStreamer.h"
+#include "DeferredReleaseQueue.h"
+#include "../Common/ThreadPool.h"
+#include "../Common/MappedFile.h"
+#include "../Common/DDSCore.h"
+#include "../Common/XXHash64.h"
+#include "../RenderComponent/Texture2D.h"
+#include <algorithm>
+#include <cstring>
+using Microsoft::WRL::ComPtr;
+
+TextureStreamer::StreamData& TextureStreamer::GetData()
+{
+	static StreamData* data = new StreamData();
+	return *data;
+}
+
+bool TextureStreamer::CompareRequest(const LoadRequest& a, const LoadRequest& b)
+{
+	//Every mip tail goes before any full chain, then by priority
+	if (a.stage != b.stage) return a.stage > b.stage;
+	return a.priority < b.priority;
+}
+
+void TextureStreamer::Init(ID3D12Device* device, ID3D12GraphicsCommandList* commandList, const wchar_t* placeholderPath)
+{
+	StreamData& data = GetData();
+	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	ComPtr<ID3D12CommandQueue> copyQueue;
+	ComPtr<ID3D12CommandAllocator> copyAllocator;
+	ComPtr<ID3D12GraphicsCommandList> copyList;
+	ComPtr<ID3D12Fence> copyFence;
+	ThrowIfFailed(device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&copyQueue)));
+	ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&copyAllocator)));
+	ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, copyAllocator.Get(), nullptr, IID_PPV_ARGS(&copyList)));
+	ThrowIfFailed(copyList->Close());
+	ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&copyFence)));
+	std::shared_ptr<Texture2D> placeholder = std::make_shared<Texture2D>(commandList, device, "StreamingPlaceholder", placeholderPath);
+	std::lock_guard<std::mutex> lck(data.mtx);
+	data.device = device;
+	data.copyQueue = copyQueue;
+	data.copyAllocator = copyAllocator;
+	data.copyList = copyList;
+	data.copyFence = copyFence;
+	data.copyFenceValue = 0;
+	data.placeholder = placeholder;
+	data.running = true;
+}
+
+void TextureStreamer::Shutdown()
+{
+	StreamData& data = GetData();
+	std::vector<LoadRequest> pending;
+	std::vector<ReadyUpload> ready;
+	ComPtr<ID3D12Device> device;
+	{
+		std::lock_guard<std::mutex> lck(data.mtx);
+		//Jobs that are still queued find nothing to do, running ones drop their result
+		data.running = false;
+		pending.swap(data.pending);
+		ready.swap(data.ready);
+		device.swap(data.device);
+		data.archive = nullptr;
+		data.contentHashes.clear();
+	}
+	if (data.copyFence != nullptr && data.copyFence->GetCompletedValue() < data.copyFenceValue)
+	{
+		HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
+		ThrowIfFailed(data.copyFence->SetEventOnCompletion(data.copyFenceValue, eventHandle));
+		WaitForSingleObject(eventHandle, INFINITE);
+		CloseHandle(eventHandle);
+	}
+	for (int i = 0; i < ready.size(); ++i)
+		UploadManager::ReleaseCopy(ready[i].stagingTicket);
+	UploadManager::RetireCopy(data.copyFenceValue);
+	data.inFlight.clear();
+	data.copyList = nullptr;
+	data.copyAllocator = nullptr;
+	data.copyQueue = nullptr;
+	data.copyFence = nullptr;
+	data.placeholder = nullptr;
+}
+
+ID3D12Resource* TextureStreamer::GetPlaceholder()
+{
+	StreamData& data = GetData();
+	return data.placeholder == nullptr ? nullptr : data.placeholder->GetResource();
+}
+
+ResidencyHandle TextureStreamer::GetPlaceholderResidency()
+{
+	StreamData& data = GetData();
+	return data.placeholder == nullptr ? ResidencyHandle() : data.placeholder->GetResidency();
+}
+
+bool TextureStreamer::MountArchive(const wchar_t* archivePath)
+{
+	std::shared_ptr<TextureArchive> archive = std::make_shared<TextureArchive>();
+	if (!archive->Open(archivePath)) return false;
+	StreamData& data = GetData();
+	std::lock_guard<std::mutex> lck(data.mtx);
+	//Jobs that already took the old archive keep it alive until they finish
+	data.archive = archive;
+	return true;
+}
+
+bool TextureStreamer::FindArchivedContent(const wchar_t* filePath, uint64_t& contentHash, uint64_t& contentSize)
+{
+	std::shared_ptr<TextureArchive> archive;
+	{
+		StreamData& data = GetData();
+		std::lock_guard<std::mutex> lck(data.mtx);
+		archive = data.archive;
+	}
+	const TextureArchiveEntry* entry = archive == nullptr ? nullptr : archive->Find(GetArchiveName(filePath));
+	if (entry == nullptr) return false;
+	contentHash = entry->contentHash;
+	contentSize = entry->contentSize;
+	return true;
+}
+
+void TextureStreamer::TakeContentHashes(std::vector<ContentHash>& hashes)
+{
+	StreamData& data = GetData();
+	std::lock_guard<std::mutex> lck(data.mtx);
+	hashes.swap(data.contentHashes);
+	data.contentHashes.clear();
+}
+
+void TextureStreamer::PushRequest(LoadRequest&& request)
+{
+	StreamData& data = GetData();
+	{
+		std::lock_guard<std::mutex> lck(data.mtx);
+		if (!data.running) return;
+		data.pending.push_back(std::move(request));
+		std::push_heap(data.pending.begin(), data.pending.end(), CompareRequest);
+	}
+	//Jobs run in any order, each one takes the best request at the time it starts
+	ThreadPool::GetInstance()->Execute([]() -> void { LoadJob(); });
+}
+
+void TextureStreamer::Request(Texture2DHandle texture, const wchar_t* filePath, float priority)
+{
+	LoadRequest request;
+	request.texture = texture;
+	request.filePath = filePath;
+	request.stage = STAGE_TAIL;
+	request.firstMip = 0;
+	request.priority = priority;
+	PushRequest(std::move(request));
+}
+
+void TextureStreamer::RequestMips(Texture2DHandle texture, UINT firstMip, float priority)
+{
+	Texture2D* tex = ResourceRegistry<Texture2D>::Get(texture);
+	if (tex == nullptr) return;
+	tex->SetTargetFirstMip(firstMip);
+	StreamData& data = GetData();
+	{
+		std::lock_guard<std::mutex> lck(data.mtx);
+		size_t count = data.pending.size();
+		data.pending.erase(std::remove_if(data.pending.begin(), data.pending.end(),
+			[texture](const LoadRequest& r) -> bool { return r.texture == texture; }), data.pending.end());
+		if (data.pending.size() != count)
+			std::make_heap(data.pending.begin(), data.pending.end(), CompareRequest);
+	}
+	if (tex->GetFirstResidentMip() == firstMip) return;
+	LoadRequest request;
+	request.texture = texture;
+	request.filePath = tex->GetFilename().str();
+	//Nothing resident yet, show the tail first as usual
+	request.stage = tex->GetFirstResidentMip() == Texture2D::NO_MIP ? STAGE_TAIL : STAGE_FULL;
+	request.firstMip = firstMip;
+	request.priority = priority;
+	PushRequest(std::move(request));
+}
+
+void TextureStreamer::SetPriority(Texture2DHandle texture, float priority)
+{
+	StreamData& data = GetData();
+	std::lock_guard<std::mutex> lck(data.mtx);
+	bool changed = false;
+	for (int i = 0; i < data.pending.size(); ++i)
+	{
+		if (data.pending[i].texture == texture && data.pending[i].priority != priority)
+		{
+			data.pending[i].priority = priority;
+			changed = true;
+		}
+	}
+	if (changed)
+		std::make_heap(data.pending.begin(), data.pending.end(), CompareRequest);
+}
+
+size_t TextureStreamer::PendingCount()
+{
+	StreamData& data = GetData();
+	std::lock_guard<std::mutex> lck(data.mtx);
+	return data.pending.size() + data.ready.size() + data.inFlight.size();
+}
+
+void TextureStreamer::LoadJob()
+{
+	StreamData& data = GetData();
+	LoadRequest request;
+	{
+		std::lock_guard<std::mutex> lck(data.mtx);
+		if (!data.running || data.pending.empty()) return;
+		std::pop_heap(data.pending.begin(), data.pending.end(), CompareRequest);
+		request = std::move(data.pending.back());
+		data.pending.pop_back();
+	}
+	ReadyUpload upload;
+	bool needFullStage = false;
+	if (!LoadStage(request, upload, needFullStage))
+	{
+		//The texture keeps showing the placeholder
+		std::wstring info = L"Texture streaming failed: " + request.filePath + L"\n";
+		OutputDebugStringW(info.c_str());
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lck(data.mtx);
+		if (!data.running)
+		{
+			UploadManager::ReleaseCopy(upload.stagingTicket);
+			return;
+		}
+		if (upload.hashed)
+			data.contentHashes.push_back(upload.content);
+		data.ready.push_back(std::move(upload));
+	}
+	if (needFullStage)
+	{
+		request.stage = STAGE_FULL;
+		PushRequest(std::move(request));
+	}
+}
+
+std::string TextureStreamer::GetArchiveName(const std::wstring& filePath)
+{
+	int length = WideCharToMultiByte(CP_UTF8, 0, filePath.c_str(), (int)filePath.size(), nullptr, 0, nullptr, nullptr);
+	std::string name(length, '\0');
+	WideCharToMultiByte(CP_UTF8, 0, filePath.c_str(), (int)filePath.size(), &name[0], length, nullptr, nullptr);
+	std::replace(name.begin(), name.end(), '\\', '/');
+	return name;
+}
+
+bool TextureStreamer::LoadStage(const LoadRequest& request, ReadyUpload& upload, bool& needFullStage)
+{
+	ComPtr<ID3D12Device> device;
+	std::shared_ptr<TextureArchive> archive;
+	{
+		StreamData& data = GetData();
+		std::lock_guard<std::mutex> lck(data.mtx);
+		device = data.device;
+		archive = data.archive;
+	}
+	if (device == nullptr) return false;
+	//Archived textures come with their header parsed and their texels laid out for upload
+	const TextureArchiveEntry* entry = archive == nullptr ? nullptr : archive->Find(GetArchiveName(request.filePath));
+	MappedFile file;
+	DDSTextureDesc desc;
+	upload.hashed = false;
+	if (entry != nullptr)
+	{
+		archive->GetDesc(*entry, desc);
+	}
+	else
+	{
+		if (!file.Open(request.filePath.c_str())) return false;
+		if (DDSCore::ParseHeader(file.GetData(), (size_t)file.GetSize(), desc) != DDS_RESULT_OK) return false;
+		//The first stage maps the file anyway, hashing it here keeps it off the render thread
+		if (request.stage == STAGE_TAIL)
+		{
+			upload.hashed = true;
+			upload.content.texture = request.texture;
+			upload.content.hash = XXHash64::Hash(file.GetData(), (size_t)file.GetSize());
+			upload.content.fileSize = file.GetSize();
+		}
+	}
+	//Same restriction as CreateDDSTextureFromFile12
+	if (desc.dimension != DDS_DIMENSION_TEXTURE2D || desc.depth > 1) return false;
+	UINT maxDimension = std::max(desc.width, desc.height);
+	UINT firstMip = std::min(request.firstMip, desc.mipCount - 1);
+	needFullStage = false;
+	if (request.stage == STAGE_TAIL)
+	{
+		UINT tailFirstMip = 0;
+		while (tailFirstMip + 1 < desc.mipCount && (maxDimension >> tailFirstMip) > TAIL_SIZE) ++tailFirstMip;
+		//Small textures, or small requests, are done in one stage
+		if (tailFirstMip > firstMip)
+		{
+			firstMip = tailFirstMip;
+			needFullStage = true;
+		}
+	}
+	DDSLayout layout;
+	if (entry != nullptr)
+	{
+		layout.width = std::max<UINT>(desc.width >> firstMip, 1);
+		layout.height = std::max<UINT>(desc.height >> firstMip, 1);
+		layout.depth = 1;
+		layout.mipCount = desc.mipCount - firstMip;
+		layout.skipMip = firstMip;
+	}
+	//Mip n is no larger than maxDimension >> n, so this skips exactly firstMip mips
+	else if (DDSCore::ComputeLayout(desc, std::max<UINT>(maxDimension >> firstMip, 1), layout) != DDS_RESULT_OK)
+		return false;
+
+	D3D12_RESOURCE_DESC texDesc = {};
+	texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	texDesc.Width = layout.width;
+	texDesc.Height = layout.height;
+	texDesc.DepthOrArraySize = (UINT16)desc.arraySize;
+	texDesc.MipLevels = (UINT16)layout.mipCount;
+	texDesc.Format = desc.format;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	texDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+	//Created in COMMON so the copy queue and then the graphics queue can both promote it implicitly
+	if (FAILED(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&upload.resource))))
+		return false;
+
+	UINT subresourceCount = layout.mipCount * desc.arraySize;
+	upload.footprints.resize(subresourceCount);
+	std::vector<UINT> numRows(subresourceCount);
+	std::vector<UINT64> rowSizes(subresourceCount);
+	UINT64 uploadSize = 0;
+	device->GetCopyableFootprints(&texDesc, 0, subresourceCount, 0, upload.footprints.data(), numRows.data(), rowSizes.data(), &uploadSize);
+	//Stays reserved until the copy fence of the submit that reads it has passed
+	upload.staging = UploadManager::AllocateCopy(uploadSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, upload.stagingTicket);
+	BYTE* mapped = upload.staging.cpuAddress;
+	if (entry != nullptr)
+	{
+		//Stored at the same pitch GetCopyableFootprints picks, so each subresource is one block copy
+		static thread_local std::vector<uint8_t> scratch;
+		for (UINT i = 0; i < subresourceCount; ++i)
+		{
+			UINT slice = i / layout.mipCount;
+			UINT mip = i % layout.mipCount;
+			UINT archiveSubresource = slice * desc.mipCount + firstMip + mip;
+			const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint = upload.footprints[i];
+			if (archive->GetSubresource(*entry, archiveSubresource).rowPitch != footprint.Footprint.RowPitch ||
+				!archive->ReadSubresource(*entry, archiveSubresource, mapped + footprint.Offset, scratch))
+			{
+				UploadManager::ReleaseCopy(upload.stagingTicket);
+				return false;
+			}
+		}
+	}
+	else
+	{
+		//Rows go straight from the file mapping into upload memory, only the row pitch differs
+		const uint8_t* fileData = file.GetData();
+		for (UINT i = 0; i < subresourceCount; ++i)
+		{
+			const DDSSubresource& sub = layout.subresources[i];
+			const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint = upload.footprints[i];
+			BYTE* dest = mapped + footprint.Offset;
+			const uint8_t* src = fileData + sub.offset;
+			for (UINT row = 0; row < numRows[i]; ++row)
+				memcpy(dest + row * footprint.Footprint.RowPitch, src + row * sub.rowBytes, (size_t)rowSizes[i]);
+		}
+	}
+	upload.texture = request.texture;
+	upload.firstMip = layout.skipMip;
+	upload.info.width = desc.width;
+	upload.info.height = desc.height;
+	upload.info.arraySize = desc.arraySize;
+	upload.info.mipCount = desc.mipCount;
+	upload.info.format = desc.format;
+	return true;
+}
+
+bool TextureStreamer::IsCloserToTarget(UINT firstMip, UINT currentFirstMip, UINT targetFirstMip)
+{
+	if (currentFirstMip == Texture2D::NO_MIP) return true;
+	UINT newDistance = firstMip > targetFirstMip ? firstMip - targetFirstMip : targetFirstMip - firstMip;
+	UINT currentDistance = currentFirstMip > targetFirstMip ? currentFirstMip - targetFirstMip : targetFirstMip - currentFirstMip;
+	return newDistance < currentDistance;
+}
+
+void TextureStreamer::Publish(std::vector<ReadyUpload>& uploads)
+{
+	for (int i = 0; i < uploads.size(); ++i)
+	{
+		ReadyUpload& upload = uploads[i];
+		Texture2D* texture = ResourceRegistry<Texture2D>::Get(upload.texture);
+		//Disposed while loading, or overtaken by a load that matches the target better
+		if (texture == nullptr || !IsCloserToTarget(upload.firstMip, texture->GetFirstResidentMip(), texture->GetTargetFirstMip())) continue;
+		texture->ReplaceResource(upload.resource, upload.firstMip, upload.info);
+	}
+	//Their copy ring space was retired against the same fence
+	uploads.clear();
+}
+
+void TextureStreamer::Update()
+{
+	StreamData& data = GetData();
+	if (data.copyQueue == nullptr) return;
+	UploadManager::RetireCopy(data.copyFence->GetCompletedValue());
+	if (!data.inFlight.empty())
+	{
+		if (data.copyFence->GetCompletedValue() < data.copyFenceValue) return;
+		Publish(data.inFlight);
+	}
+	std::vector<ReadyUpload> ready;
+	{
+		std::lock_guard<std::mutex> lck(data.mtx);
+		if (data.ready.empty()) return;
+		ready.swap(data.ready);
+	}
+	//The previous batch has completed, so the allocator is free again
+	ThrowIfFailed(data.copyAllocator->Reset());
+	ThrowIfFailed(data.copyList->Reset(data.copyAllocator.Get(), nullptr));
+	for (int i = 0; i < ready.size(); ++i)
+	{
+		ReadyUpload& upload = ready[i];
+		for (UINT sub = 0; sub < upload.footprints.size(); ++sub)
+		{
+			D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = upload.footprints[sub];
+			footprint.Offset += upload.staging.offset;
+			CD3DX12_TEXTURE_COPY_LOCATION dest(upload.resource.Get(), sub);
+			CD3DX12_TEXTURE_COPY_LOCATION src(upload.staging.resource, footprint);
+			data.copyList->CopyTextureRegion(&dest, 0, 0, 0, &src, nullptr);
+		}
+	}
+	ThrowIfFailed(data.copyList->Close());
+	ID3D12CommandList* cmdsLists[] = { data.copyList.Get() };
+	data.copyQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	ThrowIfFailed(data.copyQueue->Signal(data.copyFence.Get(), ++data.copyFenceValue));
+	for (int i = 0; i < ready.size(); ++i)
+		UploadManager::SubmitCopy(ready[i].stagingTicket, data.copyFenceValue);
+	data.inFlight.swap(ready);
+}
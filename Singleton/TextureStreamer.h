@@ -0,0 +1,112 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "../RenderComponent/Texture2D.h"
+#include "../Common/TextureArchive.h"
+#include "UploadManager.h"
+#include <mutex>
+#include <vector>
+#include <memory>
+//Loads streamed Texture2Ds in the background, the render thread never waits on a load
+//Files are mapped and copied into UploadManager's copy ring by ThreadPool jobs, highest priority first
+//Uploads run on a copy queue and a texture only switches to its new resource once the copy fence passed
+//Each texture first loads its mip tail so it is usable quickly, then the requested mips
+//Textures show the placeholder until their first stage arrives
+//Paths found in a mounted TextureArchive load from it, everything else from loose DDS files
+//Loose files are hashed while their mip tail loads, so TextureCache never reads files on the render thread
+class TextureStreamer
+{
+public:
+	//XXH64 of a whole loose DDS file
+	struct ContentHash
+	{
+		Texture2DHandle texture;
+		uint64_t hash;
+		uint64_t fileSize;
+	};
+private:
+	enum Stage
+	{
+		//Only mips no larger than TAIL_SIZE
+		STAGE_TAIL = 0,
+		//Every mip from firstMip on
+		STAGE_FULL = 1
+	};
+	struct LoadRequest
+	{
+		Texture2DHandle texture;
+		std::wstring filePath;
+		Stage stage;
+		UINT firstMip;
+		float priority;
+	};
+	struct ReadyUpload
+	{
+		Texture2DHandle texture;
+		UINT firstMip;
+		TextureStreamInfo info;
+		Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+		//Space in UploadManager's copy ring, footprint offsets are relative to staging.offset
+		UploadAllocation staging;
+		UINT64 stagingTicket;
+		std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints;
+		//Only set for the tail stage of a loose file
+		bool hashed;
+		ContentHash content;
+	};
+	struct StreamData
+	{
+		std::mutex mtx;
+		Microsoft::WRL::ComPtr<ID3D12Device> device;
+		Microsoft::WRL::ComPtr<ID3D12CommandQueue> copyQueue;
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> copyAllocator;
+		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> copyList;
+		Microsoft::WRL::ComPtr<ID3D12Fence> copyFence;
+		UINT64 copyFenceValue = 0;
+		std::shared_ptr<Texture2D> placeholder;
+		std::shared_ptr<TextureArchive> archive;
+		//Binary heap, see CompareRequest
+		std::vector<LoadRequest> pending;
+		//Loaded by a job, waiting for the next copy submit
+		std::vector<ReadyUpload> ready;
+		//Render thread only, submitted with copyFenceValue
+		std::vector<ReadyUpload> inFlight;
+		//Hashed by jobs, waiting for TakeContentHashes
+		std::vector<ContentHash> contentHashes;
+		bool running = false;
+	};
+	static const UINT TAIL_SIZE = 64;
+	//Never destroyed, jobs still running at exit only touch this
+	static StreamData& GetData();
+	static bool CompareRequest(const LoadRequest& a, const LoadRequest& b);
+	static void PushRequest(LoadRequest&& request);
+	static void LoadJob();
+	static bool LoadStage(const LoadRequest& request, ReadyUpload& upload, bool& needFullStage);
+	static std::string GetArchiveName(const std::wstring& filePath);
+	static bool IsCloserToTarget(UINT firstMip, UINT currentFirstMip, UINT targetFirstMip);
+	static void Publish(std::vector<ReadyUpload>& uploads);
+public:
+	//Creates the copy queue and loads the placeholder synchronously into commandList
+	static void Init(ID3D12Device* device, ID3D12GraphicsCommandList* commandList, const wchar_t* placeholderPath);
+	//Waits for the copy queue and drops everything not published yet
+	static void Shutdown();
+	static ID3D12Resource* GetPlaceholder();
+	static ResidencyHandle GetPlaceholderResidency();
+	//Later requests look their path up in the archive first, returns false if it can not be opened
+	//Archive names are the paths the loose files would be opened with, see TextureArchiveWriter::PackDirectory
+	static bool MountArchive(const wchar_t* archivePath);
+	//Content key the mounted archive stored for filePath, false if the path is not archived
+	static bool FindArchivedContent(const wchar_t* filePath, uint64_t& contentHash, uint64_t& contentSize);
+	//Render thread, hands over the hashes of loose files computed since the last call
+	//A texture is hashed every time its mip tail loads from a loose file
+	static void TakeContentHashes(std::vector<ContentHash>& hashes);
+	//Higher priority loads first, e.g. the inverse of the camera distance
+	static void Request(Texture2DHandle texture, const wchar_t* filePath, float priority);
+	//Render thread only, reloads the texture so its resource starts at firstMip
+	//Lower firstMip adds detail, higher evicts it, requests still pending for the texture are dropped
+	static void RequestMips(Texture2DHandle texture, UINT firstMip, float priority);
+	static void SetPriority(Texture2DHandle texture, float priority);
+	//Once per frame on the render thread, after the frame resource was waited on
+	//Publishes finished copies and submits loaded textures to the copy queue, never blocks
+	static void Update();
+	static size_t PendingCount();
+};
@@ -0,0 +1,365 @@
+#include "UploadManager.h"
+#include "DeferredReleaseQueue.h"
+#include "../Common/ThreadPool.h"
+#include <cstring>
+using Microsoft::WRL::ComPtr;
+
+UploadManager::UploadData& UploadManager::GetData()
+{
+	static UploadData* data = new UploadData();
+	return *data;
+}
+
+UploadManager::CopyData& UploadManager::GetCopyData()
+{
+	static CopyData* data = new CopyData();
+	return *data;
+}
+
+ComPtr<ID3D12Resource> UploadManager::CreateRing(ID3D12Device* device, UINT64 size, BYTE** mapped)
+{
+	ComPtr<ID3D12Resource> ring;
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&ring)));
+	//Upload heaps may stay mapped for their whole lifetime
+	ThrowIfFailed(ring->Map(0, nullptr, reinterpret_cast<void**>(mapped)));
+	return ring;
+}
+
+void UploadManager::Init(ID3D12Device* device, UINT64 ringSize, UINT64 copyRingSize)
+{
+	UploadData& data = GetData();
+	CopyData& copyData = GetCopyData();
+	BYTE* mapped = nullptr;
+	BYTE* copyMapped = nullptr;
+	ComPtr<ID3D12Resource> ring = CreateRing(device, ringSize, &mapped);
+	ComPtr<ID3D12Resource> copyRing = CreateRing(device, copyRingSize, &copyMapped);
+	{
+		std::lock_guard<std::mutex> lck(data.mtx);
+		data.device = device;
+		data.ring = ring;
+		data.mapped = mapped;
+		data.space = RingSpace();
+		data.space.size = ringSize;
+	}
+	std::lock_guard<std::mutex> lck(copyData.mtx);
+	copyData.ring = copyRing;
+	copyData.mapped = copyMapped;
+	copyData.space = RingSpace();
+	copyData.space.size = copyRingSize;
+}
+
+void UploadManager::Shutdown()
+{
+	UploadData& data = GetData();
+	CopyData& copyData = GetCopyData();
+	{
+		std::lock_guard<std::mutex> lck(data.mtx);
+		if (data.ring != nullptr)
+			data.ring->Unmap(0, nullptr);
+		data.ring = nullptr;
+		data.device = nullptr;
+		data.mapped = nullptr;
+		data.space = RingSpace();
+	}
+	//Entries not retired yet belong to jobs that are still writing, they keep the copy ring alive
+	std::lock_guard<std::mutex> lck(copyData.mtx);
+	copyData.ring = nullptr;
+	copyData.mapped = nullptr;
+	copyData.space = RingSpace();
+}
+
+bool UploadManager::ReserveSpace(RingSpace& space, UINT64 size, UINT64 alignment, UINT64& offset, UINT64& end, UINT64& consumed)
+{
+	UINT64 alignedHead = (space.head + alignment - 1) & ~(alignment - 1);
+	offset = 0;
+	bool fits = false;
+	if (space.used == 0)
+	{
+		fits = size <= space.size;
+	}
+	else if (space.head > space.tail)
+	{
+		//Free space is [head, size) and [0, tail)
+		if (alignedHead + size <= space.size)
+		{
+			offset = alignedHead;
+			fits = true;
+		}
+		else if (size <= space.tail)
+		{
+			fits = true;
+		}
+	}
+	else if (space.used < space.size)
+	{
+		//Free space is [head, tail)
+		if (alignedHead + size <= space.tail)
+		{
+			offset = alignedHead;
+			fits = true;
+		}
+	}
+	if (!fits) return false;
+	consumed = (offset >= space.head ? offset - space.head : space.size - space.head + offset) + size;
+	if (space.used == 0) consumed = size;
+	end = offset + size;
+	space.used += consumed;
+	space.head = end == space.size ? 0 : end;
+	return true;
+}
+
+void UploadManager::ReleaseSpace(RingSpace& space, UINT64 end, UINT64 consumed)
+{
+	//Shutdown already dropped the ring
+	if (consumed > space.used) return;
+	//Retired in the order they were handed out, so the tail simply follows
+	space.used -= consumed;
+	space.tail = end == space.size ? 0 : end;
+	if (space.used == 0)
+	{
+		space.head = 0;
+		space.tail = 0;
+	}
+}
+
+void UploadManager::Free(UINT64 end, UINT64 consumed)
+{
+	UploadData& data = GetData();
+	std::lock_guard<std::mutex> lck(data.mtx);
+	ReleaseSpace(data.space, end, consumed);
+}
+
+UploadAllocation UploadManager::Allocate(UINT64 size, UINT64 alignment)
+{
+	UploadData& data = GetData();
+	UploadAllocation allocation = {};
+	ComPtr<ID3D12Device> device;
+	{
+		std::lock_guard<std::mutex> lck(data.mtx);
+		UINT64 offset = 0;
+		UINT64 end = 0;
+		UINT64 consumed = 0;
+		if (ReserveSpace(data.space, size, alignment, offset, end, consumed))
+		{
+			allocation.resource = data.ring.Get();
+			allocation.offset = offset;
+			allocation.cpuAddress = data.mapped + offset;
+			//Enqueued under the lock, so frees run in the order the space was handed out
+			DeferredReleaseQueue::Enqueue([end, consumed]() -> void { Free(end, consumed); });
+			return allocation;
+		}
+		device = data.device;
+	}
+	//Larger than what is free right now, the ring can not wait for the fence while commands are still being recorded
+	OutputDebugStringA("UploadManager: ring full, using a temporary upload buffer\n");
+	ComPtr<ID3D12Resource> buffer;
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&buffer)));
+	ThrowIfFailed(buffer->Map(0, nullptr, reinterpret_cast<void**>(&allocation.cpuAddress)));
+	allocation.resource = buffer.Get();
+	allocation.offset = 0;
+	//The queue holds the only reference until the GPU is done with it
+	DeferredReleaseQueue::Release(buffer);
+	return allocation;
+}
+
+UploadAllocation UploadManager::AllocateCopy(UINT64 size, UINT64 alignment, UINT64& ticket)
+{
+	CopyData& data = GetCopyData();
+	UploadAllocation allocation = {};
+	CopyEntry entry;
+	entry.fence = COPY_PENDING;
+	entry.end = 0;
+	entry.consumed = 0;
+	{
+		std::lock_guard<std::mutex> lck(data.mtx);
+		UINT64 offset = 0;
+		if (data.ring != nullptr && ReserveSpace(data.space, size, alignment, offset, entry.end, entry.consumed))
+		{
+			entry.resource = data.ring;
+			allocation.resource = data.ring.Get();
+			allocation.offset = offset;
+			allocation.cpuAddress = data.mapped + offset;
+			ticket = data.firstTicket + data.entries.size();
+			data.entries.push_back(std::move(entry));
+			return allocation;
+		}
+	}
+	//Loads are not worth stalling on the copy fence, other work can use the ring meanwhile
+	OutputDebugStringA("UploadManager: copy ring full, using a temporary upload buffer\n");
+	ComPtr<ID3D12Device> device;
+	{
+		UploadData& uploadData = GetData();
+		std::lock_guard<std::mutex> lck(uploadData.mtx);
+		device = uploadData.device;
+	}
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&entry.resource)));
+	ThrowIfFailed(entry.resource->Map(0, nullptr, reinterpret_cast<void**>(&allocation.cpuAddress)));
+	allocation.resource = entry.resource.Get();
+	allocation.offset = 0;
+	std::lock_guard<std::mutex> lck(data.mtx);
+	ticket = data.firstTicket + data.entries.size();
+	data.entries.push_back(std::move(entry));
+	return allocation;
+}
+
+void UploadManager::SetCopyFence(UINT64 ticket, UINT64 fenceValue)
+{
+	CopyData& data = GetCopyData();
+	std::lock_guard<std::mutex> lck(data.mtx);
+	if (ticket < data.firstTicket || ticket - data.firstTicket >= data.entries.size()) return;
+	data.entries[(size_t)(ticket - data.firstTicket)].fence = fenceValue;
+}
+
+void UploadManager::SubmitCopy(UINT64 ticket, UINT64 fenceValue)
+{
+	SetCopyFence(ticket, fenceValue);
+}
+
+void UploadManager::ReleaseCopy(UINT64 ticket)
+{
+	//Passed by any completed value, retired right away if nothing before it is still pending
+	SetCopyFence(ticket, 0);
+	RetireCopy(0);
+}
+
+void UploadManager::RetireCopy(UINT64 completedFenceValue)
+{
+	CopyData& data = GetCopyData();
+	std::vector<ComPtr<ID3D12Resource>> released;
+	{
+		std::lock_guard<std::mutex> lck(data.mtx);
+		//Strictly in ticket order, so the ring tail only moves forward
+		while (!data.entries.empty() && data.entries.front().fence <= completedFenceValue && data.entries.front().fence != COPY_PENDING)
+		{
+			CopyEntry& entry = data.entries.front();
+			//Space of a ring dropped by Shutdown is not returned to its successor
+			if (entry.consumed > 0 && entry.resource == data.ring)
+				ReleaseSpace(data.space, entry.end, entry.consumed);
+			released.push_back(std::move(entry.resource));
+			data.entries.pop_front();
+			++data.firstTicket;
+		}
+	}
+	//Temporary buffers and a ring dropped by Shutdown are destroyed outside the lock
+}
+
+void UploadManager::UploadBufferRegion(
+	ID3D12GraphicsCommandList* commandList,
+	ID3D12Resource* dest,
+	UINT64 destOffset,
+	const void* data,
+	UINT64 size)
+{
+	UploadAllocation allocation = Allocate(size, 16);
+	memcpy(allocation.cpuAddress, data, (size_t)size);
+	commandList->CopyBufferRegion(dest, destOffset, allocation.resource, allocation.offset, size);
+}
+
+void UploadManager::UploadTextures(
+	ID3D12GraphicsCommandList* commandList,
+	const TextureUpload* uploads,
+	UINT uploadCount)
+{
+	struct StagedSubresource
+	{
+		UINT upload;
+		UINT index;
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint;
+		UINT numRows;
+		UINT64 rowSize;
+	};
+	ID3D12Device* device = GetData().device.Get();
+	std::vector<StagedSubresource> staged;
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints;
+	std::vector<UINT> numRows;
+	std::vector<UINT64> rowSizes;
+	UINT64 totalSize = 0;
+	for (UINT i = 0; i < uploadCount; ++i)
+	{
+		const TextureUpload& upload = uploads[i];
+		D3D12_RESOURCE_DESC desc = upload.resource->GetDesc();
+		footprints.resize(upload.subresourceCount);
+		numRows.resize(upload.subresourceCount);
+		rowSizes.resize(upload.subresourceCount);
+		UINT64 uploadSize = 0;
+		totalSize = (totalSize + D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1) & ~(UINT64)(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1);
+		device->GetCopyableFootprints(&desc, upload.firstSubresource, upload.subresourceCount, totalSize,
+			footprints.data(), numRows.data(), rowSizes.data(), &uploadSize);
+		for (UINT sub = 0; sub < upload.subresourceCount; ++sub)
+		{
+			StagedSubresource s;
+			s.upload = i;
+			s.index = sub;
+			s.footprint = footprints[sub];
+			s.numRows = numRows[sub];
+			s.rowSize = rowSizes[sub];
+			staged.push_back(s);
+		}
+		totalSize += uploadSize;
+	}
+	if (staged.empty()) return;
+	UploadAllocation allocation = Allocate(totalSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+	//Rows per subresource, so one large texture does not keep a single thread busy
+	ThreadPool::GetInstance()->ParallelFor((unsigned int)staged.size(), [&](unsigned int index) -> void
+	{
+		const StagedSubresource& s = staged[index];
+		const D3D12_SUBRESOURCE_DATA& src = uploads[s.upload].data[s.index];
+		BYTE* dest = allocation.cpuAddress + s.footprint.Offset;
+		UINT64 destSlicePitch = (UINT64)s.footprint.Footprint.RowPitch * s.numRows;
+		for (UINT z = 0; z < s.footprint.Footprint.Depth; ++z)
+		{
+			const BYTE* srcSlice = reinterpret_cast<const BYTE*>(src.pData) + (size_t)src.SlicePitch * z;
+			BYTE* destSlice = dest + destSlicePitch * z;
+			for (UINT row = 0; row < s.numRows; ++row)
+				memcpy(destSlice + (size_t)row * s.footprint.Footprint.RowPitch, srcSlice + (size_t)row * src.RowPitch, (size_t)s.rowSize);
+		}
+	});
+	for (int i = 0; i < staged.size(); ++i)
+	{
+		const StagedSubresource& s = staged[i];
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = s.footprint;
+		footprint.Offset += allocation.offset;
+		CD3DX12_TEXTURE_COPY_LOCATION dest(uploads[s.upload].resource, uploads[s.upload].firstSubresource + s.index);
+		CD3DX12_TEXTURE_COPY_LOCATION src(allocation.resource, footprint);
+		commandList->CopyTextureRegion(&dest, 0, 0, 0, &src, nullptr);
+	}
+}
+
+ComPtr<ID3D12Resource> UploadManager::CreateDefaultBuffer(
+	ID3D12GraphicsCommandList* commandList,
+	const void* data,
+	UINT64 size)
+{
+	ComPtr<ID3D12Resource> defaultBuffer;
+	ThrowIfFailed(GetData().device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(defaultBuffer.GetAddressOf())));
+	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
+		D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST));
+	UploadBufferRegion(commandList, defaultBuffer.Get(), 0, data, size);
+	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
+	return defaultBuffer;
+}
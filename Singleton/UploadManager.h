@@ -0,0 +1,122 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include <mutex>
+#include <deque>
+#include <vector>
+
+//Upload memory handed out by UploadManager, valid until the commands recorded with it were executed
+struct UploadAllocation
+{
+	ID3D12Resource* resource;
+	UINT64 offset;
+	BYTE* cpuAddress;
+};
+
+//Texels for subresources [firstSubresource, firstSubresource + subresourceCount) of resource
+struct TextureUpload
+{
+	ID3D12Resource* resource;
+	UINT firstSubresource;
+	UINT subresourceCount;
+	//One per subresource, rows are RowPitch apart and depth slices SlicePitch apart
+	const D3D12_SUBRESOURCE_DATA* data;
+};
+
+//Stages initial texture and buffer contents in one large, persistently mapped upload ring
+//Space is handed out front to back and given back through DeferredReleaseQueue once the frame that
+//used it has passed its fence, so no asset keeps an upload resource of its own
+//Allocations that do not fit the free part of the ring get a temporary upload buffer, released the same way
+//Copies are recorded into the caller's command list, transitions stay with the caller
+//A second ring serves uploads recorded on a copy queue, see AllocateCopy, its space is reclaimed
+//against that queue's fence instead of the frame fence
+class UploadManager
+{
+private:
+	//Guarded by the mutex of the ring it belongs to
+	struct RingSpace
+	{
+		UINT64 size = 0;
+		//Next byte to hand out and oldest byte still in use, equal both when empty and when full
+		UINT64 head = 0;
+		UINT64 tail = 0;
+		//Bytes between tail and head, including padding skipped when wrapping
+		UINT64 used = 0;
+	};
+	struct UploadData
+	{
+		std::mutex mtx;
+		Microsoft::WRL::ComPtr<ID3D12Device> device;
+		Microsoft::WRL::ComPtr<ID3D12Resource> ring;
+		BYTE* mapped = nullptr;
+		RingSpace space;
+	};
+	//One AllocateCopy, consecutive tickets
+	struct CopyEntry
+	{
+		//COPY_PENDING until SubmitCopy or ReleaseCopy
+		UINT64 fence;
+		UINT64 end;
+		//Zero for temporary buffers
+		UINT64 consumed;
+		//The ring or a temporary buffer, kept alive until retired so jobs still writing survive Shutdown
+		Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+	};
+	struct CopyData
+	{
+		std::mutex mtx;
+		Microsoft::WRL::ComPtr<ID3D12Resource> ring;
+		BYTE* mapped = nullptr;
+		RingSpace space;
+		//Ordered by ticket, the front holds firstTicket
+		std::deque<CopyEntry> entries;
+		UINT64 firstTicket = 0;
+	};
+	static const UINT64 COPY_PENDING = ~0ull;
+	//Never destroyed, so frees retired during exit still find it
+	static UploadData& GetData();
+	static CopyData& GetCopyData();
+	static Microsoft::WRL::ComPtr<ID3D12Resource> CreateRing(ID3D12Device* device, UINT64 size, BYTE** mapped);
+	//Returns false if size does not fit the free part of the ring
+	static bool ReserveSpace(RingSpace& space, UINT64 size, UINT64 alignment, UINT64& offset, UINT64& end, UINT64& consumed);
+	//Space has to be given back in the order it was reserved
+	static void ReleaseSpace(RingSpace& space, UINT64 end, UINT64 consumed);
+	static void Free(UINT64 end, UINT64 consumed);
+	static void SetCopyFence(UINT64 ticket, UINT64 fenceValue);
+public:
+	static const UINT64 DEFAULT_RING_SIZE = 64 * 1024 * 1024;
+	static const UINT64 DEFAULT_COPY_RING_SIZE = 32 * 1024 * 1024;
+	static void Init(ID3D12Device* device, UINT64 ringSize = DEFAULT_RING_SIZE, UINT64 copyRingSize = DEFAULT_COPY_RING_SIZE);
+	//Only after DeferredReleaseQueue::Flush and after the copy queues were waited on
+	static void Shutdown();
+	//Render thread while a frame is recorded, the space is tagged with that frame's fence
+	//alignment must be a power of two
+	static UploadAllocation Allocate(UINT64 size, UINT64 alignment);
+	//Any thread, for commands recorded on a copy queue, alignment must be a power of two
+	//The space stays reserved until SubmitCopy and RetireCopy passing its fence, or ReleaseCopy
+	//Allocations that do not fit get a temporary upload buffer with the same lifetime
+	static UploadAllocation AllocateCopy(UINT64 size, UINT64 alignment, UINT64& ticket);
+	//fenceValue is what the copy queue signals once the commands reading ticket have executed
+	static void SubmitCopy(UINT64 ticket, UINT64 fenceValue);
+	//Nothing reads ticket, e.g. the load failed or was dropped before it was submitted
+	static void ReleaseCopy(UINT64 ticket);
+	//Gives back copy ring space up to the first allocation that is still pending or in flight
+	static void RetireCopy(UINT64 completedFenceValue);
+	//dest must be in COPY_DEST
+	static void UploadBufferRegion(
+		ID3D12GraphicsCommandList* commandList,
+		ID3D12Resource* dest,
+		UINT64 destOffset,
+		const void* data,
+		UINT64 size);
+	//Stages every texture in one allocation and copies the rows on the thread pool
+	//Resources must be in COPY_DEST
+	static void UploadTextures(
+		ID3D12GraphicsCommandList* commandList,
+		const TextureUpload* uploads,
+		UINT uploadCount);
+	//Replaces d3dUtil::CreateDefaultBuffer, the result ends in GENERIC_READ
+	static Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(
+		ID3D12GraphicsCommandList* commandList,
+		const void* data,
+		UINT64 size);
+};
@@ -0,0 +1,309 @@
+#include "VirtualTextureManager.h"
+#include "UploadManager.h"
+#include "../Common/ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+using Microsoft::WRL::ComPtr;
+
+VirtualTextureManager::ManagerData& VirtualTextureManager::GetData()
+{
+	static ManagerData* data = new ManagerData();
+	return *data;
+}
+
+bool VirtualTextureManager::Init(ID3D12Device* device, UINT physicalPageCount)
+{
+	ManagerData& data = GetData();
+	D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+	ThrowIfFailed(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options)));
+	if (options.TiledResourcesTier == D3D12_TILED_RESOURCES_TIER_NOT_SUPPORTED)
+	{
+		OutputDebugStringA("VirtualTextureManager: tiled resources are not supported\n");
+		return false;
+	}
+	D3D12_HEAP_DESC heapDesc = {};
+	heapDesc.SizeInBytes = (UINT64)physicalPageCount * VIRTUAL_TEXTURE_TILE_SIZE;
+	heapDesc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+	heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	heapDesc.Flags = D3D12_HEAP_FLAG_DENY_BUFFERS | D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES;
+	ComPtr<ID3D12Heap> pageHeap;
+	ThrowIfFailed(device->CreateHeap(&heapDesc, IID_PPV_ARGS(&pageHeap)));
+	data.device = device;
+	data.pageHeap = pageHeap;
+	data.system.Reset(physicalPageCount);
+	data.textures.clear();
+	return true;
+}
+
+void VirtualTextureManager::Shutdown()
+{
+	ManagerData& data = GetData();
+	data.textures.clear();
+	data.system.Reset(0);
+	data.pageHeap = nullptr;
+	data.device = nullptr;
+}
+
+int VirtualTextureManager::Load(ID3D12CommandQueue* commandQueue, ID3D12GraphicsCommandList* commandList, const wchar_t* path)
+{
+	ManagerData& data = GetData();
+	if (data.device == nullptr || data.system.GetTextureCount() >= VIRTUAL_TEXTURE_MAX_TEXTURES) return -1;
+	VirtualTexture texture;
+	texture.file = std::make_unique<VirtualTextureFile>();
+	if (!texture.file->Open(path))
+	{
+		OutputDebugStringW((std::wstring(L"VirtualTextureManager: can not open ") + path + L"\n").c_str());
+		return -1;
+	}
+	const VirtualTextureFileHeader& header = texture.file->GetHeader();
+	D3D12_RESOURCE_DESC texDesc = {};
+	texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	texDesc.Alignment = 0;
+	texDesc.Width = header.width;
+	texDesc.Height = header.height;
+	texDesc.DepthOrArraySize = 1;
+	texDesc.MipLevels = (UINT16)header.mipCount;
+	texDesc.Format = (DXGI_FORMAT)header.format;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Layout = D3D12_TEXTURE_LAYOUT_64KB_UNDEFINED_SWIZZLE;
+	texDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+	ThrowIfFailed(data.device->CreateReservedResource(&texDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&texture.resource)));
+
+	UINT tileCount = 0;
+	D3D12_PACKED_MIP_INFO packedMipInfo;
+	D3D12_TILE_SHAPE tileShape;
+	UINT subresourceCount = header.mipCount;
+	std::vector<D3D12_SUBRESOURCE_TILING> tilings(header.mipCount);
+	data.device->GetResourceTiling(texture.resource.Get(), &tileCount, &packedMipInfo, &tileShape, &subresourceCount, 0, tilings.data());
+	if (packedMipInfo.NumStandardMips > 0 &&
+		(tileShape.WidthInTexels != header.tileWidth || tileShape.HeightInTexels != header.tileHeight))
+	{
+		OutputDebugStringW((std::wstring(L"VirtualTextureManager: tile shape does not match ") + path + L"\n").c_str());
+		return -1;
+	}
+	//The hardware may pack mips the file cut into tiles, those can not be paged either
+	UINT residentMip = std::min<UINT>(header.tailMip, packedMipInfo.NumStandardMips);
+
+	//Map the resident mips: standard ones by box, then the packed ones as a whole
+	std::vector<D3D12_TILED_RESOURCE_COORDINATE> coordinates;
+	std::vector<D3D12_TILE_REGION_SIZE> regionSizes;
+	UINT residentTileCount = 0;
+	for (UINT mip = residentMip; mip < packedMipInfo.NumStandardMips; ++mip)
+	{
+		D3D12_TILED_RESOURCE_COORDINATE coordinate = { 0, 0, 0, mip };
+		D3D12_TILE_REGION_SIZE regionSize = {};
+		regionSize.UseBox = TRUE;
+		regionSize.Width = tilings[mip].WidthInTiles;
+		regionSize.Height = tilings[mip].HeightInTiles;
+		regionSize.Depth = 1;
+		regionSize.NumTiles = regionSize.Width * regionSize.Height;
+		coordinates.push_back(coordinate);
+		regionSizes.push_back(regionSize);
+		residentTileCount += regionSize.NumTiles;
+	}
+	if (packedMipInfo.NumPackedMips > 0)
+	{
+		D3D12_TILED_RESOURCE_COORDINATE coordinate = { 0, 0, 0, packedMipInfo.NumStandardMips };
+		D3D12_TILE_REGION_SIZE regionSize = {};
+		regionSize.UseBox = FALSE;
+		regionSize.NumTiles = packedMipInfo.NumTilesForPackedMips;
+		coordinates.push_back(coordinate);
+		regionSizes.push_back(regionSize);
+		residentTileCount += regionSize.NumTiles;
+	}
+	if (residentTileCount > 0)
+	{
+		D3D12_HEAP_DESC heapDesc = {};
+		heapDesc.SizeInBytes = (UINT64)residentTileCount * VIRTUAL_TEXTURE_TILE_SIZE;
+		heapDesc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+		heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+		heapDesc.Flags = D3D12_HEAP_FLAG_DENY_BUFFERS | D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES;
+		ThrowIfFailed(data.device->CreateHeap(&heapDesc, IID_PPV_ARGS(&texture.residentHeap)));
+		//One heap range covers every region in order
+		UINT heapOffset = 0;
+		commandQueue->UpdateTileMappings(texture.resource.Get(), (UINT)coordinates.size(), coordinates.data(), regionSizes.data(),
+			texture.residentHeap.Get(), 1, nullptr, &heapOffset, &residentTileCount, D3D12_TILE_MAPPING_FLAG_NONE);
+	}
+
+	//Fill them, tiled mips tile by tile and tail mips as they are stored
+	UINT64 uploadSize = header.tailSize;
+	for (UINT mip = residentMip; mip < header.tailMip; ++mip)
+		uploadSize += (UINT64)texture.file->GetLevel(mip).pagesX * texture.file->GetLevel(mip).pagesY * VIRTUAL_TEXTURE_TILE_SIZE;
+	UploadAllocation allocation = UploadManager::Allocate(uploadSize, VIRTUAL_TEXTURE_PLACEMENT_ALIGNMENT);
+	UINT64 uploadOffset = 0;
+	for (UINT mip = residentMip; mip < header.tailMip; ++mip)
+	{
+		const VirtualTextureFileLevel& level = texture.file->GetLevel(mip);
+		for (UINT y = 0; y < level.pagesY; ++y)
+		{
+			for (UINT x = 0; x < level.pagesX; ++x)
+			{
+				texture.file->ReadTile(mip, x, y, allocation.cpuAddress + uploadOffset);
+				CopyTile(commandList, texture, mip, x, y, allocation.resource, allocation.offset + uploadOffset);
+				uploadOffset += VIRTUAL_TEXTURE_TILE_SIZE;
+			}
+		}
+	}
+	memcpy(allocation.cpuAddress + uploadOffset, texture.file->GetTailData(), (size_t)header.tailSize);
+	for (UINT mip = header.tailMip; mip < header.mipCount; ++mip)
+	{
+		const VirtualTextureFileTailMip& tail = texture.file->GetTailMip(mip - header.tailMip);
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
+		footprint.Offset = allocation.offset + uploadOffset + tail.offset;
+		footprint.Footprint.Format = texDesc.Format;
+		footprint.Footprint.Width = tail.width;
+		footprint.Footprint.Height = tail.height;
+		footprint.Footprint.Depth = 1;
+		footprint.Footprint.RowPitch = tail.rowPitch;
+		CD3DX12_TEXTURE_COPY_LOCATION dest(texture.resource.Get(), mip);
+		CD3DX12_TEXTURE_COPY_LOCATION src(allocation.resource, footprint);
+		commandList->CopyTextureRegion(&dest, 0, 0, 0, &src, nullptr);
+	}
+	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.resource.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
+	int id = data.system.AddTexture(header.width, header.height, header.tileWidth, header.tileHeight, residentMip);
+	const VirtualTexturePageTable& table = data.system.GetPageTable(id);
+	UINT mapWidth = residentMip > 0 ? table.GetPagesX(0) : 1;
+	UINT mapHeight = residentMip > 0 ? table.GetPagesY(0) : 1;
+	ThrowIfFailed(data.device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8_UINT, mapWidth, mapHeight, 1, 1),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&texture.residencyMap)));
+	data.textures.push_back(std::move(texture));
+	UploadResidencyMap(commandList, id, true);
+	return id;
+}
+
+void VirtualTextureManager::CopyTile(ID3D12GraphicsCommandList* commandList, const VirtualTexture& texture, UINT mip, UINT pageX, UINT pageY,
+	ID3D12Resource* upload, UINT64 uploadOffset)
+{
+	const VirtualTextureFileHeader& header = texture.file->GetHeader();
+	const VirtualTextureFileLevel& level = texture.file->GetLevel(mip);
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
+	footprint.Offset = uploadOffset;
+	footprint.Footprint.Format = (DXGI_FORMAT)header.format;
+	footprint.Footprint.Width = header.tileWidth;
+	footprint.Footprint.Height = header.tileHeight;
+	footprint.Footprint.Depth = 1;
+	footprint.Footprint.RowPitch = header.tileRowPitch;
+	UINT left = pageX * header.tileWidth;
+	UINT top = pageY * header.tileHeight;
+	//Edge tiles hang over the mip, a box may end at the mip's edge even inside a block
+	D3D12_BOX box = { 0, 0, 0, std::min(header.tileWidth, level.width - left), std::min(header.tileHeight, level.height - top), 1 };
+	CD3DX12_TEXTURE_COPY_LOCATION dest(texture.resource.Get(), mip);
+	CD3DX12_TEXTURE_COPY_LOCATION src(upload, footprint);
+	commandList->CopyTextureRegion(&dest, left, top, 0, &src, &box);
+}
+
+void VirtualTextureManager::UploadResidencyMap(ID3D12GraphicsCommandList* commandList, UINT id, bool initial)
+{
+	ManagerData& data = GetData();
+	VirtualTexture& texture = data.textures[id];
+	const VirtualTexturePageTable& table = data.system.GetPageTable(id);
+	table.BuildResidencyMap(data.residencyData);
+	texture.residencyVersion = table.GetVersion();
+	D3D12_RESOURCE_DESC desc = texture.residencyMap->GetDesc();
+	D3D12_SUBRESOURCE_DATA subresource;
+	subresource.pData = data.residencyData.data();
+	subresource.RowPitch = (LONG_PTR)desc.Width;
+	subresource.SlicePitch = (LONG_PTR)(desc.Width * desc.Height);
+	TextureUpload upload = { texture.residencyMap.Get(), 0, 1, &subresource };
+	if (!initial)
+	{
+		commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.residencyMap.Get(),
+			D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST));
+	}
+	UploadManager::UploadTextures(commandList, &upload, 1);
+	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.residencyMap.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+}
+
+void VirtualTextureManager::Update(ID3D12CommandQueue* commandQueue, ID3D12GraphicsCommandList* commandList, const uint32_t* feedback, size_t count)
+{
+	ManagerData& data = GetData();
+	if (data.device == nullptr || data.textures.empty()) return;
+	VirtualTextureUpdate& update = data.update;
+	data.system.ProcessFeedback(feedback, count, MAX_LOADS_PER_FRAME, update);
+
+	//Mappings are queue operations, they run after every frame submitted so far and before this one
+	std::vector<D3D12_TILED_RESOURCE_COORDINATE> coordinates;
+	std::vector<D3D12_TILE_RANGE_FLAGS> rangeFlags;
+	std::vector<UINT> heapOffsets;
+	std::vector<UINT> rangeTileCounts;
+	D3D12_TILE_REGION_SIZE tileSize = {};
+	tileSize.NumTiles = 1;
+	std::vector<D3D12_TILE_REGION_SIZE> regionSizes;
+	//Every eviction is unmapped first, their physical pages are reused by the loads of any texture
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (UINT id = 0; id < data.textures.size(); ++id)
+		{
+			const std::vector<VirtualPageLoad>& pages = pass == 0 ? update.evictions : update.loads;
+			coordinates.clear();
+			heapOffsets.clear();
+			for (int i = 0; i < pages.size(); ++i)
+			{
+				const VirtualPageLoad& page = pages[i];
+				if (page.page.texture != id) continue;
+				D3D12_TILED_RESOURCE_COORDINATE coordinate = { page.page.x, page.page.y, 0, page.page.mip };
+				coordinates.push_back(coordinate);
+				heapOffsets.push_back(page.physicalPage);
+			}
+			if (coordinates.empty()) continue;
+			UINT pageCount = (UINT)coordinates.size();
+			regionSizes.assign(pageCount, tileSize);
+			rangeFlags.assign(pageCount, pass == 0 ? D3D12_TILE_RANGE_FLAG_NULL : D3D12_TILE_RANGE_FLAG_NONE);
+			rangeTileCounts.assign(pageCount, 1);
+			commandQueue->UpdateTileMappings(data.textures[id].resource.Get(), pageCount, coordinates.data(), regionSizes.data(),
+				pass == 0 ? nullptr : data.pageHeap.Get(), pageCount, rangeFlags.data(), heapOffsets.data(), rangeTileCounts.data(),
+				D3D12_TILE_MAPPING_FLAG_NONE);
+		}
+	}
+
+	if (!update.loads.empty())
+	{
+		UINT loadCount = (UINT)update.loads.size();
+		UploadAllocation allocation = UploadManager::Allocate((UINT64)loadCount * VIRTUAL_TEXTURE_TILE_SIZE, VIRTUAL_TEXTURE_PLACEMENT_ALIGNMENT);
+		//Tiles come straight out of the mapped file, one per job
+		ThreadPool::GetInstance()->ParallelFor(loadCount, [&](unsigned int index) -> void
+		{
+			const VirtualPage& page = update.loads[index].page;
+			data.textures[page.texture].file->ReadTile(page.mip, page.x, page.y, allocation.cpuAddress + (UINT64)index * VIRTUAL_TEXTURE_TILE_SIZE);
+		}, 1);
+		std::vector<D3D12_RESOURCE_BARRIER> barriers;
+		for (UINT id = 0; id < data.textures.size(); ++id)
+		{
+			for (UINT i = 0; i < loadCount; ++i)
+			{
+				if (update.loads[i].page.texture != id) continue;
+				barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(data.textures[id].resource.Get(),
+					D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST));
+				break;
+			}
+		}
+		commandList->ResourceBarrier((UINT)barriers.size(), barriers.data());
+		for (UINT i = 0; i < loadCount; ++i)
+		{
+			const VirtualPage& page = update.loads[i].page;
+			CopyTile(commandList, data.textures[page.texture], page.mip, page.x, page.y,
+				allocation.resource, allocation.offset + (UINT64)i * VIRTUAL_TEXTURE_TILE_SIZE);
+		}
+		for (int i = 0; i < barriers.size(); ++i)
+			std::swap(barriers[i].Transition.StateBefore, barriers[i].Transition.StateAfter);
+		commandList->ResourceBarrier((UINT)barriers.size(), barriers.data());
+		//Copies are recorded ahead of every draw of the frame, so the pages count from now on
+		for (UINT i = 0; i < loadCount; ++i)
+			data.system.CompleteLoad(update.loads[i]);
+	}
+
+	for (UINT id = 0; id < data.textures.size(); ++id)
+	{
+		if (data.system.GetPageTable(id).GetVersion() != data.textures[id].residencyVersion)
+			UploadResidencyMap(commandList, id, false);
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "../Common/VirtualTexture.h"
+#include "../Common/VirtualTextureFile.h"
+#include <memory>
+#include <vector>
+//Virtual textures on reserved resources, paged tiles share one heap of physical pages
+//Load maps and fills the always resident mips, Update turns a feedback readback into tile
+//mappings on the queue and tile copies in the frame's command list, see VirtualTextureSystem
+//Shaders clamp their LOD with the residency map, see Shaders/VirtualTexture.hlsl
+//Textures stay in PIXEL_SHADER_RESOURCE between calls
+//Render thread only
+class VirtualTextureManager
+{
+private:
+	struct VirtualTexture
+	{
+		std::unique_ptr<VirtualTextureFile> file;
+		Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+		//Tiles of the mips that are never evicted, whether the hardware packs them or not
+		Microsoft::WRL::ComPtr<ID3D12Heap> residentHeap;
+		//R8_UINT, one texel per page of mip 0
+		Microsoft::WRL::ComPtr<ID3D12Resource> residencyMap;
+		UINT residencyVersion;
+	};
+	struct ManagerData
+	{
+		Microsoft::WRL::ComPtr<ID3D12Device> device;
+		Microsoft::WRL::ComPtr<ID3D12Heap> pageHeap;
+		VirtualTextureSystem system;
+		std::vector<VirtualTexture> textures;
+		//Kept between frames so Update does not allocate
+		VirtualTextureUpdate update;
+		std::vector<uint8_t> residencyData;
+	};
+	static ManagerData& GetData();
+	static void UploadResidencyMap(ID3D12GraphicsCommandList* commandList, UINT id, bool initial);
+	//Copies one tile of a tiled mip out of upload memory, clipped to the mip
+	static void CopyTile(ID3D12GraphicsCommandList* commandList, const VirtualTexture& texture, UINT mip, UINT pageX, UINT pageY,
+		ID3D12Resource* upload, UINT64 uploadOffset);
+public:
+	//64MB of physical pages
+	static const UINT DEFAULT_PAGE_COUNT = 1024;
+	//Later pages wait for the next frame's feedback
+	static const UINT MAX_LOADS_PER_FRAME = 32;
+	//Returns false and stays unusable without tiled resource support
+	static bool Init(ID3D12Device* device, UINT physicalPageCount = DEFAULT_PAGE_COUNT);
+	//Only after the command queue was flushed
+	static void Shutdown();
+	//Opens a file written by VirtualTextureFile::Build, the id is what the feedback pass writes
+	//Returns -1 if the file can not be used
+	static int Load(ID3D12CommandQueue* commandQueue, ID3D12GraphicsCommandList* commandList, const wchar_t* path);
+	//Once per frame before anything samples virtual textures, with the latest feedback readback
+	static void Update(ID3D12CommandQueue* commandQueue, ID3D12GraphicsCommandList* commandList, const uint32_t* feedback, size_t count);
+	static ID3D12Resource* GetResource(int id) { return GetData().textures[id].resource.Get(); }
+	static ID3D12Resource* GetResidencyMap(int id) { return GetData().textures[id].residencyMap.Get(); }
+	static const VirtualTexturePageTable& GetPageTable(int id) { return GetData().system.GetPageTable(id); }
+};
@@ -0,0 +1,282 @@
+#include "../Common/BCEncoder.h"
+#include "../Common/TextureImporter.h"
+#include "TestCheck.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+//Encodes an image to every format and quality, decodes the blocks again and checks the PSNR
+//against a floor per format. BC7 blocks must be mode 6, the only mode the encoder writes.
+//The same binary is built twice, with SSE2 and with BC_FORCE_SCALAR, the scalar build writes
+//its blocks with -write and the SSE2 build requires byte identical blocks with -compare
+//Usage: BCEncoderTest <bmp> [-write <file> | -compare <file>]
+
+namespace
+{
+	using TestCheck::Check;
+
+	const char* FORMAT_NAMES[] = { "BC1", "BC3", "BC4", "BC5", "BC7" };
+	//Lowest PSNR in dB over the compared channels at BC_QUALITY_NORMAL and above
+	const double PSNR_FLOORS[] = { 50.0, 42.0, 40.0, 40.0, 28.0 };
+	const int FORMAT_COUNT = 5;
+	const int QUALITY_COUNT = 3;
+
+	void Decode565(uint16_t value, int* rgb)
+	{
+		int r = value >> 11;
+		int g = (value >> 5) & 63;
+		int b = value & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	//Color half of BC1 and BC3, BC3 always uses the four color palette
+	void DecodeColorBlock(const uint8_t* block, bool fourColors, uint8_t* pixels)
+	{
+		uint16_t c0 = (uint16_t)(block[0] | block[1] << 8);
+		uint16_t c1 = (uint16_t)(block[2] | block[3] << 8);
+		int palette[4][4];
+		Decode565(c0, palette[0]);
+		Decode565(c1, palette[1]);
+		palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+		for (int c = 0; c < 3; ++c)
+		{
+			if (fourColors || c0 > c1)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			else
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+		if (!fourColors && c0 <= c1) palette[3][3] = 0;
+		uint32_t bits = block[4] | block[5] << 8 | block[6] << 16 | (uint32_t)block[7] << 24;
+		for (int i = 0; i < 16; ++i)
+		{
+			int index = (bits >> (2 * i)) & 3;
+			for (int c = 0; c < 4; ++c)
+				pixels[i * 4 + c] = (uint8_t)palette[index][c];
+		}
+	}
+
+	//BC4 block into one channel, also the alpha half of BC3 and each half of BC5
+	void DecodeChannelBlock(const uint8_t* block, uint8_t* pixels, int channel)
+	{
+		int e0 = block[0];
+		int e1 = block[1];
+		int palette[8] = { e0, e1 };
+		if (e0 > e1)
+		{
+			for (int i = 1; i < 7; ++i)
+				palette[i + 1] = ((7 - i) * e0 + i * e1 + 3) / 7;
+		}
+		else
+		{
+			for (int i = 1; i < 5; ++i)
+				palette[i + 1] = ((5 - i) * e0 + i * e1 + 2) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+		uint64_t bits = 0;
+		for (int i = 0; i < 6; ++i)
+			bits |= (uint64_t)block[2 + i] << (8 * i);
+		for (int i = 0; i < 16; ++i)
+			pixels[i * 4 + channel] = (uint8_t)palette[(bits >> (3 * i)) & 7];
+	}
+
+	int ReadBits(const uint8_t* block, int& position, int count)
+	{
+		int value = 0;
+		for (int i = 0; i < count; ++i, ++position)
+			value |= ((block[position >> 3] >> (position & 7)) & 1) << i;
+		return value;
+	}
+
+	//Mode 6 only: 7 bit RGBA endpoints with a p bit each and 4 bit indices
+	bool DecodeBC7Block(const uint8_t* block, uint8_t* pixels)
+	{
+		static const int WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+		int position = 0;
+		if (ReadBits(block, position, 7) != 1 << 6) return false;
+		int endpoints[2][4];
+		for (int c = 0; c < 4; ++c)
+		{
+			endpoints[0][c] = ReadBits(block, position, 7);
+			endpoints[1][c] = ReadBits(block, position, 7);
+		}
+		int p0 = ReadBits(block, position, 1);
+		int p1 = ReadBits(block, position, 1);
+		for (int c = 0; c < 4; ++c)
+		{
+			endpoints[0][c] = endpoints[0][c] << 1 | p0;
+			endpoints[1][c] = endpoints[1][c] << 1 | p1;
+		}
+		for (int i = 0; i < 16; ++i)
+		{
+			//The anchor index drops its top bit
+			int w = WEIGHTS[ReadBits(block, position, i == 0 ? 3 : 4)];
+			for (int c = 0; c < 4; ++c)
+				pixels[i * 4 + c] = (uint8_t)(((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6);
+		}
+		return position == 128;
+	}
+
+	bool DecodeBlock(BCFormat format, const uint8_t* block, uint8_t* pixels)
+	{
+		memset(pixels, 0, 64);
+		switch (format)
+		{
+		case BC_FORMAT_BC1:
+			DecodeColorBlock(block, false, pixels);
+			return true;
+		case BC_FORMAT_BC3:
+			DecodeColorBlock(block + 8, true, pixels);
+			DecodeChannelBlock(block, pixels, 3);
+			return true;
+		case BC_FORMAT_BC4:
+			DecodeChannelBlock(block, pixels, 0);
+			return true;
+		case BC_FORMAT_BC5:
+			DecodeChannelBlock(block, pixels, 0);
+			DecodeChannelBlock(block + 8, pixels, 1);
+			return true;
+		case BC_FORMAT_BC7:
+			return DecodeBC7Block(block, pixels);
+		}
+		return false;
+	}
+
+	//PSNR over the channels the format stores, BC1 colors only count where the texel stays opaque
+	//and its alpha must come back as 0 or 255 exactly. Returns -1 for blocks that do not decode
+	double MeasurePSNR(BCFormat format, const ImportedImage& image, const std::vector<uint8_t>& blocks, bool& alphaExact)
+	{
+		int channelCount = format == BC_FORMAT_BC4 ? 1 : (format == BC_FORMAT_BC5 ? 2 : 4);
+		size_t blockBytes = BCEncoder::GetBlockBytes(format);
+		uint32_t blocksX = (image.width + 3) / 4;
+		uint32_t blocksY = (image.height + 3) / 4;
+		double squaredError = 0.0;
+		double samples = 0.0;
+		alphaExact = true;
+		for (uint32_t by = 0; by < blocksY; ++by)
+		{
+			for (uint32_t bx = 0; bx < blocksX; ++bx)
+			{
+				uint8_t pixels[64];
+				if (!DecodeBlock(format, &blocks[(by * blocksX + bx) * blockBytes], pixels)) return -1.0;
+				for (uint32_t i = 0; i < 16; ++i)
+				{
+					uint32_t x = bx * 4 + i % 4;
+					uint32_t y = by * 4 + i / 4;
+					if (x >= image.width || y >= image.height) continue;
+					const uint8_t* source = &image.rgba[((size_t)y * image.width + x) * 4];
+					const uint8_t* decoded = &pixels[i * 4];
+					if (format == BC_FORMAT_BC1)
+					{
+						bool opaque = source[3] >= 128;
+						alphaExact &= decoded[3] == (opaque ? 255 : 0);
+						if (!opaque) continue;
+					}
+					int compared = format == BC_FORMAT_BC1 ? 3 : channelCount;
+					for (int c = 0; c < compared; ++c)
+					{
+						double e = (double)source[c] - decoded[c];
+						squaredError += e * e;
+						samples += 1.0;
+					}
+				}
+			}
+		}
+		if (squaredError == 0.0) return 99.0;
+		return 10.0 * log10(255.0 * 255.0 * samples / squaredError);
+	}
+
+	//Odd size so the right and bottom blocks repeat edges, with smooth and noisy regions
+	ImportedImage MakeGradient()
+	{
+		ImportedImage image;
+		image.width = 67;
+		image.height = 37;
+		image.rgba.resize((size_t)image.width * image.height * 4);
+		uint32_t noise = 12345;
+		for (uint32_t y = 0; y < image.height; ++y)
+		{
+			for (uint32_t x = 0; x < image.width; ++x)
+			{
+				noise = noise * 1664525 + 1013904223;
+				uint8_t* p = &image.rgba[((size_t)y * image.width + x) * 4];
+				p[0] = (uint8_t)(128 + 100 * sin(x * 0.1));
+				p[1] = (uint8_t)(x * 255 / image.width);
+				p[2] = (uint8_t)(y * 4 + (noise >> 28));
+				p[3] = (uint8_t)((x ^ y) * 7);
+			}
+		}
+		return image;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: BCEncoderTest <bmp> [-write <file> | -compare <file>]\n");
+		return 2;
+	}
+	ImportedImage bitmap;
+	if (!TextureImporter::LoadBMP(argv[1], bitmap))
+	{
+		printf("Failed to load %s\n", argv[1]);
+		return 1;
+	}
+	ImportedImage gradient = MakeGradient();
+	const ImportedImage* images[] = { &bitmap, &gradient };
+
+	//Every block of every run in order, for the SSE2 and scalar comparison
+	std::vector<uint8_t> allBlocks;
+	for (int f = 0; f < FORMAT_COUNT; ++f)
+	{
+		BCFormat format = (BCFormat)f;
+		for (int q = 0; q < QUALITY_COUNT; ++q)
+		{
+			for (int i = 0; i < 2; ++i)
+			{
+				const ImportedImage& image = *images[i];
+				std::vector<uint8_t> blocks(BCEncoder::GetImageSize(format, image.width, image.height));
+				BCEncoder::EncodeImage(format, (BCQuality)q, image.rgba.data(), image.width, image.height, (size_t)image.width * 4, blocks.data(), nullptr);
+				allBlocks.insert(allBlocks.end(), blocks.begin(), blocks.end());
+				bool alphaExact;
+				double psnr = MeasurePSNR(format, image, blocks, alphaExact);
+				char what[128];
+				snprintf(what, sizeof(what), "%s quality %d image %d decodes (PSNR %.1f dB)", FORMAT_NAMES[f], q, i, psnr);
+				Check(psnr >= 0.0, what);
+				Check(alphaExact, "BC1 punch-through alpha");
+				//The floors are set for the bitmap, the gradient only has to decode
+				if (i == 0 && q >= BC_QUALITY_NORMAL)
+				{
+					snprintf(what, sizeof(what), "%s quality %d PSNR %.1f dB, floor %.1f", FORMAT_NAMES[f], q, psnr, PSNR_FLOORS[f]);
+					Check(psnr >= PSNR_FLOORS[f], what);
+				}
+			}
+		}
+	}
+
+	if (argc >= 4 && strcmp(argv[2], "-write") == 0)
+	{
+		std::ofstream file(argv[3], std::ios::binary | std::ios::trunc);
+		file.write((const char*)allBlocks.data(), allBlocks.size());
+		Check(file.good(), "write the blocks");
+	}
+	else if (argc >= 4 && strcmp(argv[2], "-compare") == 0)
+	{
+		std::ifstream file(argv[3], std::ios::binary);
+		std::vector<uint8_t> other((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		Check(other == allBlocks, "blocks match the other build byte for byte");
+	}
+	return TestCheck::Finish();
+}
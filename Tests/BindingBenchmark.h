@@ -0,0 +1,33 @@
+#pragma once
+#include "../RenderComponent/Shader.h"
+#include <memory>
+#include <string>
+#include <vector>
+//Times binding the same resources for many draws two ways, both recorded by RecordingCommandList:
+//Shader::SetResource per draw, which looks the variable up and resolves the address every time,
+//and Shader::ApplyBindings replaying a table resolved once, as Material does
+//Run from CrateApp with "-benchbindings [drawCount]", it needs a device for the shader and buffers
+//Only compiled into Crate.exe by msbuild /p:MEngineBenchmarks=true
+struct BindingBenchmarkResource
+{
+	UINT id;
+	std::shared_ptr<MObject> object;
+	UINT indexOffset;
+};
+
+struct BindingBenchmarkResult
+{
+	UINT drawCount;
+	UINT bindingCount;
+	double setResourceNsPerDraw;
+	double replayNsPerDraw;
+	//Both ways recorded the same root arguments
+	bool sameCommands;
+};
+
+class BindingBenchmark
+{
+public:
+	static BindingBenchmarkResult Run(Shader* shader, const std::vector<BindingBenchmarkResource>& resources, UINT drawCount);
+	static std::string Format(const BindingBenchmarkResult& result);
+};
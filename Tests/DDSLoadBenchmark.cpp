@@ -0,0 +1,160 @@
+#include "../Common/DDSCore.h"
+#include "../Common/MappedFile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+//Maps, parses and lays out every DDS file in a directory, then reads every texel through the mapping
+//the way the loaders hand subresources to UpdateSubresources
+//Fails if a file does not parse, if its layout does not end exactly at the end of the file,
+//or if the same file cut short is not reported as DDS_RESULT_END_OF_FILE
+//Usage: DDSLoadBenchmark <directory> [iterations]
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	struct FileResult
+	{
+		std::string name;
+		uint64_t size;
+		double parseUs;
+		double readUs;
+	};
+
+	//Sums every byte so the reads can not be optimized away
+	uint64_t TouchSubresources(const uint8_t* data, const DDSLayout& layout)
+	{
+		uint64_t sum = 0;
+		for (size_t i = 0; i < layout.subresources.size(); ++i)
+		{
+			const DDSSubresource& sub = layout.subresources[i];
+			const uint8_t* begin = data + sub.offset;
+			const uint8_t* end = begin + sub.slicePitch * sub.depth;
+			for (const uint8_t* p = begin; p < end; p += sizeof(uint64_t))
+			{
+				uint64_t value;
+				memcpy(&value, p, end - p < (ptrdiff_t)sizeof(uint64_t) ? end - p : sizeof(uint64_t));
+				sum += value;
+			}
+		}
+		return sum;
+	}
+
+	bool CheckFile(const std::string& path, const std::string& name)
+	{
+		MappedFile file;
+		if (!file.Open(path.c_str()))
+		{
+			printf("%s: can not be opened\n", name.c_str());
+			return false;
+		}
+		DDSTextureDesc desc;
+		DDSResult result = DDSCore::ParseHeader(file.GetData(), (size_t)file.GetSize(), desc);
+		DDSLayout layout;
+		if (result == DDS_RESULT_OK)
+			result = DDSCore::ComputeLayout(desc, 0, layout);
+		if (result != DDS_RESULT_OK)
+		{
+			printf("%s: parse failed with %d\n", name.c_str(), (int)result);
+			return false;
+		}
+		const DDSSubresource& last = layout.subresources.back();
+		size_t layoutEnd = last.offset + last.slicePitch * last.depth;
+		if (layoutEnd != file.GetSize())
+		{
+			printf("%s: layout ends at %zu, file has %llu bytes\n", name.c_str(), layoutEnd, (unsigned long long)file.GetSize());
+			return false;
+		}
+		DDSTextureDesc truncated;
+		result = DDSCore::ParseHeader(file.GetData(), (size_t)file.GetSize() - 1, truncated);
+		if (result == DDS_RESULT_OK)
+			result = DDSCore::ComputeLayout(truncated, 0, layout);
+		if (result != DDS_RESULT_END_OF_FILE)
+		{
+			printf("%s: truncated file reported %d instead of end of file\n", name.c_str(), (int)result);
+			return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: DDSLoadBenchmark <directory> [iterations]\n");
+		return 2;
+	}
+	int iterations = argc >= 3 ? atoi(argv[2]) : 20;
+	if (iterations < 1) iterations = 1;
+	std::vector<std::filesystem::path> paths;
+	std::error_code ec;
+	for (std::filesystem::directory_iterator it(argv[1], ec), end; !ec && it != end; it.increment(ec))
+	{
+		if (it->path().extension() == ".dds")
+			paths.push_back(it->path());
+	}
+	if (ec || paths.empty())
+	{
+		printf("No DDS files in %s\n", argv[1]);
+		return 1;
+	}
+	std::sort(paths.begin(), paths.end());
+
+	bool succeeded = true;
+	for (size_t i = 0; i < paths.size(); ++i)
+		succeeded &= CheckFile(paths[i].string(), paths[i].filename().string());
+
+	std::vector<FileResult> results(paths.size());
+	uint64_t checksum = 0;
+	uint64_t totalBytes = 0;
+	double totalUs = 0;
+	for (size_t i = 0; i < paths.size(); ++i)
+	{
+		FileResult& fileResult = results[i];
+		fileResult.name = paths[i].filename().string();
+		fileResult.size = 0;
+		fileResult.parseUs = 0;
+		fileResult.readUs = 0;
+		std::string path = paths[i].string();
+		for (int iteration = 0; iteration < iterations; ++iteration)
+		{
+			Clock::time_point start = Clock::now();
+			MappedFile file;
+			DDSTextureDesc desc;
+			DDSLayout layout;
+			if (!file.Open(path.c_str()) ||
+				DDSCore::ParseHeader(file.GetData(), (size_t)file.GetSize(), desc) != DDS_RESULT_OK ||
+				DDSCore::ComputeLayout(desc, 0, layout) != DDS_RESULT_OK)
+				break;
+			Clock::time_point parsed = Clock::now();
+			checksum += TouchSubresources(file.GetData(), layout);
+			Clock::time_point read = Clock::now();
+			fileResult.size = file.GetSize();
+			fileResult.parseUs += std::chrono::duration<double, std::micro>(parsed - start).count();
+			fileResult.readUs += std::chrono::duration<double, std::micro>(read - parsed).count();
+		}
+		fileResult.parseUs /= iterations;
+		fileResult.readUs /= iterations;
+		totalBytes += fileResult.size;
+		totalUs += fileResult.parseUs + fileResult.readUs;
+	}
+
+	printf("%-20s %12s %12s %12s %10s\n", "file", "bytes", "open+parse", "read", "MB/s");
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const FileResult& r = results[i];
+		double us = r.parseUs + r.readUs;
+		printf("%-20s %12llu %10.1fus %10.1fus %10.1f\n", r.name.c_str(), (unsigned long long)r.size,
+			r.parseUs, r.readUs, us > 0 ? r.size / us : 0.0);
+	}
+	printf("%zu files, %llu bytes, %.1fus per pass, %.1f MB/s, %d iterations (checksum %llx)\n",
+		results.size(), (unsigned long long)totalBytes, totalUs, totalUs > 0 ? totalBytes / totalUs : 0.0,
+		iterations, (unsigned long long)checksum);
+	return succeeded ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+#include "../Common/MipGenerator.h"
+#include "../Common/TextureImporter.h"
+#include "../Common/ThreadPool.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+//Mip chains for sizes that do not halve evenly, sRGB values surviving the trip through linear
+//space, and alpha coverage kept across levels on an alpha tested bitmap
+//Usage: MipGeneratorTest <bmp with alpha>
+
+namespace
+{
+	using TestCheck::Check;
+
+	ImportedImage MakeImage(uint32_t width, uint32_t height)
+	{
+		ImportedImage image;
+		image.width = width;
+		image.height = height;
+		image.rgba.assign((size_t)width * height * 4, 0);
+		return image;
+	}
+
+	//Share of pixels whose alpha passes a test against cutoff in 0-255
+	double Coverage(const ImportedImage& image, int cutoff)
+	{
+		size_t passing = 0;
+		for (size_t i = 3; i < image.rgba.size(); i += 4)
+		{
+			if (image.rgba[i] > cutoff) ++passing;
+		}
+		return (double)passing / ((double)image.width * image.height);
+	}
+
+	void TestNonPowerOfTwo(ThreadPool* pool)
+	{
+		const uint32_t sizes[][2] = { { 259, 131 }, { 37, 5 }, { 1, 7 }, { 3, 3 }, { 5, 1 }, { 100, 100 } };
+		std::mt19937 rng(1);
+		for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+		{
+			uint32_t width = sizes[s][0];
+			uint32_t height = sizes[s][1];
+			for (int f = MIP_FILTER_BOX; f <= MIP_FILTER_LANCZOS; ++f)
+			{
+				MipSettings settings;
+				settings.filter = (MipFilter)f;
+				settings.wrap = f == MIP_FILTER_KAISER;
+				char what[128];
+				snprintf(what, sizeof(what), "%ux%u filter %d", width, height, f);
+
+				//Noise, the pooled and serial chains have to agree exactly
+				std::vector<ImportedImage> pooled(1, MakeImage(width, height));
+				for (size_t i = 0; i < pooled[0].rgba.size(); ++i)
+					pooled[0].rgba[i] = (uint8_t)rng();
+				std::vector<ImportedImage> serial = pooled;
+				MipGenerator::Generate(pooled, settings, f != MIP_FILTER_LANCZOS, pool);
+				MipGenerator::Generate(serial, settings, f != MIP_FILTER_LANCZOS, nullptr);
+				bool shaped = pooled.size() == MipGenerator::GetMipCount(width, height) && pooled.size() == serial.size();
+				bool same = shaped;
+				for (size_t i = 0; shaped && i < pooled.size(); ++i)
+				{
+					shaped &= pooled[i].width == std::max(1u, width >> i) && pooled[i].height == std::max(1u, height >> i);
+					shaped &= pooled[i].rgba.size() == (size_t)pooled[i].width * pooled[i].height * 4;
+					same &= pooled[i].rgba == serial[i].rgba;
+				}
+				Check(shaped, what);
+				Check(same, "pooled and serial chains match");
+				Check(pooled.back().width == 1 && pooled.back().height == 1, "chain ends at 1x1");
+
+				//A flat color stays flat, filters that ring or resample odd sizes must still sum to one
+				std::vector<ImportedImage> flat(1, MakeImage(width, height));
+				for (size_t i = 0; i < flat[0].rgba.size(); i += 4)
+				{
+					flat[0].rgba[i] = 200;
+					flat[0].rgba[i + 1] = 13;
+					flat[0].rgba[i + 2] = 90;
+					flat[0].rgba[i + 3] = 255;
+				}
+				MipGenerator::Generate(flat, settings, true, pool);
+				bool constant = true;
+				for (size_t m = 0; m < flat.size(); ++m)
+				{
+					for (size_t i = 0; i < flat[m].rgba.size(); i += 4)
+						constant &= flat[m].rgba[i] == 200 && flat[m].rgba[i + 1] == 13 && flat[m].rgba[i + 2] == 90 && flat[m].rgba[i + 3] == 255;
+				}
+				Check(constant, "flat color stays flat");
+			}
+		}
+		//maxLevels cuts the chain short
+		MipSettings settings;
+		settings.maxLevels = 3;
+		std::vector<ImportedImage> limited(1, MakeImage(259, 131));
+		MipGenerator::Generate(limited, settings, false, pool);
+		Check(limited.size() == 3 && limited[2].width == 64 && limited[2].height == 32, "maxLevels");
+	}
+
+	void TestSRGB(ThreadPool* pool)
+	{
+		//2x2 quads of every 8 bit value, a box filter has to give each value back exactly
+		std::vector<ImportedImage> quads(1, MakeImage(32, 32));
+		for (uint32_t y = 0; y < 32; ++y)
+		{
+			for (uint32_t x = 0; x < 32; ++x)
+			{
+				uint8_t value = (uint8_t)((y / 2) * 16 + x / 2);
+				uint8_t* p = &quads[0].rgba[(y * 32 + x) * 4];
+				p[0] = value;
+				p[1] = (uint8_t)(255 - value);
+				p[2] = value;
+				p[3] = value;
+			}
+		}
+		MipSettings settings;
+		settings.filter = MIP_FILTER_BOX;
+		settings.weightColorByAlpha = false;
+		settings.maxLevels = 2;
+		MipGenerator::Generate(quads, settings, true, pool);
+		bool roundTrips = quads.size() == 2;
+		for (uint32_t i = 0; roundTrips && i < 256; ++i)
+		{
+			const uint8_t* p = &quads[1].rgba[i * 4];
+			roundTrips &= p[0] == i && p[1] == 255 - i && p[2] == i && p[3] == i;
+		}
+		Check(roundTrips, "every sRGB value survives a box filter of equal pixels");
+
+		//Black and white averages to half the light, 188 in sRGB, and to 128 without sRGB
+		std::vector<ImportedImage> srgbChecker(1, MakeImage(8, 8));
+		for (uint32_t i = 0; i < 64; ++i)
+		{
+			uint8_t value = ((i % 8) + (i / 8)) % 2 ? 255 : 0;
+			uint8_t* p = &srgbChecker[0].rgba[i * 4];
+			p[0] = p[1] = p[2] = value;
+			p[3] = 255;
+		}
+		std::vector<ImportedImage> linearChecker = srgbChecker;
+		MipGenerator::Generate(srgbChecker, settings, true, pool);
+		MipGenerator::Generate(linearChecker, settings, false, pool);
+		int srgbValue = srgbChecker[1].rgba[0];
+		int linearValue = linearChecker[1].rgba[0];
+		Check(std::abs(srgbValue - 188) <= 1, "sRGB checker filters in linear light");
+		Check(std::abs(linearValue - 128) <= 1, "linear checker averages the stored values");
+		Check(srgbChecker[1].rgba[3] == 255, "alpha is never gamma corrected");
+	}
+
+	void TestAlphaCoverage(const char* path, ThreadPool* pool)
+	{
+		std::vector<ImportedImage> covered(1);
+		if (!TextureImporter::LoadBMP(path, covered[0]))
+		{
+			Check(false, "load the bitmap");
+			return;
+		}
+		std::vector<ImportedImage> filtered = covered;
+		MipSettings settings;
+		settings.alphaCoverageCutoff = 0.5f;
+		MipGenerator::Generate(covered, settings, true, pool);
+		MipGenerator::Generate(filtered, MipSettings(), true, pool);
+		double top = Coverage(covered[0], 127);
+		Check(top > 0.01 && top < 0.99, "bitmap is alpha tested");
+		//Levels of at least 16x16 keep the share within a few pixels, plain filtering drifts
+		bool kept = true;
+		double keptDrift = 0.0;
+		double filteredDrift = 0.0;
+		for (size_t i = 1; i < covered.size(); ++i)
+		{
+			if (covered[i].width * covered[i].height < 256) break;
+			double drift = fabs(Coverage(covered[i], 127) - top);
+			kept &= drift <= 0.005;
+			keptDrift = std::max(keptDrift, drift);
+			filteredDrift = std::max(filteredDrift, fabs(Coverage(filtered[i], 127) - top));
+		}
+		Check(kept, "alpha coverage kept on every level of 16x16 and up");
+		Check(keptDrift < filteredDrift, "coverage drifts less than with plain filtering");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: MipGeneratorTest <bmp with alpha>\n");
+		return 2;
+	}
+	ThreadPool* pool = ThreadPool::GetInstance();
+	TestNonPowerOfTwo(pool);
+	TestSRGB(pool);
+	TestAlphaCoverage(argv[1], pool);
+	return TestCheck::Finish();
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include <vector>
+//Stands in for ID3D12GraphicsCommandList in Shader::ApplyBindings and Shader::SetResource
+//Root argument calls are appended to a list instead of reaching the driver, so binding
+//code can be timed and compared without a device
+class RecordingCommandList
+{
+public:
+	enum class Kind : UINT
+	{
+		DescriptorTable,
+		ConstantBufferView,
+		ShaderResourceView,
+		Constants
+	};
+	struct Command
+	{
+		Kind kind;
+		UINT rootParameterIndex;
+		UINT64 value;
+		UINT constantCount;
+		UINT constants[4];
+		bool operator==(const Command& other) const
+		{
+			return kind == other.kind &&
+				rootParameterIndex == other.rootParameterIndex &&
+				value == other.value &&
+				constantCount == other.constantCount &&
+				memcmp(constants, other.constants, constantCount * sizeof(UINT)) == 0;
+		}
+	};
+	std::vector<Command> commands;
+	void SetGraphicsRootDescriptorTable(UINT rootParameterIndex, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor)
+	{
+		Push(Kind::DescriptorTable, rootParameterIndex, baseDescriptor.ptr);
+	}
+	void SetGraphicsRootConstantBufferView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation)
+	{
+		Push(Kind::ConstantBufferView, rootParameterIndex, bufferLocation);
+	}
+	void SetGraphicsRootShaderResourceView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation)
+	{
+		Push(Kind::ShaderResourceView, rootParameterIndex, bufferLocation);
+	}
+	void SetGraphicsRoot32BitConstants(UINT rootParameterIndex, UINT num32BitValuesToSet, const void* srcData, UINT destOffsetIn32BitValues)
+	{
+		Command& command = Push(Kind::Constants, rootParameterIndex, destOffsetIn32BitValues);
+		command.constantCount = num32BitValuesToSet < 4 ? num32BitValuesToSet : 4;
+		memcpy(command.constants, srcData, command.constantCount * sizeof(UINT));
+	}
+private:
+	Command& Push(Kind kind, UINT rootParameterIndex, UINT64 value)
+	{
+		Command command = {};
+		command.kind = kind;
+		command.rootParameterIndex = rootParameterIndex;
+		command.value = value;
+		commands.push_back(command);
+		return commands.back();
+	}
+};
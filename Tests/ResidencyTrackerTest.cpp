@@ -0,0 +1,325 @@
+#include "../Common/ResidencyTracker.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+//Runs ResidencyTracker against a fake device that keeps its own residency per object
+//Checks eviction order, behaviour over budget, call batching and that nothing the GPU
+//may still read is evicted, as well as MakeResident and Evict always alternating per object
+
+namespace
+{
+	using TestCheck::Check;
+
+	struct FakeObject
+	{
+		uint64_t size;
+		bool resident;
+	};
+
+	class FakeDevice : public IResidencyDevice
+	{
+	public:
+		std::vector<FakeObject> objects;
+		uint64_t budget = 0;
+		bool failMakeResident = false;
+		//Objects of every call, in order
+		std::vector<std::vector<FakeObject*>> evictCalls;
+		std::vector<std::vector<FakeObject*>> makeResidentCalls;
+		//A call on an object that was already in that state
+		bool unbalanced = false;
+
+		explicit FakeDevice(size_t count, uint64_t size) : objects(count)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				objects[i].size = size;
+				objects[i].resident = true;
+			}
+		}
+		void QueryBudget(uint64_t& outBudget, uint64_t& outUsage) override
+		{
+			outBudget = budget;
+			outUsage = 0;
+			for (size_t i = 0; i < objects.size(); ++i)
+			{
+				if (objects[i].resident) outUsage += objects[i].size;
+			}
+		}
+		bool MakeResident(const ResidencyObject* pageables, uint32_t count) override
+		{
+			if (failMakeResident) return false;
+			makeResidentCalls.push_back(Record(pageables, count));
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				FakeObject* object = (FakeObject*)pageables[i];
+				unbalanced |= object->resident;
+				object->resident = true;
+			}
+			return true;
+		}
+		void Evict(const ResidencyObject* pageables, uint32_t count) override
+		{
+			evictCalls.push_back(Record(pageables, count));
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				FakeObject* object = (FakeObject*)pageables[i];
+				unbalanced |= !object->resident;
+				object->resident = false;
+			}
+		}
+		size_t Index(const FakeObject* object) const { return object - objects.data(); }
+		void ClearCalls()
+		{
+			evictCalls.clear();
+			makeResidentCalls.clear();
+		}
+	private:
+		static std::vector<FakeObject*> Record(const ResidencyObject* pageables, uint32_t count)
+		{
+			std::vector<FakeObject*> call(count);
+			for (uint32_t i = 0; i < count; ++i)
+				call[i] = (FakeObject*)pageables[i];
+			return call;
+		}
+	};
+
+	std::vector<ResidencyHandle> RegisterAll(ResidencyTracker& tracker, FakeDevice& device)
+	{
+		std::vector<ResidencyHandle> handles(device.objects.size());
+		for (size_t i = 0; i < handles.size(); ++i)
+			handles[i] = tracker.Register(&device.objects[i], device.objects[i].size);
+		return handles;
+	}
+
+	//Tracker and device agree on every object
+	bool Agrees(const ResidencyTracker& tracker, const FakeDevice& device, const std::vector<ResidencyHandle>& handles)
+	{
+		for (size_t i = 0; i < handles.size(); ++i)
+		{
+			if (tracker.IsResident(handles[i]) != device.objects[i].resident) return false;
+		}
+		return !device.unbalanced;
+	}
+
+	void TestLruOrder()
+	{
+		FakeDevice device(10, 100);
+		device.budget = 10000;
+		ResidencyTracker tracker(&device);
+		std::vector<ResidencyHandle> handles = RegisterAll(tracker, device);
+		//Object i is last used in frame i + 1, in reverse registration order for good measure
+		for (uint64_t frame = 1; frame <= 10; ++frame)
+		{
+			tracker.BeginFrame(frame, frame - 1);
+			tracker.MarkUsed(handles[10 - frame]);
+			Check(tracker.EndFrame(), "within budget");
+		}
+		Check(device.evictCalls.empty(), "nothing evicted within budget");
+		//300 bytes over, everything up to frame 10 is done on the GPU
+		device.budget = 700;
+		tracker.BeginFrame(11, 10);
+		Check(tracker.EndFrame(), "evicting idle objects");
+		Check(device.evictCalls.size() == 1 && device.evictCalls[0].size() == 3, "one call for three objects");
+		if (device.evictCalls.size() == 1 && device.evictCalls[0].size() == 3)
+		{
+			Check(device.Index(device.evictCalls[0][0]) == 9 && device.Index(device.evictCalls[0][1]) == 8 &&
+				device.Index(device.evictCalls[0][2]) == 7, "least recently used first");
+		}
+		Check(tracker.GetStats().residentBytes == 700 && tracker.GetStats().evictedCount == 3, "stats after eviction");
+		Check(Agrees(tracker, device, handles), "tracker and device agree");
+
+		//Same frame, the larger object goes first so fewer are evicted
+		FakeDevice sized(2, 50);
+		sized.objects[1].size = 200;
+		sized.budget = 10000;
+		ResidencyTracker sizedTracker(&sized);
+		std::vector<ResidencyHandle> sizedHandles = RegisterAll(sizedTracker, sized);
+		sized.budget = 150;
+		sizedTracker.BeginFrame(1, 0);
+		Check(sizedTracker.EndFrame(), "evicting by size");
+		Check(!sized.objects[1].resident && sized.objects[0].resident, "larger of equally old objects first");
+		Check(Agrees(sizedTracker, sized, sizedHandles), "tracker and device agree");
+	}
+
+	void TestBudgetOvershoot()
+	{
+		FakeDevice device(10, 100);
+		device.budget = 10000;
+		ResidencyTracker tracker(&device);
+		std::vector<ResidencyHandle> handles = RegisterAll(tracker, device);
+		//Evict everything idle
+		device.budget = 0;
+		tracker.BeginFrame(1, 0);
+		Check(tracker.EndFrame(), "evicting everything");
+		Check(tracker.GetStats().residentBytes == 0, "nothing resident");
+
+		//The working set is larger than the budget, it is made resident anyway
+		device.budget = 500;
+		tracker.BeginFrame(2, 1);
+		for (int i = 0; i < 8; ++i)
+			tracker.MarkUsed(handles[i]);
+		Check(tracker.EndFrame(), "working set over budget");
+		Check(tracker.GetStats().residentBytes == 800 && tracker.GetStats().workingSetBytes == 800, "whole working set resident");
+		Check(tracker.GetStats().usage == 0 && tracker.GetStats().budget == 500, "budget queried before the frame");
+
+		//Frame 2 is still in flight, so nothing can go for the two objects frame 3 adds
+		tracker.BeginFrame(3, 1);
+		tracker.MarkUsed(handles[8]);
+		tracker.MarkUsed(handles[9]);
+		device.ClearCalls();
+		Check(tracker.EndFrame(), "in flight objects over budget");
+		Check(device.evictCalls.empty() && tracker.GetStats().residentBytes == 1000, "overshoot while the GPU needs everything");
+
+		//Once frame 3 completed, just enough is evicted for the new working set
+		tracker.BeginFrame(4, 3);
+		tracker.MarkUsed(handles[0]);
+		device.ClearCalls();
+		Check(tracker.EndFrame(), "back within budget");
+		Check(tracker.GetStats().residentBytes == 500, "evicted down to the budget");
+		Check(device.objects[0].resident, "working set kept");
+		Check(Agrees(tracker, device, handles), "tracker and device agree");
+
+		//Objects the CPU writes to are never evicted, even when that leaves the budget exceeded
+		FakeDevice pinned(4, 100);
+		pinned.budget = 10000;
+		ResidencyTracker pinnedTracker(&pinned);
+		std::vector<ResidencyHandle> pinnedHandles(4);
+		for (int i = 0; i < 4; ++i)
+			pinnedHandles[i] = pinnedTracker.Register(&pinned.objects[i], 100, i >= 2);
+		pinned.budget = 0;
+		pinnedTracker.BeginFrame(1, 0);
+		Check(pinnedTracker.EndFrame(), "evicting with pinned objects");
+		Check(pinned.objects[0].resident && pinned.objects[1].resident, "objects that are not evictable stay");
+		Check(!pinned.objects[2].resident && !pinned.objects[3].resident, "evictable objects go");
+		Check(Agrees(pinnedTracker, pinned, pinnedHandles), "tracker and device agree");
+	}
+
+	void TestBatching()
+	{
+		const uint32_t count = 150;
+		FakeDevice device(count, 1);
+		device.budget = 10000;
+		ResidencyTracker tracker(&device);
+		std::vector<ResidencyHandle> handles = RegisterAll(tracker, device);
+		device.budget = 0;
+		tracker.BeginFrame(1, 0);
+		Check(tracker.EndFrame(), "evicting all");
+		Check(device.evictCalls.size() == 3, "evictions in three calls");
+		if (device.evictCalls.size() == 3)
+		{
+			Check(device.evictCalls[0].size() == 64 && device.evictCalls[1].size() == 64 &&
+				device.evictCalls[2].size() == 22, "evictions batched by MAX_BATCH");
+		}
+
+		//Every tenth object made resident alone, they are skipped in the batches below
+		device.budget = 10000;
+		tracker.BeginFrame(2, 1);
+		for (uint32_t i = 0; i < count; i += 10)
+			tracker.MarkUsed(handles[i]);
+		Check(tracker.EndFrame(), "making a few resident");
+		device.ClearCalls();
+		tracker.BeginFrame(3, 2);
+		for (uint32_t i = 0; i < count; ++i)
+			tracker.MarkUsed(handles[i]);
+		//Marking twice does not add to the working set
+		tracker.MarkUsed(handles[1]);
+		Check(tracker.EndFrame(), "making all resident");
+		Check(tracker.GetStats().workingSetCount == count, "working set counted once per object");
+		Check(device.makeResidentCalls.size() == 3, "residency in three calls");
+		size_t made = 0;
+		bool withinBatch = true;
+		for (size_t i = 0; i < device.makeResidentCalls.size(); ++i)
+		{
+			made += device.makeResidentCalls[i].size();
+			withinBatch &= device.makeResidentCalls[i].size() <= ResidencyTracker::MAX_BATCH;
+		}
+		Check(withinBatch && made == count - count / 10, "only evicted objects made resident, at most MAX_BATCH a call");
+		Check(tracker.GetStats().madeResidentCount == count - count / 10, "made resident count");
+		Check(Agrees(tracker, device, handles), "tracker and device agree");
+	}
+
+	void TestRecentlyUsedKept()
+	{
+		const uint32_t count = 300;
+		FakeDevice device(count, 10);
+		device.budget = 1000;
+		ResidencyTracker tracker(&device);
+		std::vector<ResidencyHandle> handles = RegisterAll(tracker, device);
+		//The GPU runs two frames behind, a working set many times the budget is spread over random objects
+		std::mt19937 rng(1);
+		uint64_t completed = 0;
+		bool kept = true;
+		bool agrees = true;
+		for (uint64_t frame = 1; frame < 500; ++frame)
+		{
+			tracker.BeginFrame(frame, completed);
+			int used = 20 + rng() % 60;
+			for (int i = 0; i < used; ++i)
+				tracker.MarkUsed(handles[rng() % count]);
+			Check(tracker.EndFrame(), "random frame");
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				//Used this frame, or by a frame the GPU may still be running
+				if (tracker.GetLastUsedFrame(handles[i]) > completed)
+					kept &= tracker.IsResident(handles[i]);
+			}
+			agrees &= Agrees(tracker, device, handles);
+			completed = frame >= 2 ? frame - 2 : 0;
+		}
+		Check(kept, "objects the GPU may use are never evicted");
+		Check(agrees, "tracker and device agree every frame");
+		//At most three frames of working sets over the budget
+		Check(tracker.GetStats().residentBytes <= 1000 + 3 * 80 * 10, "overshoot bounded by the frames in flight");
+
+		//Frame 1001 is in flight, frame 1000 done: the 250 objects only frame 1000 used go first
+		device.budget = 100000;
+		tracker.BeginFrame(1000, 999);
+		for (uint32_t i = 0; i < count; ++i)
+			tracker.MarkUsed(handles[i]);
+		Check(tracker.EndFrame(), "everything resident");
+		tracker.BeginFrame(1001, 1000);
+		for (uint32_t i = 0; i < 50; ++i)
+			tracker.MarkUsed(handles[i]);
+		Check(tracker.EndFrame(), "in flight frame");
+		device.budget = 1000;
+		tracker.BeginFrame(1002, 1000);
+		Check(tracker.EndFrame(), "evicting down to the budget");
+		uint32_t evicted = 0;
+		uint32_t firstEvicted = 0;
+		kept = true;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			if (i < 50) kept &= tracker.IsResident(handles[i]);
+			else if (!tracker.IsResident(handles[i]) && evicted++ == 0) firstEvicted = i;
+		}
+		Check(kept && evicted == 200, "in flight objects kept, idle ones evicted");
+
+		//Making resident fails, everything idle is evicted and it fails again
+		tracker.BeginFrame(1003, 1002);
+		tracker.MarkUsed(handles[firstEvicted]);
+		device.failMakeResident = true;
+		Check(!tracker.EndFrame(), "failure is reported");
+		device.failMakeResident = false;
+		Check(!tracker.IsResident(handles[0]) && !tracker.IsResident(handles[firstEvicted]), "idle objects evicted on failure");
+		Check(Agrees(tracker, device, handles), "tracker and device agree after failure");
+
+		//Stale handles are ignored, replaced objects are resident
+		tracker.Unregister(handles[5]);
+		tracker.MarkUsed(handles[5]);
+		Check(!tracker.Contains(handles[5]) && tracker.Count() == count - 1, "unregistered");
+		FakeObject replacement = { 20, true };
+		tracker.Replace(handles[6], &replacement, 20);
+		Check(tracker.GetStats().trackedBytes == count * 10 - 10 - 10 + 20 && tracker.IsResident(handles[6]), "replaced");
+	}
+}
+
+int main()
+{
+	TestLruOrder();
+	TestBudgetOvershoot();
+	TestBatching();
+	TestRecentlyUsedKept();
+	return TestCheck::Finish();
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdio>
+//Shared by the test targets: Check records a failure and keeps going,
+//so one run reports every broken expectation, main returns Finish()
+namespace TestCheck
+{
+	inline int& Failures()
+	{
+		static int failures = 0;
+		return failures;
+	}
+
+	inline void Check(bool condition, const char* what)
+	{
+		if (condition) return;
+		printf("FAILED: %s\n", what);
+		++Failures();
+	}
+
+	//Prints the summary, the exit code for ctest
+	inline int Finish()
+	{
+		if (Failures() > 0)
+		{
+			printf("%d checks failed\n", Failures());
+			return 1;
+		}
+		printf("All checks passed\n");
+		return 0;
+	}
+}
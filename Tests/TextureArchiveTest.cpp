@@ -0,0 +1,246 @@
+#include "../Common/LZ4Block.h"
+#include "../Common/TextureArchiveWriter.h"
+#include "../Common/XXHash64.h"
+#include "TestCheck.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+//Round trips LZ4 blocks and every DDS file of a directory through TextureArchiveWriter and
+//TextureArchive::ReadSubresource, stored raw and with LZ4, then feeds truncated and corrupted
+//archives to Open and ReadSubresource, which must reject them without reading out of bounds
+//Usage: TextureArchiveTest <texture directory> [scratch directory]
+
+namespace
+{
+	using TestCheck::Check;
+
+	std::vector<uint8_t> ReadFile(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	void WriteFile(const std::string& path, const uint8_t* data, size_t size)
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write((const char*)data, size);
+	}
+
+	//Opens data written to path, reads every subresource if it opened
+	//Returns whether Open accepted it, reads of a corrupted payload may fail but must stay in bounds
+	bool OpenAndReadAll(const std::string& path, const std::vector<uint8_t>& data)
+	{
+		WriteFile(path, data.data(), data.size());
+		TextureArchive archive;
+		if (!archive.Open(path.c_str())) return false;
+		std::vector<uint8_t> scratch;
+		std::vector<uint8_t> dest;
+		for (uint32_t i = 0; i < archive.GetTextureCount(); ++i)
+		{
+			const TextureArchiveEntry& entry = archive.GetEntry(i);
+			for (uint32_t s = 0; s < entry.subresourceCount; ++s)
+			{
+				dest.resize(archive.GetSubresource(entry, s).size);
+				archive.ReadSubresource(entry, s, dest.data(), scratch);
+			}
+		}
+		return true;
+	}
+
+	void TestLZ4()
+	{
+		std::mt19937 rng(1);
+		bool roundTrips = true;
+		for (int t = 0; t < 2000; ++t)
+		{
+			size_t size = rng() % 5000;
+			std::vector<uint8_t> source(size);
+			//Noise, few symbols and long runs
+			for (size_t i = 0; i < size; ++i)
+				source[i] = t % 3 == 0 ? (uint8_t)rng() : (t % 3 == 1 ? (uint8_t)(rng() % 4) : (uint8_t)(i / 37));
+			std::vector<uint8_t> compressed(LZ4Block::CompressBound(size));
+			size_t compressedSize = LZ4Block::Compress(source.data(), size, compressed.data(), compressed.size());
+			compressed.resize(compressedSize);
+			std::vector<uint8_t> decoded(size);
+			roundTrips &= compressedSize > 0 && LZ4Block::Decompress(compressed.data(), compressedSize, decoded.data(), size) && decoded == source;
+			//Flipped bits either decode to something or fail, never past the buffers
+			for (int k = 0; k < 20 && compressedSize > 0; ++k)
+			{
+				std::vector<uint8_t> corrupt = compressed;
+				corrupt[rng() % compressedSize] ^= (uint8_t)(1 << (rng() % 8));
+				LZ4Block::Decompress(corrupt.data(), corrupt.size(), decoded.data(), size);
+			}
+			//Cut short it can not produce size bytes
+			if (compressedSize > 1 && size > 0)
+				roundTrips &= !LZ4Block::Decompress(compressed.data(), compressedSize - 1, decoded.data(), size);
+		}
+		Check(roundTrips, "LZ4 round trips and rejects truncated blocks");
+	}
+
+	//Every texel row read from the archive matches the DDS file it was packed from
+	void TestRoundTrip(const std::string& textureDirectory, const std::string& archivePath, TextureArchiveCompression compression)
+	{
+		std::string error;
+		if (!TextureArchiveWriter::PackDirectory(textureDirectory.c_str(), archivePath.c_str(), compression, error))
+		{
+			Check(false, error.c_str());
+			return;
+		}
+		TextureArchive archive;
+		if (!archive.Open(archivePath.c_str()))
+		{
+			Check(false, "open the packed archive");
+			return;
+		}
+		Check(archive.GetTextureCount() > 0, "archive holds textures");
+		bool found = true;
+		bool hashed = true;
+		bool matches = true;
+		bool compressed = false;
+		std::vector<uint8_t> scratch;
+		std::vector<uint8_t> dest;
+		for (uint32_t i = 0; i < archive.GetTextureCount(); ++i)
+		{
+			const TextureArchiveEntry& entry = archive.GetEntry(i);
+			std::string name = archive.GetName(entry);
+			found &= archive.Find(name) == &entry;
+			compressed |= entry.compression == TEXTURE_ARCHIVE_COMPRESSION_LZ4;
+			//Names are the path the loader would have opened
+			MappedFile file;
+			DDSTextureDesc desc;
+			DDSLayout layout;
+			if (!file.Open(name.c_str()) ||
+				DDSCore::ParseHeader(file.GetData(), (size_t)file.GetSize(), desc) != DDS_RESULT_OK ||
+				DDSCore::ComputeLayout(desc, 0, layout) != DDS_RESULT_OK ||
+				layout.subresources.size() != entry.subresourceCount)
+			{
+				Check(false, name.c_str());
+				continue;
+			}
+			hashed &= entry.contentSize == file.GetSize() && entry.contentHash == XXHash64::Hash(file.GetData(), (size_t)file.GetSize());
+			for (uint32_t s = 0; s < entry.subresourceCount; ++s)
+			{
+				const TextureArchiveSubresource& sub = archive.GetSubresource(entry, s);
+				const DDSSubresource& source = layout.subresources[s];
+				Check(sub.offset % TEXTURE_ARCHIVE_PLACEMENT_ALIGNMENT == 0 && sub.rowPitch % TEXTURE_ARCHIVE_PITCH_ALIGNMENT == 0, "upload alignment");
+				dest.assign(sub.size, 0);
+				if (!archive.ReadSubresource(entry, s, dest.data(), scratch))
+				{
+					matches = false;
+					continue;
+				}
+				for (size_t row = 0; row < (size_t)sub.numRows * sub.depth; ++row)
+					matches &= memcmp(dest.data() + row * sub.rowPitch, file.GetData() + source.offset + row * source.rowBytes, source.rowBytes) == 0;
+			}
+		}
+		Check(found, "every texture found by name");
+		Check(hashed, "content hash of the source file");
+		Check(matches, "every subresource reads back the source texels");
+		Check(compression == TEXTURE_ARCHIVE_COMPRESSION_NONE ? !compressed : compressed, "compression as requested");
+		Check(archive.Find("missing.dds") == nullptr, "unknown name");
+	}
+
+	void TestCorruption(const std::string& archivePath, const std::string& scratchPath)
+	{
+		std::vector<uint8_t> original = ReadFile(archivePath);
+		if (original.size() < sizeof(TextureArchiveHeader))
+		{
+			Check(false, "read the packed archive");
+			return;
+		}
+		Check(OpenAndReadAll(scratchPath, original), "unchanged copy opens");
+		TextureArchiveHeader header;
+		memcpy(&header, original.data(), sizeof(header));
+
+		//Payloads end the file, so any cut removes something a table points at
+		uint64_t cuts[] = { 0, 4, sizeof(TextureArchiveHeader) - 1, header.entryOffset + 1, header.subresourceOffset + 1,
+			header.chunkOffset + 1, header.nameOffset + 1, original.size() / 2, original.size() - 1 };
+		bool truncatedRejected = true;
+		for (size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]); ++i)
+		{
+			std::vector<uint8_t> truncated(original.begin(), original.begin() + (size_t)std::min<uint64_t>(cuts[i], original.size()));
+			truncatedRejected &= !OpenAndReadAll(scratchPath, truncated);
+		}
+		Check(truncatedRejected, "truncated archives are rejected");
+
+		//Header fields pointing outside the file or at a wrong count
+		struct HeaderEdit
+		{
+			size_t offset;
+			uint64_t value;
+			size_t size;
+			const char* what;
+		};
+		const HeaderEdit edits[] =
+		{
+			{ offsetof(TextureArchiveHeader, magic), 0x12345678, 4, "bad magic" },
+			{ offsetof(TextureArchiveHeader, version), TextureArchiveHeader::VERSION + 1, 4, "unknown version" },
+			{ offsetof(TextureArchiveHeader, textureCount), 0x40000000, 4, "texture count past the file" },
+			{ offsetof(TextureArchiveHeader, subresourceCount), 0xffffffff, 4, "subresource count past the file" },
+			{ offsetof(TextureArchiveHeader, entryOffset), original.size(), 8, "entries past the file" },
+			{ offsetof(TextureArchiveHeader, entryOffset), header.entryOffset + 4, 8, "misaligned entries" },
+			{ offsetof(TextureArchiveHeader, nameOffset), 0xfffffffffffffff0ull, 8, "name offset overflowing" }
+		};
+		for (size_t i = 0; i < sizeof(edits) / sizeof(edits[0]); ++i)
+		{
+			std::vector<uint8_t> edited = original;
+			memcpy(edited.data() + edits[i].offset, &edits[i].value, edits[i].size);
+			Check(!OpenAndReadAll(scratchPath, edited), edits[i].what);
+		}
+		if (header.textureCount > 0)
+		{
+			//The first entry's payload runs past the end
+			std::vector<uint8_t> edited = original;
+			uint64_t storedSize = original.size();
+			memcpy(edited.data() + header.entryOffset + offsetof(TextureArchiveEntry, storedSize), &storedSize, sizeof(storedSize));
+			Check(!OpenAndReadAll(scratchPath, edited), "payload past the file");
+			//Subresources beyond the table
+			edited = original;
+			uint32_t firstSubresource = header.subresourceCount;
+			memcpy(edited.data() + header.entryOffset + offsetof(TextureArchiveEntry, firstSubresource), &firstSubresource, sizeof(firstSubresource));
+			Check(!OpenAndReadAll(scratchPath, edited), "subresources past the table");
+		}
+
+		//Random flips anywhere, whatever Open accepts has to read within bounds
+		std::mt19937 rng(2);
+		for (int i = 0; i < 300; ++i)
+		{
+			std::vector<uint8_t> corrupt = original;
+			int flips = 1 + rng() % 4;
+			for (int f = 0; f < flips; ++f)
+			{
+				//Mostly in the tables, sometimes in the payloads
+				size_t end = i % 4 == 0 ? corrupt.size() : (size_t)std::min<uint64_t>(header.nameOffset + header.nameSize, corrupt.size());
+				corrupt[rng() % end] ^= (uint8_t)(1 << (rng() % 8));
+			}
+			OpenAndReadAll(scratchPath, corrupt);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: TextureArchiveTest <texture directory> [scratch directory]\n");
+		return 2;
+	}
+	std::filesystem::path scratch = argc >= 3 ? std::filesystem::path(argv[2]) : std::filesystem::temp_directory_path();
+	std::string rawPath = (scratch / "TextureArchiveTest.raw.mtar").string();
+	std::string lz4Path = (scratch / "TextureArchiveTest.lz4.mtar").string();
+	std::string corruptPath = (scratch / "TextureArchiveTest.corrupt.mtar").string();
+	TestLZ4();
+	TestRoundTrip(argv[1], rawPath, TEXTURE_ARCHIVE_COMPRESSION_NONE);
+	TestRoundTrip(argv[1], lz4Path, TEXTURE_ARCHIVE_COMPRESSION_LZ4);
+	TestCorruption(rawPath, corruptPath);
+	TestCorruption(lz4Path, corruptPath);
+	std::error_code ec;
+	std::filesystem::remove(rawPath, ec);
+	std::filesystem::remove(lz4Path, ec);
+	std::filesystem::remove(corruptPath, ec);
+	return TestCheck::Finish();
+}
@@ -0,0 +1,76 @@
+#include "../Common/ThreadPool.h"
+#include "TestCheck.h"
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+//ParallelFor coverage, nesting and exceptions thrown by the callback on the caller and on workers
+
+namespace
+{
+	using TestCheck::Check;
+
+	void TestCoverage(ThreadPool& pool)
+	{
+		std::vector<std::atomic<int>> hits(1000);
+		for (size_t i = 0; i < hits.size(); ++i)
+			hits[i] = 0;
+		pool.ParallelFor((unsigned int)hits.size(), [&](unsigned int i) -> void { ++hits[i]; }, 7);
+		bool once = true;
+		for (size_t i = 0; i < hits.size(); ++i)
+			once &= hits[i] == 1;
+		Check(once, "every index runs once");
+
+		//Nested calls from workers help with their own batches instead of blocking
+		std::atomic<unsigned int> total(0);
+		pool.ParallelFor(16, [&](unsigned int) -> void
+		{
+			pool.ParallelFor(64, [&](unsigned int) -> void { ++total; });
+		});
+		Check(total == 16 * 64, "nested calls");
+	}
+
+	void TestExceptions(ThreadPool& pool)
+	{
+		//Thrown on whichever thread gets the batch, the caller or a worker
+		for (unsigned int thrower = 0; thrower < 64; thrower += 9)
+		{
+			std::atomic<unsigned int> running(0);
+			std::atomic<unsigned int> afterReturn(0);
+			std::atomic<bool> returned(false);
+			bool caught = false;
+			try
+			{
+				pool.ParallelFor(64, [&](unsigned int i) -> void
+				{
+					if (returned) ++afterReturn;
+					++running;
+					if (i == thrower) throw std::runtime_error("batch failed");
+					std::this_thread::sleep_for(std::chrono::microseconds(200));
+					--running;
+				});
+			}
+			catch (const std::runtime_error&)
+			{
+				caught = true;
+			}
+			returned = true;
+			Check(caught, "exception reaches the caller");
+			//The throwing call never decrements
+			Check(running == 1, "no batch is still running after the throw");
+			Check(afterReturn == 0, "func is not called after ParallelFor returned");
+		}
+		//The pool still works afterwards
+		std::atomic<unsigned int> total(0);
+		pool.ParallelFor(100, [&](unsigned int) -> void { ++total; });
+		Check(total == 100, "pool usable after an exception");
+	}
+}
+
+int main()
+{
+	ThreadPool pool(4);
+	TestCoverage(pool);
+	TestExceptions(pool);
+	return TestCheck::Finish();
+}
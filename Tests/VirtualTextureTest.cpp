@@ -0,0 +1,382 @@
+#include "../Common/VirtualTexture.h"
+#include "../Common/VirtualTextureFile.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+//Drives the virtual texture page table, page cache and tile files without a device
+//Feedback buffers are made up here the way the feedback pass would write them,
+//then the loads, evictions, page tables and the cache's use order are checked
+//Usage: VirtualTextureTest [scratch directory]
+
+namespace
+{
+	using TestCheck::Check;
+
+	uint32_t Word(uint32_t texture, uint32_t mip, uint32_t x, uint32_t y)
+	{
+		VirtualPage page = { texture, mip, x, y };
+		return VirtualTextureSystem::EncodeFeedback(page);
+	}
+
+	bool SamePage(const VirtualPage& page, uint32_t texture, uint32_t mip, uint32_t x, uint32_t y)
+	{
+		return page.texture == texture && page.mip == mip && page.x == x && page.y == y;
+	}
+
+	void Process(VirtualTextureSystem& system, const std::vector<uint32_t>& feedback, uint32_t maxLoads, VirtualTextureUpdate& update)
+	{
+		system.ProcessFeedback(feedback.data(), feedback.size(), maxLoads, update);
+	}
+
+	void CompleteAll(VirtualTextureSystem& system, const VirtualTextureUpdate& update)
+	{
+		for (size_t i = 0; i < update.loads.size(); ++i)
+			system.CompleteLoad(update.loads[i]);
+	}
+
+	void TestPageTable()
+	{
+		//Not a power of two, the last page of each mip is partly outside
+		VirtualTexturePageTable table(1000, 700, 128, 128, 3);
+		Check(table.GetTailMip() == 3, "tail mip");
+		Check(table.GetPagesX(0) == 8 && table.GetPagesY(0) == 6, "mip 0 pages");
+		Check(table.GetPagesX(1) == 4 && table.GetPagesY(1) == 3, "mip 1 pages");
+		Check(table.GetPagesX(2) == 2 && table.GetPagesY(2) == 2, "mip 2 pages");
+		Check(!table.IsValid(3, 0, 0) && !table.IsValid(0, 8, 0), "outside the paged mips");
+		uint32_t parentX, parentY;
+		table.GetParent(0, 7, 5, 2, parentX, parentY);
+		Check(parentX == 1 && parentY == 1, "parent is clamped");
+
+		std::vector<uint8_t> map;
+		table.BuildResidencyMap(map);
+		Check(map.size() == 48 && map[0] == 3, "empty table samples the tail");
+		uint32_t version = table.GetVersion();
+		table.SetPending(2, 0, 0, 5);
+		table.BuildResidencyMap(map);
+		Check(map[0] == 3 && table.GetVersion() == version, "pending pages are not sampled");
+		Check(table.GetPhysicalPage(2, 0, 0) == 5 && !table.IsResident(2, 0, 0), "pending page is mapped");
+		table.SetResident(2, 0, 0);
+		table.SetPending(0, 0, 0, 6);
+		table.SetResident(0, 0, 0);
+		table.BuildResidencyMap(map);
+		//Mip 1 is missing, so mip 0 can not be sampled either
+		Check(map[0] == 2 && table.GetVersion() == version + 2, "holes stop the walk");
+		table.Clear(2, 0, 0);
+		table.BuildResidencyMap(map);
+		Check(map[0] == 3 && table.GetPhysicalPage(2, 0, 0) == VIRTUAL_TEXTURE_INVALID_PAGE, "cleared page");
+	}
+
+	void TestPageCache()
+	{
+		VirtualTexturePageCache cache(3);
+		VirtualPage evicted;
+		bool hasEvicted;
+		VirtualPage a = { 0, 0, 0, 0 }, b = { 0, 0, 1, 0 }, c = { 0, 0, 2, 0 };
+		Check(cache.Allocate(a, 1, evicted, hasEvicted) == 0 && !hasEvicted, "free slot 0");
+		Check(cache.Allocate(b, 1, evicted, hasEvicted) == 1 && !hasEvicted, "free slot 1");
+		Check(cache.Allocate(c, 1, evicted, hasEvicted) == 2 && !hasEvicted, "free slot 2");
+		Check(cache.GetUsedCount() == 3, "full");
+		//a becomes the most recent, b is now the least recently used
+		cache.Touch(0, 2);
+		VirtualPage d = { 0, 0, 3, 0 }, e = { 0, 0, 4, 0 }, f = { 0, 0, 5, 0 };
+		Check(cache.Allocate(d, 2, evicted, hasEvicted) == 1 && hasEvicted && SamePage(evicted, 0, 0, 1, 0), "evicts b first");
+		Check(cache.Allocate(e, 2, evicted, hasEvicted) == 2 && hasEvicted && SamePage(evicted, 0, 0, 2, 0), "then c");
+		Check(cache.Allocate(f, 2, evicted, hasEvicted) == VIRTUAL_TEXTURE_INVALID_PAGE && !hasEvicted, "pages used this frame stay");
+		//Use order is a, d, e, the pinned a is skipped
+		cache.Pin(0);
+		Check(cache.Allocate(f, 3, evicted, hasEvicted) == 1 && SamePage(evicted, 0, 0, 3, 0), "pinned page stays");
+		cache.Unpin(0);
+		cache.Free(2);
+		Check(cache.GetUsedCount() == 2, "freed");
+		Check(cache.Allocate(e, 3, evicted, hasEvicted) == 2 && !hasEvicted, "freed slot comes back first");
+		Check(SamePage(cache.GetPage(0), 0, 0, 0, 0) && SamePage(cache.GetPage(1), 0, 0, 5, 0), "slot pages");
+	}
+
+	void TestFeedback()
+	{
+		VirtualTextureSystem system(20);
+		Check(system.AddTexture(4096, 4096, 128, 128, 6) == 0, "first id");
+		Check(system.AddTexture(1000, 700, 128, 128, 3) == 1, "second id");
+		VirtualTextureUpdate update;
+		std::vector<uint32_t> feedback(50, Word(0, 0, 10, 10));
+		//None of these ask for a paged mip
+		feedback.push_back(VIRTUAL_TEXTURE_FEEDBACK_NONE);
+		feedback.push_back(Word(5, 0, 0, 0));
+		feedback.push_back(Word(0, 7, 0, 0));
+		feedback.push_back(Word(0, 0, 40, 0));
+		Process(system, feedback, 100, update);
+		Check(update.loads.size() == 6 && update.evictions.empty(), "one page and its parents");
+		for (uint32_t i = 0; i < update.loads.size(); ++i)
+		{
+			const VirtualPage& page = update.loads[i].page;
+			uint32_t mip = 5 - i;
+			Check(SamePage(page, 0, mip, 10 >> mip, 10 >> mip), "coarsest first");
+			Check(system.GetPageTable(0).IsPending(mip, page.x, page.y), "loads are pending");
+		}
+		std::vector<uint8_t> map;
+		system.GetPageTable(0).BuildResidencyMap(map);
+		Check(map[10 * 32 + 10] == 6, "nothing resident before the loads complete");
+		CompleteAll(system, update);
+		system.GetPageTable(0).BuildResidencyMap(map);
+		Check(map[10 * 32 + 10] == 0, "requested page resident");
+		Check(map[11 * 32 + 11] == 1 && map[0] == 4 && map[31 * 32 + 31] == 5, "parents resident");
+		Check(system.GetCache().GetUsedCount() == 6, "six physical pages");
+
+		//Same request again, all there
+		Process(system, std::vector<uint32_t>(1, Word(0, 0, 10, 10)), 100, update);
+		Check(update.loads.empty() && update.evictions.empty(), "resident pages are not loaded again");
+
+		//Coarser mips first, pages asked for by more pixels first within a mip
+		feedback.clear();
+		for (uint32_t x = 0; x < 8; ++x)
+			feedback.insert(feedback.end(), x + 1, Word(1, 0, x, 5));
+		Process(system, feedback, 3, update);
+		Check(update.loads.size() == 3, "load limit");
+		Check(SamePage(update.loads[0].page, 1, 2, 1, 1) && SamePage(update.loads[1].page, 1, 2, 0, 1), "coarse pages first, busier first");
+		Check(SamePage(update.loads[2].page, 1, 1, 3, 2), "busiest page of the next mip");
+		CompleteAll(system, update);
+	}
+
+	void TestEviction()
+	{
+		//Four physical pages, mip 0 has 4x4 pages and mip 1 2x2
+		VirtualTextureSystem system(4);
+		system.AddTexture(512, 512, 128, 128, 2);
+		const VirtualTexturePageTable& table = system.GetPageTable(0);
+		VirtualTextureUpdate update;
+		Process(system, std::vector<uint32_t>(1, Word(0, 0, 0, 0)), 8, update);
+		CompleteAll(system, update);
+		Process(system, std::vector<uint32_t>(1, Word(0, 0, 3, 3)), 8, update);
+		CompleteAll(system, update);
+		Check(system.GetCache().GetUsedCount() == 4, "pool full");
+		//Seeing (0, 0) again makes the (3, 3) chain the least recently used
+		Process(system, std::vector<uint32_t>(1, Word(0, 0, 0, 0)), 8, update);
+		Check(update.loads.empty(), "nothing to load");
+		Process(system, std::vector<uint32_t>(1, Word(0, 0, 2, 0)), 8, update);
+		Check(update.loads.size() == 2 && update.evictions.size() == 2, "two pages replaced");
+		Check(SamePage(update.evictions[0].page, 0, 1, 1, 1) && SamePage(update.evictions[1].page, 0, 0, 3, 3), "least recently used evicted");
+		for (size_t i = 0; i < update.evictions.size(); ++i)
+		{
+			Check(update.evictions[i].physicalPage == update.loads[i].physicalPage, "eviction frees the load's page");
+			const VirtualPage& page = update.evictions[i].page;
+			Check(table.GetPhysicalPage(page.mip, page.x, page.y) == VIRTUAL_TEXTURE_INVALID_PAGE, "evicted page unmapped");
+		}
+		Check(table.IsResident(0, 0, 0) && table.IsResident(1, 0, 0), "recently used pages kept");
+		CompleteAll(system, update);
+		std::vector<uint8_t> map;
+		table.BuildResidencyMap(map);
+		Check(map[0] == 0 && map[2] == 0 && map[3] == 1 && map[15] == 2, "residency after eviction");
+
+		//Needs five pages this frame, only four exist and none may be taken from this frame's pages
+		std::vector<uint32_t> feedback;
+		feedback.push_back(Word(0, 0, 0, 0));
+		feedback.push_back(Word(0, 0, 2, 0));
+		feedback.push_back(Word(0, 0, 1, 0));
+		Process(system, feedback, 8, update);
+		Check(update.loads.empty() && update.evictions.empty(), "pages seen this frame are never evicted");
+		//A failed load gives its page back
+		Process(system, std::vector<uint32_t>(1, Word(0, 0, 1, 0)), 8, update);
+		Check(update.loads.size() == 1 && SamePage(update.evictions[0].page, 0, 0, 0, 0), "oldest page replaced");
+		system.CancelLoad(update.loads[0]);
+		Check(system.GetCache().GetUsedCount() == 3 && table.GetPhysicalPage(0, 1, 0) == VIRTUAL_TEXTURE_INVALID_PAGE, "cancelled load");
+	}
+
+	//Random feedback, checks the page tables and the cache agree after every frame
+	void TestRandomFrames()
+	{
+		const uint32_t pageCount = 20;
+		VirtualTextureSystem system(pageCount);
+		system.AddTexture(4096, 4096, 128, 128, 6);
+		system.AddTexture(1000, 700, 128, 128, 3);
+		VirtualTextureUpdate update;
+		std::vector<uint32_t> feedback;
+		std::vector<uint8_t> map;
+		std::mt19937 rng(1);
+		int failuresBefore = TestCheck::Failures();
+		for (uint32_t frame = 0; frame < 2000 && TestCheck::Failures() == failuresBefore; ++frame)
+		{
+			feedback.clear();
+			uint32_t centerX = rng() % 32, centerY = rng() % 32;
+			for (int i = 0; i < 200; ++i)
+			{
+				uint32_t mip = rng() % 7;
+				if (mip > 5) mip = 0;
+				feedback.push_back(Word(0, mip, (centerX + rng() % 3) >> mip, (centerY + rng() % 3) >> mip));
+			}
+			if (frame % 3 == 0) feedback.push_back(Word(1, 0, rng() % 8, rng() % 6));
+			Process(system, feedback, 8, update);
+			std::set<uint32_t> physicalPages;
+			for (size_t i = 0; i < update.loads.size(); ++i)
+			{
+				Check(update.loads[i].physicalPage < pageCount, "physical page in range");
+				Check(physicalPages.insert(update.loads[i].physicalPage).second, "physical page loaded once");
+			}
+			for (size_t i = 0; i < update.loads.size(); ++i)
+			{
+				if (frame % 5 == 0 && i == 0) system.CancelLoad(update.loads[i]);
+				else system.CompleteLoad(update.loads[i]);
+			}
+			Check(system.GetCache().GetUsedCount() <= pageCount, "pool size");
+			uint32_t mapped = 0;
+			for (uint32_t t = 0; t < system.GetTextureCount(); ++t)
+			{
+				const VirtualTexturePageTable& table = system.GetPageTable(t);
+				for (uint32_t mip = 0; mip < table.GetTailMip(); ++mip)
+				{
+					for (uint32_t y = 0; y < table.GetPagesY(mip); ++y)
+					{
+						for (uint32_t x = 0; x < table.GetPagesX(mip); ++x)
+						{
+							uint32_t physicalPage = table.GetPhysicalPage(mip, x, y);
+							if (physicalPage == VIRTUAL_TEXTURE_INVALID_PAGE) continue;
+							++mapped;
+							Check(SamePage(system.GetCache().GetPage(physicalPage), t, mip, x, y), "page table and cache agree");
+						}
+					}
+				}
+			}
+			Check(mapped == system.GetCache().GetUsedCount(), "every used physical page is mapped once");
+			//A map value of v means mips v up to the tail are all resident there
+			const VirtualTexturePageTable& table = system.GetPageTable(0);
+			table.BuildResidencyMap(map);
+			for (uint32_t y = 0; y < 32; ++y)
+			{
+				for (uint32_t x = 0; x < 32; ++x)
+				{
+					for (uint32_t mip = map[y * 32 + x]; mip < table.GetTailMip(); ++mip)
+					{
+						uint32_t parentX, parentY;
+						table.GetParent(0, x, y, mip, parentX, parentY);
+						Check(table.IsResident(mip, parentX, parentY), "residency map only points at resident pages");
+					}
+				}
+			}
+		}
+	}
+
+	//Builds a tiled file from a made up DDS and compares every tile and tail mip with the source
+	void TestTileFile(const std::filesystem::path& directory, DXGI_FORMAT format, uint32_t width, uint32_t height, uint32_t mipCount)
+	{
+		DDSTextureDesc desc = {};
+		desc.dimension = DDS_DIMENSION_TEXTURE2D;
+		desc.width = width;
+		desc.height = height;
+		desc.depth = 1;
+		desc.arraySize = 1;
+		desc.mipCount = mipCount;
+		desc.format = format;
+		std::vector<uint8_t> source;
+		Check(DDSCore::BuildHeader(desc, source) == DDS_RESULT_OK, "build header");
+		size_t texelBytes = 0;
+		for (uint32_t mip = 0; mip < mipCount; ++mip)
+		{
+			size_t numBytes;
+			DDSCore::GetSurfaceInfo(std::max(width >> mip, 1u), std::max(height >> mip, 1u), format, &numBytes, nullptr, nullptr);
+			texelBytes += numBytes;
+		}
+		for (size_t i = 0; i < texelBytes; ++i)
+			source.push_back((uint8_t)(i * 7 + i / 13));
+		std::string sourcePath = (directory / "VirtualTextureTest.dds").string();
+		std::string tiledPath = (directory / "VirtualTextureTest.mvt").string();
+		{
+			std::ofstream file(sourcePath, std::ios::binary);
+			file.write((const char*)source.data(), source.size());
+		}
+		std::string error;
+		if (!VirtualTextureFile::Build(sourcePath.c_str(), tiledPath.c_str(), error))
+		{
+			Check(false, error.c_str());
+			return;
+		}
+		VirtualTextureFile tiled;
+		if (!tiled.Open(tiledPath.c_str()))
+		{
+			Check(false, "open the tiled file");
+			return;
+		}
+		const VirtualTextureFileHeader& header = tiled.GetHeader();
+		DDSTextureDesc sourceDesc;
+		DDSLayout layout;
+		DDSCore::ParseHeader(source.data(), source.size(), sourceDesc);
+		DDSCore::ComputeLayout(sourceDesc, 0, layout);
+		std::vector<uint8_t> tile(VIRTUAL_TEXTURE_TILE_SIZE);
+		bool tilesMatch = true;
+		for (uint32_t mip = 0; mip < header.tailMip; ++mip)
+		{
+			const VirtualTextureFileLevel& level = tiled.GetLevel(mip);
+			const DDSSubresource& sub = layout.subresources[mip];
+			for (uint32_t pageY = 0; pageY < level.pagesY; ++pageY)
+			{
+				for (uint32_t pageX = 0; pageX < level.pagesX; ++pageX)
+				{
+					tiled.ReadTile(mip, pageX, pageY, tile.data());
+					for (uint32_t row = 0; row < header.tileRows; ++row)
+					{
+						for (uint32_t column = 0; column < header.tileRowPitch; ++column)
+						{
+							size_t sourceRow = (size_t)pageY * header.tileRows + row;
+							size_t sourceColumn = (size_t)pageX * header.tileRowPitch + column;
+							//Texels past the edge of the mip are zero
+							uint8_t expected = sourceRow < sub.numRows && sourceColumn < sub.rowBytes ? source[sub.offset + sourceRow * sub.rowBytes + sourceColumn] : 0;
+							tilesMatch &= tile[row * header.tileRowPitch + column] == expected;
+						}
+					}
+				}
+			}
+		}
+		Check(tilesMatch, "tiles hold the source texels");
+		for (uint32_t mip = header.tailMip; mip < header.mipCount; ++mip)
+		{
+			const VirtualTextureFileTailMip& tail = tiled.GetTailMip(mip - header.tailMip);
+			const DDSSubresource& sub = layout.subresources[mip];
+			Check(tail.width >= sub.width && tail.numRows == sub.numRows, "tail mip size");
+			for (uint32_t row = 0; row < tail.numRows; ++row)
+				Check(memcmp(tiled.GetTailData() + tail.offset + row * tail.rowPitch, source.data() + sub.offset + row * sub.rowBytes, sub.rowBytes) == 0, "tail mip texels");
+		}
+		tiled.Close();
+		std::error_code ec;
+		std::filesystem::remove(sourcePath, ec);
+		std::filesystem::remove(tiledPath, ec);
+	}
+
+	void TestTileFiles(const std::filesystem::path& directory)
+	{
+		uint32_t tileWidth, tileHeight;
+		Check(VirtualTextureFile::GetTileShape(DXGI_FORMAT_BC1_UNORM, tileWidth, tileHeight) && tileWidth == 512 && tileHeight == 256, "BC1 tile");
+		Check(VirtualTextureFile::GetTileShape(DXGI_FORMAT_BC7_UNORM, tileWidth, tileHeight) && tileWidth == 256 && tileHeight == 256, "BC7 tile");
+		Check(VirtualTextureFile::GetTileShape(DXGI_FORMAT_R8G8B8A8_UNORM, tileWidth, tileHeight) && tileWidth == 128 && tileHeight == 128, "32 bit tile");
+		Check(VirtualTextureFile::GetTileShape(DXGI_FORMAT_R16G16B16A16_FLOAT, tileWidth, tileHeight) && tileWidth == 128 && tileHeight == 64, "64 bit tile");
+		Check(!VirtualTextureFile::GetTileShape(DXGI_FORMAT_R32G32B32_FLOAT, tileWidth, tileHeight), "96 bit formats can not be tiled");
+		TestTileFile(directory, DXGI_FORMAT_R8G8B8A8_UNORM, 300, 200, 9);
+		TestTileFile(directory, DXGI_FORMAT_BC1_UNORM, 1100, 600, 11);
+
+		std::string corruptPath = (directory / "VirtualTextureTest.bad.mvt").string();
+		{
+			std::ofstream file(corruptPath, std::ios::binary);
+			file.write("MVTX", 4);
+		}
+		VirtualTextureFile corrupt;
+		Check(!corrupt.Open(corruptPath.c_str()), "truncated file is rejected");
+		std::error_code ec;
+		std::filesystem::remove(corruptPath, ec);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::filesystem::path directory = argc >= 2 ? std::filesystem::path(argv[1]) : std::filesystem::temp_directory_path();
+	TestPageTable();
+	TestPageCache();
+	TestFeedback();
+	TestEviction();
+	TestRandomFrames();
+	TestTileFiles(directory);
+	return TestCheck::Finish();
+}
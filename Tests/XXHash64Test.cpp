@@ -0,0 +1,71 @@
+#include "../Common/XXHash64.h"
+#include "TestCheck.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+//XXHash64 against the reference implementation's values
+//The sanity buffer is generated the way xxhsum's self test generates it, lengths cover
+//every tail path (8, 4 and 1 byte steps) and inputs shorter and longer than one 32 byte stripe
+
+namespace
+{
+	using TestCheck::Check;
+
+	const uint64_t PRIME32 = 2654435761u;
+
+	struct Vector
+	{
+		size_t size;
+		uint64_t hash;
+		uint64_t seededHash;
+	};
+
+	const Vector VECTORS[] =
+	{
+		{ 0, 0xEF46DB3751D8E999ULL, 0xAC75FDA2929B17EFULL },
+		{ 1, 0x4FCE394CC88952D8ULL, 0x739840CB819FA723ULL },
+		{ 3, 0x63E19DE8A52309F9ULL, 0x16FFBA65774BAE68ULL },
+		{ 4, 0x9256E58AA397AEF1ULL, 0x09D5FFDFB928AB4BULL },
+		{ 7, 0xAB48F5CD83BCB62CULL, 0x3502E64A543D783BULL },
+		{ 8, 0xF74CB1451B32B8CFULL, 0x9C44B77FBCC302C5ULL },
+		{ 14, 0xCFFA8DB881BC3A3DULL, 0x5B9611585EFCC9CBULL },
+		{ 31, 0xAD09D9A6941DD847ULL, 0x9C90D9D9C2E3D340ULL },
+		{ 32, 0xAF5753D39159EDEEULL, 0xDCAB9233B8CA7B0FULL },
+		{ 33, 0x6711CBDD8543BAA8ULL, 0x66E9CECF2F1DE71CULL },
+		{ 63, 0xFF4410E17CE11EFAULL, 0x7F715F51D0F26050ULL },
+		{ 64, 0x18F5388F1D2BA08CULL, 0x479E7103CF9AA020ULL },
+		{ 100, 0x7DA3F79A7D2667C2ULL, 0x69D2695B86943C22ULL },
+		{ 101, 0x0EAB543384F878ADULL, 0xCAA65939306F1E21ULL },
+		{ 222, 0x9DD507880DEBB03DULL, 0xDC515172B8EE0600ULL },
+		{ 2243, 0xD76351FD4C4164F4ULL, 0x77490394FF78C25EULL }
+	};
+}
+
+int main()
+{
+	std::vector<uint8_t> buffer(2243);
+	uint32_t byteGen = (uint32_t)PRIME32;
+	for (size_t i = 0; i < buffer.size(); ++i)
+	{
+		buffer[i] = (uint8_t)(byteGen >> 24);
+		byteGen *= byteGen;
+	}
+	//One byte in, so every read is unaligned
+	std::vector<uint8_t> shifted(buffer.size() + 1);
+	memcpy(shifted.data() + 1, buffer.data(), buffer.size());
+	for (size_t i = 0; i < sizeof(VECTORS) / sizeof(VECTORS[0]); ++i)
+	{
+		const Vector& v = VECTORS[i];
+		char what[64];
+		snprintf(what, sizeof(what), "%zu bytes", v.size);
+		Check(XXHash64::Hash(buffer.data(), v.size) == v.hash, what);
+		snprintf(what, sizeof(what), "%zu bytes, seeded", v.size);
+		Check(XXHash64::Hash(buffer.data(), v.size, PRIME32) == v.seededHash, what);
+		snprintf(what, sizeof(what), "%zu bytes, unaligned", v.size);
+		Check(XXHash64::Hash(shifted.data() + 1, v.size) == v.hash, what);
+	}
+	Check(XXHash64::Hash("abc", 3) == 0x44BC2CF5AD770999ULL, "abc");
+	const char* text = "Nobody inspects the spammish repetition";
+	Check(XXHash64::Hash(text, strlen(text)) == 0xFBCEA83C8A378BF1ULL, "text");
+	return TestCheck::Finish();
+}